@@ -0,0 +1,103 @@
+#ifndef ADAPTIVE_HUFFMAN_H
+#define ADAPTIVE_HUFFMAN_H
+
+#include "bit_tools.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// 256 byte values plus an end-of-stream symbol
+#define ADAPTIVE_NUM_SYMBOLS 257
+#define ADAPTIVE_EOS (ADAPTIVE_NUM_SYMBOLS - 1)
+
+// Every symbol adds one leaf and one internal node below the NYT node
+#define ADAPTIVE_MAX_NODES (2 * ADAPTIVE_NUM_SYMBOLS + 1)
+
+/**
+ * A node in an adaptive Huffman tree. Nodes live in AdaptiveModel.nodes and
+ * refer to each other by index. A node's index is its FGK order number, so
+ * weights never decrease as the index grows (the sibling property).
+ */
+typedef struct _AdaptiveNode
+{
+  uint64_t weight;
+  int parent;
+  int left;
+  int right;
+  int symbol; // -1 for internal nodes and for the NYT node
+} AdaptiveNode;
+
+/**
+ * The state of an FGK (Faller-Gallager-Knuth) adaptive Huffman coder. The
+ * encoder and the decoder each keep one and update it after every symbol, so
+ * both sides hold the same tree without a coding table ever being written.
+ *
+ * Symbols that have not been seen yet are sent as the code of the NYT
+ * ("not yet transmitted") node followed by the 9-bit symbol value.
+ */
+typedef struct _AdaptiveModel
+{
+  AdaptiveNode nodes[ADAPTIVE_MAX_NODES];
+  int leaf_of[ADAPTIVE_NUM_SYMBOLS]; // -1 until the symbol has been seen
+  int nyt;
+} AdaptiveModel;
+
+/**
+ * @brief Reset `a_model` to a tree holding only the NYT node.
+ *
+ * @param a_model the model to initialize
+ */
+void init_adaptive_model(AdaptiveModel *a_model);
+
+/**
+ * @brief Write the current code for `symbol` and update the model.
+ *
+ * @param a_model the encoder's model
+ * @param a_writer the BitWriter to write the code to
+ * @param symbol a byte value, or ADAPTIVE_EOS
+ */
+void adaptive_encode_symbol(AdaptiveModel *a_model, BitWriter *a_writer, uint16_t symbol);
+
+/**
+ * @brief Read one symbol written by adaptive_encode_symbol(...) and update
+ * the model.
+ *
+ * @param a_model the decoder's model
+ * @param a_reader the BitReader to read the code from
+ * @return uint16_t a byte value, or ADAPTIVE_EOS at the end of the stream
+ * (also returned if the input ends early)
+ */
+uint16_t adaptive_decode_symbol(AdaptiveModel *a_model, BitReader *a_reader);
+
+/**
+ * @brief Compress everything readable from `uncompressed` in a single pass,
+ * followed by the end-of-stream symbol. The input may be a pipe.
+ *
+ * @param uncompressed the stream to compress
+ * @param a_writer the BitWriter to write the compressed bits to
+ * @return uint64_t the number of bytes compressed
+ */
+uint64_t adaptive_compress_stream(FILE *uncompressed, BitWriter *a_writer);
+
+/**
+ * @brief Decode a stream written by adaptive_compress_stream(...).
+ *
+ * @param a_reader the BitReader positioned at the first compressed bit
+ * @param uncompressed the stream to write the decoded bytes to
+ * @return uint64_t the number of bytes decoded
+ */
+uint64_t adaptive_decompress_stream(BitReader *a_reader, FILE *uncompressed);
+
+/**
+ * @brief Like adaptive_decompress_stream(...), but write the decoded bytes to
+ * any BitWriter. Decoding stops early if the input runs out or a fixed output
+ * overflows.
+ *
+ * @param a_reader the BitReader positioned at the first compressed bit
+ * @param a_output the byte-aligned BitWriter to write the decoded bytes to
+ * @return uint64_t the number of bytes decoded
+ */
+uint64_t adaptive_decode_stream(BitReader *a_reader, BitWriter *a_output);
+
+#endif // ADAPTIVE_HUFFMAN_H
@@ -0,0 +1,375 @@
+#include "archive.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Seeds of the two halves of a chunk key
+#define CHUNK_SEED_LOW 0
+#define CHUNK_SEED_HIGH 0x27D4EB2F165667C5ull
+
+static void _init_chunk_store(ChunkStore *a_store, size_t capacity)
+{
+  a_store->slots = malloc(capacity * sizeof(StoredChunk));
+  for (size_t idx = 0; idx < capacity; idx++)
+  {
+    a_store->slots[idx].block = UINT64_MAX;
+  }
+  a_store->capacity = capacity;
+  a_store->num_blocks = 0;
+}
+
+// The slot holding the chunk with this hash, or the empty slot where it belongs
+static StoredChunk *_find_slot(const ChunkStore *a_store, const uint64_t hash[2])
+{
+  size_t mask = a_store->capacity - 1;
+  size_t idx = hash[0] & mask;
+  while (a_store->slots[idx].block != UINT64_MAX &&
+         (a_store->slots[idx].hash[0] != hash[0] || a_store->slots[idx].hash[1] != hash[1]))
+  {
+    idx = (idx + 1) & mask;
+  }
+  return &a_store->slots[idx];
+}
+
+/*
+ * The block already holding a chunk with this hash, or `new_block` after
+ * recording that it will. The table doubles before it is half full, so
+ * probes stay short.
+ */
+static uint64_t _store_chunk(ChunkStore *a_store, const uint64_t hash[2], uint64_t new_block)
+{
+  StoredChunk *slot = _find_slot(a_store, hash);
+  if (slot->block != UINT64_MAX)
+  {
+    return slot->block;
+  }
+  slot->hash[0] = hash[0];
+  slot->hash[1] = hash[1];
+  slot->block = new_block;
+  a_store->num_blocks++;
+
+  if (2 * a_store->num_blocks >= a_store->capacity)
+  {
+    ChunkStore grown;
+    _init_chunk_store(&grown, 2 * a_store->capacity);
+    for (size_t idx = 0; idx < a_store->capacity; idx++)
+    {
+      if (a_store->slots[idx].block != UINT64_MAX)
+      {
+        *_find_slot(&grown, a_store->slots[idx].hash) = a_store->slots[idx];
+      }
+    }
+    grown.num_blocks = a_store->num_blocks;
+    free(a_store->slots);
+    *a_store = grown;
+  }
+  return new_block;
+}
+
+void open_archive_writer(ArchiveWriter *a_archive, BitWriter *a_writer, const BlockOptions *a_options,
+                         size_t chunk_size)
+{
+  *a_archive = (ArchiveWriter){.writer = a_writer,
+                               .options = *a_options,
+                               .chunk_size = chunk_size,
+                               .block_sizes = NULL,
+                               .block_sizes_capacity = 0,
+                               .members = NULL,
+                               .num_members = 0,
+                               .members_capacity = 0,
+                               .num_referenced_blocks = 0,
+                               .num_block_bytes = 0};
+  // Every chunk is exactly one block, which any file can share
+  a_archive->options.max_block_size = chunk_size;
+  a_archive->options.split_on_drift = false;
+  a_archive->options.self_contained = true;
+  a_archive->options.shared_table = NULL;
+  _init_chunk_store(&a_archive->store, 1024);
+  write_container_header(a_writer, CONTAINER_ARCHIVE);
+}
+
+void share_archive_table(ArchiveWriter *a_archive, const Frequencies freq)
+{
+  // A single byte value is coded by BLOCK_FILL, so it needs no table
+  int num_distinct = 0;
+  for (int ch = 0; ch < 256; ch++)
+  {
+    num_distinct += freq[ch] > 0;
+  }
+  memcpy(a_archive->table_freq, freq, sizeof(Frequencies));
+  a_archive->options.shared_table = num_distinct > 1 ? &a_archive->table_freq : NULL;
+}
+
+void add_archive_member(ArchiveWriter *a_archive, const char *name, const uint8_t *bytes, size_t num_bytes)
+{
+  if (a_archive->num_members == a_archive->members_capacity)
+  {
+    a_archive->members_capacity = a_archive->members_capacity * 2 + 16;
+    a_archive->members = realloc(a_archive->members, a_archive->members_capacity * sizeof(ArchiveMember));
+  }
+  ArchiveMember *member = &a_archive->members[a_archive->num_members++];
+  size_t num_chunks = (num_bytes + a_archive->chunk_size - 1) / a_archive->chunk_size;
+  *member = (ArchiveMember){.name = strdup(name),
+                            .num_bytes = num_bytes,
+                            .blocks = malloc((num_chunks + 1) * sizeof(uint64_t)),
+                            .num_blocks = num_chunks};
+
+  // New chunks are gathered so that their blocks are coded together, which lets front-ends use several threads
+  uint8_t *new_chunks = malloc(num_bytes + 1);
+  size_t num_new_bytes = 0;
+  size_t num_new_chunks = 0;
+  for (size_t chunk = 0; chunk < num_chunks; chunk++)
+  {
+    const uint8_t *chunk_bytes = bytes + chunk * a_archive->chunk_size;
+    size_t chunk_size = num_bytes - chunk * a_archive->chunk_size;
+    chunk_size = chunk_size < a_archive->chunk_size ? chunk_size : a_archive->chunk_size;
+    uint64_t hash[2] = {xxhash64(chunk_bytes, chunk_size, CHUNK_SEED_LOW),
+                        xxhash64(chunk_bytes, chunk_size, CHUNK_SEED_HIGH)};
+    uint64_t next_block = a_archive->store.num_blocks;
+    member->blocks[chunk] = _store_chunk(&a_archive->store, hash, next_block);
+    if (member->blocks[chunk] == next_block)
+    {
+      memcpy(new_chunks + num_new_bytes, chunk_bytes, chunk_size);
+      num_new_bytes += chunk_size;
+      num_new_chunks++;
+    }
+  }
+  a_archive->num_referenced_blocks += num_chunks;
+
+  // Only the last chunk of a file is short, so the chunks gathered split into blocks where they were cut
+  BitWriter blocks = open_memory_bit_writer(num_new_bytes / 2 + 64);
+  a_archive->num_block_bytes += write_blocks(&blocks, new_chunks, num_new_bytes, &a_archive->options);
+  write_bytes(a_archive->writer, blocks.buffer, blocks.num_bytes);
+
+  size_t first_new_block = a_archive->store.num_blocks - num_new_chunks;
+  if (a_archive->store.num_blocks > a_archive->block_sizes_capacity)
+  {
+    a_archive->block_sizes_capacity = a_archive->store.num_blocks * 2 + 16;
+    a_archive->block_sizes = realloc(a_archive->block_sizes, a_archive->block_sizes_capacity * sizeof(uint64_t));
+  }
+  for (size_t offset = 0, block = first_new_block; offset < blocks.num_bytes; block++)
+  {
+    const uint8_t *header = blocks.buffer + offset;
+    uint32_t num_payload_bytes = header[5] | header[6] << 8 | header[7] << 16 | (uint32_t)header[8] << 24;
+    a_archive->block_sizes[block] = BLOCK_HEADER_BITS / 8 + num_payload_bytes;
+    offset += a_archive->block_sizes[block];
+  }
+  free(blocks.buffer);
+  free(new_chunks);
+}
+
+static uint64_t _zigzag(int64_t value)
+{
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t _unzigzag(uint64_t value)
+{
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+void close_archive_writer(ArchiveWriter *a_archive)
+{
+  BitWriter *writer = a_archive->writer;
+  write_bits(writer, BLOCK_END, 8);
+
+  BitWriter directory = open_memory_bit_writer(1024);
+  write_varint(&directory, a_archive->store.num_blocks);
+  for (size_t block = 0; block < a_archive->store.num_blocks; block++)
+  {
+    write_varint(&directory, a_archive->block_sizes[block]);
+  }
+  write_varint(&directory, a_archive->num_members);
+  for (size_t idx = 0; idx < a_archive->num_members; idx++)
+  {
+    ArchiveMember *member = &a_archive->members[idx];
+    size_t name_length = strlen(member->name);
+    write_varint(&directory, name_length);
+    write_bytes(&directory, (const uint8_t *)member->name, name_length);
+    write_varint(&directory, member->num_blocks);
+    uint64_t next = 0;
+    for (size_t chunk = 0; chunk < member->num_blocks; chunk++)
+    {
+      write_varint(&directory, _zigzag((int64_t)(member->blocks[chunk] - next)));
+      next = member->blocks[chunk] + 1;
+    }
+    free(member->name);
+    free(member->blocks);
+  }
+  if (a_archive->options.shared_table != NULL)
+  {
+    TreeNode *root = make_huffman_tree(a_archive->table_freq);
+    write_coding_table(root, &directory);
+    write_bits(&directory, 0, 1);
+    align_bit_writer(&directory);
+    destroy_huffman_tree(&root);
+  }
+  write_bytes(writer, directory.buffer, directory.num_bytes);
+  write_uint32(writer, (uint32_t)directory.num_bytes);
+  write_uint32(writer, ARCHIVE_MAGIC);
+
+  free(directory.buffer);
+  free(a_archive->members);
+  free(a_archive->block_sizes);
+  free(a_archive->store.slots);
+  a_archive->members = NULL;
+  a_archive->block_sizes = NULL;
+  a_archive->store.slots = NULL;
+}
+
+bool read_archive(FILE *file, Archive *a_archive, const char **a_error)
+{
+  *a_archive = (Archive){.block_offsets = NULL, .num_blocks = 0, .members = NULL, .num_members = 0, .table_root = NULL};
+  uint8_t header[CONTAINER_HEADER_BYTES];
+  uint8_t footer[2 * sizeof(uint32_t)];
+  if (fseek(file, 0, SEEK_SET) != 0 || fread(header, 1, sizeof(header), file) != sizeof(header) ||
+      (header[0] | header[1] << 8 | header[2] << 16 | (uint32_t)header[3] << 24) != CONTAINER_MAGIC ||
+      header[4] != CONTAINER_ARCHIVE || fseek(file, -(long)sizeof(footer), SEEK_END) != 0 ||
+      fread(footer, 1, sizeof(footer), file) != sizeof(footer))
+  {
+    *a_error = "not an archive";
+    return false;
+  }
+  BitReader footer_reader = open_memory_bit_reader(footer, sizeof(footer));
+  uint32_t size = read_uint32(&footer_reader);
+  long end = ftell(file) - (long)sizeof(footer);
+  uint8_t *directory = read_uint32(&footer_reader) == ARCHIVE_MAGIC && size <= (uint64_t)end ? malloc(size + 1) : NULL;
+  if (directory == NULL || fseek(file, end - (long)size, SEEK_SET) != 0 || fread(directory, 1, size, file) != size)
+  {
+    *a_error = "corrupt archive directory";
+    free(directory);
+    return false;
+  }
+
+  // Sizes are checked against the directory, so that nothing is allocated for counts it cannot hold
+  BitReader reader = open_memory_bit_reader(directory, size);
+  uint64_t num_blocks = read_varint(&reader);
+  bool ok = num_blocks <= size;
+  a_archive->block_offsets = malloc((ok ? num_blocks + 1 : 1) * sizeof(uint64_t));
+  a_archive->block_offsets[0] = 0;
+  for (uint64_t block = 0; ok && block < num_blocks; block++)
+  {
+    a_archive->block_offsets[block + 1] = a_archive->block_offsets[block] + read_varint(&reader);
+    ok = a_archive->block_offsets[block + 1] <= (uint64_t)end;
+  }
+  a_archive->num_blocks = ok ? num_blocks : 0;
+
+  uint64_t num_members = ok ? read_varint(&reader) : 0;
+  ok = ok && num_members <= size;
+  a_archive->members = malloc((ok ? num_members + 1 : 1) * sizeof(ArchiveMember));
+  for (uint64_t idx = 0; ok && idx < num_members; idx++)
+  {
+    ArchiveMember *member = &a_archive->members[a_archive->num_members];
+    uint64_t name_length = read_varint(&reader);
+    ok = name_length <= size && is_bit_reader_open(&reader);
+    if (!ok)
+    {
+      break;
+    }
+    member->name = malloc(name_length + 1);
+    read_bytes(&reader, (uint8_t *)member->name, name_length);
+    member->name[name_length] = '\0';
+    member->num_blocks = read_varint(&reader);
+    member->num_bytes = 0;
+    ok = member->num_blocks <= size;
+    member->blocks = malloc((ok ? member->num_blocks + 1 : 1) * sizeof(uint64_t));
+    a_archive->num_members++;
+    uint64_t next = 0;
+    for (size_t chunk = 0; ok && chunk < member->num_blocks; chunk++)
+    {
+      member->blocks[chunk] = next + _unzigzag(read_varint(&reader));
+      next = member->blocks[chunk] + 1;
+      ok = member->blocks[chunk] < num_blocks;
+    }
+    member->num_blocks = ok ? member->num_blocks : 0;
+  }
+  if (ok && reader.byte_idx < size)
+  {
+    a_archive->table_root = read_coding_table(&reader);
+    ok = a_archive->table_root != NULL;
+  }
+  ok = ok && is_bit_reader_open(&reader);
+  free(directory);
+
+  // The size of each file is the sum of its blocks', read from their headers
+  for (size_t idx = 0; ok && idx < a_archive->num_members; idx++)
+  {
+    ArchiveMember *member = &a_archive->members[idx];
+    for (size_t chunk = 0; ok && chunk < member->num_blocks; chunk++)
+    {
+      BlockType type;
+      uint32_t num_bytes;
+      uint32_t num_payload_bytes;
+      ok = read_block_header(file, a_archive->block_offsets[member->blocks[chunk]], &type, &num_bytes,
+                             &num_payload_bytes);
+      member->num_bytes += num_bytes;
+    }
+  }
+  if (!ok)
+  {
+    *a_error = "corrupt archive directory";
+    destroy_archive(a_archive);
+    return false;
+  }
+  return true;
+}
+
+bool extract_archive_member(FILE *file, const Archive *a_archive, size_t member, BitWriter *a_output,
+                            const char **a_error)
+{
+  const ArchiveMember *entry = &a_archive->members[member];
+  TreeNode *table_root = NULL;
+  bool ok = true;
+  for (size_t chunk = 0; ok && chunk < entry->num_blocks; chunk++)
+  {
+    BlockType type;
+    uint32_t num_bytes;
+    uint32_t num_payload_bytes;
+    uint8_t *payload = NULL;
+    if (read_block_header(file, a_archive->block_offsets[entry->blocks[chunk]], &type, &num_bytes,
+                          &num_payload_bytes) &&
+        num_bytes <= MAX_DECODED_BLOCK_SIZE)
+    {
+      payload = read_block_payload(file, num_payload_bytes);
+    }
+    if (payload == NULL)
+    {
+      *a_error = "truncated block";
+      ok = false;
+      break;
+    }
+    // Blocks are self-contained, so no table carries over from the block before; the shared one is never replaced
+    uint8_t *bytes = malloc(num_bytes + 1);
+    destroy_huffman_tree(&table_root);
+    TreeNode *shared_root = a_archive->table_root;
+    ok = decode_block(type, payload, num_payload_bytes, bytes, num_bytes,
+                      type == BLOCK_HUFFMAN_REPEAT ? &shared_root : &table_root, a_error);
+    if (ok)
+    {
+      write_bytes(a_output, bytes, num_bytes);
+    }
+    free(bytes);
+    free(payload);
+  }
+  destroy_huffman_tree(&table_root);
+  if (ok && a_output->overflowed)
+  {
+    *a_error = "output buffer too small";
+    ok = false;
+  }
+  return ok;
+}
+
+void destroy_archive(Archive *a_archive)
+{
+  for (size_t idx = 0; idx < a_archive->num_members; idx++)
+  {
+    free(a_archive->members[idx].name);
+    free(a_archive->members[idx].blocks);
+  }
+  free(a_archive->members);
+  free(a_archive->block_offsets);
+  destroy_huffman_tree(&a_archive->table_root);
+  *a_archive = (Archive){.block_offsets = NULL, .num_blocks = 0, .members = NULL, .num_members = 0, .table_root = NULL};
+}
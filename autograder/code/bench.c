@@ -0,0 +1,359 @@
+#include "huffman.h"
+#include "adaptive_huffman.h"
+#include "tans.h"
+#include "message_codec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Compares the coders in this directory on throughput and compression ratio.
+ * Each input is encoded and decoded through temporary files until about
+ * MIN_BYTES_PER_RUN bytes (or MAX_RUNS runs) have been processed, and the decoded bytes are
+ * checked against the input.
+ *
+ * The in-memory rows compare the two entropy coders of the block container
+ * on equal terms: a Huffman section (write_huffman_section(...)) against a
+ * tANS payload (tans_write_payload(...)), each building its own histogram.
+ * Without arguments, synthetic skewed inputs follow the corpus, since those
+ * are where a prefix code loses most to its fractional-bit rival.
+ *
+ * Each file is also split into lines and coded one line at a time with a
+ * MessageCodec built from the whole input, as a batch of log lines would
+ * be, to measure the cost of a call.
+ *
+ * Usage: ./bench [file ...]   (defaults to the tests/ corpus)
+ */
+
+#define MIN_BYTES_PER_RUN (4u << 20)
+#define MAX_RUNS 200
+#define SYNTHETIC_BYTES (1u << 20)
+
+static const char *DEFAULT_FILES[] = {
+    "tests/bee-movie.txt", "tests/cornell.txt", "tests/dialogue.txt", "tests/ex.txt",
+    "tests/gophers.txt", "tests/hello_world.c", "tests/poem.txt", "tests/recipe.txt",
+    "tests/report.txt", "tests/smaug.txt"};
+
+static const char *SYNTHETIC_NAMES[] = {"skewed-90%", "skewed-99%", "geometric"};
+#define NUM_SYNTHETIC 3
+
+typedef struct _BenchResult
+{
+  size_t compressed_bytes;
+  double encode_seconds;
+  double decode_seconds;
+  bool round_trips;
+} BenchResult;
+
+static double _now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint8_t *_read_all(const char *path, size_t *a_len)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+  {
+    return NULL;
+  }
+  fseek(file, 0, SEEK_END);
+  *a_len = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  uint8_t *bytes = malloc(*a_len + 1);
+  *a_len = fread(bytes, 1, *a_len, file);
+  bytes[*a_len] = '\0';
+  fclose(file);
+  return bytes;
+}
+
+static bool _matches(FILE *decoded, const uint8_t *bytes, size_t len)
+{
+  rewind(decoded);
+  for (size_t idx = 0; idx < len; idx++)
+  {
+    if (getc(decoded) != bytes[idx])
+    {
+      return false;
+    }
+  }
+  return getc(decoded) == EOF;
+}
+
+static size_t _file_size(FILE *file)
+{
+  fflush(file);
+  fseek(file, 0, SEEK_END);
+  return ftell(file);
+}
+
+static BenchResult _bench_static(uint8_t *bytes, size_t len, int runs)
+{
+  BenchResult result = {0};
+  FILE *decoded = NULL;
+  for (int run = 0; run < runs; run++)
+  {
+    double start = _now();
+    Frequencies freq = {0};
+    for (size_t idx = 0; idx < len; idx++)
+    {
+      freq[bytes[idx]]++;
+    }
+    TreeNode *root = make_huffman_tree(freq);
+    BitWriter table_writer = {.file = tmpfile(), .current_byte = 0, .num_bits_left = 8};
+    write_coding_table(root, &table_writer);
+    flush_bit_writer(&table_writer);
+    BitWriter writer = {.file = tmpfile(), .current_byte = 0, .num_bits_left = 8};
+    write_compressed(&writer, bytes, root);
+    flush_bit_writer(&writer);
+    destroy_huffman_tree(&root);
+    result.encode_seconds += _now() - start;
+    result.compressed_bytes = sizeof(uint32_t) + _file_size(writer.file) + _file_size(table_writer.file);
+
+    rewind(table_writer.file);
+    rewind(writer.file);
+    if (decoded != NULL)
+    {
+      fclose(decoded);
+    }
+    decoded = tmpfile();
+    start = _now();
+    BitReader table_reader = {.file = table_writer.file, .current_byte = 0, .current_bit = -1};
+    root = read_coding_table(&table_reader);
+    BitReader reader = {.file = writer.file, .current_byte = 0, .current_bit = -1};
+    read_compressed(&reader, decoded, root, len);
+    fflush(decoded);
+    destroy_huffman_tree(&root);
+    result.decode_seconds += _now() - start;
+
+    close_bit_reader(&table_reader);
+    close_bit_reader(&reader);
+  }
+  result.round_trips = _matches(decoded, bytes, len);
+  fclose(decoded);
+  return result;
+}
+
+static BenchResult _bench_adaptive(uint8_t *bytes, size_t len, int runs)
+{
+  BenchResult result = {0};
+  FILE *decoded = NULL;
+  FILE *input = tmpfile();
+  fwrite(bytes, 1, len, input);
+  for (int run = 0; run < runs; run++)
+  {
+    rewind(input);
+    double start = _now();
+    BitWriter writer = {.file = tmpfile(), .current_byte = 0, .num_bits_left = 8};
+    adaptive_compress_stream(input, &writer);
+    flush_bit_writer(&writer);
+    result.encode_seconds += _now() - start;
+    result.compressed_bytes = _file_size(writer.file);
+
+    rewind(writer.file);
+    if (decoded != NULL)
+    {
+      fclose(decoded);
+    }
+    decoded = tmpfile();
+    start = _now();
+    BitReader reader = {.file = writer.file, .current_byte = 0, .current_bit = -1};
+    adaptive_decompress_stream(&reader, decoded);
+    fflush(decoded);
+    result.decode_seconds += _now() - start;
+    close_bit_reader(&reader);
+  }
+  result.round_trips = _matches(decoded, bytes, len);
+  fclose(decoded);
+  fclose(input);
+  return result;
+}
+
+typedef void (*WritePayloadFn)(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes);
+typedef bool (*ReadPayloadFn)(BitReader *a_reader, uint8_t *bytes, size_t num_bytes);
+
+static void _write_tans(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes)
+{
+  Frequencies freq = {0};
+  add_frequencies(freq, bytes, num_bytes);
+  tans_write_payload(a_writer, bytes, num_bytes, freq);
+}
+
+static BenchResult _bench_memory(uint8_t *bytes, size_t len, int runs, WritePayloadFn write_fn, ReadPayloadFn read_fn)
+{
+  BenchResult result = {.round_trips = true};
+  uint8_t *decoded = malloc(len + 1);
+  for (int run = 0; run < runs; run++)
+  {
+    double start = _now();
+    BitWriter writer = open_memory_bit_writer(len / 2 + 1);
+    write_fn(&writer, bytes, len);
+    align_bit_writer(&writer);
+    result.encode_seconds += _now() - start;
+    result.compressed_bytes = writer.num_bytes;
+
+    start = _now();
+    BitReader reader = open_memory_bit_reader(writer.buffer, writer.num_bytes);
+    result.round_trips = read_fn(&reader, decoded, len) && result.round_trips;
+    result.decode_seconds += _now() - start;
+    free(writer.buffer);
+  }
+  result.round_trips = result.round_trips && memcmp(decoded, bytes, len) == 0;
+  free(decoded);
+  return result;
+}
+
+/*
+ * Skewed byte distributions: one byte at 90% and at 99% of the input (the
+ * rest spread over a few others), and a geometric distribution with p = 1/2.
+ */
+static uint8_t *_make_synthetic(int kind, size_t len)
+{
+  uint8_t *bytes = malloc(len + 1);
+  uint32_t state = 12345;
+  for (size_t idx = 0; idx < len; idx++)
+  {
+    state = state * 1103515245 + 12345;
+    uint32_t draw = (state >> 8) % 1000;
+    if (kind == 0)
+    {
+      bytes[idx] = draw < 900 ? 'a' : 'b' + draw % 15;
+    }
+    else if (kind == 1)
+    {
+      bytes[idx] = draw < 990 ? 'a' : 'b' + draw % 7;
+    }
+    else
+    {
+      uint8_t symbol = 0;
+      for (uint32_t bits = state >> 16; (bits & 1) && symbol < 15; bits >>= 1)
+      {
+        symbol++;
+      }
+      bytes[idx] = 'a' + symbol;
+    }
+  }
+  return bytes;
+}
+
+static bool _bench_messages(const char *name, const uint8_t *bytes, size_t len)
+{
+  Frequencies freq = {0};
+  add_frequencies(freq, bytes, len);
+  MessageCodec codec;
+  init_message_codec(&codec, freq);
+  uint8_t *encoded = malloc(message_bound(&codec, len) + len);
+  uint8_t *decoded = malloc(len + 1);
+
+  size_t num_messages = 0;
+  size_t num_encoded = 0;
+  int runs = 0;
+  double encode_seconds = 0;
+  double decode_seconds = 0;
+  bool round_trips = true;
+  while (runs == 0 || (encode_seconds + decode_seconds < 0.2 && runs < MAX_RUNS))
+  {
+    double start = _now();
+    num_messages = 0;
+    num_encoded = 0;
+    for (size_t line_start = 0; line_start < len; num_messages++)
+    {
+      const uint8_t *newline = memchr(bytes + line_start, '\n', len - line_start);
+      size_t line_end = newline != NULL ? (size_t)(newline - bytes) + 1 : len;
+      num_encoded += encode_message(&codec, bytes + line_start, line_end - line_start, encoded + num_encoded,
+                                    message_bound(&codec, line_end - line_start));
+      line_start = line_end;
+    }
+    encode_seconds += _now() - start;
+
+    start = _now();
+    size_t num_decoded = 0;
+    for (size_t pos = 0; pos < num_encoded && round_trips;)
+    {
+      size_t num_bytes = 0;
+      size_t num_consumed = 0;
+      round_trips = decode_message(&codec, encoded + pos, num_encoded - pos, decoded + num_decoded,
+                                   len - num_decoded, &num_bytes, &num_consumed);
+      num_decoded += num_bytes;
+      pos += num_consumed;
+    }
+    decode_seconds += _now() - start;
+    round_trips = round_trips && num_decoded == len && memcmp(decoded, bytes, len) == 0;
+    runs++;
+  }
+
+  double calls = (double)num_messages * runs;
+  printf("%-22s %-10s %10zu %10zu %7.3f   %zu lines, %.0f ns per encode, %.0f ns per decode %s\n", name,
+         "messages", len, num_encoded, len > 0 ? (double)num_encoded / len : 0.0, num_messages,
+         calls > 0 ? encode_seconds * 1e9 / calls : 0.0, calls > 0 ? decode_seconds * 1e9 / calls : 0.0,
+         round_trips ? "ok" : "MISMATCH");
+  free(decoded);
+  free(encoded);
+  destroy_message_codec(&codec);
+  return round_trips;
+}
+
+static void _print_result(const char *name, const char *coder, size_t len, int runs, BenchResult result)
+{
+  double mb = (double)len * runs / (1 << 20);
+  printf("%-22s %-10s %10zu %10zu %7.3f %9.2f %9.2f %s\n", name, coder, len, result.compressed_bytes,
+         len > 0 ? (double)result.compressed_bytes / len : 0.0,
+         result.encode_seconds > 0 ? mb / result.encode_seconds : 0.0,
+         result.decode_seconds > 0 ? mb / result.decode_seconds : 0.0,
+         result.round_trips ? "ok" : "MISMATCH");
+}
+
+static bool _bench_all(const char *name, uint8_t *bytes, size_t len)
+{
+  int runs = len > 0 && len < MIN_BYTES_PER_RUN ? (int)(MIN_BYTES_PER_RUN / len) : 1;
+  runs = runs > MAX_RUNS ? MAX_RUNS : runs;
+
+  BenchResult result = _bench_static(bytes, len, runs);
+  _print_result(name, "static", len, runs, result);
+  bool all_ok = result.round_trips;
+  result = _bench_adaptive(bytes, len, runs);
+  _print_result(name, "adaptive", len, runs, result);
+  all_ok = all_ok && result.round_trips;
+  result = _bench_memory(bytes, len, runs, write_huffman_section, read_huffman_section);
+  _print_result(name, "huffman", len, runs, result);
+  all_ok = all_ok && result.round_trips;
+  result = _bench_memory(bytes, len, runs, _write_tans, tans_read_payload);
+  _print_result(name, "tans", len, runs, result);
+  return all_ok && result.round_trips;
+}
+
+int main(int argc, char *argv[])
+{
+  const char **paths = argc > 1 ? (const char **)&argv[1] : DEFAULT_FILES;
+  int num_paths = argc > 1 ? argc - 1 : (int)(sizeof(DEFAULT_FILES) / sizeof(DEFAULT_FILES[0]));
+  bool all_ok = true;
+
+  printf("%-22s %-10s %10s %10s %7s %9s %9s\n", "file", "coder", "bytes", "out", "ratio", "enc MB/s", "dec MB/s");
+  for (int path_idx = 0; path_idx < num_paths; path_idx++)
+  {
+    size_t len = 0;
+    uint8_t *bytes = _read_all(paths[path_idx], &len);
+    if (bytes == NULL)
+    {
+      fprintf(stderr, "Error: cannot read %s\n", paths[path_idx]);
+      all_ok = false;
+      continue;
+    }
+    const char *name = strrchr(paths[path_idx], '/') ? strrchr(paths[path_idx], '/') + 1 : paths[path_idx];
+
+    all_ok = _bench_all(name, bytes, len) && all_ok;
+    all_ok = _bench_messages(name, bytes, len) && all_ok;
+    free(bytes);
+  }
+
+  for (int kind = 0; argc == 1 && kind < NUM_SYNTHETIC; kind++)
+  {
+    uint8_t *bytes = _make_synthetic(kind, SYNTHETIC_BYTES);
+    all_ok = _bench_all(SYNTHETIC_NAMES[kind], bytes, SYNTHETIC_BYTES) && all_ok;
+    free(bytes);
+  }
+
+  return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
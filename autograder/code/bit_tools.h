@@ -3,14 +3,27 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 /**
  * A struct representing a bit writer. The bit writer writes bits to a file.
  * The bit writer writes bits to the file in the order they are written.
+ *
+ * A writer made by open_memory_bit_writer(...) has no file and appends to
+ * `buffer` instead, growing it as needed; the caller frees `buffer`. A writer
+ * made by open_fixed_bit_writer(...) appends to a caller buffer that never
+ * grows: bytes past its capacity are dropped and `overflowed` is set. A writer
+ * with neither a file nor a buffer discards everything written to it.
  */
 typedef struct _BitWriter
 {
   FILE *file;
+  uint8_t *buffer;
+  size_t num_bytes;
+  size_t capacity;
+  bool fixed;
+  bool overflowed;
   uint8_t current_byte;
   uint8_t num_bits_left;
 } BitWriter;
@@ -23,6 +36,24 @@ typedef struct _BitWriter
  */
 BitWriter open_bit_writer(const char *path);
 
+/**
+ * @brief Return a BitWriter that appends to a growable memory buffer.
+ *
+ * @param initial_capacity the number of bytes to allocate up front
+ * @return BitWriter
+ */
+BitWriter open_memory_bit_writer(size_t initial_capacity);
+
+/**
+ * @brief Return a BitWriter that appends to the `capacity` bytes at `buffer`
+ * and never allocates. Check `overflowed` once done writing.
+ *
+ * @param buffer where to write; owned by the caller
+ * @param capacity the number of bytes at buffer
+ * @return BitWriter
+ */
+BitWriter open_fixed_bit_writer(uint8_t *buffer, size_t capacity);
+
 /**
  * @brief Write the least significant num_bits_to_write bits of bits to the file.
  *
@@ -33,6 +64,52 @@ BitWriter open_bit_writer(const char *path);
  */
 void write_bits(BitWriter *a_writer, uint8_t bits, uint8_t num_bits_to_write);
 
+/**
+ * @brief Write `num_bits_to_write` bits (at most 64) from the least
+ * significant end of `bits`, most significant first.
+ *
+ * @param a_writer the address of the BitWriter object
+ * @param bits the bits to write
+ * @param num_bits_to_write the number of bits to write
+ */
+void write_code(BitWriter *a_writer, uint64_t bits, uint8_t num_bits_to_write);
+
+/**
+ * @brief Write `value` as 32 bits, least significant byte first.
+ *
+ * @param a_writer the address of the BitWriter object
+ * @param value the value to write
+ */
+void write_uint32(BitWriter *a_writer, uint32_t value);
+
+/**
+ * @brief Write `value` in as few bytes as it needs: seven bits per byte,
+ * least significant first, with the top bit set on every byte but the last
+ * (LEB128). Values below 128 take one byte.
+ *
+ * @param a_writer the address of the BitWriter object
+ * @param value the value to write
+ */
+void write_varint(BitWriter *a_writer, uint64_t value);
+
+/**
+ * @brief Write `num_bytes` whole bytes. The writer must be byte-aligned.
+ *
+ * @param a_writer the address of the BitWriter object
+ * @param bytes the bytes to write
+ * @param num_bytes the number of bytes to write
+ */
+void write_bytes(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes);
+
+/**
+ * @brief Pad the current byte with zeros and write it, if any bits are
+ * pending. Unlike flush_bit_writer(...), nothing is written when the writer is
+ * already byte-aligned.
+ *
+ * @param a_writer the address of the BitWriter object
+ */
+void align_bit_writer(BitWriter *a_writer);
+
 /**
  * @brief Write the current byte to the file.
  *
@@ -51,10 +128,16 @@ void close_bit_writer(BitWriter *a_writer);
 /**
  * A struct representing a bit reader. The bit reader reads bits from a file.
  *
+ * A reader made by open_memory_bit_reader(...) has no file and reads from
+ * `buffer` instead. Either way, the source is set to NULL once a read runs past
+ * its end, and later reads return 0 bits.
  */
 typedef struct _BitReader
 {
   FILE *file;
+  const uint8_t *buffer;
+  size_t num_bytes;
+  size_t byte_idx;
   uint8_t current_byte;
   int8_t current_bit;
 } BitReader;
@@ -67,6 +150,24 @@ typedef struct _BitReader
  */
 BitReader open_bit_reader(const char *path);
 
+/**
+ * @brief Return a BitReader over `num_bytes` bytes at `buffer`. The buffer is
+ * not copied and must outlive the reader.
+ *
+ * @param buffer the bytes to read
+ * @param num_bytes the number of bytes at buffer
+ * @return BitReader
+ */
+BitReader open_memory_bit_reader(const uint8_t *buffer, size_t num_bytes);
+
+/**
+ * @brief Check whether the reader still has a source to read from.
+ *
+ * @param a_reader the address of the BitReader object
+ * @return bool false once a read has run past the end of the input
+ */
+bool is_bit_reader_open(const BitReader *a_reader);
+
 /**
  * @brief Read a single bit from the file.
  * 
@@ -86,6 +187,62 @@ uint8_t read_bit(BitReader *a_reader);
  */
 uint8_t read_bits(BitReader *a_reader, uint8_t num_bits_to_read);
 
+/**
+ * @brief Read `num_bits_to_read` bits (at most 64), most significant first.
+ *
+ * @param a_reader the address of the BitReader object
+ * @param num_bits_to_read the number of bits to read
+ * @return uint64_t
+ */
+uint64_t read_code(BitReader *a_reader, uint8_t num_bits_to_read);
+
+/**
+ * @brief Look at the next `num_bits_to_peek` bits (at most 32) without
+ * consuming them. Bits past the end read as 0. Only memory readers can peek.
+ *
+ * @param a_reader the address of a BitReader from open_memory_bit_reader(...)
+ * @param num_bits_to_peek the number of bits to look at
+ * @return uint32_t
+ */
+uint32_t peek_bits(const BitReader *a_reader, uint8_t num_bits_to_peek);
+
+/**
+ * @brief Consume `num_bits_to_skip` bits, as if they were read.
+ *
+ * @param a_reader the address of the BitReader object
+ * @param num_bits_to_skip the number of bits to skip
+ */
+void skip_bits(BitReader *a_reader, uint8_t num_bits_to_skip);
+
+/**
+ * @brief Read a value written by write_uint32(...).
+ *
+ * @param a_reader the address of the BitReader object
+ * @return uint32_t
+ */
+uint32_t read_uint32(BitReader *a_reader);
+
+/**
+ * @brief Read a value written by write_varint(...).
+ *
+ * @param a_reader the address of the BitReader object
+ * @return uint64_t the value, or UINT64_MAX for a varint longer than ten
+ * bytes (too long for a uint64_t)
+ */
+uint64_t read_varint(BitReader *a_reader);
+
+/**
+ * @brief Read up to `num_bytes` whole bytes into `bytes`. Any bits left in
+ * the current byte are skipped first.
+ *
+ * @param a_reader the address of the BitReader object
+ * @param bytes where to store the bytes read
+ * @param num_bytes the number of bytes to read
+ * @return size_t the number of bytes read, less than num_bytes at the end of
+ * the input
+ */
+size_t read_bytes(BitReader *a_reader, uint8_t *bytes, size_t num_bytes);
+
 /**
  * @brief Close the given BitReader and reset its fields.
  * 
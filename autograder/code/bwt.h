@@ -0,0 +1,60 @@
+#ifndef BWT_H
+#define BWT_H
+
+#include "bit_tools.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Apply the Burrows-Wheeler transform to `bytes` followed by a unique
+ * end marker that sorts before every byte. The suffixes are sorted with SA-IS
+ * in linear time. The column of bytes preceding each sorted suffix is stored
+ * in `last_column`, leaving out the row where the end marker would be.
+ *
+ * @param bytes the bytes to transform (fewer than 2^31)
+ * @param num_bytes the number of bytes to transform
+ * @param last_column where to store the num_bytes transformed bytes
+ * @return size_t the row of the end marker, needed to undo the transform
+ */
+size_t bwt_forward(const uint8_t *bytes, size_t num_bytes, uint8_t *last_column);
+
+/**
+ * @brief Undo bwt_forward(...).
+ *
+ * @param last_column the transformed bytes
+ * @param num_bytes the number of transformed bytes
+ * @param primary_index the row of the end marker returned by bwt_forward(...)
+ * @param bytes where to store the num_bytes original bytes
+ * @return bool false if `primary_index` or the column is not a valid transform
+ */
+bool bwt_inverse(const uint8_t *last_column, size_t num_bytes, size_t primary_index, uint8_t *bytes);
+
+/**
+ * @brief Write `bytes` as a block payload in the style of bzip2: the
+ * Burrows-Wheeler transform, move-to-front, then the zero runs that
+ * move-to-front leaves behind replaced by a single 0 each.
+ *
+ * The payload is the end marker row, the number of move-to-front values and
+ * the number of zero runs (uint32), then two Huffman sections (see
+ * write_huffman_section(...)): the values, and the value codes (see
+ * value_code(...)) of the run lengths minus one, whose extra bits follow.
+ *
+ * @param a_writer the BitWriter to write the payload to
+ * @param bytes the bytes to compress
+ * @param num_bytes the number of bytes to compress
+ */
+void bwt_write_payload(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes);
+
+/**
+ * @brief Decode a payload written by bwt_write_payload(...).
+ *
+ * @param a_reader the BitReader positioned at the payload
+ * @param bytes where to store the decoded bytes
+ * @param num_bytes the number of bytes the payload decodes to
+ * @return bool false if the payload is malformed
+ */
+bool bwt_read_payload(BitReader *a_reader, uint8_t *bytes, size_t num_bytes);
+
+#endif // BWT_H
@@ -0,0 +1,136 @@
+#ifndef CANONICAL_HUFFMAN_H
+#define CANONICAL_HUFFMAN_H
+
+#include "bit_tools.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Huffman coding for alphabets too large for Frequencies and TreeNode, such
+ * as the words of a text. Symbols are numbered from 0 and a code is described
+ * only by the length of each symbol's code: canonical codes assign
+ * consecutive values to the symbols of each length in symbol order, shorter
+ * lengths first, so the lengths alone let the decoder rebuild every code.
+ */
+
+// Counts below 2^32 never give longer codes, and longer ones would not fit a uint64_t code
+#define CANONICAL_MAX_CODE_LENGTH 57
+
+// Codes up to this long are decoded with a single table lookup
+#define CANONICAL_LOOKUP_BITS 11
+
+// What canonical_decode(...) returns for bits that are not a code
+#define CANONICAL_INVALID_SYMBOL UINT32_MAX
+
+/**
+ * @brief Compute Huffman code lengths for `num_symbols` symbols, building
+ * the tree with a MinHeap in O(n log n). Symbols with a count of 0 get
+ * length 0; a lone symbol gets length 1.
+ *
+ * @param counts the number of occurrences of each symbol
+ * @param num_symbols the size of the alphabet
+ * @param lengths where to store the code length of each symbol
+ */
+void huffman_code_lengths(const uint64_t *counts, size_t num_symbols, uint8_t *lengths);
+
+/**
+ * @brief Assign the canonical code of each symbol from the code lengths.
+ *
+ * @param lengths the code length of each symbol, 0 for unused symbols
+ * @param num_symbols the size of the alphabet
+ * @param codes where to store the code of each symbol
+ */
+void canonical_codes(const uint8_t *lengths, size_t num_symbols, uint64_t *codes);
+
+/**
+ * A canonical code, arranged for decoding.
+ */
+typedef struct _CanonicalDecoder
+{
+  uint8_t max_length;
+  uint64_t first_code[CANONICAL_MAX_CODE_LENGTH + 1];  // The code of the first symbol of each length
+  uint32_t first_index[CANONICAL_MAX_CODE_LENGTH + 1]; // Where that symbol is in `sorted_symbols`
+  uint32_t count[CANONICAL_MAX_CODE_LENGTH + 1];       // The number of symbols of each length
+  uint32_t *sorted_symbols;                            // By code length, then by symbol
+  uint32_t lookup_symbol[1 << CANONICAL_LOOKUP_BITS];
+  uint8_t lookup_length[1 << CANONICAL_LOOKUP_BITS]; // 0 if the code is longer than the table
+} CanonicalDecoder;
+
+/**
+ * @brief Prepare to decode the canonical code with the given lengths.
+ *
+ * @param a_decoder the decoder to fill
+ * @param lengths the code length of each symbol, 0 for unused symbols
+ * @param num_symbols the size of the alphabet
+ * @return bool false if the lengths are longer than CANONICAL_MAX_CODE_LENGTH
+ * or describe more codes than fit (a malformed table)
+ */
+bool build_canonical_decoder(CanonicalDecoder *a_decoder, const uint8_t *lengths, size_t num_symbols);
+
+/**
+ * @brief Decode one symbol.
+ *
+ * @param a_decoder the decoder for the code the symbol was written with
+ * @param a_reader a memory BitReader (see peek_bits(...)) at the code
+ * @return uint32_t the symbol, or CANONICAL_INVALID_SYMBOL
+ */
+uint32_t canonical_decode(const CanonicalDecoder *a_decoder, BitReader *a_reader);
+
+/**
+ * @brief Free what build_canonical_decoder(...) allocated.
+ *
+ * @param a_decoder the decoder to destroy
+ */
+void destroy_canonical_decoder(CanonicalDecoder *a_decoder);
+
+// The alphabet of write_canonical_section(...): 16-bit samples, UTF-16 code units, byte pairs
+#define CANONICAL_SECTION_SYMBOLS 65536
+
+/**
+ * @brief Write code lengths for an alphabet of up to 2^32 symbols, most of
+ * which may be unused. The table is the longest code length (one byte), the
+ * number of codes of each length up to it (uint32), then for each length
+ * the gaps between its symbols in increasing order: their value codes (see
+ * value_code(...)) as one Huffman section, with their extra bits following.
+ *
+ * @param a_writer the BitWriter to write the table to
+ * @param lengths the code length of each symbol, 0 for unused symbols
+ * @param num_symbols the size of the alphabet
+ */
+void write_canonical_table(BitWriter *a_writer, const uint8_t *lengths, size_t num_symbols);
+
+/**
+ * @brief Read a table written by write_canonical_table(...).
+ *
+ * @param a_reader the BitReader positioned at the table
+ * @param lengths where to store the code length of each symbol
+ * @param num_symbols the size of the alphabet
+ * @return bool false if the table is malformed, including a symbol outside
+ * the alphabet or listed twice
+ */
+bool read_canonical_table(BitReader *a_reader, uint8_t *lengths, size_t num_symbols);
+
+/**
+ * @brief Write 16-bit symbols with a canonical Huffman code built from their
+ * counts: the table (see write_canonical_table(...)), then the codes. This
+ * is write_huffman_section(...) for an alphabet of CANONICAL_SECTION_SYMBOLS.
+ *
+ * @param a_writer the BitWriter to write the section to
+ * @param symbols the symbols to write
+ * @param num_symbols the number of symbols
+ */
+void write_canonical_section(BitWriter *a_writer, const uint16_t *symbols, size_t num_symbols);
+
+/**
+ * @brief Read a section written by write_canonical_section(...).
+ *
+ * @param a_reader the memory BitReader positioned at the section
+ * @param symbols where to store the symbols
+ * @param num_symbols the number of symbols the section holds
+ * @return bool false if the section is malformed or ends early
+ */
+bool read_canonical_section(BitReader *a_reader, uint16_t *symbols, size_t num_symbols);
+
+#endif // CANONICAL_HUFFMAN_H
@@ -0,0 +1,692 @@
+#include "code_search.h"
+#include "container.h"
+#include "bit_tools.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// The leading bits of a pattern's codes that the scan looks for; the rest are checked at each candidate
+#define MAX_PREFIX_BITS 56
+
+// Codes are walked this many bits per table lookup
+#define WALK_BITS 12
+
+typedef struct _OffsetList
+{
+  uint64_t *offsets;
+  size_t num_offsets;
+  size_t capacity;
+} OffsetList;
+
+static void _add_offset(OffsetList *a_list, uint64_t offset)
+{
+  if (a_list->num_offsets == a_list->capacity)
+  {
+    a_list->capacity = a_list->capacity * 2 + 16;
+    a_list->offsets = realloc(a_list->offsets, a_list->capacity * sizeof(uint64_t));
+  }
+  a_list->offsets[a_list->num_offsets++] = offset;
+}
+
+typedef struct _Search
+{
+  const uint8_t *pattern;
+  size_t pattern_size;
+  OffsetList matches;
+  SearchStats stats;
+} Search;
+
+// The whole codes in the next WALK_BITS bits: how many, and how many bits they take
+typedef struct _WalkEntry
+{
+  uint8_t num_bits;
+  uint8_t num_codes;
+} WalkEntry;
+
+/*
+ * The pattern compiled for one coding table, and the tables for walking its
+ * codes. Only a tree with at least two leaves has codes to search; a lone
+ * leaf codes every byte as nothing.
+ */
+typedef struct _SearchTable
+{
+  TreeNode *root;
+  bool has_codes;
+  HuffEncoder encoder;
+  HuffDecoder decoder;
+  WalkEntry walk[1 << WALK_BITS];
+  bool codable;             // Every byte of the pattern has a code
+  uint64_t num_pattern_bits;
+  uint64_t prefix;          // The first num_prefix_bits bits of the pattern's codes
+  int num_prefix_bits;
+  uint8_t first_shifts[256];  // For each byte, the bit offsets into it where the prefix could start
+  uint8_t second_shifts[256]; // For each byte, the bit offsets into the byte before it where the prefix could start
+} SearchTable;
+
+/*
+ * A stretch of codes under one table: a Huffman block, or the whole of the
+ * two-file format. Bit offsets count from the start of `codes`.
+ */
+typedef struct _CodeStream
+{
+  const SearchTable *table;
+  const uint8_t *codes;
+  size_t num_code_bytes;
+  uint64_t start_bit;
+  uint64_t num_symbols;
+  uint64_t offset;                // The uncompressed offset of the first code
+  const Checkpoint *checkpoints;  // Checkpoints inside the codes, in order
+  size_t num_checkpoints;
+} CodeStream;
+
+// Eight bytes from byte `idx` on, first byte most significant; bytes past the end read as 0
+static inline uint64_t _load(const uint8_t *codes, size_t num_code_bytes, size_t idx)
+{
+  if (idx + 8 <= num_code_bytes)
+  {
+    const uint8_t *bytes = codes + idx;
+    return (uint64_t)bytes[0] << 56 | (uint64_t)bytes[1] << 48 | (uint64_t)bytes[2] << 40 | (uint64_t)bytes[3] << 32 |
+           (uint64_t)bytes[4] << 24 | (uint64_t)bytes[5] << 16 | (uint64_t)bytes[6] << 8 | bytes[7];
+  }
+  uint64_t window = 0;
+  for (int byte = 0; byte < 8; byte++)
+  {
+    window = (window << 8) | (idx + byte < num_code_bytes ? codes[idx + byte] : 0);
+  }
+  return window;
+}
+
+// The `num_bits` (1 to 57) bits from bit `pos` on
+static inline uint64_t _peek(const uint8_t *codes, size_t num_code_bytes, uint64_t pos, int num_bits)
+{
+  return (_load(codes, num_code_bytes, pos / 8) << (pos % 8)) >> (64 - num_bits);
+}
+
+static SearchTable *_new_search_table(TreeNode *root, const uint8_t *pattern, size_t pattern_size)
+{
+  SearchTable *table = malloc(sizeof(SearchTable));
+  table->root = root;
+  table->has_codes = root != NULL && root->left != NULL && root->right != NULL;
+  if (!table->has_codes)
+  {
+    return table;
+  }
+  build_huff_encoder(&table->encoder, root);
+  build_huff_decoder(&table->decoder, root);
+
+  for (uint32_t bits = 0; bits < (1u << WALK_BITS); bits++)
+  {
+    const TreeNode *node = root;
+    WalkEntry entry = {.num_bits = 0, .num_codes = 0};
+    for (int bit = 0; bit < WALK_BITS; bit++)
+    {
+      node = (bits >> (WALK_BITS - 1 - bit)) & 1 ? node->right : node->left;
+      if (node->left == NULL || node->right == NULL)
+      {
+        entry.num_bits = bit + 1;
+        entry.num_codes++;
+        node = root;
+      }
+    }
+    table->walk[bits] = entry;
+  }
+
+  // The pattern's codes, and the first MAX_PREFIX_BITS of them to scan for
+  table->codable = true;
+  table->num_pattern_bits = 0;
+  table->prefix = 0;
+  table->num_prefix_bits = 0;
+  for (size_t idx = 0; idx < pattern_size; idx++)
+  {
+    const HuffCode *code = &table->encoder.codes[pattern[idx]];
+    table->codable = table->codable && code->length > 0;
+    table->num_pattern_bits += code->length;
+    for (int bit = code->length - 1; bit >= 0 && table->num_prefix_bits < MAX_PREFIX_BITS; bit--)
+    {
+      table->prefix = (table->prefix << 1) | ((code->bits >> bit) & 1);
+      table->num_prefix_bits++;
+    }
+  }
+
+  // A prefix starting at bit `shift` of a byte covers the rest of that byte and up to all of the next one
+  memset(table->first_shifts, 0, sizeof(table->first_shifts));
+  memset(table->second_shifts, 0, sizeof(table->second_shifts));
+  for (int shift = 0; shift < 8 && table->codable; shift++)
+  {
+    int num_first = 8 - shift < table->num_prefix_bits ? 8 - shift : table->num_prefix_bits;
+    int num_second = table->num_prefix_bits - num_first < 8 ? table->num_prefix_bits - num_first : 8;
+    uint32_t first_bits = table->prefix >> (table->num_prefix_bits - num_first);
+    uint32_t second_bits = (table->prefix >> (table->num_prefix_bits - num_first - num_second)) &
+                           ((1u << num_second) - 1);
+    for (uint32_t byte = 0; byte < 256; byte++)
+    {
+      if (((byte >> (8 - shift - num_first)) & ((1u << num_first) - 1)) == first_bits)
+      {
+        table->first_shifts[byte] |= 1 << shift;
+      }
+      if (byte >> (8 - num_second) == second_bits)
+      {
+        table->second_shifts[byte] |= 1 << shift;
+      }
+    }
+  }
+  return table;
+}
+
+static void _destroy_search_table(SearchTable **a_table)
+{
+  if (*a_table != NULL)
+  {
+    destroy_huffman_tree(&(*a_table)->root);
+    free(*a_table);
+    *a_table = NULL;
+  }
+}
+
+// Step over the code at `*a_pos` and return its byte
+static inline uint8_t _step(const CodeStream *a_stream, uint64_t *a_pos)
+{
+  const SearchTable *table = a_stream->table;
+  const HuffLookupEntry *entry =
+      &table->decoder.lookup[_peek(a_stream->codes, a_stream->num_code_bytes, *a_pos, HUFF_LOOKUP_BITS)];
+  *a_pos += entry->length;
+  const TreeNode *node = entry->node;
+  while (node->left != NULL && node->right != NULL)
+  {
+    node = _peek(a_stream->codes, a_stream->num_code_bytes, (*a_pos)++, 1) ? node->right : node->left;
+  }
+  return node->character;
+}
+
+// Whether the pattern's codes are at `pos`, which is known to be a code boundary
+static bool _codes_match_at(const Search *a_search, const CodeStream *a_stream, uint64_t pos)
+{
+  for (size_t idx = 0; idx < a_search->pattern_size; idx++)
+  {
+    const HuffCode *code = &a_stream->table->encoder.codes[a_search->pattern[idx]];
+    int length = code->length;
+    if (length > 32)
+    {
+      if (_peek(a_stream->codes, a_stream->num_code_bytes, pos, length - 32) != code->bits >> 32)
+      {
+        return false;
+      }
+      pos += length - 32;
+      length = 32;
+    }
+    if (_peek(a_stream->codes, a_stream->num_code_bytes, pos, length) != (code->bits & (UINT64_MAX >> (64 - length))))
+    {
+      return false;
+    }
+    pos += length;
+  }
+  return true;
+}
+
+// Move `*a_pos` and `*a_symbol` to the last checkpoint at or before bit `pos_limit` and code `symbol_limit`,
+// looking only at checkpoints from `*a_next` on
+static void _jump_to_checkpoint(const CodeStream *a_stream, uint64_t pos_limit, uint64_t symbol_limit, size_t *a_next,
+                                uint64_t *a_pos, uint64_t *a_symbol)
+{
+  while (*a_next < a_stream->num_checkpoints && a_stream->checkpoints[*a_next].bit_offset <= pos_limit)
+  {
+    const Checkpoint *checkpoint = &a_stream->checkpoints[(*a_next)++];
+    if (checkpoint->offset >= a_stream->offset && checkpoint->offset - a_stream->offset <= symbol_limit &&
+        checkpoint->bit_offset > *a_pos && checkpoint->offset - a_stream->offset > *a_symbol)
+    {
+      *a_pos = checkpoint->bit_offset;
+      *a_symbol = checkpoint->offset - a_stream->offset;
+    }
+  }
+}
+
+// Move `*a_pos` and `*a_symbol` forward by one code, or by as many as the walk table allows without passing
+// bit `pos_limit` or code `symbol_limit`
+static inline void _walk(Search *a_search, const CodeStream *a_stream, uint64_t pos_limit, uint64_t symbol_limit,
+                         uint64_t *a_pos, uint64_t *a_symbol)
+{
+  WalkEntry entry = a_stream->table->walk[_peek(a_stream->codes, a_stream->num_code_bytes, *a_pos, WALK_BITS)];
+  if (entry.num_codes > 0 && *a_pos + entry.num_bits <= pos_limit && *a_symbol + entry.num_codes <= symbol_limit)
+  {
+    *a_pos += entry.num_bits;
+    *a_symbol += entry.num_codes;
+    a_search->stats.num_walked_codes += entry.num_codes;
+  }
+  else
+  {
+    _step(a_stream, a_pos);
+    (*a_symbol)++;
+    a_search->stats.num_walked_codes++;
+  }
+}
+
+// Find the bit offsets where the leading bits of the pattern's codes occur
+static void _find_candidates(const CodeStream *a_stream, OffsetList *a_candidates)
+{
+  const SearchTable *table = a_stream->table;
+  const uint8_t *codes = a_stream->codes;
+  size_t num_code_bytes = a_stream->num_code_bytes;
+  uint64_t end_bit = 8 * (uint64_t)num_code_bytes;
+  int num_prefix_bits = table->num_prefix_bits;
+  for (size_t idx = a_stream->start_bit / 8; idx < num_code_bytes; idx++)
+  {
+    uint8_t next_byte = idx + 1 < num_code_bytes ? codes[idx + 1] : 0;
+    uint8_t shifts = table->first_shifts[codes[idx]] & table->second_shifts[next_byte];
+    if (shifts == 0)
+    {
+      continue;
+    }
+    uint64_t window = _load(codes, num_code_bytes, idx);
+    for (int shift = 0; shift < 8; shift++)
+    {
+      uint64_t pos = 8 * (uint64_t)idx + shift;
+      if ((shifts >> shift & 1) && (window << shift) >> (64 - num_prefix_bits) == table->prefix &&
+          pos >= a_stream->start_bit && pos + table->num_pattern_bits <= end_bit)
+      {
+        _add_offset(a_candidates, pos);
+      }
+    }
+  }
+}
+
+// Walk the codes to each candidate, from the start or the checkpoint before it, and keep those on a code boundary
+static void _check_candidates(Search *a_search, const CodeStream *a_stream, const OffsetList *a_candidates)
+{
+  if (a_search->pattern_size > a_stream->num_symbols)
+  {
+    return;
+  }
+  uint64_t last_symbol = a_stream->num_symbols - a_search->pattern_size;
+  uint64_t pos = a_stream->start_bit;
+  uint64_t symbol = 0;
+  size_t next_checkpoint = 0;
+  for (size_t idx = 0; idx < a_candidates->num_offsets && symbol <= last_symbol; idx++)
+  {
+    uint64_t candidate = a_candidates->offsets[idx];
+    _jump_to_checkpoint(a_stream, candidate, last_symbol, &next_checkpoint, &pos, &symbol);
+    while (pos < candidate && symbol <= last_symbol)
+    {
+      _walk(a_search, a_stream, candidate, last_symbol + 1, &pos, &symbol);
+    }
+    if (pos == candidate && symbol <= last_symbol && _codes_match_at(a_search, a_stream, pos))
+    {
+      _add_offset(&a_search->matches, a_stream->offset + symbol);
+    }
+  }
+}
+
+// Decode codes `first` to `first + count`, which must all be in the stream
+static void _decode_codes(Search *a_search, const CodeStream *a_stream, uint64_t first, size_t count, uint8_t *dst)
+{
+  uint64_t pos = a_stream->start_bit;
+  uint64_t symbol = 0;
+  size_t next_checkpoint = 0;
+  _jump_to_checkpoint(a_stream, UINT64_MAX, first, &next_checkpoint, &pos, &symbol);
+  while (symbol < first)
+  {
+    _walk(a_search, a_stream, UINT64_MAX, first, &pos, &symbol);
+  }
+  for (size_t idx = 0; idx < count; idx++)
+  {
+    dst[idx] = _step(a_stream, &pos);
+  }
+}
+
+static void _search_codes(Search *a_search, const CodeStream *a_stream)
+{
+  a_search->stats.num_blocks++;
+  OffsetList candidates = {.offsets = NULL, .num_offsets = 0, .capacity = 0};
+  if (a_stream->table->codable)
+  {
+    _find_candidates(a_stream, &candidates);
+  }
+  a_search->stats.num_candidates += candidates.num_offsets;
+  if (candidates.num_offsets == 0)
+  {
+    a_search->stats.num_skipped_blocks++;
+  }
+  _check_candidates(a_search, a_stream, &candidates);
+  free(candidates.offsets);
+}
+
+static void _search_bytes(Search *a_search, const uint8_t *bytes, size_t num_bytes, uint64_t offset)
+{
+  a_search->stats.num_blocks++;
+  a_search->stats.num_plain_bytes += num_bytes;
+  if (a_search->pattern_size > num_bytes)
+  {
+    return;
+  }
+  size_t last = num_bytes - a_search->pattern_size;
+  const uint8_t *next = memchr(bytes, a_search->pattern[0], last + 1);
+  while (next != NULL)
+  {
+    size_t idx = next - bytes;
+    if (memcmp(next, a_search->pattern, a_search->pattern_size) == 0)
+    {
+      _add_offset(&a_search->matches, offset + idx);
+    }
+    next = idx < last ? memchr(next + 1, a_search->pattern[0], last - idx) : NULL;
+  }
+}
+
+static void _add_stats(SearchStats *a_total, const SearchStats *a_stats)
+{
+  if (a_total != NULL)
+  {
+    a_total->num_blocks += a_stats->num_blocks;
+    a_total->num_skipped_blocks += a_stats->num_skipped_blocks;
+    a_total->num_candidates += a_stats->num_candidates;
+    a_total->num_walked_codes += a_stats->num_walked_codes;
+    a_total->num_plain_bytes += a_stats->num_plain_bytes;
+  }
+}
+
+void search_huffman_codes(TreeNode *root, const uint8_t *codes, size_t num_code_bytes, uint64_t num_symbols,
+                          const uint8_t *pattern, size_t pattern_size, uint64_t **a_offsets, size_t *a_num_offsets,
+                          SearchStats *a_stats)
+{
+  Search search = {.pattern = pattern, .pattern_size = pattern_size};
+  if (pattern_size > 0 && root != NULL)
+  {
+    SearchTable *table = _new_search_table(root, pattern, pattern_size);
+    if (table->has_codes)
+    {
+      CodeStream stream = {.table = table,
+                           .codes = codes,
+                           .num_code_bytes = num_code_bytes,
+                           .start_bit = 0,
+                           .num_symbols = num_symbols,
+                           .offset = 0,
+                           .checkpoints = NULL,
+                           .num_checkpoints = 0};
+      _search_codes(&search, &stream);
+    }
+    else
+    {
+      // A lone leaf: every byte is the same, so the pattern matches everywhere or nowhere
+      search.stats.num_blocks++;
+      bool all_leaf = true;
+      for (size_t idx = 0; idx < pattern_size; idx++)
+      {
+        all_leaf = all_leaf && pattern[idx] == root->character;
+      }
+      for (uint64_t offset = 0; all_leaf && offset + pattern_size <= num_symbols; offset++)
+      {
+        _add_offset(&search.matches, offset);
+      }
+    }
+    table->root = NULL; // Owned by the caller
+    _destroy_search_table(&table);
+  }
+  *a_offsets = search.matches.offsets;
+  *a_num_offsets = search.matches.num_offsets;
+  _add_stats(a_stats, &search.stats);
+}
+
+// Whether `head`, the first bytes of a block, could continue a match that started before the block
+static bool _could_continue(const Search *a_search, const uint8_t *head, size_t head_size)
+{
+  for (size_t skip = 1; skip < a_search->pattern_size; skip++)
+  {
+    size_t size = a_search->pattern_size - skip < head_size ? a_search->pattern_size - skip : head_size;
+    if (memcmp(a_search->pattern + skip, head, size) == 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Find the matches that start in `tail`, the bytes before a block boundary, and end in `head`, the bytes after it
+static void _search_boundary(Search *a_search, const uint8_t *tail, size_t tail_size, const uint8_t *head,
+                             size_t head_size, uint64_t boundary)
+{
+  size_t window_size = tail_size + head_size;
+  uint8_t *window = malloc(window_size);
+  memcpy(window, tail, tail_size);
+  memcpy(window + tail_size, head, head_size);
+  for (size_t idx = 0; idx < tail_size && idx + a_search->pattern_size <= window_size; idx++)
+  {
+    if (memcmp(window + idx, a_search->pattern, a_search->pattern_size) == 0)
+    {
+      _add_offset(&a_search->matches, boundary - tail_size + idx);
+    }
+  }
+  free(window);
+}
+
+/*
+ * The last pattern_size - 1 bytes before the block being searched. They are
+ * only decoded once a match might straddle the boundary; until then `pending`
+ * holds the codes of the block they end, which are at least that long.
+ */
+typedef struct _Carry
+{
+  uint8_t *bytes;
+  size_t num_bytes;
+  bool has_pending;
+  CodeStream pending;
+  uint8_t *pending_payload;
+} Carry;
+
+static void _resolve_carry(Search *a_search, Carry *a_carry)
+{
+  if (a_carry->has_pending)
+  {
+    size_t size = a_search->pattern_size - 1;
+    _decode_codes(a_search, &a_carry->pending, a_carry->pending.num_symbols - size, size, a_carry->bytes);
+    a_carry->num_bytes = size;
+    a_carry->has_pending = false;
+    free(a_carry->pending_payload);
+    a_carry->pending_payload = NULL;
+  }
+}
+
+// Make the carry end with the `num_bytes` bytes of a block that were decoded (or, for short blocks of codes, its head)
+static void _carry_bytes(Search *a_search, Carry *a_carry, const uint8_t *bytes, size_t num_bytes)
+{
+  size_t size = a_search->pattern_size - 1;
+  if (num_bytes >= size)
+  {
+    memcpy(a_carry->bytes, bytes + num_bytes - size, size);
+    a_carry->num_bytes = size;
+    a_carry->has_pending = false;
+    free(a_carry->pending_payload);
+    a_carry->pending_payload = NULL;
+    return;
+  }
+  _resolve_carry(a_search, a_carry);
+  size_t num_kept = a_carry->num_bytes + num_bytes > size ? size - num_bytes : a_carry->num_bytes;
+  memmove(a_carry->bytes, a_carry->bytes + a_carry->num_bytes - num_kept, num_kept);
+  memcpy(a_carry->bytes + num_kept, bytes, num_bytes);
+  a_carry->num_bytes = num_kept + num_bytes;
+}
+
+static bool _search_blocks(Search *a_search, FILE *container, const char **a_error)
+{
+  Checkpoint *checkpoints = NULL;
+  size_t num_checkpoints = 0;
+  if (!read_checkpoints(container, &checkpoints, &num_checkpoints, a_error))
+  {
+    return false;
+  }
+
+  size_t carry_size = a_search->pattern_size - 1;
+  Carry carry = {.bytes = malloc(carry_size + 1), .num_bytes = 0, .has_pending = false, .pending_payload = NULL};
+  uint8_t *head = malloc(carry_size + 1);
+  SearchTable *table = NULL;
+  SearchTable *retired_table = NULL;
+  uint64_t offset = 0;
+  uint64_t block_offset = 0;
+  size_t checkpoint_idx = 0;
+  bool ok = true;
+  BlockType type;
+  uint32_t num_bytes;
+  uint32_t num_payload_bytes;
+  while (ok && read_block_header(container, block_offset, &type, &num_bytes, &num_payload_bytes))
+  {
+    uint8_t *payload = num_bytes <= MAX_DECODED_BLOCK_SIZE ? read_block_payload(container, num_payload_bytes) : NULL;
+    if (payload == NULL)
+    {
+      *a_error = "truncated block";
+      ok = false;
+      break;
+    }
+
+    // Huffman blocks are searched as codes, the rest as the bytes they decode to
+    bool as_codes = false;
+    CodeStream stream = {
+        .codes = payload, .num_code_bytes = num_payload_bytes, .num_symbols = num_bytes, .offset = offset};
+    uint8_t *bytes = NULL;
+    if (type == BLOCK_HUFFMAN || type == BLOCK_HUFFMAN_REPEAT)
+    {
+      BitReader reader = open_memory_bit_reader(payload, num_payload_bytes);
+      if (type == BLOCK_HUFFMAN)
+      {
+        retired_table = table;
+        table = _new_search_table(read_coding_table(&reader), a_search->pattern, a_search->pattern_size);
+      }
+      if (table == NULL || (table->root == NULL && num_bytes > 0))
+      {
+        *a_error = table == NULL ? "repeated table before any table" : "empty coding table";
+        free(payload);
+        ok = false;
+        break;
+      }
+      as_codes = table->has_codes;
+      if (!as_codes)
+      {
+        bytes = malloc(num_bytes + 1);
+        memset(bytes, table->root != NULL ? table->root->character : 0, num_bytes);
+      }
+      stream.table = table;
+      stream.start_bit = 8 * reader.byte_idx - (reader.current_bit + 1);
+    }
+    else if (type == BLOCK_STORED && num_payload_bytes == num_bytes)
+    {
+      bytes = payload;
+    }
+    else
+    {
+      TreeNode *unused_root = NULL;
+      bytes = malloc(num_bytes + 1);
+      ok = decode_block(type, payload, num_payload_bytes, bytes, num_bytes, &unused_root, a_error);
+    }
+
+    // The checkpoints inside this block
+    while (checkpoint_idx < num_checkpoints && checkpoints[checkpoint_idx].block_offset < block_offset)
+    {
+      checkpoint_idx++;
+    }
+    stream.checkpoints = checkpoints + checkpoint_idx;
+    while (checkpoint_idx < num_checkpoints && checkpoints[checkpoint_idx].block_offset == block_offset)
+    {
+      checkpoint_idx++;
+    }
+    stream.num_checkpoints = checkpoints + checkpoint_idx - stream.checkpoints;
+
+    if (ok)
+    {
+      size_t head_size = num_bytes < carry_size ? num_bytes : carry_size;
+      const uint8_t *block_head = bytes;
+      if (as_codes)
+      {
+        _decode_codes(a_search, &stream, 0, head_size, head);
+        block_head = head;
+      }
+      if (head_size > 0 && _could_continue(a_search, block_head, head_size))
+      {
+        _resolve_carry(a_search, &carry);
+        _search_boundary(a_search, carry.bytes, carry.num_bytes, block_head, head_size, offset);
+      }
+
+      if (as_codes)
+      {
+        _search_codes(a_search, &stream);
+      }
+      else
+      {
+        _search_bytes(a_search, bytes, num_bytes, offset);
+      }
+
+      if (as_codes && num_bytes >= carry_size)
+      {
+        free(carry.pending_payload);
+        carry.has_pending = true;
+        carry.pending = stream;
+        carry.pending_payload = payload;
+        payload = NULL;
+      }
+      else
+      {
+        _carry_bytes(a_search, &carry, as_codes ? head : bytes, num_bytes);
+      }
+    }
+
+    if (bytes != payload)
+    {
+      free(bytes);
+    }
+    free(payload);
+    _destroy_search_table(&retired_table);
+    offset += num_bytes;
+    block_offset += BLOCK_HEADER_BITS / 8 + num_payload_bytes;
+  }
+
+  free(carry.pending_payload);
+  free(carry.bytes);
+  free(head);
+  _destroy_search_table(&table);
+  _destroy_search_table(&retired_table);
+  free(checkpoints);
+  return ok;
+}
+
+bool search_container(FILE *container, const uint8_t *pattern, size_t pattern_size, uint64_t **a_offsets,
+                      size_t *a_num_offsets, SearchStats *a_stats, const char **a_error)
+{
+  *a_offsets = NULL;
+  *a_num_offsets = 0;
+  uint8_t header[CONTAINER_HEADER_BYTES];
+  if (fseek(container, 0, SEEK_SET) != 0 || fread(header, 1, sizeof(header), container) != sizeof(header) ||
+      (header[0] | header[1] << 8 | header[2] << 16 | (uint32_t)header[3] << 24) != CONTAINER_MAGIC)
+  {
+    *a_error = "not a container";
+    return false;
+  }
+
+  Search search = {.pattern = pattern, .pattern_size = pattern_size};
+  bool ok = true;
+  if (pattern_size == 0)
+  {
+    // Nothing to find
+  }
+  else if (header[4] == CONTAINER_BLOCKS)
+  {
+    ok = _search_blocks(&search, container, a_error);
+  }
+  else
+  {
+    // An adaptive code changes with every byte, so there is no fixed coded form to look for
+    BitReader reader = {.file = container, .current_byte = 0, .current_bit = -1};
+    fseek(container, sizeof(uint32_t), SEEK_SET);
+    BitWriter output = open_memory_bit_writer(0);
+    ok = decode_container(&reader, &output, a_error);
+    if (ok)
+    {
+      _search_bytes(&search, output.buffer, output.num_bytes, 0);
+    }
+    free(output.buffer);
+  }
+
+  if (!ok)
+  {
+    free(search.matches.offsets);
+    return false;
+  }
+  *a_offsets = search.matches.offsets;
+  *a_num_offsets = search.matches.num_offsets;
+  _add_stats(a_stats, &search.stats);
+  return true;
+}
@@ -0,0 +1,43 @@
+#ifndef COLUMNS_H
+#define COLUMNS_H
+
+#include "bit_tools.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Wider records leave too few bytes per column to pay for a table each
+#define COLUMNS_MAX_WIDTH 4096
+
+/**
+ * @brief Write `bytes`, taken as fixed-width records of `record_width` bytes
+ * (the last one may be cut short), as one stream per column: byte i of every
+ * record, in order. Each column is coded with a tree of its own, so a field
+ * that is nearly constant, or a counter whose high byte rarely changes, costs
+ * little even where the bytes of the whole record look random.
+ *
+ * The columns are counted from the first byte of `bytes`, so a block that
+ * starts partway into a record only rotates which field each column holds.
+ *
+ * The payload is the record width as a varint (no more than `num_bytes`),
+ * then a Huffman section (see write_huffman_section(...)) for each column.
+ *
+ * @param a_writer the BitWriter to write the payload to
+ * @param bytes the bytes to compress
+ * @param num_bytes the number of bytes to compress, at least one
+ * @param record_width the bytes per record, 1 to COLUMNS_MAX_WIDTH
+ */
+void columns_write_payload(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes, size_t record_width);
+
+/**
+ * @brief Decode a payload written by columns_write_payload(...).
+ *
+ * @param a_reader the memory BitReader positioned at the payload
+ * @param bytes where to store the decoded bytes
+ * @param num_bytes the number of bytes the payload decodes to
+ * @return bool false if the payload is malformed
+ */
+bool columns_read_payload(BitReader *a_reader, uint8_t *bytes, size_t num_bytes);
+
+#endif // COLUMNS_H
@@ -1,7 +1,14 @@
 #include "huffman.h"
 #include "utils.h"
+#include "container.h"
+#include "adaptive_huffman.h"
+#include "lz77.h"
+#include "columns.h"
+#include "dictionary.h"
+#include "parallel_huffman.h"
 #include <stdint.h>
 #include <inttypes.h>
+#include <unistd.h>
 
 uint32_t get_total_bytes(Frequencies freqs)
 {
@@ -33,17 +40,45 @@ uint8_t *read_file(const char *path)
   return buffer;
 }
 
-int main(int argc, char *argv[])
+static bool _is_std_stream(const char *path)
 {
-  if (argc != 2)
-  {
-    printf("Usage: %s <filename>\n", argv[0]);
-    return EXIT_FAILURE;
-  }
+  return strcmp(path, "-") == 0;
+}
+
+static void _print_usage(const char *program)
+{
+  printf("Usage: %s [-p <threads>] <filename>\n", program);
+  printf("       %s -a|-b|-c|-e|-j|-t|-z <level>|-R <bytes> [-w <window_log>] [-p <threads>] [-i <KiB>] [-s] "
+         "[-T <cache_file>] [-o <output_file>|-] <filename>|-\n",
+         program);
+  printf("       %s -d <dictionary_file> [-o <output_file>|-] <filename>|-\n", program);
+  printf("       %s -A|-P <offset> [block container options] [-o <output_file>] <filename>|-\n", program);
+  printf("  (no option)  write compressed.bits and coding_table.bits\n");
+  printf("  -a           one-pass adaptive Huffman container; reads pipes\n");
+  printf("  -b           block container, with a new table where statistics shift\n");
+  printf("  -z           block container with LZ77 matching, level 1 (fast) to %d (small)\n", LZ_MAX_LEVEL);
+  printf("  -w           LZ77 window of 2^window_log bytes, %d to %d (default %d)\n", LZ_MIN_WINDOW_LOG,
+         LZ_MAX_WINDOW_LOG, LZ_DEFAULT_WINDOW_LOG);
+  printf("  -c           block container with order-1 (previous byte) tables; combines with -j and -z\n");
+  printf("  -j           block container with the Burrows-Wheeler transform, for the best ratio\n");
+  printf("  -t           block container with word tokens as symbols; combines with -c\n");
+  printf("  -e           block container with tANS where it beats Huffman, as on skewed bytes; combines with all\n");
+  printf("  -R           block container with a table per byte of records <bytes> long, 1 to %d; combines with all\n",
+         COLUMNS_MAX_WIDTH);
+  printf("  -d           a frame coded with the dictionary made by train and no table, for tiny inputs\n");
+  printf("  -p           threads for -z, -j and the two-file format (default one per core)\n");
+  printf("  -i           end a block container with an index of checkpoints every <KiB> KiB, for decompress -r\n");
+  printf("  -s           end a block container with the byte histogram of every block, for hstat\n");
+  printf("  -T           reuse coding tables kept in <cache_file> for blocks shaped alike, and keep new ones\n");
+  printf("  -A           add to the end of an existing block container as new blocks\n");
+  printf("  -P           overwrite an existing block container's bytes from <offset> on, coding only their blocks\n");
+  printf("  -o           container output path (default compressed.bits)\n");
+}
 
+static int _compress_two_file(const char *filename, int num_threads)
+{
   Frequencies freq = {0};
   const char *error = NULL;
-  const char *filename = argv[1];
   uchar *uncompressed_bytes = read_file(filename);
 
   if (calc_frequencies(freq, filename, &error))
@@ -52,7 +87,7 @@ int main(int argc, char *argv[])
     TreeNode *root = make_huffman_tree(freq);
     BitWriter compressed_writer = open_bit_writer("compressed.bits");
     fwrite(&total_bytes, sizeof(uint32_t), 1, compressed_writer.file);
-    write_compressed(&compressed_writer, uncompressed_bytes, root);
+    write_compressed_parallel(&compressed_writer, uncompressed_bytes, root, num_threads);
     BitWriter coding_table_writer = open_bit_writer("coding_table.bits");
     write_coding_table(root, &coding_table_writer);
     close_bit_writer(&compressed_writer);
@@ -67,4 +102,372 @@ int main(int argc, char *argv[])
   free(uncompressed_bytes);
 
   return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
+
+static int _compress_container(ContainerMode mode, const BlockOptions *a_options, const char *filename,
+                               const char *output_path)
+{
+  FILE *uncompressed = _is_std_stream(filename) ? stdin : fopen(filename, "rb");
+  if (uncompressed == NULL)
+  {
+    printf("Error: %s\n", strerror(errno));
+    return EXIT_FAILURE;
+  }
+  BitWriter writer = _is_std_stream(output_path)
+                         ? (BitWriter){.file = stdout, .current_byte = 0, .num_bits_left = 8}
+                         : open_bit_writer(output_path);
+  if (writer.file == NULL)
+  {
+    printf("Error: %s\n", strerror(errno));
+    fclose(uncompressed);
+    return EXIT_FAILURE;
+  }
+
+  write_container_header(&writer, mode);
+  switch (mode)
+  {
+  case CONTAINER_ADAPTIVE:
+    adaptive_compress_stream(uncompressed, &writer);
+    break;
+  case CONTAINER_BLOCKS:
+  {
+    size_t num_bytes = 0;
+    uint8_t *bytes = read_stream(uncompressed, &num_bytes);
+    compress_blocks(&writer, bytes, num_bytes, a_options);
+    free(bytes);
+    break;
+  }
+  default: // No option selects CONTAINER_ARCHIVE: an archive holds many files, so only harc writes one
+    break;
+  }
+
+  align_bit_writer(&writer);
+  if (writer.file == stdout)
+  {
+    fflush(stdout);
+  }
+  else
+  {
+    fclose(writer.file);
+  }
+  if (uncompressed != stdin)
+  {
+    fclose(uncompressed);
+  }
+  return EXIT_SUCCESS;
+}
+
+static int _compress_dictionary(const char *dictionary_path, const char *filename, const char *output_path)
+{
+  BitReader dictionary_reader = open_bit_reader(dictionary_path);
+  if (dictionary_reader.file == NULL)
+  {
+    printf("Error: %s: %s\n", dictionary_path, strerror(errno));
+    return EXIT_FAILURE;
+  }
+  HuffDictionary dictionary;
+  const char *error = NULL;
+  bool loaded = read_dictionary(&dictionary_reader, &dictionary, &error);
+  close_bit_reader(&dictionary_reader);
+  if (!loaded)
+  {
+    printf("Error: %s: %s\n", dictionary_path, error);
+    return EXIT_FAILURE;
+  }
+
+  FILE *uncompressed = _is_std_stream(filename) ? stdin : fopen(filename, "rb");
+  BitWriter writer = {.file = NULL};
+  if (uncompressed != NULL)
+  {
+    writer = _is_std_stream(output_path) ? (BitWriter){.file = stdout, .current_byte = 0, .num_bits_left = 8}
+                                         : open_bit_writer(output_path);
+  }
+  if (uncompressed == NULL || writer.file == NULL)
+  {
+    printf("Error: %s\n", strerror(errno));
+    if (uncompressed != NULL && uncompressed != stdin)
+    {
+      fclose(uncompressed);
+    }
+    destroy_dictionary(&dictionary);
+    return EXIT_FAILURE;
+  }
+
+  size_t num_bytes = 0;
+  uint8_t *bytes = read_stream(uncompressed, &num_bytes);
+  write_dictionary_frame(&writer, &dictionary, bytes, num_bytes);
+  free(bytes);
+  if (writer.file == stdout)
+  {
+    fflush(stdout);
+  }
+  else
+  {
+    fclose(writer.file); // The frame ends aligned; flushing would add a byte
+  }
+  if (uncompressed != stdin)
+  {
+    fclose(uncompressed);
+  }
+  destroy_dictionary(&dictionary);
+  return EXIT_SUCCESS;
+}
+
+// Write a tree cache back to its file and report how often it was used
+static bool _save_tree_cache(const char *path, TreeCache *a_cache)
+{
+  const TreeCacheStats *stats = &a_cache->stats;
+  fprintf(stderr, "tree cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " rejected, %zu tables\n",
+          stats->num_hits, stats->num_misses, stats->num_rejected, a_cache->num_tables);
+  const char *error = NULL;
+  bool ok = save_tree_cache(path, a_cache, &error);
+  if (!ok)
+  {
+    printf("Error: %s: %s\n", path, error);
+  }
+  destroy_tree_cache(a_cache);
+  return ok;
+}
+
+/*
+ * Append `filename` to the container at `output_path`, or with `patch`,
+ * overwrite its bytes from `patch_offset` on. A missing container is written
+ * from scratch when appending.
+ */
+static int _update_container(const BlockOptions *a_options, const char *filename, const char *output_path, bool patch,
+                             uint64_t patch_offset)
+{
+  FILE *container = fopen(output_path, "r+b");
+  if (container == NULL && errno == ENOENT && !patch)
+  {
+    return _compress_container(CONTAINER_BLOCKS, a_options, filename, output_path);
+  }
+  if (container == NULL)
+  {
+    printf("Error: %s\n", strerror(errno));
+    return EXIT_FAILURE;
+  }
+  FILE *uncompressed = _is_std_stream(filename) ? stdin : fopen(filename, "rb");
+  if (uncompressed == NULL)
+  {
+    printf("Error: %s\n", strerror(errno));
+    fclose(container);
+    return EXIT_FAILURE;
+  }
+
+  size_t num_bytes = 0;
+  uint8_t *bytes = read_stream(uncompressed, &num_bytes);
+  const char *error = NULL;
+  bool ok = patch ? patch_container(container, patch_offset, bytes, num_bytes, a_options, &error)
+                  : append_container(container, bytes, num_bytes, a_options, &error);
+  if (!ok)
+  {
+    printf("Error: %s: %s\n", output_path, error);
+  }
+  free(bytes);
+  fclose(container);
+  if (uncompressed != stdin)
+  {
+    fclose(uncompressed);
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[])
+{
+  ContainerMode mode = 0;
+  const char *output_path = NULL; // Until -o sets it
+  int lz_level = 0;
+  int lz_window_log = 0; // Until -w sets it
+  bool bwt = false;
+  bool order1 = false;
+  bool words = false;
+  bool tans = false;
+  size_t record_width = 0;
+  int num_threads = 0;
+  size_t index_interval = 0;
+  bool summaries = false;
+  bool append = false;
+  bool patch = false;
+  uint64_t patch_offset = 0;
+  const char *dictionary_path = NULL;
+  const char *tree_cache_path = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "abcejstAz:w:p:o:d:i:P:R:T:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'a':
+      mode = CONTAINER_ADAPTIVE;
+      break;
+    case 'b':
+      mode = CONTAINER_BLOCKS;
+      break;
+    case 'z':
+      mode = CONTAINER_BLOCKS;
+      lz_level = atoi(optarg);
+      if (lz_level < 1 || lz_level > LZ_MAX_LEVEL)
+      {
+        _print_usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'w':
+      lz_window_log = atoi(optarg);
+      if (lz_window_log < LZ_MIN_WINDOW_LOG || lz_window_log > LZ_MAX_WINDOW_LOG)
+      {
+        _print_usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'c':
+      mode = CONTAINER_BLOCKS;
+      order1 = true;
+      break;
+    case 't':
+      mode = CONTAINER_BLOCKS;
+      words = true;
+      break;
+    case 'e':
+      mode = CONTAINER_BLOCKS;
+      tans = true;
+      break;
+    case 'j':
+      mode = CONTAINER_BLOCKS;
+      bwt = true;
+      break;
+    case 'R':
+      mode = CONTAINER_BLOCKS;
+      record_width = (size_t)atoi(optarg);
+      if (record_width < 1 || record_width > COLUMNS_MAX_WIDTH)
+      {
+        _print_usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'p':
+      num_threads = atoi(optarg);
+      if (num_threads < 1)
+      {
+        _print_usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'i':
+    {
+      // Digits only, as for -P below, and few enough KiB that the interval in bytes fits in a size_t
+      char *end = NULL;
+      errno = 0;
+      unsigned long long kib = strtoull(optarg, &end, 10);
+      if (optarg[0] < '0' || optarg[0] > '9' || *end != '\0' || errno != 0 || kib < 1 || kib > SIZE_MAX >> 10)
+      {
+        _print_usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      index_interval = (size_t)kib << 10;
+      break;
+    }
+    case 's':
+      summaries = true;
+      break;
+    case 'A':
+      append = true;
+      break;
+    case 'P':
+    {
+      // strtoull(...) takes a sign and stops at junk, so check that the whole argument is digits
+      char *end = NULL;
+      errno = 0;
+      patch = true;
+      patch_offset = strtoull(optarg, &end, 10);
+      if (optarg[0] < '0' || optarg[0] > '9' || *end != '\0' || errno != 0)
+      {
+        _print_usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+    }
+    case 'o':
+      output_path = optarg;
+      break;
+    case 'd':
+      dictionary_path = optarg;
+      break;
+    case 'T':
+      tree_cache_path = optarg;
+      break;
+    default:
+      _print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc - 1)
+  {
+    _print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  // A frame has no blocks, so the container mode and the options it reads make no sense with -d
+  bool block_options = lz_window_log > 0 || index_interval > 0 || summaries || tree_cache_path != NULL;
+  if (dictionary_path != NULL && (mode != 0 || append || patch || block_options))
+  {
+    _print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  // Without a mode the two files have fixed names and no room for what the block options add
+  bool two_file = dictionary_path == NULL && mode == 0 && !append && !patch;
+  if (two_file && (block_options || output_path != NULL))
+  {
+    _print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (output_path == NULL)
+  {
+    output_path = "compressed.bits";
+  }
+
+  const char *filename = argv[optind];
+  if (dictionary_path != NULL)
+  {
+    return _compress_dictionary(dictionary_path, filename, output_path);
+  }
+  if ((append || patch) && (mode == CONTAINER_ADAPTIVE || _is_std_stream(output_path)))
+  {
+    _print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (two_file)
+  {
+    return _compress_two_file(filename, num_threads);
+  }
+  int window_log = lz_window_log > 0 ? lz_window_log : LZ_DEFAULT_WINDOW_LOG;
+  BlockOptions options = bwt            ? bwt_block_options()
+                         : lz_level > 0 ? lz_block_options(lz_level, window_log)
+                         : words        ? word_block_options()
+                                        : default_block_options();
+  options.order1 = order1;
+  options.words = words;
+  options.tans = tans;
+  options.record_width = record_width;
+  options.num_threads = num_threads;
+  options.index_interval = index_interval;
+  options.summaries = summaries;
+  TreeCache tree_cache;
+  const char *error = NULL;
+  if (tree_cache_path != NULL && !load_tree_cache(tree_cache_path, &tree_cache, DEFAULT_TREE_CACHE_TOLERANCE, &error))
+  {
+    printf("Error: %s: %s\n", tree_cache_path, error);
+    destroy_tree_cache(&tree_cache);
+    return EXIT_FAILURE;
+  }
+  options.tree_cache = tree_cache_path != NULL ? &tree_cache : NULL;
+  int status = append || patch ? _update_container(&options, filename, output_path, patch, patch_offset)
+                               : _compress_container(mode, &options, filename, output_path);
+  if (tree_cache_path != NULL && !_save_tree_cache(tree_cache_path, &tree_cache))
+  {
+    status = EXIT_FAILURE;
+  }
+  return status;
+}
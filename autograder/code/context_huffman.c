@@ -0,0 +1,223 @@
+#include "context_huffman.h"
+#include "huffman.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_CONTEXTS 256
+
+typedef struct _Cluster
+{
+  Frequencies freq;
+  double cost; // Estimated bits for the codes and the table
+  bool alive;
+} Cluster;
+
+static double _cluster_cost(const Frequencies freq)
+{
+  return entropy_bits(freq) + coding_table_bits(freq);
+}
+
+static double _merge_cost(const Cluster *a_first, const Cluster *a_second)
+{
+  Frequencies merged;
+  for (int ch = 0; ch < 256; ch++)
+  {
+    merged[ch] = a_first->freq[ch] + a_second->freq[ch];
+  }
+  return _cluster_cost(merged) - a_first->cost - a_second->cost;
+}
+
+/*
+ * Group the contexts, filling cluster_of[context] with a cluster number and
+ * cluster_freq[cluster] with the byte counts of its contexts. Returns the
+ * number of clusters.
+ */
+static int _cluster_contexts(Frequencies *context_freq, uint8_t *cluster_of, Frequencies *cluster_freq)
+{
+  Cluster *clusters = malloc(NUM_CONTEXTS * sizeof(Cluster));
+  int num_alive = 0;
+  for (int ctx = 0; ctx < NUM_CONTEXTS; ctx++)
+  {
+    memcpy(clusters[ctx].freq, context_freq[ctx], sizeof(Frequencies));
+    clusters[ctx].alive = false;
+    for (int ch = 0; ch < 256 && !clusters[ctx].alive; ch++)
+    {
+      clusters[ctx].alive = context_freq[ctx][ch] > 0;
+    }
+    clusters[ctx].cost = _cluster_cost(context_freq[ctx]);
+    num_alive += clusters[ctx].alive;
+  }
+
+  // merge_cost[a][b] for a < b, updated only for the row and column of each merge
+  double *merge_cost = malloc(NUM_CONTEXTS * NUM_CONTEXTS * sizeof(double));
+  for (int first = 0; first < NUM_CONTEXTS; first++)
+  {
+    for (int second = first + 1; second < NUM_CONTEXTS && clusters[first].alive; second++)
+    {
+      if (clusters[second].alive)
+      {
+        merge_cost[first * NUM_CONTEXTS + second] = _merge_cost(&clusters[first], &clusters[second]);
+      }
+    }
+  }
+
+  // merged_into[ctx] follows each merged cluster to the one that absorbed it
+  int merged_into[NUM_CONTEXTS];
+  for (int ctx = 0; ctx < NUM_CONTEXTS; ctx++)
+  {
+    merged_into[ctx] = ctx;
+  }
+
+  while (num_alive > 1)
+  {
+    int best_first = -1;
+    int best_second = -1;
+    for (int first = 0; first < NUM_CONTEXTS; first++)
+    {
+      for (int second = first + 1; second < NUM_CONTEXTS && clusters[first].alive; second++)
+      {
+        if (clusters[second].alive &&
+            (best_first < 0 ||
+             merge_cost[first * NUM_CONTEXTS + second] < merge_cost[best_first * NUM_CONTEXTS + best_second]))
+        {
+          best_first = first;
+          best_second = second;
+        }
+      }
+    }
+    if (merge_cost[best_first * NUM_CONTEXTS + best_second] >= 0 && num_alive <= CONTEXT_MAX_CLUSTERS)
+    {
+      break;
+    }
+
+    Cluster *kept = &clusters[best_first];
+    for (int ch = 0; ch < 256; ch++)
+    {
+      kept->freq[ch] += clusters[best_second].freq[ch];
+    }
+    kept->cost = _cluster_cost(kept->freq);
+    clusters[best_second].alive = false;
+    merged_into[best_second] = best_first;
+    num_alive--;
+
+    for (int other = 0; other < NUM_CONTEXTS; other++)
+    {
+      if (clusters[other].alive && other != best_first)
+      {
+        int first = other < best_first ? other : best_first;
+        int second = other < best_first ? best_first : other;
+        merge_cost[first * NUM_CONTEXTS + second] = _merge_cost(&clusters[first], &clusters[second]);
+      }
+    }
+  }
+
+  // Number the surviving clusters in context order; contexts that never occur share cluster 0
+  int cluster_number[NUM_CONTEXTS];
+  int num_clusters = 0;
+  for (int ctx = 0; ctx < NUM_CONTEXTS; ctx++)
+  {
+    if (clusters[ctx].alive)
+    {
+      memcpy(cluster_freq[num_clusters], clusters[ctx].freq, sizeof(Frequencies));
+      cluster_number[ctx] = num_clusters++;
+    }
+  }
+  for (int ctx = 0; ctx < NUM_CONTEXTS; ctx++)
+  {
+    int root_ctx = ctx;
+    while (merged_into[root_ctx] != root_ctx)
+    {
+      root_ctx = merged_into[root_ctx];
+    }
+    cluster_of[ctx] = clusters[root_ctx].alive ? (uint8_t)cluster_number[root_ctx] : 0;
+  }
+
+  free(merge_cost);
+  free(clusters);
+  return num_clusters;
+}
+
+void context_write_payload(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes)
+{
+  Frequencies *context_freq = calloc(NUM_CONTEXTS, sizeof(Frequencies));
+  uint8_t prev = 0;
+  for (size_t idx = 0; idx < num_bytes; idx++)
+  {
+    context_freq[prev][bytes[idx]]++;
+    prev = bytes[idx];
+  }
+
+  uint8_t cluster_of[NUM_CONTEXTS];
+  Frequencies *cluster_freq = malloc(NUM_CONTEXTS * sizeof(Frequencies));
+  int num_clusters = _cluster_contexts(context_freq, cluster_of, cluster_freq);
+
+  write_bits(a_writer, (uint8_t)num_clusters, 8);
+  write_huffman_section(a_writer, cluster_of, NUM_CONTEXTS);
+  HuffEncoder *encoders = malloc(num_clusters * sizeof(HuffEncoder));
+  for (int cluster = 0; cluster < num_clusters; cluster++)
+  {
+    TreeNode *root = make_huffman_tree(cluster_freq[cluster]);
+    build_huff_encoder(&encoders[cluster], root);
+    write_coding_table(root, a_writer);
+    write_bits(a_writer, 0, 1);
+    destroy_huffman_tree(&root);
+  }
+
+  prev = 0;
+  for (size_t idx = 0; idx < num_bytes; idx++)
+  {
+    const HuffCode *code = &encoders[cluster_of[prev]].codes[bytes[idx]];
+    write_code(a_writer, code->bits, code->length);
+    prev = bytes[idx];
+  }
+
+  free(encoders);
+  free(cluster_freq);
+  free(context_freq);
+}
+
+bool context_read_payload(BitReader *a_reader, uint8_t *bytes, size_t num_bytes)
+{
+  int num_clusters = read_bits(a_reader, 8);
+  uint8_t cluster_of[NUM_CONTEXTS];
+  if (num_clusters == 0 || num_clusters > CONTEXT_MAX_CLUSTERS ||
+      !read_huffman_section(a_reader, cluster_of, NUM_CONTEXTS))
+  {
+    return false;
+  }
+  for (int ctx = 0; ctx < NUM_CONTEXTS; ctx++)
+  {
+    if (cluster_of[ctx] >= num_clusters)
+    {
+      return false;
+    }
+  }
+
+  TreeNode *roots[CONTEXT_MAX_CLUSTERS] = {NULL};
+  HuffDecoder *decoders = malloc(num_clusters * sizeof(HuffDecoder));
+  bool ok = true;
+  for (int cluster = 0; ok && cluster < num_clusters; cluster++)
+  {
+    roots[cluster] = read_coding_table(a_reader);
+    ok = roots[cluster] != NULL;
+    if (ok)
+    {
+      build_huff_decoder(&decoders[cluster], roots[cluster]);
+    }
+  }
+
+  uint8_t prev = 0;
+  for (size_t idx = 0; ok && idx < num_bytes; idx++)
+  {
+    bytes[idx] = decode_symbol(&decoders[cluster_of[prev]], a_reader);
+    prev = bytes[idx];
+  }
+
+  for (int cluster = 0; cluster < num_clusters; cluster++)
+  {
+    destroy_huffman_tree(&roots[cluster]);
+  }
+  free(decoders);
+  return ok && is_bit_reader_open(a_reader);
+}
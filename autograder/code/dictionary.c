@@ -0,0 +1,125 @@
+#include "dictionary.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+TreeNode *train_dictionary_tree(const Frequencies freq)
+{
+  Frequencies smoothed;
+  for (int ch = 0; ch < 256; ch++)
+  {
+    smoothed[ch] = freq[ch] > 0 ? freq[ch] : 1;
+  }
+  return make_huffman_tree(smoothed);
+}
+
+static uint32_t _table_id(TreeNode *root)
+{
+  BitWriter table = open_memory_bit_writer(64);
+  write_coding_table(root, &table);
+  align_bit_writer(&table);
+  uint32_t hash = 2166136261u; // FNV-1a
+  for (size_t idx = 0; idx < table.num_bytes; idx++)
+  {
+    hash = (hash ^ table.buffer[idx]) * 16777619u;
+  }
+  free(table.buffer);
+  return hash;
+}
+
+void write_dictionary(BitWriter *a_writer, TreeNode *root)
+{
+  write_uint32(a_writer, DICTIONARY_MAGIC);
+  write_uint32(a_writer, _table_id(root));
+  write_coding_table(root, a_writer);
+  write_bits(a_writer, 0, 1);
+  align_bit_writer(a_writer);
+}
+
+bool read_dictionary(BitReader *a_reader, HuffDictionary *a_dictionary, const char **a_error)
+{
+  a_dictionary->root = NULL;
+  if (read_uint32(a_reader) != DICTIONARY_MAGIC)
+  {
+    *a_error = "not a dictionary";
+    return false;
+  }
+  a_dictionary->id = read_uint32(a_reader);
+  a_dictionary->root = read_coding_table(a_reader);
+  if (a_dictionary->root == NULL || _table_id(a_dictionary->root) != a_dictionary->id)
+  {
+    *a_error = "corrupt dictionary";
+    destroy_huffman_tree(&a_dictionary->root);
+    return false;
+  }
+  build_huff_encoder(&a_dictionary->encoder, a_dictionary->root);
+  return true;
+}
+
+void destroy_dictionary(HuffDictionary *a_dictionary)
+{
+  destroy_huffman_tree(&a_dictionary->root);
+}
+
+void write_dictionary_frame(BitWriter *a_writer, const HuffDictionary *a_dictionary, const uint8_t *bytes,
+                            size_t num_bytes)
+{
+  write_bits(a_writer, (uint8_t)a_dictionary->id, 8);
+  write_bits(a_writer, (uint8_t)(a_dictionary->id >> 8), 8);
+  write_varint(a_writer, num_bytes);
+
+  // Bytes the corpus never used have long codes, so data unlike it is stored instead
+  Frequencies freq = {0};
+  add_frequencies(freq, bytes, num_bytes);
+  bool raw = coded_bits(freq, &a_dictionary->encoder) > 8 * (uint64_t)num_bytes;
+  write_bits(a_writer, raw, 1);
+  if (raw)
+  {
+    align_bit_writer(a_writer);
+    write_bytes(a_writer, bytes, num_bytes);
+    return;
+  }
+  write_symbols(a_writer, &a_dictionary->encoder, bytes, num_bytes);
+  align_bit_writer(a_writer);
+}
+
+bool read_dictionary_frame(BitReader *a_reader, const HuffDictionary *a_dictionary, uint8_t **a_bytes,
+                           size_t *a_num_bytes, const char **a_error)
+{
+  *a_bytes = NULL;
+  uint32_t id = read_bits(a_reader, 8);
+  id |= (uint32_t)read_bits(a_reader, 8) << 8;
+  if (id != (a_dictionary->id & 0xffff))
+  {
+    *a_error = "written with another dictionary";
+    return false;
+  }
+
+  // Every code is at least one bit, which bounds the length before anything is allocated
+  uint64_t num_bytes = read_varint(a_reader);
+  if (!is_bit_reader_open(a_reader) || num_bytes > 8 * (uint64_t)(a_reader->num_bytes - a_reader->byte_idx) + 8)
+  {
+    *a_error = "corrupt dictionary frame";
+    return false;
+  }
+  bool raw = read_bits(a_reader, 1);
+  *a_bytes = malloc(num_bytes + 1);
+  *a_num_bytes = num_bytes;
+  bool ok = true;
+  if (raw)
+  {
+    ok = read_bytes(a_reader, *a_bytes, num_bytes) == num_bytes;
+  }
+  else
+  {
+    read_symbols(a_reader, a_dictionary->root, *a_bytes, num_bytes);
+  }
+  if (!ok || !is_bit_reader_open(a_reader))
+  {
+    *a_error = "truncated dictionary frame";
+    free(*a_bytes);
+    *a_bytes = NULL;
+    return false;
+  }
+  return true;
+}
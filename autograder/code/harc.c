@@ -0,0 +1,211 @@
+#include "archive.h"
+#include "container.h"
+#include "lz77.h"
+#include "utils.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/*
+ * Writes, lists and extracts archives of many files that store each distinct
+ * chunk of bytes once (see archive.h).
+ */
+
+static void _print_usage(const char *program)
+{
+  printf("Usage: %s -c [-s] [-z <level>] [-e] [-k <KiB>] [-T <cache_file>] <archive_file> <file>...\n", program);
+  printf("       %s -l <archive_file>\n", program);
+  printf("       %s -x <archive_file> <name>\n", program);
+  printf("  -c           write an archive of the files, storing chunks they share once\n");
+  printf("  -s           code all the files with one table, built from all of them, for many small files\n");
+  printf("  -z           code chunks with LZ77 matching, level 1 (fast) to %d (small)\n", LZ_MAX_LEVEL);
+  printf("  -e           code chunks with tANS where it beats Huffman\n");
+  printf("  -T           reuse coding tables kept in <cache_file> for chunks shaped alike, and keep new ones\n");
+  printf("  -k           chunks of <KiB> KiB (default %u); smaller chunks find more in common\n",
+         DEFAULT_ARCHIVE_CHUNK_SIZE >> 10);
+  printf("  -l           list the files of an archive, with their sizes and numbers of blocks\n");
+  printf("  -x           write the file stored as <name> to standard output\n");
+}
+
+static uint8_t *_read_file(const char *path, size_t *a_num_bytes)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+  {
+    fprintf(stderr, "Error: %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+  uint8_t *bytes = read_stream(file, a_num_bytes);
+  fclose(file);
+  return bytes;
+}
+
+static int _create_archive(const char *archive_path, char **paths, int num_paths, const BlockOptions *a_options,
+                           size_t chunk_size, bool share_table)
+{
+  // The shared table needs every file's bytes before the first is coded, so they are read twice
+  Frequencies freq = {0};
+  for (int idx = 0; share_table && idx < num_paths; idx++)
+  {
+    size_t num_file_bytes = 0;
+    uint8_t *bytes = _read_file(paths[idx], &num_file_bytes);
+    if (bytes == NULL)
+    {
+      return EXIT_FAILURE;
+    }
+    add_frequencies(freq, bytes, num_file_bytes);
+    free(bytes);
+  }
+
+  BitWriter writer = open_bit_writer(archive_path);
+  if (writer.file == NULL)
+  {
+    fprintf(stderr, "Error: %s: %s\n", archive_path, strerror(errno));
+    return EXIT_FAILURE;
+  }
+  ArchiveWriter archive;
+  open_archive_writer(&archive, &writer, a_options, chunk_size);
+  if (share_table)
+  {
+    share_archive_table(&archive, freq);
+  }
+  uint64_t num_bytes = 0;
+  for (int idx = 0; idx < num_paths; idx++)
+  {
+    size_t num_file_bytes = 0;
+    uint8_t *bytes = _read_file(paths[idx], &num_file_bytes);
+    if (bytes == NULL)
+    {
+      close_archive_writer(&archive);
+      fclose(writer.file);
+      return EXIT_FAILURE;
+    }
+    add_archive_member(&archive, paths[idx], bytes, num_file_bytes);
+    num_bytes += num_file_bytes;
+    free(bytes);
+  }
+  printf("%d files, %" PRIu64 " bytes: %" PRIu64 " chunks, %zu stored, %" PRIu64 " bytes of blocks\n", num_paths,
+         num_bytes, archive.num_referenced_blocks, archive.store.num_blocks, archive.num_block_bytes);
+  close_archive_writer(&archive);
+  fclose(writer.file);
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+  char action = 0;
+  BlockOptions options = default_block_options();
+  size_t chunk_size = DEFAULT_ARCHIVE_CHUNK_SIZE;
+  bool share_table = false;
+  const char *tree_cache_path = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "clxsez:k:T:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'c':
+    case 'l':
+    case 'x':
+      action = (char)opt;
+      break;
+    case 'z':
+      options.lz_level = atoi(optarg);
+      if (options.lz_level < 1 || options.lz_level > LZ_MAX_LEVEL)
+      {
+        _print_usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 's':
+      share_table = true;
+      break;
+    case 'T':
+      tree_cache_path = optarg;
+      break;
+    case 'e':
+      options.tans = true;
+      break;
+    case 'k':
+      chunk_size = (size_t)atoi(optarg) << 10;
+      if (chunk_size == 0 || chunk_size > MAX_DECODED_BLOCK_SIZE)
+      {
+        _print_usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+    default:
+      _print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  int num_args = argc - optind;
+  char **args = argv + optind;
+  if (action == 0 || num_args < 1 || (action == 'c' && num_args < 2) || (action == 'l' && num_args != 1) ||
+      (action == 'x' && num_args != 2))
+  {
+    _print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (action == 'c')
+  {
+    TreeCache tree_cache;
+    const char *error = NULL;
+    bool ok = tree_cache_path == NULL ||
+              load_tree_cache(tree_cache_path, &tree_cache, DEFAULT_TREE_CACHE_TOLERANCE, &error);
+    options.tree_cache = tree_cache_path != NULL ? &tree_cache : NULL;
+    int status = ok ? _create_archive(args[0], args + 1, num_args - 1, &options, chunk_size, share_table)
+                    : EXIT_FAILURE;
+    if (ok && tree_cache_path != NULL)
+    {
+      const TreeCacheStats *stats = &tree_cache.stats;
+      printf("tree cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " rejected, %zu tables\n", stats->num_hits,
+             stats->num_misses, stats->num_rejected, tree_cache.num_tables);
+      ok = save_tree_cache(tree_cache_path, &tree_cache, &error);
+    }
+    if (!ok)
+    {
+      fprintf(stderr, "Error: %s: %s\n", tree_cache_path, error);
+      status = EXIT_FAILURE;
+    }
+    if (tree_cache_path != NULL)
+    {
+      destroy_tree_cache(&tree_cache);
+    }
+    return status;
+  }
+
+  FILE *file = fopen(args[0], "rb");
+  if (file == NULL)
+  {
+    fprintf(stderr, "Error: %s: %s\n", args[0], strerror(errno));
+    return EXIT_FAILURE;
+  }
+  Archive archive;
+  const char *error = NULL;
+  bool ok = read_archive(file, &archive, &error);
+  for (size_t idx = 0; ok && action == 'l' && idx < archive.num_members; idx++)
+  {
+    const ArchiveMember *member = &archive.members[idx];
+    printf("%12" PRIu64 " %6zu %s\n", member->num_bytes, member->num_blocks, member->name);
+  }
+  if (ok && action == 'x')
+  {
+    size_t member = 0;
+    while (member < archive.num_members && strcmp(archive.members[member].name, args[1]) != 0)
+    {
+      member++;
+    }
+    BitWriter output = {.file = stdout, .current_byte = 0, .num_bits_left = 8};
+    error = member == archive.num_members ? "no such file in the archive" : NULL;
+    ok = error == NULL && extract_archive_member(file, &archive, member, &output, &error);
+    fflush(stdout);
+  }
+  if (!ok)
+  {
+    fprintf(stderr, "Error: %s: %s\n", args[0], error);
+  }
+  destroy_archive(&archive);
+  fclose(file);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
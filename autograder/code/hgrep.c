@@ -0,0 +1,140 @@
+#include "huffman.h"
+#include "container.h"
+#include "code_search.h"
+#include "utils.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/*
+ * Finds a byte pattern in a compressed file without decompressing it (see
+ * code_search.h). Like grep, it exits with 0 if the pattern occurs, 1 if it
+ * does not, and 2 on errors.
+ */
+#define EXIT_MATCH 0
+#define EXIT_NO_MATCH 1
+#define EXIT_ERROR 2
+
+static void _print_usage(const char *program)
+{
+  printf("Usage: %s [-c] [-s] <pattern> <container_file>\n", program);
+  printf("       %s [-c] [-s] <pattern> <compressed_file> <coding_table_file>\n", program);
+  printf("Prints the uncompressed offset of every occurrence of <pattern>, one per line.\n");
+  printf("  -c           print only the number of occurrences\n");
+  printf("  -s           print how much of the input had to be decoded to standard error\n");
+}
+
+// The two-file format is read whole, since its codes are one stream
+static bool _search_two_file(FILE *compressed, const char *table_path, const uint8_t *pattern, size_t pattern_size,
+                             uint64_t **a_offsets, size_t *a_num_offsets, SearchStats *a_stats)
+{
+  BitReader table_reader = open_bit_reader(table_path);
+  if (table_reader.file == NULL)
+  {
+    fprintf(stderr, "Error: %s: %s\n", table_path, strerror(errno));
+    return false;
+  }
+  TreeNode *root = read_coding_table(&table_reader);
+  close_bit_reader(&table_reader);
+
+  size_t num_bytes = 0;
+  uint8_t *bytes = read_stream(compressed, &num_bytes);
+  bool ok = num_bytes >= sizeof(uint32_t);
+  uint32_t num_symbols = ok ? bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24 : 0;
+  ok = ok && (root != NULL || num_symbols == 0);
+  if (ok)
+  {
+    search_huffman_codes(root, bytes + sizeof(uint32_t), num_bytes - sizeof(uint32_t), num_symbols, pattern,
+                         pattern_size, a_offsets, a_num_offsets, a_stats);
+  }
+  else
+  {
+    fprintf(stderr, "Error: %s: empty coding table\n", table_path);
+  }
+  free(bytes);
+  destroy_huffman_tree(&root);
+  return ok;
+}
+
+int main(int argc, char *argv[])
+{
+  bool count_only = false;
+  bool print_stats = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "cs")) != -1)
+  {
+    switch (opt)
+    {
+    case 'c':
+      count_only = true;
+      break;
+    case 's':
+      print_stats = true;
+      break;
+    default:
+      _print_usage(argv[0]);
+      return EXIT_ERROR;
+    }
+  }
+  int num_args = argc - optind;
+  char **args = argv + optind;
+  if (num_args < 2 || num_args > 3 || args[0][0] == '\0')
+  {
+    _print_usage(argv[0]);
+    return EXIT_ERROR;
+  }
+
+  const uint8_t *pattern = (const uint8_t *)args[0];
+  size_t pattern_size = strlen(args[0]);
+  const char *compressed_path = args[1];
+  FILE *compressed = fopen(compressed_path, "rb");
+  if (compressed == NULL)
+  {
+    fprintf(stderr, "Error: %s: %s\n", compressed_path, strerror(errno));
+    return EXIT_ERROR;
+  }
+
+  uint64_t *offsets = NULL;
+  size_t num_offsets = 0;
+  SearchStats stats = {0};
+  bool ok = true;
+  if (num_args == 2)
+  {
+    const char *error = NULL;
+    ok = search_container(compressed, pattern, pattern_size, &offsets, &num_offsets, &stats, &error);
+    if (!ok)
+    {
+      fprintf(stderr, "Error: %s: %s\n", compressed_path, error);
+    }
+  }
+  else
+  {
+    ok = _search_two_file(compressed, args[2], pattern, pattern_size, &offsets, &num_offsets, &stats);
+  }
+  fclose(compressed);
+
+  if (ok && count_only)
+  {
+    printf("%zu\n", num_offsets);
+  }
+  for (size_t idx = 0; ok && !count_only && idx < num_offsets; idx++)
+  {
+    printf("%" PRIu64 "\n", offsets[idx]);
+  }
+  if (ok && print_stats)
+  {
+    fprintf(stderr,
+            "%" PRIu64 " blocks, %" PRIu64 " ruled out from their codes, %" PRIu64 " candidates, %" PRIu64
+            " codes walked, %" PRIu64 " bytes decoded to be searched\n",
+            stats.num_blocks, stats.num_skipped_blocks, stats.num_candidates, stats.num_walked_codes,
+            stats.num_plain_bytes);
+  }
+  free(offsets);
+
+  if (!ok)
+  {
+    return EXIT_ERROR;
+  }
+  return num_offsets > 0 ? EXIT_MATCH : EXIT_NO_MATCH;
+}
@@ -0,0 +1,147 @@
+#include "huffman.h"
+#include "container.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/*
+ * Answers byte counts and entropy for a range of blocks of a container
+ * written with compress -s, from the block summaries alone (see
+ * read_block_summaries(...)): no block is decoded.
+ */
+
+static void _print_usage(const char *program)
+{
+  printf("Usage: %s [-r <first_block>[:<num_blocks>]] [-c <byte>] <container_file>\n", program);
+  printf("Prints the byte counts and entropy of a container written with compress -s.\n");
+  printf("  -r           only the given blocks (default all of them)\n");
+  printf("  -c           print only the count of <byte>, 0 to 255\n");
+}
+
+// Parse "first" or "first:count"; a missing count means up to the last block
+static bool _parse_range(const char *arg, size_t *a_first, size_t *a_count)
+{
+  char *end = NULL;
+  *a_first = strtoul(arg, &end, 10);
+  *a_count = SIZE_MAX;
+  if (end == arg)
+  {
+    return false;
+  }
+  if (*end == ':')
+  {
+    const char *count = end + 1;
+    *a_count = strtoul(count, &end, 10);
+    if (end == count)
+    {
+      return false;
+    }
+  }
+  return *end == '\0';
+}
+
+static bool _is_block_container(FILE *container)
+{
+  uint8_t header[CONTAINER_HEADER_BYTES];
+  if (fread(header, 1, sizeof(header), container) != sizeof(header))
+  {
+    return false;
+  }
+  BitReader reader = open_memory_bit_reader(header, sizeof(header));
+  return read_uint32(&reader) == CONTAINER_MAGIC && read_bits(&reader, 8) == CONTAINER_BLOCKS;
+}
+
+int main(int argc, char *argv[])
+{
+  size_t first_block = 0;
+  size_t num_blocks = SIZE_MAX;
+  int byte = -1;
+  int opt;
+  while ((opt = getopt(argc, argv, "r:c:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'r':
+      if (!_parse_range(optarg, &first_block, &num_blocks))
+      {
+        _print_usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'c':
+      byte = atoi(optarg);
+      if (byte < 0 || byte > 255)
+      {
+        _print_usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+    default:
+      _print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (optind != argc - 1)
+  {
+    _print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const char *path = argv[optind];
+  FILE *container = fopen(path, "rb");
+  if (container == NULL)
+  {
+    fprintf(stderr, "Error: %s: %s\n", path, strerror(errno));
+    return EXIT_FAILURE;
+  }
+  BlockSummary *summaries = NULL;
+  size_t num_summaries = 0;
+  const char *error = "not a block container";
+  bool ok = _is_block_container(container) && read_block_summaries(container, &summaries, &num_summaries, &error);
+  fclose(container);
+  if (!ok)
+  {
+    fprintf(stderr, "Error: %s: %s\n", path, error);
+    return EXIT_FAILURE;
+  }
+  if (first_block > num_summaries || (first_block == num_summaries && num_summaries > 0))
+  {
+    fprintf(stderr, "Error: %s: has %zu blocks\n", path, num_summaries);
+    free(summaries);
+    return EXIT_FAILURE;
+  }
+  num_blocks = num_blocks < num_summaries - first_block ? num_blocks : num_summaries - first_block;
+
+  Frequencies freq = {0};
+  add_block_summaries(summaries, first_block, num_blocks, freq);
+  uint64_t num_bytes = 0;
+  uint64_t num_non_ascii = 0;
+  for (int ch = 0; ch < 256; ch++)
+  {
+    num_bytes += freq[ch];
+    num_non_ascii += ch >= 0x80 ? freq[ch] : 0;
+  }
+
+  if (byte >= 0)
+  {
+    printf("%" PRIu64 "\n", freq[byte]);
+  }
+  else
+  {
+    uint64_t offset = num_blocks > 0 ? summaries[first_block].offset : 0;
+    printf("%zu of %zu blocks from block %zu, at offsets %" PRIu64 " to %" PRIu64 "\n", num_blocks, num_summaries,
+           first_block, offset, offset + num_bytes);
+    printf("%" PRIu64 " bytes, %" PRIu64 " non-ASCII, %.4f bits of entropy per byte\n", num_bytes, num_non_ascii,
+           num_bytes > 0 ? entropy_bits(freq) / num_bytes : 0.0);
+    for (int ch = 0; ch < 256; ch++)
+    {
+      if (freq[ch] > 0)
+      {
+        printf("%3d %" PRIu64 "\n", ch, freq[ch]);
+      }
+    }
+  }
+  free(summaries);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,67 @@
+#include "huff.h"
+#include "bit_tools.h"
+#include "container.h"
+
+#include <stdlib.h>
+
+size_t huff_compress_bound(size_t num_bytes)
+{
+  // Blocks are whole segments, but for the last, and none grows past its stored size
+  size_t max_blocks = num_bytes / default_block_options().segment_size + 1;
+  return CONTAINER_HEADER_BYTES + num_bytes + max_blocks * (BLOCK_HEADER_BITS / 8) + 1; // and BLOCK_END
+}
+
+size_t huff_compressed_size(const uint8_t *src, size_t num_bytes)
+{
+  BlockOptions options = default_block_options();
+  return CONTAINER_HEADER_BYTES + compressed_blocks_size(src, num_bytes, &options);
+}
+
+size_t huff_compress(const uint8_t *src, size_t num_bytes, uint8_t *dst, size_t capacity)
+{
+  BitWriter writer = open_fixed_bit_writer(dst, capacity);
+  BlockOptions options = default_block_options();
+  write_container_header(&writer, CONTAINER_BLOCKS);
+  compress_blocks(&writer, src, num_bytes, &options);
+  align_bit_writer(&writer);
+  return writer.overflowed ? HUFF_ERROR : writer.num_bytes;
+}
+
+size_t huff_decompress(const uint8_t *src, size_t num_bytes, uint8_t *dst, size_t capacity)
+{
+  BitReader reader = open_memory_bit_reader(src, num_bytes);
+  BitWriter writer = open_fixed_bit_writer(dst, capacity);
+  if (read_uint32(&reader) != CONTAINER_MAGIC)
+  {
+    return HUFF_ERROR;
+  }
+  const char *error = NULL;
+  if (!decode_container(&reader, &writer, &error))
+  {
+    return HUFF_ERROR;
+  }
+  return writer.num_bytes;
+}
+
+size_t huff_read_range(FILE *container, uint64_t offset, size_t num_bytes, uint8_t *dst)
+{
+  uint8_t header[CONTAINER_HEADER_BYTES];
+  if (fseek(container, 0, SEEK_SET) != 0 || fread(header, 1, sizeof(header), container) != sizeof(header))
+  {
+    return HUFF_ERROR;
+  }
+  BitReader reader = open_memory_bit_reader(header, sizeof(header));
+  if (read_uint32(&reader) != CONTAINER_MAGIC || read_bits(&reader, 8) != CONTAINER_BLOCKS)
+  {
+    return HUFF_ERROR;
+  }
+
+  Checkpoint *checkpoints = NULL;
+  size_t num_checkpoints = 0;
+  size_t num_read = 0;
+  const char *error = NULL;
+  bool ok = read_checkpoints(container, &checkpoints, &num_checkpoints, &error) &&
+            read_container_range(container, checkpoints, num_checkpoints, offset, num_bytes, dst, &num_read, &error);
+  free(checkpoints);
+  return ok ? num_read : HUFF_ERROR;
+}
@@ -0,0 +1,83 @@
+#ifndef HUFF_H
+#define HUFF_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Buffer-to-buffer compression, for embedding the codec without files. The
+ * output is a container (see container.h) coded like `compress -b`, so it
+ * can also be written to disk and read back with `decompress`. Neither call
+ * opens a file or makes a system call beyond what malloc needs.
+ */
+
+/**
+ * Returned by huff_compress(...) and huff_decompress(...) when `dst` is too
+ * small or the input is malformed.
+ */
+#define HUFF_ERROR SIZE_MAX
+
+/**
+ * @brief The most bytes huff_compress(...) can write for `num_bytes` bytes of
+ * input: every block stored as is, with its header, plus the container's.
+ *
+ * @param num_bytes the input length
+ * @return size_t
+ */
+size_t huff_compress_bound(size_t num_bytes);
+
+/**
+ * @brief The exact number of bytes huff_compress(...) will write for
+ * `num_bytes` bytes at `src`, found without encoding them (see
+ * compressed_blocks_size(...)). Use it to allocate the output in one piece,
+ * or to skip compressing input that would not shrink. two_file_sizes(...)
+ * gives the sizes of the two files `compress` writes without options.
+ *
+ * @param src the bytes to compress
+ * @param num_bytes the number of bytes at src
+ * @return size_t
+ */
+size_t huff_compressed_size(const uint8_t *src, size_t num_bytes);
+
+/**
+ * @brief Compress `num_bytes` bytes at `src` into `dst`.
+ *
+ * @param src the bytes to compress
+ * @param num_bytes the number of bytes at src
+ * @param dst where to write the container
+ * @param capacity the size of dst; huff_compressed_size(...) or
+ * huff_compress_bound(num_bytes) bytes always fit
+ * @return size_t the number of bytes written, or HUFF_ERROR if dst is too small
+ */
+size_t huff_compress(const uint8_t *src, size_t num_bytes, uint8_t *dst, size_t capacity);
+
+/**
+ * @brief Decompress a container written by huff_compress(...) or by
+ * `compress -a/-b/-z/-j/-t/-e`. The original two-file format is not accepted.
+ *
+ * @param src the container
+ * @param num_bytes the number of bytes at src
+ * @param dst where to write the uncompressed bytes
+ * @param capacity the size of dst
+ * @return size_t the number of bytes written, or HUFF_ERROR if the container
+ * is malformed or does not fit in dst
+ */
+size_t huff_decompress(const uint8_t *src, size_t num_bytes, uint8_t *dst, size_t capacity);
+
+/**
+ * @brief Read `num_bytes` uncompressed bytes from offset `offset` of a block
+ * container file, decoding only from the nearest checkpoint before them.
+ * Containers written with an index (`compress -i`) have checkpoints inside
+ * blocks; others are read from the start of the block holding `offset`.
+ *
+ * @param container the container file, opened for reading
+ * @param offset the uncompressed offset of the first byte to read
+ * @param num_bytes the number of bytes to read
+ * @param dst where to write them
+ * @return size_t the number of bytes read, fewer than num_bytes if the range
+ * runs past the end, or HUFF_ERROR if the file is not a well-formed block container
+ */
+size_t huff_read_range(FILE *container, uint64_t offset, size_t num_bytes, uint8_t *dst);
+
+#endif // HUFF_H
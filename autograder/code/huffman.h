@@ -85,4 +85,225 @@ void write_coding_table(TreeNode *root, BitWriter *a_writer);
  */
 void write_compressed(BitWriter *a_writer, uint8_t *uncompressed_bytes, TreeNode *root);
 
+/**
+ * @brief Rebuild a Huffman tree from a coding table written by
+ * write_coding_table(...). The table ends at the first internal-node bit that
+ * is read while only the root is left on the stack.
+ *
+ * @param a_reader a pointer to the BitReader positioned at the coding table
+ *
+ * @return TreeNode* the root of the rebuilt tree, or NULL for an empty table
+ */
+TreeNode *read_coding_table(BitReader *a_reader);
+
+/**
+ * @brief Decode `num_uncompressed_bytes` characters written by
+ * write_compressed(...) and write them to `uncompressed`.
+ *
+ * @param a_reader a pointer to the BitReader positioned at the compressed bits
+ * @param uncompressed the stream to write the decoded bytes to
+ * @param root the root of the Huffman tree used for compression
+ * @param num_uncompressed_bytes the number of characters to decode
+ */
+void read_compressed(BitReader *a_reader, FILE *uncompressed, TreeNode *root, uint32_t num_uncompressed_bytes);
+
+/**
+ * The code for one character: the low `length` bits of `bits`, most
+ * significant bit first.
+ */
+typedef struct _HuffCode
+{
+  uint64_t bits;
+  uint8_t length;
+} HuffCode;
+
+/**
+ * A lookup table from each character to its code in a Huffman tree, so that
+ * encoding does not walk the tree. Characters not in the tree have length 0.
+ */
+typedef struct _HuffEncoder
+{
+  HuffCode codes[256];
+} HuffEncoder;
+
+/**
+ * @brief Fill `a_encoder` with the codes of the tree at `root`. A tree that
+ * is a single leaf gives that character a code of length 0.
+ *
+ * @param a_encoder the encoder to fill
+ * @param root the root of the Huffman tree, or NULL for an empty tree
+ */
+void build_huff_encoder(HuffEncoder *a_encoder, TreeNode *root);
+
+/**
+ * @brief Write the codes for `num_bytes` bytes. Unlike write_compressed(...),
+ * the input may contain '\0' bytes.
+ *
+ * @param a_writer the BitWriter to write the codes to
+ * @param a_encoder the codes to use; every byte must have one
+ * @param bytes the bytes to encode
+ * @param num_bytes the number of bytes to encode
+ */
+void write_symbols(BitWriter *a_writer, const HuffEncoder *a_encoder, const uint8_t *bytes, size_t num_bytes);
+
+// Codes up to this long are decoded with a single table lookup
+#define HUFF_LOOKUP_BITS 10
+
+/**
+ * What the next HUFF_LOOKUP_BITS bits of the input lead to: the node reached
+ * by following them from the root until a leaf, and how many were used. If
+ * the node is not a leaf, the code is longer and decoding continues from it.
+ */
+typedef struct _HuffLookupEntry
+{
+  TreeNode *node;
+  uint8_t length;
+} HuffLookupEntry;
+
+/**
+ * A table-driven decoder for one Huffman tree, the counterpart of
+ * HuffEncoder. It refers to the tree, which must outlive it.
+ */
+typedef struct _HuffDecoder
+{
+  HuffLookupEntry lookup[1 << HUFF_LOOKUP_BITS];
+} HuffDecoder;
+
+/**
+ * @brief Fill the lookup table of `a_decoder` from the tree at `root`.
+ *
+ * @param a_decoder the decoder to fill
+ * @param root the root of a non-empty Huffman tree
+ */
+void build_huff_decoder(HuffDecoder *a_decoder, TreeNode *root);
+
+/**
+ * @brief Decode one character with `a_decoder`.
+ *
+ * @param a_decoder the decoder for the tree the character was coded with
+ * @param a_reader a memory BitReader (see peek_bits(...)) at the code
+ * @return uint8_t
+ */
+uint8_t decode_symbol(const HuffDecoder *a_decoder, BitReader *a_reader);
+
+/**
+ * @brief Decode `num_bytes` bytes written by write_symbols(...). Memory
+ * readers decode long inputs through a HuffDecoder.
+ *
+ * @param a_reader the BitReader positioned at the first code
+ * @param root the root of the Huffman tree used for encoding
+ * @param bytes where to store the decoded bytes
+ * @param num_bytes the number of bytes to decode
+ */
+void read_symbols(BitReader *a_reader, TreeNode *root, uint8_t *bytes, size_t num_bytes);
+
+/**
+ * @brief Add the byte counts of `num_bytes` bytes to `freqs`.
+ *
+ * @param freqs the histogram to add to
+ * @param bytes the bytes to count
+ * @param num_bytes the number of bytes to count
+ */
+void add_frequencies(Frequencies freqs, const uint8_t *bytes, size_t num_bytes);
+
+/**
+ * @brief The Shannon entropy of the histogram in bits, i.e. the sum over
+ * characters of freq * log2(total / freq). No prefix code can do better, and
+ * a Huffman code is within one bit per character of it.
+ *
+ * @param freqs the histogram
+ * @return double
+ */
+double entropy_bits(const Frequencies freqs);
+
+/**
+ * @brief The number of bits the codes of `a_encoder` take for the characters
+ * counted in `freqs`, i.e. the sum over characters of freq * code length.
+ * With coding_table_bits(...), this is the exact size of a Huffman coding
+ * before any of it is written.
+ *
+ * @param freqs the histogram
+ * @param a_encoder the codes
+ * @return uint64_t
+ */
+uint64_t coded_bits(const Frequencies freqs, const HuffEncoder *a_encoder);
+
+/**
+ * @brief The number of bits write_coding_table(...) writes for a tree built
+ * from `freqs`, plus the terminating internal-node bit that
+ * read_coding_table(...) consumes.
+ *
+ * @param freqs the histogram
+ * @return uint64_t
+ */
+uint64_t coding_table_bits(const Frequencies freqs);
+
+/**
+ * @brief The exact sizes of the two files `compress` writes without options,
+ * found without encoding: compressed.bits is the byte count as a uint32, then
+ * the codes of the bytes before the first NUL byte (see write_compressed(...)),
+ * and coding_table.bits the table of a tree built from all of them. Both end
+ * with close_bit_writer(...), which writes the byte in progress even if empty.
+ *
+ * @param bytes the bytes of the file
+ * @param num_bytes the number of bytes at bytes
+ * @param a_compressed_size where to store the size of compressed.bits
+ * @param a_table_size where to store the size of coding_table.bits
+ */
+void two_file_sizes(const uint8_t *bytes, size_t num_bytes, uint64_t *a_compressed_size, uint64_t *a_table_size);
+
+/**
+ * @brief Write a self-contained Huffman coding of `num_bytes` bytes: the
+ * coding table of a tree built from their histogram, one 0 bit that ends the
+ * table, then the codes. Used for each stream inside a container block.
+ *
+ * @param a_writer the BitWriter to write to
+ * @param bytes the bytes to encode
+ * @param num_bytes the number of bytes to encode
+ */
+void write_huffman_section(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes);
+
+/**
+ * @brief Decode `num_bytes` bytes written by write_huffman_section(...).
+ *
+ * @param a_reader the BitReader positioned at the coding table
+ * @param bytes where to store the decoded bytes
+ * @param num_bytes the number of bytes to decode
+ * @return bool false if the table is empty but bytes were expected
+ */
+bool read_huffman_section(BitReader *a_reader, uint8_t *bytes, size_t num_bytes);
+
+/*
+ * Lengths, distances and other unbounded integers are sent DEFLATE-style: a
+ * small value code, which is Huffman coded like a byte, followed by raw extra
+ * bits. Values below 16 are their own code with no extra bits; a larger value
+ * v has code 12 + floor(log2 v) and floor(log2 v) extra bits holding
+ * v - 2^floor(log2 v).
+ */
+#define NUM_VALUE_CODES 44
+
+/**
+ * @brief The value code for `value` (see above).
+ *
+ * @param value any uint32_t
+ * @return uint8_t a code below NUM_VALUE_CODES
+ */
+uint8_t value_code(uint32_t value);
+
+/**
+ * @brief The number of extra bits that follow `code`.
+ *
+ * @param code a value code
+ * @return uint8_t
+ */
+uint8_t value_code_extra_bits(uint8_t code);
+
+/**
+ * @brief The smallest value with value code `code`.
+ *
+ * @param code a value code
+ * @return uint32_t
+ */
+uint32_t value_code_base(uint8_t code);
+
 #endif // HUFFMAN_H
\ No newline at end of file
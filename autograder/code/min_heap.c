@@ -0,0 +1,71 @@
+#include "min_heap.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+MinHeap create_min_heap(size_t capacity)
+{
+  capacity = capacity > 0 ? capacity : 16;
+  return (MinHeap){.entries = malloc(capacity * sizeof(HeapEntry)), .size = 0, .capacity = capacity};
+}
+
+static bool _before(HeapEntry a, HeapEntry b)
+{
+  return a.key < b.key || (a.key == b.key && a.value < b.value);
+}
+
+void heap_push(MinHeap *a_heap, uint64_t key, uint32_t value)
+{
+  if (a_heap->size == a_heap->capacity)
+  {
+    a_heap->capacity *= 2;
+    a_heap->entries = realloc(a_heap->entries, a_heap->capacity * sizeof(HeapEntry));
+  }
+
+  // Sift the new entry up from the first free slot
+  HeapEntry entry = {.key = key, .value = value};
+  size_t idx = a_heap->size++;
+  while (idx > 0 && _before(entry, a_heap->entries[(idx - 1) / 2]))
+  {
+    a_heap->entries[idx] = a_heap->entries[(idx - 1) / 2];
+    idx = (idx - 1) / 2;
+  }
+  a_heap->entries[idx] = entry;
+}
+
+HeapEntry heap_pop(MinHeap *a_heap)
+{
+  assert(a_heap->size > 0);
+
+  HeapEntry top = a_heap->entries[0];
+  HeapEntry last = a_heap->entries[--a_heap->size];
+
+  // Sift the last entry down from the root
+  size_t idx = 0;
+  for (;;)
+  {
+    size_t child = 2 * idx + 1;
+    if (child >= a_heap->size)
+    {
+      break;
+    }
+    if (child + 1 < a_heap->size && _before(a_heap->entries[child + 1], a_heap->entries[child]))
+    {
+      child++;
+    }
+    if (!_before(a_heap->entries[child], last))
+    {
+      break;
+    }
+    a_heap->entries[idx] = a_heap->entries[child];
+    idx = child;
+  }
+  a_heap->entries[idx] = last;
+  return top;
+}
+
+void destroy_min_heap(MinHeap *a_heap)
+{
+  free(a_heap->entries);
+  *a_heap = (MinHeap){.entries = NULL, .size = 0, .capacity = 0};
+}
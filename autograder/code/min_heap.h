@@ -0,0 +1,65 @@
+#ifndef MIN_HEAP_H
+#define MIN_HEAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * An item in a MinHeap: a priority and the value it belongs to, such as a
+ * symbol or a tree node index.
+ */
+typedef struct _HeapEntry
+{
+  uint64_t key;
+  uint32_t value;
+} HeapEntry;
+
+/**
+ * A binary min-heap stored in an array. Unlike the sorted list in
+ * priority_queue.h, pushing and popping take O(log n), so it serves
+ * alphabets of millions of symbols. Entries with equal keys come out in
+ * order of their values, so results do not depend on the order of pushes.
+ */
+typedef struct _MinHeap
+{
+  HeapEntry *entries;
+  size_t size;
+  size_t capacity;
+} MinHeap;
+
+/**
+ * @brief Create an empty heap with room for `capacity` entries. It grows as
+ * needed.
+ *
+ * @param capacity the expected number of entries
+ * @return MinHeap
+ */
+MinHeap create_min_heap(size_t capacity);
+
+/**
+ * @brief Add an entry.
+ *
+ * @param a_heap the heap to add to
+ * @param key the priority; smaller keys are popped first
+ * @param value the value stored with the key
+ */
+void heap_push(MinHeap *a_heap, uint64_t key, uint32_t value);
+
+/**
+ * @brief Remove and return the entry with the smallest key. The heap must
+ * not be empty.
+ *
+ * @param a_heap the heap to pop from
+ * @return HeapEntry
+ */
+HeapEntry heap_pop(MinHeap *a_heap);
+
+/**
+ * @brief Free the entries of a heap created by create_min_heap(...).
+ *
+ * @param a_heap the heap to destroy
+ */
+void destroy_min_heap(MinHeap *a_heap);
+
+#endif // MIN_HEAP_H
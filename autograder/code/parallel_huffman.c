@@ -0,0 +1,369 @@
+#include "parallel_huffman.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Below this many bytes per chunk, starting a thread costs more than it saves
+#define MIN_CHUNK_BYTES (64u << 10)
+
+// Compressed bytes per thread that are decoded, and their bytes written, before more are read
+#define ROUND_CHUNK_BYTES (1u << 20)
+
+// The longest code a tree of 256 leaves can have
+#define MAX_CODE_BITS 255
+
+// A decoding thread remembers where this many of its first codes start, to find where it fell into step
+#define SYNC_SYMBOLS 4096
+
+typedef struct _EncodeChunk
+{
+  const HuffEncoder *encoder;
+  const uint8_t *bytes;
+  size_t num_bytes;
+  uint64_t num_bits;
+  uint64_t bit_offset; // Where the chunk starts in the stream
+  uint8_t *encoded;    // The chunk's codes, after bit_offset % 8 zero bits
+  size_t num_encoded_bytes;
+} EncodeChunk;
+
+static long _num_workers(int num_threads, size_t num_bytes, size_t min_chunk_bytes)
+{
+  long num_workers = num_threads > 0 ? num_threads : sysconf(_SC_NPROCESSORS_ONLN);
+  long max_workers = (long)(num_bytes / min_chunk_bytes);
+  num_workers = num_workers > max_workers ? max_workers : num_workers;
+  return num_workers < 1 ? 1 : num_workers;
+}
+
+/*
+ * Run `work` on `num_chunks` chunks of `chunk_size` bytes each, the first on
+ * this thread; a chunk whose thread fails to start runs here too.
+ */
+static void _run_chunks(void *chunks, size_t chunk_size, long num_chunks, void *(*work)(void *))
+{
+  pthread_t *threads = malloc(num_chunks * sizeof(pthread_t));
+  bool *started = malloc(num_chunks * sizeof(bool));
+  for (long idx = 1; idx < num_chunks; idx++)
+  {
+    started[idx] = pthread_create(&threads[idx], NULL, work, (uint8_t *)chunks + idx * chunk_size) == 0;
+  }
+  work(chunks);
+  for (long idx = 1; idx < num_chunks; idx++)
+  {
+    if (started[idx])
+    {
+      pthread_join(threads[idx], NULL);
+    }
+    else
+    {
+      work((uint8_t *)chunks + idx * chunk_size);
+    }
+  }
+  free(started);
+  free(threads);
+}
+
+static void *_count_chunk_bits(void *a_chunk)
+{
+  EncodeChunk *chunk = a_chunk;
+  Frequencies freq = {0};
+  add_frequencies(freq, chunk->bytes, chunk->num_bytes);
+  chunk->num_bits = coded_bits(freq, chunk->encoder);
+  return NULL;
+}
+
+static void *_encode_chunk(void *a_chunk)
+{
+  EncodeChunk *chunk = a_chunk;
+  int phase = chunk->bit_offset % 8;
+  chunk->num_encoded_bytes = (phase + chunk->num_bits + 7) / 8;
+  chunk->encoded = malloc(chunk->num_encoded_bytes + 1);
+
+  // The low `num_pending` bits of `pending` are not yet written; codes over 32 bits go in two parts
+  uint64_t pending = 0;
+  int num_pending = phase;
+  size_t pos = 0;
+  for (size_t idx = 0; idx < chunk->num_bytes; idx++)
+  {
+    const HuffCode *code = &chunk->encoder->codes[chunk->bytes[idx]];
+    uint8_t length = code->length;
+    if (length > 32)
+    {
+      pending = (pending << (length - 32)) | (code->bits >> 32);
+      num_pending += length - 32;
+      length = 32;
+    }
+    pending = (pending << length) | (code->bits & UINT32_MAX);
+    num_pending += length;
+    while (num_pending >= 8)
+    {
+      num_pending -= 8;
+      chunk->encoded[pos++] = (uint8_t)(pending >> num_pending);
+    }
+  }
+  if (num_pending > 0)
+  {
+    chunk->encoded[pos++] = (uint8_t)(pending << (8 - num_pending));
+  }
+  return NULL;
+}
+
+void write_compressed_parallel(BitWriter *a_writer, uint8_t *uncompressed_bytes, TreeNode *root, int num_threads)
+{
+  if (root == NULL)
+  {
+    return;
+  }
+
+  HuffEncoder encoder;
+  build_huff_encoder(&encoder, root);
+  size_t num_bytes = strlen((const char *)uncompressed_bytes);
+  long num_chunks = _num_workers(num_threads, num_bytes, MIN_CHUNK_BYTES);
+  EncodeChunk *chunks = malloc(num_chunks * sizeof(EncodeChunk));
+  for (long idx = 0; idx < num_chunks; idx++)
+  {
+    size_t start = num_bytes * idx / num_chunks;
+    size_t end = num_bytes * (idx + 1) / num_chunks;
+    chunks[idx] = (EncodeChunk){.encoder = &encoder, .bytes = uncompressed_bytes + start, .num_bytes = end - start};
+  }
+  _run_chunks(chunks, sizeof(EncodeChunk), num_chunks, _count_chunk_bits);
+
+  // The writer's pending bits come first
+  uint64_t bit_offset = 8 - a_writer->num_bits_left;
+  for (long idx = 0; idx < num_chunks; idx++)
+  {
+    chunks[idx].bit_offset = bit_offset;
+    bit_offset += chunks[idx].num_bits;
+  }
+  _run_chunks(chunks, sizeof(EncodeChunk), num_chunks, _encode_chunk);
+
+  // Each chunk starts in the byte where the last one ended, with zeros where the last one's bits are
+  uint8_t *stream = calloc(bit_offset / 8 + 1, 1);
+  stream[0] = a_writer->current_byte;
+  for (long idx = 0; idx < num_chunks; idx++)
+  {
+    size_t first_byte = chunks[idx].bit_offset / 8;
+    if (chunks[idx].num_encoded_bytes > 0)
+    {
+      stream[first_byte] |= chunks[idx].encoded[0];
+      memcpy(stream + first_byte + 1, chunks[idx].encoded + 1, chunks[idx].num_encoded_bytes - 1);
+    }
+    free(chunks[idx].encoded);
+  }
+  free(chunks);
+
+  a_writer->current_byte = 0;
+  a_writer->num_bits_left = 8;
+  write_bytes(a_writer, stream, bit_offset / 8);
+  if (bit_offset % 8 > 0)
+  {
+    write_bits(a_writer, stream[bit_offset / 8] >> (8 - bit_offset % 8), bit_offset % 8);
+  }
+  free(stream);
+}
+
+typedef struct _DecodeChunk
+{
+  const HuffDecoder *decoder;
+  const uint8_t *bytes;
+  size_t num_bytes;
+  uint64_t start; // The bit to start decoding at
+  uint64_t stop;  // Codes starting before this bit belong to the chunk
+  uint64_t end;   // Where the last code ended
+  uint8_t *symbols;
+  size_t num_symbols;
+  size_t capacity;
+  uint64_t sync_positions[SYNC_SYMBOLS]; // Where the first codes started
+  size_t num_sync_positions;
+} DecodeChunk;
+
+// The `num_bits` (at most 16) bits from bit `pos` on; bits past the end of the input read as 0
+static inline uint32_t _peek(const uint8_t *bytes, size_t num_bytes, uint64_t pos, int num_bits)
+{
+  size_t idx = pos / 8;
+  uint32_t window = 0;
+  for (int byte = 0; byte < 3; byte++)
+  {
+    window = (window << 8) | (idx + byte < num_bytes ? bytes[idx + byte] : 0);
+  }
+  return ((window << (pos % 8)) & 0xffffff) >> (24 - num_bits);
+}
+
+// Decode the code starting at bit `*a_pos`, the way read_compressed(...) walks the tree
+static inline uint8_t _decode_at(const HuffDecoder *a_decoder, const uint8_t *bytes, size_t num_bytes, uint64_t *a_pos)
+{
+  const HuffLookupEntry *entry = &a_decoder->lookup[_peek(bytes, num_bytes, *a_pos, HUFF_LOOKUP_BITS)];
+  *a_pos += entry->length;
+  const TreeNode *node = entry->node;
+  while (node->left != NULL && node->right != NULL)
+  {
+    node = _peek(bytes, num_bytes, (*a_pos)++, 1) ? node->right : node->left;
+  }
+  return node->character;
+}
+
+static void _append_symbol(DecodeChunk *a_chunk, uint8_t symbol)
+{
+  if (a_chunk->num_symbols == a_chunk->capacity)
+  {
+    a_chunk->capacity = a_chunk->capacity * 2 + 64;
+    a_chunk->symbols = realloc(a_chunk->symbols, a_chunk->capacity);
+  }
+  a_chunk->symbols[a_chunk->num_symbols++] = symbol;
+}
+
+// Decode from `pos` to the chunk's stop, after whatever the chunk holds
+static void _decode_until_stop(DecodeChunk *a_chunk, uint64_t pos, bool record_sync)
+{
+  while (pos < a_chunk->stop)
+  {
+    if (record_sync && a_chunk->num_sync_positions < SYNC_SYMBOLS)
+    {
+      a_chunk->sync_positions[a_chunk->num_sync_positions++] = pos;
+    }
+    _append_symbol(a_chunk, _decode_at(a_chunk->decoder, a_chunk->bytes, a_chunk->num_bytes, &pos));
+  }
+  a_chunk->end = pos;
+}
+
+static void *_decode_chunk(void *a_chunk)
+{
+  DecodeChunk *chunk = a_chunk;
+  chunk->capacity = (chunk->stop - chunk->start) / 4 + 64;
+  chunk->symbols = malloc(chunk->capacity);
+  _decode_until_stop(chunk, chunk->start, true);
+  return NULL;
+}
+
+/*
+ * Make `a_chunk` hold what decoding from the true code boundary `pos` gives:
+ * decode until reaching a code start the chunk's thread also found, and keep
+ * the thread's codes from there. Returns the index of the first of the
+ * thread's codes to keep, after the `a_prefix` codes decoded here.
+ */
+static size_t _resync_chunk(DecodeChunk *a_chunk, uint64_t pos, DecodeChunk *a_prefix)
+{
+  size_t sync_idx = 0;
+  while (pos < a_chunk->stop)
+  {
+    while (sync_idx < a_chunk->num_sync_positions && a_chunk->sync_positions[sync_idx] < pos)
+    {
+      sync_idx++;
+    }
+    if (sync_idx == a_chunk->num_sync_positions)
+    {
+      break; // Never in step within the positions recorded, so decode the rest here
+    }
+    if (a_chunk->sync_positions[sync_idx] == pos)
+    {
+      return sync_idx;
+    }
+    _append_symbol(a_prefix, _decode_at(a_chunk->decoder, a_chunk->bytes, a_chunk->num_bytes, &pos));
+  }
+  _decode_until_stop(a_prefix, pos, false);
+  a_chunk->end = a_prefix->end;
+  return a_chunk->num_symbols;
+}
+
+/*
+ * Decode the codes that start from the true code boundary `pos` up to `stop`
+ * on the chunks' threads, and write them, no more than `*a_num_left` of them.
+ * Returns where the last code ended, the true start of the codes after them.
+ */
+static uint64_t _decode_round(const HuffDecoder *a_decoder, const uint8_t *bytes, size_t num_bytes, uint64_t pos,
+                              uint64_t stop, int num_threads, FILE *uncompressed, uint64_t *a_num_left)
+{
+  if (pos >= stop)
+  {
+    return pos;
+  }
+  long num_chunks = _num_workers(num_threads, (stop - pos) / 8, MIN_CHUNK_BYTES);
+  DecodeChunk *chunks = malloc(num_chunks * sizeof(DecodeChunk));
+  for (long idx = 0; idx < num_chunks; idx++)
+  {
+    chunks[idx] = (DecodeChunk){.decoder = a_decoder,
+                                .bytes = bytes,
+                                .num_bytes = num_bytes,
+                                .start = pos + (stop - pos) * idx / num_chunks,
+                                .stop = pos + (stop - pos) * (idx + 1) / num_chunks,
+                                .num_sync_positions = 0};
+  }
+  _run_chunks(chunks, sizeof(DecodeChunk), num_chunks, _decode_chunk);
+
+  // The first chunk starts at a true boundary, and each chunk's true end is where the next one truly starts
+  for (long idx = 0; idx < num_chunks && *a_num_left > 0; idx++)
+  {
+    DecodeChunk *chunk = &chunks[idx];
+    DecodeChunk prefix = {.decoder = a_decoder, .bytes = bytes, .num_bytes = num_bytes, .stop = chunk->stop};
+    size_t first_symbol = idx == 0 ? 0 : _resync_chunk(chunk, pos, &prefix);
+    size_t num_prefix = prefix.num_symbols < *a_num_left ? prefix.num_symbols : *a_num_left;
+    if (num_prefix > 0)
+    {
+      fwrite(prefix.symbols, 1, num_prefix, uncompressed);
+      *a_num_left -= num_prefix;
+    }
+    size_t num_kept =
+        chunk->num_symbols - first_symbol < *a_num_left ? chunk->num_symbols - first_symbol : *a_num_left;
+    fwrite(chunk->symbols + first_symbol, 1, num_kept, uncompressed);
+    *a_num_left -= num_kept;
+    pos = chunk->end;
+    free(prefix.symbols);
+  }
+  for (long idx = 0; idx < num_chunks; idx++)
+  {
+    free(chunks[idx].symbols);
+  }
+  free(chunks);
+  return pos;
+}
+
+void read_compressed_parallel(BitReader *a_reader, FILE *uncompressed, TreeNode *root,
+                              uint32_t num_uncompressed_bytes, int num_threads)
+{
+  // A lone leaf has an empty code, which only the serial decoder handles
+  if (root == NULL || (root->left == NULL && root->right == NULL) || a_reader->current_bit >= 0)
+  {
+    read_compressed(a_reader, uncompressed, root, num_uncompressed_bytes);
+    return;
+  }
+
+  HuffDecoder *decoder = malloc(sizeof(HuffDecoder));
+  build_huff_decoder(decoder, root);
+  size_t window_size = (size_t)_num_workers(num_threads, SIZE_MAX, MIN_CHUNK_BYTES) * ROUND_CHUNK_BYTES;
+  uint8_t *window = malloc(window_size);
+  size_t num_window_bytes = 0;
+  uint64_t pos = 0;
+  uint64_t num_left = num_uncompressed_bytes;
+  bool at_end = false;
+  while (num_left > 0 && !at_end)
+  {
+    // Keep the bytes from the one the next code starts in, and fill the window after them
+    size_t num_kept = num_window_bytes - pos / 8;
+    memmove(window, window + pos / 8, num_kept);
+    pos %= 8;
+    num_window_bytes = num_kept + read_bytes(a_reader, window + num_kept, window_size - num_kept);
+    at_end = num_window_bytes < window_size;
+
+    // Before the end, a code that starts this far from the window's end may run past it, so it waits for the next round
+    uint64_t stop = at_end ? 8 * (uint64_t)num_window_bytes : 8 * (uint64_t)num_window_bytes - MAX_CODE_BITS;
+    pos = _decode_round(decoder, window, num_window_bytes, pos, stop, num_threads, uncompressed, &num_left);
+  }
+
+  // A count past the end of the codes decodes zero bits, as read_compressed(...) does
+  uint8_t tail[4096];
+  while (num_left > 0)
+  {
+    size_t num_tail = num_left < sizeof(tail) ? num_left : sizeof(tail);
+    for (size_t idx = 0; idx < num_tail; idx++)
+    {
+      tail[idx] = _decode_at(decoder, window, num_window_bytes, &pos);
+    }
+    fwrite(tail, 1, num_tail, uncompressed);
+    num_left -= num_tail;
+  }
+
+  free(decoder);
+  free(window);
+}
@@ -0,0 +1,242 @@
+#include "tans.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A decoder state: the symbol it stands for, and how to reach the next state
+typedef struct _TansEntry
+{
+  uint16_t base; // The next state, less L, before adding `num_bits` read bits
+  uint8_t symbol;
+  uint8_t num_bits;
+} TansEntry;
+
+static int _floor_log2(uint32_t value)
+{
+  int log = 0;
+  while (value >>= 1)
+  {
+    log++;
+  }
+  return log;
+}
+
+void tans_normalize(const Frequencies freq, int table_log, uint16_t normalized[256])
+{
+  uint64_t total = 0;
+  for (int ch = 0; ch < 256; ch++)
+  {
+    total += freq[ch];
+  }
+  if (total == 0)
+  {
+    memset(normalized, 0, 256 * sizeof(uint16_t));
+    return;
+  }
+  int64_t table_size = (int64_t)1 << table_log;
+  int64_t sum = 0;
+  for (int ch = 0; ch < 256; ch++)
+  {
+    uint64_t scaled = (uint64_t)((double)freq[ch] * table_size / total + 0.5);
+    normalized[ch] = freq[ch] == 0 ? 0 : scaled < 1 ? 1 : (uint16_t)scaled;
+    sum += normalized[ch];
+  }
+
+  // Giving a byte one more count saves freq * log2((n + 1) / n) bits; taking one away costs freq * log2(n / (n - 1))
+  while (sum != table_size)
+  {
+    int step = sum < table_size ? 1 : -1;
+    int best = -1;
+    double best_cost = INFINITY;
+    for (int ch = 0; ch < 256; ch++)
+    {
+      if (normalized[ch] == 0 || (step < 0 && normalized[ch] == 1))
+      {
+        continue;
+      }
+      double cost = step > 0 ? -(freq[ch] * log2((normalized[ch] + 1.0) / normalized[ch]))
+                             : freq[ch] * log2(normalized[ch] / (normalized[ch] - 1.0));
+      if (cost < best_cost)
+      {
+        best = ch;
+        best_cost = cost;
+      }
+    }
+    normalized[best] += step;
+    sum += step;
+  }
+}
+
+// Deal the L states out to the symbols, each symbol's states scattered over the table
+static void _spread_symbols(const uint16_t normalized[256], int table_log, uint8_t *spread)
+{
+  uint32_t mask = (1u << table_log) - 1;
+  uint32_t step = (mask >> 1) + (mask >> 3) + 3; // Odd, so every position is visited once
+  uint32_t pos = 0;
+  for (int ch = 0; ch < 256; ch++)
+  {
+    for (uint32_t idx = 0; idx < normalized[ch]; idx++)
+    {
+      spread[pos] = (uint8_t)ch;
+      pos = (pos + step) & mask;
+    }
+  }
+}
+
+static int _pick_table_log(size_t num_bytes)
+{
+  int table_log = TANS_DEFAULT_TABLE_LOG;
+  while (table_log > TANS_MIN_TABLE_LOG && ((size_t)1 << (table_log - 1)) >= num_bytes)
+  {
+    table_log--;
+  }
+  return table_log;
+}
+
+void tans_write_payload(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes, const Frequencies freq)
+{
+  int table_log = _pick_table_log(num_bytes);
+  uint32_t table_size = 1u << table_log;
+  uint16_t normalized[256];
+  tans_normalize(freq, table_log, normalized);
+
+  // The bytes that occur, each as its distance from the one before and its count less one
+  write_bits(a_writer, (uint8_t)table_log, 8);
+  uint32_t values[2 * 256];
+  uint8_t value_codes[2 * 256];
+  size_t num_values = 0;
+  int next_symbol = 0;
+  for (int ch = 0; ch < 256; ch++)
+  {
+    if (normalized[ch] > 0)
+    {
+      values[num_values++] = ch - next_symbol;
+      values[num_values++] = normalized[ch] - 1;
+      next_symbol = ch + 1;
+    }
+  }
+  for (size_t idx = 0; idx < num_values; idx++)
+  {
+    value_codes[idx] = value_code(values[idx]);
+  }
+  write_code(a_writer, num_values / 2, 9);
+  write_huffman_section(a_writer, value_codes, num_values);
+  for (size_t idx = 0; idx < num_values; idx++)
+  {
+    write_code(a_writer, values[idx] - value_code_base(value_codes[idx]), value_code_extra_bits(value_codes[idx]));
+  }
+
+  // Symbol s owns the states x in [n_s, 2 n_s), and next_state[start[s] + x - n_s] is where x leads
+  uint8_t *spread = malloc(table_size);
+  _spread_symbols(normalized, table_log, spread);
+  uint32_t start[256];
+  uint32_t max_bits[256]; // Bits to emit for a state at or above threshold[s]; one fewer below
+  uint32_t threshold[256];
+  uint32_t next_start = 0;
+  for (int ch = 0; ch < 256; ch++)
+  {
+    start[ch] = next_start;
+    next_start += normalized[ch];
+    max_bits[ch] = normalized[ch] > 0 ? table_log - _floor_log2(normalized[ch]) : 0;
+    threshold[ch] = (uint32_t)normalized[ch] << max_bits[ch];
+  }
+  uint16_t *next_state = malloc(table_size * sizeof(uint16_t));
+  uint32_t seen[256] = {0};
+  for (uint32_t pos = 0; pos < table_size; pos++)
+  {
+    next_state[start[spread[pos]] + seen[spread[pos]]++] = (uint16_t)(table_size + pos);
+  }
+
+  // Encode backwards, keeping each symbol's bits so that they can be written in decoding order
+  uint16_t *chunk_bits = malloc((num_bytes + 1) * sizeof(uint16_t));
+  uint8_t *chunk_lengths = malloc(num_bytes + 1);
+  uint32_t state = table_size;
+  for (size_t idx = num_bytes; idx-- > 0;)
+  {
+    uint8_t ch = bytes[idx];
+    uint32_t num_bits = max_bits[ch] - (state < threshold[ch]);
+    chunk_bits[idx] = (uint16_t)(state & ((1u << num_bits) - 1));
+    chunk_lengths[idx] = (uint8_t)num_bits;
+    state = next_state[start[ch] + (state >> num_bits) - normalized[ch]];
+  }
+  write_code(a_writer, state - table_size, (uint8_t)table_log);
+  for (size_t idx = 0; idx < num_bytes; idx++)
+  {
+    write_code(a_writer, chunk_bits[idx], chunk_lengths[idx]);
+  }
+
+  free(chunk_lengths);
+  free(chunk_bits);
+  free(next_state);
+  free(spread);
+}
+
+bool tans_read_payload(BitReader *a_reader, uint8_t *bytes, size_t num_bytes)
+{
+  int table_log = read_bits(a_reader, 8);
+  size_t num_values = 2 * read_code(a_reader, 9);
+  uint8_t value_codes[2 * 256];
+  if (table_log < TANS_MIN_TABLE_LOG || table_log > TANS_MAX_TABLE_LOG || num_values > 2 * 256 ||
+      !read_huffman_section(a_reader, value_codes, num_values))
+  {
+    return false;
+  }
+  uint32_t table_size = 1u << table_log;
+  uint16_t normalized[256] = {0};
+  uint64_t sum = 0;
+  uint64_t next_symbol = 0;
+  for (size_t idx = 0; idx < num_values; idx += 2)
+  {
+    if (value_codes[idx] >= NUM_VALUE_CODES || value_codes[idx + 1] >= NUM_VALUE_CODES)
+    {
+      return false;
+    }
+    uint64_t symbol =
+        next_symbol + value_code_base(value_codes[idx]) + read_code(a_reader, value_code_extra_bits(value_codes[idx]));
+    uint64_t count =
+        value_code_base(value_codes[idx + 1]) + read_code(a_reader, value_code_extra_bits(value_codes[idx + 1])) + 1;
+    if (symbol >= 256 || count > table_size)
+    {
+      return false;
+    }
+    normalized[symbol] = (uint16_t)count;
+    sum += count;
+    next_symbol = symbol + 1;
+  }
+  if (sum != table_size)
+  {
+    return sum == 0 && num_bytes == 0; // An empty input has no symbols to give the states to
+  }
+
+  // State x of symbol s is at the position where the encoder put it, and reads back to [L, 2L)
+  uint8_t *spread = malloc(table_size);
+  _spread_symbols(normalized, table_log, spread);
+  TansEntry *table = malloc(table_size * sizeof(TansEntry));
+  uint32_t next_x[256];
+  for (int ch = 0; ch < 256; ch++)
+  {
+    next_x[ch] = normalized[ch];
+  }
+  for (uint32_t pos = 0; pos < table_size; pos++)
+  {
+    uint8_t ch = spread[pos];
+    uint32_t x = next_x[ch]++;
+    int num_bits = table_log - _floor_log2(x);
+    table[pos] =
+        (TansEntry){.base = (uint16_t)((x << num_bits) - table_size), .symbol = ch, .num_bits = (uint8_t)num_bits};
+  }
+
+  uint32_t state = (uint32_t)read_code(a_reader, (uint8_t)table_log);
+  for (size_t idx = 0; idx < num_bytes; idx++)
+  {
+    const TansEntry *entry = &table[state];
+    bytes[idx] = entry->symbol;
+    state = entry->base + peek_bits(a_reader, entry->num_bits);
+    skip_bits(a_reader, entry->num_bits);
+  }
+
+  free(table);
+  free(spread);
+  return is_bit_reader_open(a_reader);
+}
@@ -0,0 +1,220 @@
+#include "canonical_huffman.h"
+#include "min_heap.h"
+#include "huffman.h"
+#include "cu_unit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Write `num_coded` symbols with the canonical code for `lengths` and decode them again
+static bool round_trip(const uint8_t *lengths, size_t num_symbols, const uint32_t *symbols, size_t num_coded)
+{
+  uint64_t *codes = malloc(num_symbols * sizeof(uint64_t));
+  canonical_codes(lengths, num_symbols, codes);
+  BitWriter writer = open_memory_bit_writer(num_coded);
+  for (size_t idx = 0; idx < num_coded; idx++)
+  {
+    write_code(&writer, codes[symbols[idx]], lengths[symbols[idx]]);
+  }
+  align_bit_writer(&writer);
+
+  CanonicalDecoder *decoder = malloc(sizeof(*decoder));
+  bool matches = build_canonical_decoder(decoder, lengths, num_symbols);
+  BitReader reader = open_memory_bit_reader(writer.buffer, writer.num_bytes);
+  for (size_t idx = 0; matches && idx < num_coded; idx++)
+  {
+    matches = canonical_decode(decoder, &reader) == symbols[idx];
+  }
+  destroy_canonical_decoder(decoder);
+  free(decoder);
+  free(writer.buffer);
+  free(codes);
+  return matches;
+}
+
+static int _test_min_heap_order()
+{
+  cu_start();
+  // -------------------------------
+  MinHeap heap = create_min_heap(1);
+  uint32_t state = 3;
+  for (uint32_t value = 0; value < 1000; value++)
+  {
+    state = state * 1103515245 + 12345;
+    heap_push(&heap, (state >> 16) % 50, value);
+  }
+  HeapEntry prev = heap_pop(&heap);
+  bool ordered = true;
+  while (heap.size > 0)
+  {
+    HeapEntry next = heap_pop(&heap);
+    ordered = ordered && (prev.key < next.key || (prev.key == next.key && prev.value < next.value));
+    prev = next;
+  }
+  cu_check(ordered);
+  destroy_min_heap(&heap);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_code_lengths_small()
+{
+  cu_start();
+  // -------------------------------
+  uint64_t counts[] = {5, 0, 1, 1, 2};
+  uint8_t lengths[5];
+  huffman_code_lengths(counts, 5, lengths);
+  cu_check(lengths[0] == 1);
+  cu_check(lengths[1] == 0);
+  cu_check(lengths[2] == 3 && lengths[3] == 3);
+  cu_check(lengths[4] == 2);
+
+  uint64_t lone[] = {0, 7};
+  huffman_code_lengths(lone, 2, lengths);
+  cu_check(lengths[0] == 0 && lengths[1] == 1);
+  uint32_t symbols[] = {1, 1, 1};
+  cu_check(round_trip(lengths, 2, symbols, 3));
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_large_alphabet()
+{
+  cu_start();
+  // -------------------------------
+  // A Zipf-like word distribution over a million symbols
+  size_t num_symbols = 1 << 20;
+  uint64_t *counts = malloc(num_symbols * sizeof(uint64_t));
+  for (size_t symbol = 0; symbol < num_symbols; symbol++)
+  {
+    counts[symbol] = (1 << 22) / (symbol + 1);
+  }
+  uint8_t *lengths = malloc(num_symbols);
+  huffman_code_lengths(counts, num_symbols, lengths);
+
+  uint32_t *symbols = malloc(num_symbols * sizeof(uint32_t));
+  for (size_t idx = 0; idx < num_symbols; idx++)
+  {
+    symbols[idx] = (uint32_t)((idx * 2654435761u) % num_symbols);
+  }
+  cu_check(lengths[0] < lengths[num_symbols - 1]);
+  cu_check(round_trip(lengths, num_symbols, symbols, num_symbols));
+  free(symbols);
+  free(lengths);
+  free(counts);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_decoder_rejects_oversubscribed()
+{
+  cu_start();
+  // -------------------------------
+  uint8_t lengths[] = {1, 1, 2};
+  CanonicalDecoder *decoder = malloc(sizeof(*decoder));
+  cu_check(!build_canonical_decoder(decoder, lengths, 3));
+  destroy_canonical_decoder(decoder);
+  uint8_t too_long[] = {1, CANONICAL_MAX_CODE_LENGTH + 1};
+  cu_check(!build_canonical_decoder(decoder, too_long, 2));
+  destroy_canonical_decoder(decoder);
+  free(decoder);
+  // -------------------------------
+  cu_end();
+}
+
+// Write `symbols` as a 16-bit section and check they decode unchanged
+static bool section_round_trip(const uint16_t *symbols, size_t num_symbols)
+{
+  BitWriter writer = open_memory_bit_writer(num_symbols);
+  write_canonical_section(&writer, symbols, num_symbols);
+  align_bit_writer(&writer);
+
+  uint16_t *decoded = malloc((num_symbols + 1) * sizeof(uint16_t));
+  BitReader reader = open_memory_bit_reader(writer.buffer, writer.num_bytes);
+  bool matches = read_canonical_section(&reader, decoded, num_symbols);
+  for (size_t idx = 0; matches && idx < num_symbols; idx++)
+  {
+    matches = decoded[idx] == symbols[idx];
+  }
+  free(decoded);
+  free(writer.buffer);
+  return matches;
+}
+
+static int _test_16_bit_sections()
+{
+  cu_start();
+  // -------------------------------
+  // Audio-like samples: small differences around the middle of the range
+  size_t num_samples = 1 << 18;
+  uint16_t *samples = malloc(num_samples * sizeof(uint16_t));
+  uint32_t state = 7;
+  for (size_t idx = 0; idx < num_samples; idx++)
+  {
+    state = state * 1103515245 + 12345;
+    int spread = 1 << ((state >> 16) % 12);
+    samples[idx] = (uint16_t)(32768 + (int)((state >> 8) % (2 * spread)) - spread);
+  }
+  cu_check(section_round_trip(samples, num_samples));
+
+  // Every symbol of the alphabet, and a sparse one
+  for (size_t idx = 0; idx < num_samples; idx++)
+  {
+    samples[idx] = (uint16_t)(idx * 40503);
+  }
+  cu_check(section_round_trip(samples, num_samples));
+  uint16_t sparse[] = {0, 65535, 0, 4097, 65535, 0};
+  cu_check(section_round_trip(sparse, 6));
+
+  uint16_t lone[] = {513, 513, 513};
+  cu_check(section_round_trip(lone, 3));
+  cu_check(section_round_trip(lone, 0));
+  free(samples);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_table_rejects_bad_symbols()
+{
+  cu_start();
+  // -------------------------------
+  uint8_t lengths[7] = {0, 0, 0, 0, 0, 1, 2};
+  BitWriter writer = open_memory_bit_writer(16);
+  write_canonical_table(&writer, lengths, 7);
+  align_bit_writer(&writer);
+  uint8_t decoded[7];
+  BitReader reader = open_memory_bit_reader(writer.buffer, writer.num_bytes);
+  cu_check(read_canonical_table(&reader, decoded, 7));
+  cu_check(memcmp(decoded, lengths, 7) == 0);
+  // Symbol 6 is outside a 6-symbol alphabet
+  reader = open_memory_bit_reader(writer.buffer, writer.num_bytes);
+  cu_check(!read_canonical_table(&reader, decoded, 6));
+  free(writer.buffer);
+
+  // Symbol 5 listed with both lengths
+  writer = open_memory_bit_writer(16);
+  write_bits(&writer, 2, 8);
+  write_uint32(&writer, 1);
+  write_uint32(&writer, 1);
+  uint8_t gap_codes[] = {5, 5};
+  write_huffman_section(&writer, gap_codes, 2);
+  align_bit_writer(&writer);
+  reader = open_memory_bit_reader(writer.buffer, writer.num_bytes);
+  cu_check(!read_canonical_table(&reader, decoded, 7));
+  free(writer.buffer);
+  // -------------------------------
+  cu_end();
+}
+
+int main()
+{
+  cu_start_tests();
+  cu_run(_test_min_heap_order);
+  cu_run(_test_code_lengths_small);
+  cu_run(_test_large_alphabet);
+  cu_run(_test_decoder_rejects_oversubscribed);
+  cu_run(_test_16_bit_sections);
+  cu_run(_test_table_rejects_bad_symbols);
+  cu_end_tests();
+  return EXIT_SUCCESS;
+}
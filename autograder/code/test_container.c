@@ -0,0 +1,1999 @@
+#include "container.h"
+#include "huffman.h"
+#include "rle.h"
+#include "lz77.h"
+#include "bwt.h"
+#include "context_huffman.h"
+#include "word_huffman.h"
+#include "tans.h"
+#include "columns.h"
+#include "dictionary.h"
+#include "message_codec.h"
+#include "adaptive_huffman.h"
+#include "huff.h"
+#include "parallel_huffman.h"
+#include "code_search.h"
+#include "archive.h"
+#include "utils.h"
+#include "cu_unit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static BitWriter compress_to_memory(const uint8_t *bytes, size_t num_bytes, const BlockOptions *a_options)
+{
+  BitWriter writer = open_memory_bit_writer(num_bytes);
+  write_container_header(&writer, CONTAINER_BLOCKS);
+  compress_blocks(&writer, bytes, num_bytes, a_options);
+  align_bit_writer(&writer);
+  return writer;
+}
+
+// Decode a container held in memory and compare it with the original bytes
+static bool decodes_to(const BitWriter *a_compressed, const uint8_t *bytes, size_t num_bytes)
+{
+  BitReader reader = open_memory_bit_reader(a_compressed->buffer + sizeof(uint32_t),
+                                            a_compressed->num_bytes - sizeof(uint32_t));
+  FILE *decoded = tmpfile();
+  const char *error = NULL;
+  bool matches = decompress_container(&reader, decoded, &error);
+  matches = matches && (size_t)ftell(decoded) == num_bytes;
+  rewind(decoded);
+  for (size_t idx = 0; matches && idx < num_bytes; idx++)
+  {
+    matches = getc(decoded) == bytes[idx];
+  }
+  fclose(decoded);
+  return matches;
+}
+
+// Count the blocks of the given type by walking the block headers
+static int count_blocks(const BitWriter *a_compressed, BlockType type)
+{
+  int count = 0;
+  size_t offset = sizeof(uint32_t) + 1;
+  while (offset < a_compressed->num_bytes && a_compressed->buffer[offset] != BLOCK_END)
+  {
+    uint32_t num_payload_bytes;
+    memcpy(&num_payload_bytes, a_compressed->buffer + offset + 5, sizeof(num_payload_bytes));
+    count += a_compressed->buffer[offset] == type;
+    offset += BLOCK_HEADER_BITS / 8 + num_payload_bytes;
+  }
+  return count;
+}
+
+static uint8_t *read_test_file(const char *path, size_t *a_num_bytes)
+{
+  FILE *file = fopen(path, "rb");
+  uint8_t *bytes = malloc(1 << 17);
+  *a_num_bytes = fread(bytes, 1, 1 << 17, file);
+  fclose(file);
+  return bytes;
+}
+
+// Alternating stretches of JSON-like text and base64, like a log that switches formats
+static uint8_t *make_drifting_input(size_t *a_num_bytes)
+{
+  const char *json = "{\"level\":\"info\",\"msg\":\"request served\",\"status\":200}\n";
+  const char *base64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t stretch = 32 << 10;
+  *a_num_bytes = 4 * stretch;
+  uint8_t *bytes = malloc(*a_num_bytes);
+  uint32_t state = 12345;
+  for (size_t idx = 0; idx < *a_num_bytes; idx++)
+  {
+    state = state * 1103515245 + 12345;
+    bytes[idx] = (idx / stretch) % 2 == 0 ? json[idx % strlen(json)] : base64[(state >> 16) % 64];
+  }
+  return bytes;
+}
+
+static int _test_blocks_empty()
+{
+  cu_start();
+  // -------------------------------
+  BlockOptions options = default_block_options();
+  BitWriter compressed = compress_to_memory(NULL, 0, &options);
+  cu_check(compressed.num_bytes == sizeof(uint32_t) + 2);
+  cu_check(decodes_to(&compressed, NULL, 0));
+  free(compressed.buffer);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_blocks_binary()
+{
+  cu_start();
+  // -------------------------------
+  uint8_t bytes[3000];
+  for (size_t idx = 0; idx < sizeof(bytes); idx++)
+  {
+    bytes[idx] = idx % 7 == 0 ? 0 : (uint8_t)(idx % 5);
+  }
+  BlockOptions options = default_block_options();
+  BitWriter compressed = compress_to_memory(bytes, sizeof(bytes), &options);
+  cu_check(decodes_to(&compressed, bytes, sizeof(bytes)));
+  free(compressed.buffer);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_blocks_single_symbol()
+{
+  cu_start();
+  // -------------------------------
+  uint8_t bytes[5000];
+  memset(bytes, 'q', sizeof(bytes));
+  BlockOptions options = default_block_options();
+  BitWriter compressed = compress_to_memory(bytes, sizeof(bytes), &options);
+  cu_check(decodes_to(&compressed, bytes, sizeof(bytes)));
+  cu_check(count_blocks(&compressed, BLOCK_FILL) == 1);
+  cu_check(compressed.num_bytes < 32);
+  free(compressed.buffer);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_blocks_corpus()
+{
+  cu_start();
+  // -------------------------------
+  const char *paths[] = {"./tests/bee-movie.txt", "./tests/gophers.txt", "./tests/hello_world.c", "./tests/smaug.txt"};
+  for (size_t path_idx = 0; path_idx < sizeof(paths) / sizeof(paths[0]); path_idx++)
+  {
+    size_t num_bytes = 0;
+    uint8_t *bytes = read_test_file(paths[path_idx], &num_bytes);
+    BlockOptions options = default_block_options();
+    BitWriter compressed = compress_to_memory(bytes, num_bytes, &options);
+    cu_check(decodes_to(&compressed, bytes, num_bytes));
+    free(compressed.buffer);
+    free(bytes);
+  }
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_blocks_split_on_drift()
+{
+  cu_start();
+  // -------------------------------
+  size_t num_bytes = 0;
+  uint8_t *bytes = make_drifting_input(&num_bytes);
+  BlockOptions options = default_block_options();
+  BitWriter split = compress_to_memory(bytes, num_bytes, &options);
+  options.split_on_drift = false;
+  BitWriter single = compress_to_memory(bytes, num_bytes, &options);
+
+  cu_check(decodes_to(&split, bytes, num_bytes));
+  cu_check(decodes_to(&single, bytes, num_bytes));
+  cu_check(count_blocks(&single, BLOCK_HUFFMAN) == 1);
+  cu_check(count_blocks(&split, BLOCK_HUFFMAN) >= 4);
+  cu_check(split.num_bytes < single.num_bytes);
+  free(split.buffer);
+  free(single.buffer);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_blocks_repeat_table()
+{
+  cu_start();
+  // -------------------------------
+  size_t num_bytes = 64 << 10;
+  uint8_t *bytes = malloc(num_bytes);
+  const char *line = "GET /index.html 200\nGET /about.html 404\n";
+  for (size_t idx = 0; idx < num_bytes; idx++)
+  {
+    bytes[idx] = line[idx % strlen(line)];
+  }
+  BlockOptions options = default_block_options();
+  options.split_on_drift = false;
+  options.max_block_size = 8 << 10;
+  BitWriter compressed = compress_to_memory(bytes, num_bytes, &options);
+  cu_check(decodes_to(&compressed, bytes, num_bytes));
+  cu_check(count_blocks(&compressed, BLOCK_HUFFMAN_REPEAT) > 0);
+  free(compressed.buffer);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_blocks_store_incompressible()
+{
+  cu_start();
+  // -------------------------------
+  size_t num_bytes = 100 << 10;
+  uint8_t *bytes = malloc(num_bytes);
+  uint32_t state = 2463534242u;
+  for (size_t idx = 0; idx < num_bytes; idx++)
+  {
+    state ^= state << 13; // xorshift32
+    state ^= state >> 17;
+    state ^= state << 5;
+    bytes[idx] = (uint8_t)state;
+  }
+  BlockOptions options = default_block_options();
+  BitWriter compressed = compress_to_memory(bytes, num_bytes, &options);
+  cu_check(decodes_to(&compressed, bytes, num_bytes));
+  cu_check(count_blocks(&compressed, BLOCK_HUFFMAN) == 0);
+  cu_check(count_blocks(&compressed, BLOCK_STORED) > 0);
+  cu_check(compressed.num_bytes <= num_bytes + 64);
+  free(compressed.buffer);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_blocks_store_mixed()
+{
+  cu_start();
+  // -------------------------------
+  size_t num_text_bytes = 0;
+  uint8_t *text = read_test_file("./tests/bee-movie.txt", &num_text_bytes);
+  size_t num_bytes = num_text_bytes + (64 << 10);
+  uint8_t *bytes = malloc(num_bytes);
+  memcpy(bytes, text, num_text_bytes);
+  uint32_t state = 88675123u;
+  for (size_t idx = num_text_bytes; idx < num_bytes; idx++)
+  {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    bytes[idx] = (uint8_t)state;
+  }
+  BlockOptions options = default_block_options();
+  BitWriter compressed = compress_to_memory(bytes, num_bytes, &options);
+  cu_check(decodes_to(&compressed, bytes, num_bytes));
+  cu_check(count_blocks(&compressed, BLOCK_HUFFMAN) > 0);
+  cu_check(count_blocks(&compressed, BLOCK_STORED) > 0);
+  free(compressed.buffer);
+  free(text);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_rle_long_runs()
+{
+  cu_start();
+  // -------------------------------
+  uint8_t bytes[1000];
+  memset(bytes, 0, sizeof(bytes));
+  bytes[0] = 7;
+  bytes[600] = 9;
+  bytes[601] = 9;
+  uint8_t encoded[2 * sizeof(bytes)];
+  size_t num_encoded = rle_encode_runs(bytes, sizeof(bytes), 0, encoded);
+  cu_check(num_encoded == 1 + 2 * 3 + 2 + 2 * 2); // 599 zeros = 256 + 256 + 87, 398 zeros = 256 + 142
+  uint8_t decoded[sizeof(bytes)];
+  cu_check(rle_decode_runs(encoded, num_encoded, 0, decoded, sizeof(decoded)));
+  cu_check(memcmp(bytes, decoded, sizeof(bytes)) == 0);
+  cu_check(!rle_decode_runs(encoded, num_encoded, 0, decoded, sizeof(decoded) - 1));
+  cu_check(!rle_decode_runs(encoded, num_encoded - 1, 0, decoded, sizeof(decoded)));
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_blocks_sparse_runs()
+{
+  cu_start();
+  // -------------------------------
+  size_t num_bytes = 200 << 10;
+  uint8_t *bytes = calloc(num_bytes, 1);
+  uint32_t state = 1;
+  for (size_t idx = 0; idx < num_bytes; idx += 1 + state % 97)
+  {
+    state = state * 1103515245 + 12345;
+    bytes[idx] = (uint8_t)(1 << (state >> 29));
+  }
+  BlockOptions options = default_block_options();
+  BitWriter compressed = compress_to_memory(bytes, num_bytes, &options);
+  cu_check(decodes_to(&compressed, bytes, num_bytes));
+  cu_check(count_blocks(&compressed, BLOCK_RLE) > 0);
+  cu_check(compressed.num_bytes < num_bytes / 16);
+  free(compressed.buffer);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_lz77_corpus()
+{
+  cu_start();
+  // -------------------------------
+  size_t num_bytes = 0;
+  uint8_t *bytes = read_test_file("./tests/bee-movie.txt", &num_bytes);
+  BlockOptions options = default_block_options();
+  BitWriter huffman_only = compress_to_memory(bytes, num_bytes, &options);
+  for (int level = 1; level <= LZ_MAX_LEVEL; level++)
+  {
+    options = lz_block_options(level, LZ_DEFAULT_WINDOW_LOG);
+    BitWriter compressed = compress_to_memory(bytes, num_bytes, &options);
+    cu_check(decodes_to(&compressed, bytes, num_bytes));
+    cu_check(count_blocks(&compressed, BLOCK_LZ77) == 1);
+    cu_check(compressed.num_bytes < huffman_only.num_bytes * 3 / 4);
+    free(compressed.buffer);
+  }
+  free(huffman_only.buffer);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_lz77_window()
+{
+  cu_start();
+  // -------------------------------
+  // Random bytes repeated: only matches can shrink them, and only if the window spans a repeat
+  size_t chunk_size = 16 << 10;
+  size_t num_bytes = 8 * chunk_size;
+  uint8_t *bytes = malloc(num_bytes);
+  uint32_t state = 99;
+  for (size_t idx = 0; idx < num_bytes; idx++)
+  {
+    state = state * 1103515245 + 12345;
+    bytes[idx] = idx < chunk_size ? (uint8_t)(state >> 16) : bytes[idx - chunk_size];
+  }
+
+  BlockOptions options = lz_block_options(LZ_DEFAULT_LEVEL, 15);
+  BitWriter compressed = compress_to_memory(bytes, num_bytes, &options);
+  cu_check(decodes_to(&compressed, bytes, num_bytes));
+  cu_check(count_blocks(&compressed, BLOCK_LZ77) == 1);
+  cu_check(compressed.num_bytes < chunk_size + chunk_size / 8);
+  free(compressed.buffer);
+
+  options = lz_block_options(LZ_DEFAULT_LEVEL, 12);
+  compressed = compress_to_memory(bytes, num_bytes, &options);
+  cu_check(decodes_to(&compressed, bytes, num_bytes));
+  cu_check(count_blocks(&compressed, BLOCK_STORED) == 1);
+  free(compressed.buffer);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_lz77_corrupt()
+{
+  cu_start();
+  // -------------------------------
+  size_t num_bytes = 0;
+  uint8_t *bytes = read_test_file("./tests/bee-movie.txt", &num_bytes);
+  BlockOptions options = lz_block_options(LZ_DEFAULT_LEVEL, LZ_DEFAULT_WINDOW_LOG);
+  BitWriter compressed = compress_to_memory(bytes, num_bytes, &options);
+  // Claim more sequences than the block can hold
+  size_t payload_offset = sizeof(uint32_t) + 1 + BLOCK_HEADER_BITS / 8;
+  memset(compressed.buffer + payload_offset, 0xff, sizeof(uint32_t));
+  cu_check(!decodes_to(&compressed, bytes, num_bytes));
+  free(compressed.buffer);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_bwt_round_trip()
+{
+  cu_start();
+  // -------------------------------
+  const char *inputs[] = {"a", "banana", "abracadabra", "aaaaaaaaaa", "mississippi\0mississippi"};
+  size_t lengths[] = {1, 6, 11, 10, 23};
+  for (size_t idx = 0; idx < sizeof(inputs) / sizeof(inputs[0]); idx++)
+  {
+    uint8_t transformed[32];
+    uint8_t restored[32];
+    size_t primary_index = bwt_forward((const uint8_t *)inputs[idx], lengths[idx], transformed);
+    cu_check(bwt_inverse(transformed, lengths[idx], primary_index, restored));
+    cu_check(memcmp(restored, inputs[idx], lengths[idx]) == 0);
+  }
+  // "banana" + end marker sorts as $, a$, ana$, anana$, banana$, na$, nana$
+  uint8_t transformed[6];
+  cu_check(bwt_forward((const uint8_t *)"banana", 6, transformed) == 4);
+  cu_check(memcmp(transformed, "annbaa", 6) == 0);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_bwt_blocks()
+{
+  cu_start();
+  // -------------------------------
+  size_t num_bytes = 0;
+  uint8_t *bytes = read_test_file("./tests/bee-movie.txt", &num_bytes);
+  BlockOptions options = lz_block_options(LZ_MAX_LEVEL, LZ_DEFAULT_WINDOW_LOG);
+  BitWriter lz = compress_to_memory(bytes, num_bytes, &options);
+  options = bwt_block_options();
+  BitWriter compressed = compress_to_memory(bytes, num_bytes, &options);
+  cu_check(decodes_to(&compressed, bytes, num_bytes));
+  cu_check(count_blocks(&compressed, BLOCK_BWT) == 1);
+  cu_check(compressed.num_bytes < lz.num_bytes);
+  free(compressed.buffer);
+  free(lz.buffer);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_bwt_parallel_blocks()
+{
+  cu_start();
+  // -------------------------------
+  size_t num_bytes = 0;
+  uint8_t *bytes = make_drifting_input(&num_bytes);
+  BlockOptions options = bwt_block_options();
+  options.max_block_size = 16 << 10;
+  options.num_threads = 1;
+  BitWriter serial = compress_to_memory(bytes, num_bytes, &options);
+  options.num_threads = 4;
+  BitWriter parallel = compress_to_memory(bytes, num_bytes, &options);
+  cu_check(decodes_to(&parallel, bytes, num_bytes));
+  cu_check(count_blocks(&parallel, BLOCK_BWT) > 0);
+  // Blocks don't depend on which thread transformed them
+  cu_check(serial.num_bytes == parallel.num_bytes);
+  cu_check(memcmp(serial.buffer, parallel.buffer, serial.num_bytes) == 0);
+  free(serial.buffer);
+  free(parallel.buffer);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_huff_decoder_long_codes()
+{
+  cu_start();
+  // -------------------------------
+  // Fibonacci counts give a maximally skewed tree, with codes longer than HUFF_LOOKUP_BITS
+  Frequencies freq = {0};
+  uint64_t prev = 1;
+  uint64_t curr = 1;
+  for (int ch = 0; ch < 20; ch++)
+  {
+    freq[ch] = curr;
+    uint64_t next = prev + curr;
+    prev = curr;
+    curr = next;
+  }
+  TreeNode *root = make_huffman_tree(freq);
+  HuffEncoder encoder;
+  build_huff_encoder(&encoder, root);
+  cu_check(encoder.codes[0].length > HUFF_LOOKUP_BITS);
+
+  uint8_t bytes[2 * 20];
+  for (int idx = 0; idx < 2 * 20; idx++)
+  {
+    bytes[idx] = (uint8_t)(idx % 20);
+  }
+  BitWriter writer = open_memory_bit_writer(64);
+  write_symbols(&writer, &encoder, bytes, sizeof(bytes));
+  align_bit_writer(&writer);
+
+  HuffDecoder *decoder = malloc(sizeof(*decoder));
+  build_huff_decoder(decoder, root);
+  BitReader reader = open_memory_bit_reader(writer.buffer, writer.num_bytes);
+  bool matches = true;
+  for (size_t idx = 0; idx < sizeof(bytes); idx++)
+  {
+    matches = matches && decode_symbol(decoder, &reader) == bytes[idx];
+  }
+  cu_check(matches);
+  free(decoder);
+  free(writer.buffer);
+  destroy_huffman_tree(&root);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_order1_corpus()
+{
+  cu_start();
+  // -------------------------------
+  size_t num_bytes = 0;
+  uint8_t *bytes = read_test_file("./tests/bee-movie.txt", &num_bytes);
+  BlockOptions options = default_block_options();
+  BitWriter order0 = compress_to_memory(bytes, num_bytes, &options);
+  options.order1 = true;
+  BitWriter compressed = compress_to_memory(bytes, num_bytes, &options);
+  cu_check(decodes_to(&compressed, bytes, num_bytes));
+  cu_check(count_blocks(&compressed, BLOCK_CONTEXT) > 0);
+  cu_check(compressed.num_bytes < order0.num_bytes * 4 / 5);
+  free(compressed.buffer);
+  free(order0.buffer);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_order1_clusters()
+{
+  cu_start();
+  // -------------------------------
+  // 16 letters, each followed by one of two others: order-0 sees 4 bits per byte, order-1 one
+  size_t num_bytes = 64 << 10;
+  uint8_t *bytes = malloc(num_bytes);
+  uint32_t state = 7;
+  bytes[0] = 'a';
+  for (size_t idx = 1; idx < num_bytes; idx++)
+  {
+    state = state * 1103515245 + 12345;
+    bytes[idx] = (uint8_t)('a' + ((bytes[idx - 1] - 'a') * 5 + 1 + ((state >> 16) & 1) * 8) % 16);
+  }
+  BitWriter writer = open_memory_bit_writer(num_bytes);
+  context_write_payload(&writer, bytes, num_bytes);
+  align_bit_writer(&writer);
+  cu_check(writer.buffer[0] >= 1 && writer.buffer[0] <= CONTEXT_MAX_CLUSTERS);
+  cu_check(writer.num_bytes < num_bytes / 4);
+
+  uint8_t *decoded = malloc(num_bytes);
+  BitReader reader = open_memory_bit_reader(writer.buffer, writer.num_bytes);
+  cu_check(context_read_payload(&reader, decoded, num_bytes));
+  cu_check(memcmp(decoded, bytes, num_bytes) == 0);
+
+  writer.buffer[0] = CONTEXT_MAX_CLUSTERS + 1;
+  reader = open_memory_bit_reader(writer.buffer, writer.num_bytes);
+  cu_check(!context_read_payload(&reader, decoded, num_bytes));
+  free(decoded);
+  free(writer.buffer);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_words_corpus()
+{
+  cu_start();
+  // -------------------------------
+  size_t num_bytes = 0;
+  uint8_t *bytes = read_test_file("./tests/bee-movie.txt", &num_bytes);
+  BlockOptions options = default_block_options();
+  BitWriter bytewise = compress_to_memory(bytes, num_bytes, &options);
+  options = word_block_options();
+  BitWriter compressed = compress_to_memory(bytes, num_bytes, &options);
+  cu_check(decodes_to(&compressed, bytes, num_bytes));
+  cu_check(count_blocks(&compressed, BLOCK_WORDS) == 1);
+  cu_check(compressed.num_bytes < bytewise.num_bytes * 3 / 4);
+  free(compressed.buffer);
+  free(bytewise.buffer);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_words_many_tokens()
+{
+  cu_start();
+  // -------------------------------
+  // Numbered log lines: far more distinct tokens than bytes in an alphabet, with long separators
+  size_t capacity = 4 << 20;
+  uint8_t *bytes = malloc(capacity);
+  size_t num_bytes = 0;
+  for (int line = 0; num_bytes + 100 < capacity; line++)
+  {
+    num_bytes += sprintf((char *)bytes + num_bytes, "id=%d user%d ok%s\n", line, line % 977,
+                         line % 5000 == 0 ? "                                                                "
+                                            "                                                                "
+                                            "                                                                "
+                                            "                                                                "
+                                          : "");
+  }
+  BitWriter writer = open_memory_bit_writer(num_bytes);
+  words_write_payload(&writer, bytes, num_bytes);
+  align_bit_writer(&writer);
+  uint32_t num_tokens;
+  memcpy(&num_tokens, writer.buffer, sizeof(num_tokens));
+  cu_check(num_tokens > 100000);
+
+  uint8_t *decoded = malloc(num_bytes);
+  BitReader reader = open_memory_bit_reader(writer.buffer, writer.num_bytes);
+  cu_check(words_read_payload(&reader, decoded, num_bytes));
+  cu_check(memcmp(decoded, bytes, num_bytes) == 0);
+  reader = open_memory_bit_reader(writer.buffer, writer.num_bytes);
+  cu_check(!words_read_payload(&reader, decoded, num_bytes - 1));
+  free(decoded);
+  free(writer.buffer);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_tans_skewed()
+{
+  cu_start();
+  // -------------------------------
+  // One byte at 95%: Huffman spends at least a bit on it, tANS about 0.07
+  size_t num_bytes = 1 << 18;
+  uint8_t *bytes = malloc(num_bytes);
+  uint32_t state = 11;
+  for (size_t idx = 0; idx < num_bytes; idx++)
+  {
+    state = state * 1103515245 + 12345;
+    bytes[idx] = (state >> 8) % 100 < 95 ? 'x' : 'a' + (state >> 16) % 20;
+  }
+  BlockOptions options = default_block_options();
+  BitWriter huffman = compress_to_memory(bytes, num_bytes, &options);
+  options.tans = true;
+  BitWriter compressed = compress_to_memory(bytes, num_bytes, &options);
+  cu_check(decodes_to(&compressed, bytes, num_bytes));
+  cu_check(count_blocks(&compressed, BLOCK_TANS) > 0);
+  cu_check(compressed.num_bytes < huffman.num_bytes * 3 / 4);
+  free(compressed.buffer);
+  free(huffman.buffer);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_tans_payload()
+{
+  cu_start();
+  // -------------------------------
+  uint8_t lone[] = {'q', 'q', 'q', 'q', 'q'};
+  uint8_t mixed[] = {0, 255, 0, 0, 7, 255, 0, 0, 0};
+  uint8_t *inputs[] = {lone, mixed, mixed};
+  size_t lengths[] = {sizeof(lone), sizeof(mixed), 0};
+  uint8_t decoded[16];
+  for (int input = 0; input < 3; input++)
+  {
+    Frequencies freq = {0};
+    add_frequencies(freq, inputs[input], lengths[input]);
+    BitWriter writer = open_memory_bit_writer(16);
+    tans_write_payload(&writer, inputs[input], lengths[input], freq);
+    align_bit_writer(&writer);
+    BitReader reader = open_memory_bit_reader(writer.buffer, writer.num_bytes);
+    cu_check(tans_read_payload(&reader, decoded, lengths[input]));
+    cu_check(memcmp(decoded, inputs[input], lengths[input]) == 0);
+
+    // With a larger table log the counts no longer fill the table
+    if (lengths[input] > 0)
+    {
+      writer.buffer[0]++;
+      reader = open_memory_bit_reader(writer.buffer, writer.num_bytes);
+      cu_check(!tans_read_payload(&reader, decoded, lengths[input]));
+    }
+    free(writer.buffer);
+  }
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_column_records()
+{
+  cu_start();
+  // -------------------------------
+  // 12-byte records of a counter, a constant, a few ids and noise: each column is cheap alone, not mixed together
+  size_t record_width = 12;
+  size_t num_bytes = 20000 * record_width + 5;
+  uint8_t *bytes = malloc(num_bytes);
+  uint32_t state = 50;
+  for (size_t idx = 0; idx < num_bytes; idx++)
+  {
+    size_t record = idx / record_width;
+    size_t column = idx % record_width;
+    state = state * 1103515245 + 12345;
+    bytes[idx] = column < 4   ? (uint8_t)((record * 3) >> (8 * column))
+                 : column < 6 ? 0x80
+                 : column < 8 ? (uint8_t)((state >> 16) % 4)
+                              : (uint8_t)(state >> 16);
+  }
+  BlockOptions options = default_block_options();
+  BitWriter huffman = compress_to_memory(bytes, num_bytes, &options);
+  options.record_width = record_width;
+  BitWriter compressed = compress_to_memory(bytes, num_bytes, &options);
+  cu_check(decodes_to(&compressed, bytes, num_bytes));
+  cu_check(count_blocks(&compressed, BLOCK_COLUMNS) > 0);
+  cu_check(compressed.num_bytes < huffman.num_bytes * 3 / 4);
+  free(compressed.buffer);
+  free(huffman.buffer);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_column_payload()
+{
+  cu_start();
+  // -------------------------------
+  // Records wider than the input, a cut-short last record, and one byte per record
+  uint8_t bytes[] = {1, 2, 3, 1, 2, 4, 1, 2, 5, 1, 9};
+  size_t widths[] = {100, 3, 1};
+  uint8_t decoded[sizeof(bytes)];
+  for (int input = 0; input < 3; input++)
+  {
+    BitWriter writer = open_memory_bit_writer(16);
+    columns_write_payload(&writer, bytes, sizeof(bytes), widths[input]);
+    align_bit_writer(&writer);
+    BitReader reader = open_memory_bit_reader(writer.buffer, writer.num_bytes);
+    cu_check(columns_read_payload(&reader, decoded, sizeof(bytes)));
+    cu_check(memcmp(decoded, bytes, sizeof(bytes)) == 0);
+
+    // A record width longer than the block is refused
+    reader = open_memory_bit_reader(writer.buffer, writer.num_bytes);
+    cu_check(input > 0 || !columns_read_payload(&reader, decoded, sizeof(bytes) - 1));
+    free(writer.buffer);
+  }
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_dictionary_frames()
+{
+  cu_start();
+  // -------------------------------
+  // A dictionary trained on the other corpus files codes a message smaller than the message
+  const char *samples[] = {"./tests/bee-movie.txt", "./tests/dialogue.txt", "./tests/poem.txt", "./tests/report.txt"};
+  Frequencies freq = {0};
+  const char *error = NULL;
+  for (int idx = 0; idx < 4; idx++)
+  {
+    cu_check(calc_frequencies(freq, samples[idx], &error));
+  }
+  TreeNode *root = train_dictionary_tree(freq);
+  BitWriter dictionary_writer = open_memory_bit_writer(256);
+  write_dictionary(&dictionary_writer, root);
+  destroy_huffman_tree(&root);
+  BitReader dictionary_reader = open_memory_bit_reader(dictionary_writer.buffer, dictionary_writer.num_bytes);
+  HuffDictionary dictionary;
+  cu_check(read_dictionary(&dictionary_reader, &dictionary, &error));
+
+  size_t num_bytes = 0;
+  uint8_t *bytes = read_test_file("./tests/cornell.txt", &num_bytes);
+  BitWriter frame = open_memory_bit_writer(num_bytes);
+  write_dictionary_frame(&frame, &dictionary, bytes, num_bytes);
+  cu_check(frame.num_bytes < num_bytes * 3 / 4);
+  uint8_t *decoded = NULL;
+  size_t num_decoded = 0;
+  BitReader reader = open_memory_bit_reader(frame.buffer, frame.num_bytes);
+  cu_check(read_dictionary_frame(&reader, &dictionary, &decoded, &num_decoded, &error));
+  cu_check(num_decoded == num_bytes && memcmp(decoded, bytes, num_bytes) == 0);
+  free(decoded);
+
+  // A truncated frame, and a frame for another dictionary
+  reader = open_memory_bit_reader(frame.buffer, frame.num_bytes / 2);
+  cu_check(!read_dictionary_frame(&reader, &dictionary, &decoded, &num_decoded, &error));
+  frame.buffer[0] ^= 1;
+  reader = open_memory_bit_reader(frame.buffer, frame.num_bytes);
+  cu_check(!read_dictionary_frame(&reader, &dictionary, &decoded, &num_decoded, &error));
+  cu_check(decoded == NULL);
+
+  // Bytes the corpus never used would take long codes, so random bytes are stored as they are
+  uint8_t random_bytes[20000];
+  srand(11);
+  for (size_t idx = 0; idx < sizeof(random_bytes); idx++)
+  {
+    random_bytes[idx] = (uint8_t)rand();
+  }
+  BitWriter random_frame = open_memory_bit_writer(sizeof(random_bytes));
+  write_dictionary_frame(&random_frame, &dictionary, random_bytes, sizeof(random_bytes));
+  cu_check(random_frame.num_bytes <= sizeof(random_bytes) + 6);
+  reader = open_memory_bit_reader(random_frame.buffer, random_frame.num_bytes);
+  cu_check(read_dictionary_frame(&reader, &dictionary, &decoded, &num_decoded, &error));
+  cu_check(num_decoded == sizeof(random_bytes) && memcmp(decoded, random_bytes, sizeof(random_bytes)) == 0);
+  free(decoded);
+  reader = open_memory_bit_reader(random_frame.buffer, random_frame.num_bytes - 1);
+  cu_check(!read_dictionary_frame(&reader, &dictionary, &decoded, &num_decoded, &error));
+  cu_check(decoded == NULL);
+  free(random_frame.buffer);
+
+  destroy_dictionary(&dictionary);
+  free(frame.buffer);
+  free(bytes);
+  free(dictionary_writer.buffer);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_varints()
+{
+  cu_start();
+  // -------------------------------
+  uint64_t values[] = {0, 1, 127, 128, 300, 16383, 16384, UINT32_MAX, UINT64_MAX - 1};
+  BitWriter writer = open_memory_bit_writer(16);
+  for (int idx = 0; idx < 9; idx++)
+  {
+    write_varint(&writer, values[idx]);
+  }
+  cu_check(writer.num_bytes == 1 + 1 + 1 + 2 + 2 + 2 + 3 + 5 + 10);
+  BitReader reader = open_memory_bit_reader(writer.buffer, writer.num_bytes);
+  for (int idx = 0; idx < 9; idx++)
+  {
+    cu_check(read_varint(&reader) == values[idx]);
+  }
+  free(writer.buffer);
+
+  uint8_t overlong[11];
+  memset(overlong, 0x80, sizeof(overlong));
+  reader = open_memory_bit_reader(overlong, sizeof(overlong));
+  cu_check(read_varint(&reader) == UINT64_MAX);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_message_codec()
+{
+  cu_start();
+  // -------------------------------
+  // Every line of a text as its own message, back to back in one buffer
+  size_t num_bytes = 0;
+  uint8_t *bytes = read_test_file("./tests/bee-movie.txt", &num_bytes);
+  Frequencies freq = {0};
+  add_frequencies(freq, bytes, num_bytes);
+  MessageCodec codec;
+  init_message_codec(&codec, freq);
+  size_t capacity = message_bound(&codec, num_bytes) + num_bytes;
+  uint8_t *encoded = malloc(capacity);
+  size_t num_encoded = 0;
+  size_t num_messages = 0;
+  bool fits = true;
+  for (size_t line_start = 0; line_start < num_bytes && fits; num_messages++)
+  {
+    const uint8_t *newline = memchr(bytes + line_start, '\n', num_bytes - line_start);
+    size_t line_end = newline != NULL ? (size_t)(newline - bytes) + 1 : num_bytes;
+    size_t num_written = encode_message(&codec, bytes + line_start, line_end - line_start, encoded + num_encoded,
+                                        capacity - num_encoded);
+    fits = num_written > 0 && num_written <= message_bound(&codec, line_end - line_start);
+    num_encoded += num_written;
+    line_start = line_end;
+  }
+  cu_check(fits);
+  cu_check(num_encoded < num_bytes * 3 / 4);
+
+  uint8_t *decoded = malloc(num_bytes);
+  size_t num_decoded = 0;
+  size_t num_decoded_messages = 0;
+  bool ok = true;
+  for (size_t pos = 0; pos < num_encoded && ok; num_decoded_messages++)
+  {
+    size_t message_bytes = 0;
+    size_t num_consumed = 0;
+    ok = decode_message(&codec, encoded + pos, num_encoded - pos, decoded + num_decoded, num_bytes - num_decoded,
+                        &message_bytes, &num_consumed);
+    num_decoded += message_bytes;
+    pos += num_consumed;
+  }
+  cu_check(ok && num_decoded_messages == num_messages);
+  cu_check(num_decoded == num_bytes && memcmp(decoded, bytes, num_bytes) == 0);
+
+  // Buffers that are too small, and a message cut short
+  uint8_t message[] = {'\0', 0xff, 'h', 'i'};
+  uint8_t small[4];
+  cu_check(encode_message(&codec, message, sizeof(message), small, 2) == 0);
+  size_t num_written = encode_message(&codec, message, sizeof(message), encoded, capacity);
+  size_t message_bytes = 0;
+  size_t num_consumed = 0;
+  cu_check(decode_message(&codec, encoded, num_written, small, 4, &message_bytes, &num_consumed));
+  cu_check(message_bytes == 4 && num_consumed == num_written && memcmp(small, message, 4) == 0);
+  cu_check(!decode_message(&codec, encoded, num_written, small, 3, &message_bytes, &num_consumed));
+  cu_check(!decode_message(&codec, encoded, num_written - 1, small, 4, &message_bytes, &num_consumed));
+
+  free(decoded);
+  free(encoded);
+  destroy_message_codec(&codec);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_huff_buffers()
+{
+  cu_start();
+  // -------------------------------
+  // The same container as `compress -b`, written and read without files
+  size_t num_bytes = 0;
+  uint8_t *bytes = read_test_file("./tests/bee-movie.txt", &num_bytes);
+  BlockOptions options = default_block_options();
+  BitWriter expected = compress_to_memory(bytes, num_bytes, &options);
+  size_t capacity = huff_compress_bound(num_bytes);
+  uint8_t *compressed = malloc(capacity);
+  size_t num_compressed = huff_compress(bytes, num_bytes, compressed, capacity);
+  cu_check(num_compressed == expected.num_bytes && memcmp(compressed, expected.buffer, num_compressed) == 0);
+  uint8_t *decoded = malloc(num_bytes);
+  cu_check(huff_decompress(compressed, num_compressed, decoded, num_bytes) == num_bytes);
+  cu_check(memcmp(decoded, bytes, num_bytes) == 0);
+
+  // Buffers one byte too small, and a container cut short
+  cu_check(huff_compress(bytes, num_bytes, compressed, num_compressed - 1) == HUFF_ERROR);
+  cu_check(huff_decompress(compressed, num_compressed, decoded, num_bytes - 1) == HUFF_ERROR);
+  cu_check(huff_decompress(compressed, num_compressed - 1, decoded, num_bytes) == HUFF_ERROR);
+  cu_check(huff_decompress(bytes, num_bytes, decoded, num_bytes) == HUFF_ERROR);
+
+  // Incompressible input stays within the bound, and empty input round-trips
+  uint8_t random_bytes[20000];
+  srand(7);
+  for (size_t idx = 0; idx < sizeof(random_bytes); idx++)
+  {
+    random_bytes[idx] = (uint8_t)rand();
+  }
+  size_t random_capacity = huff_compress_bound(sizeof(random_bytes));
+  uint8_t *random_compressed = malloc(random_capacity);
+  size_t num_random = huff_compress(random_bytes, sizeof(random_bytes), random_compressed, random_capacity);
+  cu_check(num_random != HUFF_ERROR && num_random <= random_capacity);
+  cu_check(huff_decompress(random_compressed, num_random, decoded, num_bytes) == sizeof(random_bytes));
+  cu_check(memcmp(decoded, random_bytes, sizeof(random_bytes)) == 0);
+  num_random = huff_compress(NULL, 0, random_compressed, huff_compress_bound(0));
+  cu_check(num_random != HUFF_ERROR && huff_decompress(random_compressed, num_random, decoded, 0) == 0);
+
+  // Adaptive containers decode too
+  BitWriter adaptive = open_memory_bit_writer(num_bytes);
+  write_container_header(&adaptive, CONTAINER_ADAPTIVE);
+  AdaptiveModel *model = malloc(sizeof(*model));
+  init_adaptive_model(model);
+  for (size_t idx = 0; idx < 1000; idx++)
+  {
+    adaptive_encode_symbol(model, &adaptive, bytes[idx]);
+  }
+  adaptive_encode_symbol(model, &adaptive, ADAPTIVE_EOS);
+  align_bit_writer(&adaptive);
+  cu_check(huff_decompress(adaptive.buffer, adaptive.num_bytes, decoded, num_bytes) == 1000);
+  cu_check(memcmp(decoded, bytes, 1000) == 0);
+  cu_check(huff_decompress(adaptive.buffer, adaptive.num_bytes, decoded, 999) == HUFF_ERROR);
+  cu_check(huff_decompress(adaptive.buffer, adaptive.num_bytes / 2, decoded, num_bytes) == HUFF_ERROR);
+
+  free(model);
+  free(adaptive.buffer);
+  free(random_compressed);
+  free(decoded);
+  free(compressed);
+  free(expected.buffer);
+  free(bytes);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_exact_sizes()
+{
+  cu_start();
+  // -------------------------------
+  // Text, a fill, noise, runs of one byte, then the text again to reuse its table
+  size_t num_text_bytes = 0;
+  uint8_t *text = read_test_file("./tests/bee-movie.txt", &num_text_bytes);
+  num_text_bytes -= num_text_bytes % 4096; // Keep each part in blocks of its own
+  size_t num_bytes = 2 * num_text_bytes + 3 * 8192;
+  uint8_t *bytes = malloc(num_bytes);
+  memcpy(bytes, text, num_text_bytes);
+  uint8_t *mixed = bytes + num_text_bytes;
+  memset(mixed, 0, 8192);
+  srand(11);
+  for (size_t idx = 8192; idx < 3 * 8192; idx++)
+  {
+    mixed[idx] = idx < 2 * 8192 ? (uint8_t)rand() : rand() % 16 == 0 ? (uint8_t)(rand() % 4) : 'a';
+  }
+  memcpy(mixed + 3 * 8192, text, num_text_bytes);
+
+  BlockOptions options[] = {default_block_options(), lz_block_options(3, 16), bwt_block_options(),
+                            word_block_options(), default_block_options(), default_block_options()};
+  options[4].order1 = true;
+  options[5].tans = true;
+  bool exact = true;
+  for (size_t idx = 0; idx < sizeof(options) / sizeof(options[0]); idx++)
+  {
+    BitWriter compressed = compress_to_memory(bytes, num_bytes, &options[idx]);
+    exact = exact && compressed_blocks_size(bytes, num_bytes, &options[idx]) + 5 == compressed.num_bytes;
+    free(compressed.buffer);
+  }
+  cu_check(exact);
+  BitWriter compressed = compress_to_memory(bytes, num_bytes, &options[0]);
+  cu_check(count_blocks(&compressed, BLOCK_FILL) > 0 && count_blocks(&compressed, BLOCK_STORED) > 0);
+  cu_check(count_blocks(&compressed, BLOCK_RLE) > 0 && count_blocks(&compressed, BLOCK_HUFFMAN_REPEAT) > 0);
+  free(compressed.buffer);
+
+  // The size fits the output exactly, and nothing less does
+  size_t size = huff_compressed_size(text, num_text_bytes);
+  uint8_t *dst = malloc(size);
+  cu_check(huff_compress(text, num_text_bytes, dst, size) == size);
+  cu_check(huff_compress(text, num_text_bytes, dst, size - 1) == HUFF_ERROR);
+  cu_check(huff_compressed_size(NULL, 0) == 6);
+
+  // The sum of count times code length is the size of the codes
+  Frequencies freq = {0};
+  add_frequencies(freq, text, num_text_bytes);
+  TreeNode *root = make_huffman_tree(freq);
+  HuffEncoder encoder;
+  build_huff_encoder(&encoder, root);
+  BitWriter codes = open_memory_bit_writer(num_text_bytes);
+  write_symbols(&codes, &encoder, text, num_text_bytes);
+  cu_check(codes.num_bytes == coded_bits(freq, &encoder) / 8);
+
+  free(codes.buffer);
+  destroy_huffman_tree(&root);
+  free(dst);
+  free(bytes);
+  free(text);
+  // -------------------------------
+  cu_end();
+}
+
+// The sizes of compressed.bits and coding_table.bits as compress writes them
+static void write_two_file_sizes(uint8_t *bytes, size_t num_bytes, uint64_t *a_compressed_size, uint64_t *a_table_size)
+{
+  Frequencies freq = {0};
+  add_frequencies(freq, bytes, num_bytes);
+  TreeNode *root = make_huffman_tree(freq);
+  uint32_t total_bytes = (uint32_t)num_bytes;
+  BitWriter compressed_writer = {.file = tmpfile(), .current_byte = 0, .num_bits_left = 8};
+  fwrite(&total_bytes, sizeof(uint32_t), 1, compressed_writer.file);
+  write_compressed_parallel(&compressed_writer, bytes, root, 2);
+  flush_bit_writer(&compressed_writer);
+  *a_compressed_size = (uint64_t)ftell(compressed_writer.file);
+  BitWriter table_writer = {.file = tmpfile(), .current_byte = 0, .num_bits_left = 8};
+  write_coding_table(root, &table_writer);
+  flush_bit_writer(&table_writer);
+  *a_table_size = (uint64_t)ftell(table_writer.file);
+  close_bit_writer(&compressed_writer);
+  close_bit_writer(&table_writer);
+  destroy_huffman_tree(&root);
+}
+
+static int _test_exact_sizes_with_tree_cache()
+{
+  cu_start();
+  // -------------------------------
+  // Text, other text, then the first text again, which coding finds in the cache it filled a moment before;
+  // the others are the text in capitals and in rot13, so that they are shaped differently
+  uint8_t *texts[3];
+  size_t text_size = 0;
+  texts[0] = read_test_file("./tests/bee-movie.txt", &text_size);
+  texts[1] = malloc(text_size);
+  texts[2] = malloc(text_size);
+  for (size_t idx = 0; idx < text_size; idx++)
+  {
+    uint8_t ch = texts[0][idx];
+    texts[1][idx] = ch >= 'a' && ch <= 'z' ? ch - 'a' + 'A' : ch;
+    texts[2][idx] = ch >= 'a' && ch <= 'z' ? (ch - 'a' + 13) % 26 + 'a' : ch;
+  }
+  size_t piece_size = 8192;
+  size_t num_bytes = 3 * piece_size;
+  uint8_t *bytes = malloc(num_bytes);
+  memcpy(bytes, texts[0], piece_size);
+  memcpy(bytes + piece_size, texts[1], piece_size);
+  memcpy(bytes + 2 * piece_size, texts[0], piece_size);
+
+  TreeCache cache;
+  init_tree_cache(&cache, DEFAULT_TREE_CACHE_TOLERANCE);
+  BlockOptions options = default_block_options();
+  options.tree_cache = &cache;
+  uint64_t size = compressed_blocks_size(bytes, num_bytes, &options);
+  cu_check(cache.num_tables == 0 && cache.stats.num_hits == 0 && cache.stats.num_misses == 0);
+  BitWriter compressed = compress_to_memory(bytes, num_bytes, &options);
+  cu_check(size + 5 == compressed.num_bytes && cache.stats.num_hits > 0);
+  free(compressed.buffer);
+
+  // With the cache warm, pieces from anywhere in the texts
+  srand(49);
+  bool exact = true;
+  for (int input = 0; input < 40; input++)
+  {
+    for (size_t piece = 0; piece < 3; piece++)
+    {
+      int text = rand() % 3;
+      size_t offset = (size_t)rand() % (text_size - piece_size);
+      memcpy(bytes + piece * piece_size, texts[text] + offset, piece_size);
+    }
+    TreeCacheStats stats = cache.stats;
+    size_t num_tables = cache.num_tables;
+    size = compressed_blocks_size(bytes, num_bytes, &options);
+    exact = exact && cache.num_tables == num_tables && cache.stats.num_hits == stats.num_hits &&
+            cache.stats.num_misses == stats.num_misses && cache.stats.num_rejected == stats.num_rejected;
+    compressed = compress_to_memory(bytes, num_bytes, &options);
+    exact = exact && size + 5 == compressed.num_bytes;
+    free(compressed.buffer);
+  }
+  cu_check(exact);
+
+  destroy_tree_cache(&cache);
+  free(bytes);
+  for (int idx = 0; idx < 3; idx++)
+  {
+    free(texts[idx]);
+  }
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_two_file_sizes()
+{
+  cu_start();
+  // -------------------------------
+  // Text, one byte repeated, a NUL that ends the codes early, and nothing at all
+  size_t num_text_bytes = 0;
+  uint8_t *text = read_test_file("./tests/bee-movie.txt", &num_text_bytes);
+  uint8_t *inputs[4];
+  size_t lengths[] = {num_text_bytes, 1000, 3000, 0};
+  for (int input = 0; input < 4; input++)
+  {
+    inputs[input] = malloc(lengths[input] + 1);
+    memcpy(inputs[input], text, input == 0 ? num_text_bytes : 0);
+    inputs[input][lengths[input]] = '\0'; // The writer stops here, as for a file read by compress
+  }
+  memset(inputs[1], 'z', lengths[1]);
+  memcpy(inputs[2], text, lengths[2]);
+  inputs[2][1234] = '\0';
+  bool exact = true;
+  for (int input = 0; input < 4; input++)
+  {
+    uint64_t compressed_size = 0;
+    uint64_t table_size = 0;
+    two_file_sizes(inputs[input], lengths[input], &compressed_size, &table_size);
+    uint64_t written_compressed_size = 0;
+    uint64_t written_table_size = 0;
+    write_two_file_sizes(inputs[input], lengths[input], &written_compressed_size, &written_table_size);
+    exact = exact && compressed_size == written_compressed_size && table_size == written_table_size;
+    free(inputs[input]);
+  }
+  cu_check(exact);
+  free(text);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_parallel_encoder()
+{
+  cu_start();
+  // -------------------------------
+  // Several chunks' worth of text, written after three pending bits
+  size_t num_text_bytes = 0;
+  uint8_t *text = read_test_file("./tests/bee-movie.txt", &num_text_bytes);
+  size_t num_bytes = 8 * num_text_bytes;
+  uint8_t *bytes = malloc(num_bytes + 1);
+  for (size_t idx = 0; idx < num_bytes; idx++)
+  {
+    bytes[idx] = text[idx % num_text_bytes] ^ (idx % 7 == 0 ? 1 : 0);
+  }
+  bytes[num_bytes] = '\0';
+  Frequencies freq = {0};
+  add_frequencies(freq, bytes, num_bytes);
+  TreeNode *root = make_huffman_tree(freq);
+
+  BitWriter serial = open_memory_bit_writer(num_bytes);
+  write_bits(&serial, 5, 3);
+  write_compressed(&serial, bytes, root);
+  flush_bit_writer(&serial);
+  bool identical = true;
+  int thread_counts[] = {1, 3, 8};
+  for (int idx = 0; idx < 3; idx++)
+  {
+    BitWriter parallel = open_memory_bit_writer(num_bytes);
+    write_bits(&parallel, 5, 3);
+    write_compressed_parallel(&parallel, bytes, root, thread_counts[idx]);
+    flush_bit_writer(&parallel);
+    identical = identical && parallel.num_bytes == serial.num_bytes &&
+                memcmp(parallel.buffer, serial.buffer, serial.num_bytes) == 0;
+    free(parallel.buffer);
+  }
+  cu_check(identical);
+  destroy_huffman_tree(&root);
+  free(serial.buffer);
+
+  // One repeated byte codes to nothing, and coding stops at a NUL byte
+  memset(bytes, 'x', num_bytes);
+  bytes[num_bytes / 2] = '\0';
+  memset(freq, 0, sizeof(Frequencies));
+  freq['x'] = num_bytes / 2;
+  root = make_huffman_tree(freq);
+  BitWriter single = open_memory_bit_writer(16);
+  write_compressed_parallel(&single, bytes, root, 4);
+  cu_check(single.num_bytes == 0 && single.num_bits_left == 8);
+  destroy_huffman_tree(&root);
+  free(single.buffer);
+
+  freq['y'] = 1;
+  root = make_huffman_tree(freq);
+  BitWriter halves = open_memory_bit_writer(16);
+  write_compressed_parallel(&halves, bytes, root, 4);
+  flush_bit_writer(&halves);
+  cu_check(halves.num_bytes == num_bytes / 2 / 8 + 1);
+  destroy_huffman_tree(&root);
+  free(halves.buffer);
+
+  free(bytes);
+  free(text);
+  // -------------------------------
+  cu_end();
+}
+
+// Decode a two-file stream with `num_threads` threads (0 for the serial decoder) and read back what was written
+static uint8_t *decode_two_file(const BitWriter *a_compressed, TreeNode *root, uint32_t num_bytes, int num_threads,
+                                size_t *a_num_decoded)
+{
+  BitReader reader = open_memory_bit_reader(a_compressed->buffer, a_compressed->num_bytes);
+  FILE *decoded = tmpfile();
+  if (num_threads == 0)
+  {
+    read_compressed(&reader, decoded, root, num_bytes);
+  }
+  else
+  {
+    read_compressed_parallel(&reader, decoded, root, num_bytes, num_threads);
+  }
+  *a_num_decoded = ftell(decoded);
+  rewind(decoded);
+  uint8_t *bytes = malloc(*a_num_decoded + 1);
+  *a_num_decoded = fread(bytes, 1, *a_num_decoded, decoded);
+  fclose(decoded);
+  return bytes;
+}
+
+static int _test_parallel_decoder()
+{
+  cu_start();
+  // -------------------------------
+  // Enough codes for several chunks, each thread starting mid-code, and for one thread several rounds
+  size_t num_text_bytes = 0;
+  uint8_t *text = read_test_file("./tests/bee-movie.txt", &num_text_bytes);
+  size_t num_bytes = 48 * num_text_bytes;
+  uint8_t *bytes = malloc(num_bytes + 1);
+  for (size_t idx = 0; idx < num_bytes; idx++)
+  {
+    bytes[idx] = text[idx % num_text_bytes] ^ (idx % 5 == 0 ? 2 : 0);
+  }
+  bytes[num_bytes] = '\0';
+  Frequencies freq = {0};
+  add_frequencies(freq, bytes, num_bytes);
+  TreeNode *root = make_huffman_tree(freq);
+  BitWriter compressed = open_memory_bit_writer(num_bytes);
+  write_compressed(&compressed, bytes, root);
+  flush_bit_writer(&compressed);
+
+  // Exact counts, counts past the end of the codes, and counts that stop early
+  uint32_t counts[] = {num_bytes, num_bytes + 100, num_bytes / 3};
+  int thread_counts[] = {1, 3, 8};
+  bool identical = true;
+  for (int count_idx = 0; count_idx < 3; count_idx++)
+  {
+    size_t num_serial = 0;
+    uint8_t *serial = decode_two_file(&compressed, root, counts[count_idx], 0, &num_serial);
+    identical = identical && num_serial == counts[count_idx];
+    for (int idx = 0; idx < 3; idx++)
+    {
+      size_t num_parallel = 0;
+      uint8_t *parallel = decode_two_file(&compressed, root, counts[count_idx], thread_counts[idx], &num_parallel);
+      identical = identical && num_parallel == num_serial && memcmp(parallel, serial, num_serial) == 0;
+      free(parallel);
+    }
+    free(serial);
+  }
+  cu_check(identical);
+  destroy_huffman_tree(&root);
+
+  // Noise under a skewed tree with long codes still decodes as the serial decoder does
+  memset(freq, 0, sizeof(Frequencies));
+  for (int ch = 0; ch < 40; ch++)
+  {
+    freq[ch + 'A'] = 1u << (ch % 30);
+  }
+  root = make_huffman_tree(freq);
+  srand(5);
+  for (size_t idx = 0; idx < compressed.num_bytes; idx++)
+  {
+    compressed.buffer[idx] = (uint8_t)rand();
+  }
+  size_t num_serial = 0;
+  uint8_t *serial = decode_two_file(&compressed, root, num_bytes, 0, &num_serial);
+  for (int num_threads = 1; num_threads <= 6; num_threads += 5)
+  {
+    size_t num_parallel = 0;
+    uint8_t *parallel = decode_two_file(&compressed, root, num_bytes, num_threads, &num_parallel);
+    cu_check(num_parallel == num_serial && memcmp(parallel, serial, num_serial) == 0);
+    free(parallel);
+  }
+  free(serial);
+
+  // Only the longest codes of that tree, so that the rounds one thread reads end mid-code
+  size_t num_long = 1u << 20;
+  uint8_t *long_codes = malloc(num_long + 1);
+  for (size_t idx = 0; idx < num_long; idx++)
+  {
+    long_codes[idx] = 'A' + rand() % 3;
+  }
+  long_codes[num_long] = '\0';
+  BitWriter long_compressed = open_memory_bit_writer(num_long);
+  write_compressed(&long_compressed, long_codes, root);
+  flush_bit_writer(&long_compressed);
+  size_t num_decoded = 0;
+  uint8_t *decoded = decode_two_file(&long_compressed, root, num_long, 1, &num_decoded);
+  cu_check(long_compressed.num_bytes > (2u << 20) && num_decoded == num_long);
+  cu_check(memcmp(decoded, long_codes, num_long) == 0);
+  free(decoded);
+  free(long_compressed.buffer);
+  free(long_codes);
+  destroy_huffman_tree(&root);
+  free(compressed.buffer);
+  free(bytes);
+  free(text);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_range_reads()
+{
+  cu_start();
+  // -------------------------------
+  // Text, a fill, noise and runs, so that every kind of block is read from
+  size_t num_text_bytes = 0;
+  uint8_t *text = read_test_file("./tests/bee-movie.txt", &num_text_bytes);
+  num_text_bytes -= num_text_bytes % 4096;
+  size_t num_bytes = 3 * num_text_bytes + 3 * 8192;
+  uint8_t *bytes = malloc(num_bytes);
+  memcpy(bytes, text, num_text_bytes);
+  uint8_t *mixed = bytes + num_text_bytes;
+  memset(mixed, 0, 8192);
+  srand(13);
+  for (size_t idx = 8192; idx < 3 * 8192; idx++)
+  {
+    mixed[idx] = idx < 2 * 8192 ? (uint8_t)rand() : rand() % 16 == 0 ? (uint8_t)(rand() % 4) : 'a';
+  }
+  memcpy(mixed + 3 * 8192, text, num_text_bytes);
+  memcpy(mixed + 3 * 8192 + num_text_bytes, text, num_text_bytes);
+
+  bool matches = true;
+  size_t intervals[] = {0, 1000};
+  for (int interval_idx = 0; interval_idx < 2; interval_idx++)
+  {
+    BlockOptions options = default_block_options();
+    options.index_interval = intervals[interval_idx];
+    BitWriter compressed = compress_to_memory(bytes, num_bytes, &options);
+    matches = matches && decodes_to(&compressed, bytes, num_bytes);
+    matches = matches && compressed_blocks_size(bytes, num_bytes, &options) + 5 == compressed.num_bytes;
+    FILE *container = tmpfile();
+    fwrite(compressed.buffer, 1, compressed.num_bytes, container);
+
+    uint8_t range[5000];
+    for (int trial = 0; trial < 200 && matches; trial++)
+    {
+      uint64_t offset = (uint64_t)rand() % (num_bytes + 100);
+      size_t length = rand() % sizeof(range);
+      size_t expected = offset >= num_bytes ? 0 : num_bytes - offset < length ? num_bytes - offset : length;
+      size_t num_read = huff_read_range(container, offset, length, range);
+      matches = num_read == expected && memcmp(range, bytes + offset, expected) == 0;
+    }
+    matches = matches && huff_read_range(container, 0, 0, range) == 0;
+    matches = matches && huff_read_range(container, num_bytes - 1, 1, range) == 1 && range[0] == bytes[num_bytes - 1];
+    fclose(container);
+    free(compressed.buffer);
+  }
+  cu_check(matches);
+
+  // Files that are not block containers
+  FILE *other = tmpfile();
+  fwrite(text, 1, 100, other);
+  uint8_t range[10];
+  cu_check(huff_read_range(other, 0, sizeof(range), range) == HUFF_ERROR);
+  fclose(other);
+
+  free(bytes);
+  free(text);
+  // -------------------------------
+  cu_end();
+}
+
+// Every offset of `pattern` in `bytes`, overlapping ones included, matches `offsets`
+static bool _finds_all(const uint8_t *bytes, size_t num_bytes, const uint8_t *pattern, size_t pattern_size,
+                       const uint64_t *offsets, size_t num_offsets)
+{
+  size_t num_found = 0;
+  for (size_t idx = 0; idx + pattern_size <= num_bytes; idx++)
+  {
+    if (memcmp(bytes + idx, pattern, pattern_size) == 0)
+    {
+      if (num_found == num_offsets || offsets[num_found] != idx)
+      {
+        return false;
+      }
+      num_found++;
+    }
+  }
+  return num_found == num_offsets;
+}
+
+static int _test_code_search()
+{
+  cu_start();
+  // -------------------------------
+  // Text between a fill, noise and runs, and patterns that straddle the block boundaries
+  size_t num_text_bytes = 0;
+  uint8_t *text = read_test_file("./tests/bee-movie.txt", &num_text_bytes);
+  num_text_bytes -= num_text_bytes % 4096;
+  size_t num_bytes = 2 * num_text_bytes + 3 * 8192;
+  uint8_t *bytes = malloc(num_bytes);
+  memcpy(bytes, text, num_text_bytes);
+  uint8_t *mixed = bytes + num_text_bytes;
+  memset(mixed, 'a', 8192);
+  srand(17);
+  for (size_t idx = 8192; idx < 3 * 8192; idx++)
+  {
+    mixed[idx] = idx < 2 * 8192 ? (uint8_t)rand() : rand() % 16 == 0 ? 'b' : 'a';
+  }
+  memcpy(mixed + 3 * 8192, text, num_text_bytes);
+
+  const uint8_t *patterns[16] = {(const uint8_t *)"Barry", (const uint8_t *)"e", (const uint8_t *)"aab",
+                                 (const uint8_t *)"zebra crossing",
+                                 (const uint8_t *)"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab"};
+  size_t pattern_sizes[16] = {5, 1, 3, 14, 38};
+  int num_patterns = 5;
+  for (size_t boundary = 4096; num_patterns < 16; boundary += 3 * 4096)
+  {
+    patterns[num_patterns] = bytes + boundary - num_patterns;
+    pattern_sizes[num_patterns] = 2 * num_patterns;
+    num_patterns++;
+  }
+
+  bool matches = true;
+  bool skipped = true;
+  BlockOptions options[] = {default_block_options(), default_block_options(), bwt_block_options()};
+  options[1].index_interval = 1000;
+  for (int options_idx = 0; options_idx < 3; options_idx++)
+  {
+    BitWriter compressed = compress_to_memory(bytes, num_bytes, &options[options_idx]);
+    FILE *container = tmpfile();
+    fwrite(compressed.buffer, 1, compressed.num_bytes, container);
+    for (int pattern_idx = 0; pattern_idx < num_patterns; pattern_idx++)
+    {
+      uint64_t *offsets = NULL;
+      size_t num_offsets = 0;
+      SearchStats stats = {0};
+      const char *error = NULL;
+      matches = matches && search_container(container, patterns[pattern_idx], pattern_sizes[pattern_idx], &offsets,
+                                            &num_offsets, &stats, &error);
+      matches = matches && _finds_all(bytes, num_bytes, patterns[pattern_idx], pattern_sizes[pattern_idx], offsets,
+                                      num_offsets);
+      bool ruled_out = stats.num_candidates == 0 && stats.num_skipped_blocks > 0;
+      skipped = skipped && (pattern_idx != 3 || options_idx == 2 || ruled_out);
+      free(offsets);
+    }
+    fclose(container);
+    free(compressed.buffer);
+  }
+  cu_check(matches);
+  cu_check(skipped);
+
+  // The original two-file format, whose codes are one stream
+  Frequencies freq = {0};
+  add_frequencies(freq, text, num_text_bytes);
+  TreeNode *root = make_huffman_tree(freq);
+  BitWriter codes = open_memory_bit_writer(num_text_bytes);
+  HuffEncoder encoder;
+  build_huff_encoder(&encoder, root);
+  write_symbols(&codes, &encoder, text, num_text_bytes);
+  align_bit_writer(&codes);
+  matches = true;
+  for (int pattern_idx = 0; pattern_idx < 4; pattern_idx++)
+  {
+    uint64_t *offsets = NULL;
+    size_t num_offsets = 0;
+    search_huffman_codes(root, codes.buffer, codes.num_bytes, num_text_bytes, patterns[pattern_idx],
+                         pattern_sizes[pattern_idx], &offsets, &num_offsets, NULL);
+    matches = matches && _finds_all(text, num_text_bytes, patterns[pattern_idx], pattern_sizes[pattern_idx], offsets,
+                                    num_offsets);
+    free(offsets);
+  }
+  cu_check(matches);
+  free(codes.buffer);
+  destroy_huffman_tree(&root);
+
+  free(bytes);
+  free(text);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_block_summaries()
+{
+  cu_start();
+  // -------------------------------
+  // Text, a fill and noise, with and without front-ends and an index
+  size_t num_text_bytes = 0;
+  uint8_t *text = read_test_file("./tests/bee-movie.txt", &num_text_bytes);
+  size_t num_bytes = num_text_bytes + 2 * 8192;
+  uint8_t *bytes = malloc(num_bytes);
+  memcpy(bytes, text, num_text_bytes);
+  memset(bytes + num_text_bytes, 0, 8192);
+  srand(19);
+  for (size_t idx = num_text_bytes + 8192; idx < num_bytes; idx++)
+  {
+    bytes[idx] = (uint8_t)rand();
+  }
+
+  bool matches = true;
+  for (int variant = 0; variant < 3; variant++)
+  {
+    BlockOptions options = variant == 2 ? lz_block_options(3, LZ_DEFAULT_WINDOW_LOG) : default_block_options();
+    options.index_interval = variant == 1 ? 1000 : 0;
+    options.summaries = true;
+    BitWriter compressed = compress_to_memory(bytes, num_bytes, &options);
+    matches = matches && decodes_to(&compressed, bytes, num_bytes);
+    matches = matches && compressed_blocks_size(bytes, num_bytes, &options) + 5 == compressed.num_bytes;
+    FILE *container = tmpfile();
+    fwrite(compressed.buffer, 1, compressed.num_bytes, container);
+
+    // Every summary matches its block, and the blocks cover the input
+    BlockSummary *summaries = NULL;
+    size_t num_summaries = 0;
+    const char *error = NULL;
+    matches = matches && read_block_summaries(container, &summaries, &num_summaries, &error);
+    for (size_t idx = 0; matches && idx < num_summaries; idx++)
+    {
+      Frequencies freq = {0};
+      add_frequencies(freq, bytes + summaries[idx].offset, summaries[idx].num_bytes);
+      matches = memcmp(freq, summaries[idx].freq, sizeof(freq)) == 0;
+    }
+    matches = matches && num_summaries > 0 &&
+              summaries[num_summaries - 1].offset + summaries[num_summaries - 1].num_bytes == num_bytes;
+
+    // A range of blocks adds up
+    Frequencies expected = {0};
+    Frequencies freq = {0};
+    if (matches && num_summaries > 1)
+    {
+      add_frequencies(expected, bytes + summaries[1].offset, num_bytes - summaries[1].offset);
+      add_block_summaries(summaries, 1, num_summaries - 1, freq);
+    }
+    matches = matches && memcmp(freq, expected, sizeof(freq)) == 0;
+
+    // The index is still found behind the summaries, and without one, every block starts where its summary says
+    Checkpoint *checkpoints = NULL;
+    size_t num_checkpoints = 0;
+    matches = matches && read_checkpoints(container, &checkpoints, &num_checkpoints, &error);
+    matches = matches && (variant == 1 ? num_checkpoints > num_summaries : num_checkpoints == num_summaries);
+    for (size_t idx = 0; matches && variant != 1 && idx < num_summaries; idx++)
+    {
+      matches = checkpoints[idx].offset == summaries[idx].offset;
+    }
+    free(checkpoints);
+    free(summaries);
+    fclose(container);
+    free(compressed.buffer);
+  }
+  cu_check(matches);
+
+  // Containers written without summaries, and truncated ones
+  BlockOptions options = default_block_options();
+  options.index_interval = 1000;
+  BitWriter compressed = compress_to_memory(text, num_text_bytes, &options);
+  FILE *container = tmpfile();
+  fwrite(compressed.buffer, 1, compressed.num_bytes, container);
+  BlockSummary *summaries = NULL;
+  size_t num_summaries = 0;
+  const char *error = NULL;
+  cu_check(!read_block_summaries(container, &summaries, &num_summaries, &error));
+  cu_check(error != NULL && strcmp(error, "no block summaries") == 0);
+  fclose(container);
+  free(compressed.buffer);
+
+  options.summaries = true;
+  compressed = compress_to_memory(text, num_text_bytes, &options);
+  BitReader reader = open_memory_bit_reader(compressed.buffer + compressed.num_bytes - 8, 8);
+  uint32_t index_size = read_uint32(&reader);
+  size_t summaries_end = compressed.num_bytes - 8 - index_size;
+  memset(compressed.buffer + summaries_end - 8, 0xff, sizeof(uint32_t)); // The size of the summaries
+  container = tmpfile();
+  fwrite(compressed.buffer, 1, compressed.num_bytes, container);
+  error = NULL;
+  cu_check(!read_block_summaries(container, &summaries, &num_summaries, &error));
+  cu_check(error != NULL && summaries == NULL);
+  fclose(container);
+  free(compressed.buffer);
+
+  free(bytes);
+  free(text);
+  // -------------------------------
+  cu_end();
+}
+
+// Read a whole container file back into memory, for decodes_to(...)
+static BitWriter read_container_file(FILE *container)
+{
+  fseek(container, 0, SEEK_END);
+  BitWriter contents = open_memory_bit_writer(ftell(container) + 1);
+  contents.num_bytes = ftell(container);
+  rewind(container);
+  fread(contents.buffer, 1, contents.num_bytes, container);
+  return contents;
+}
+
+// Check every byte, a few ranges and the summaries of a container file against `bytes`
+static bool container_file_holds(FILE *container, const uint8_t *bytes, size_t num_bytes)
+{
+  BitWriter contents = read_container_file(container);
+  bool matches = decodes_to(&contents, bytes, num_bytes);
+  free(contents.buffer);
+
+  Checkpoint *checkpoints = NULL;
+  size_t num_checkpoints = 0;
+  const char *error = NULL;
+  matches = matches && read_checkpoints(container, &checkpoints, &num_checkpoints, &error);
+  uint8_t range[3000];
+  for (int trial = 0; matches && trial < 50; trial++)
+  {
+    uint64_t offset = (uint64_t)rand() % num_bytes;
+    size_t length = num_bytes - offset < sizeof(range) ? num_bytes - offset : sizeof(range);
+    size_t num_read = 0;
+    matches = read_container_range(container, checkpoints, num_checkpoints, offset, length, range, &num_read, &error) &&
+              num_read == length && memcmp(range, bytes + offset, length) == 0;
+  }
+  free(checkpoints);
+
+  BlockSummary *summaries = NULL;
+  size_t num_summaries = 0;
+  matches = matches && read_block_summaries(container, &summaries, &num_summaries, &error);
+  for (size_t idx = 0; matches && idx < num_summaries; idx++)
+  {
+    Frequencies freq = {0};
+    add_frequencies(freq, bytes + summaries[idx].offset, summaries[idx].num_bytes);
+    matches = memcmp(freq, summaries[idx].freq, sizeof(freq)) == 0;
+  }
+  matches = matches && num_summaries > 0 &&
+            summaries[num_summaries - 1].offset + summaries[num_summaries - 1].num_bytes == num_bytes;
+  free(summaries);
+  return matches;
+}
+
+static int _test_append_and_patch()
+{
+  cu_start();
+  // -------------------------------
+  // Text, appended in three parts with different front-ends, so that Huffman blocks repeat their tables
+  size_t num_text_bytes = 0;
+  uint8_t *text = read_test_file("./tests/bee-movie.txt", &num_text_bytes);
+  size_t num_bytes = 3 * num_text_bytes;
+  uint8_t *bytes = malloc(num_bytes);
+  for (int copy = 0; copy < 3; copy++)
+  {
+    memcpy(bytes + copy * num_text_bytes, text, num_text_bytes);
+  }
+  BlockOptions options = default_block_options();
+  options.index_interval = 1000;
+  options.summaries = true;
+  BitWriter compressed = compress_to_memory(bytes, num_text_bytes, &options);
+  FILE *container = tmpfile();
+  fwrite(compressed.buffer, 1, compressed.num_bytes, container);
+  free(compressed.buffer);
+
+  const char *error = NULL;
+  BlockOptions lz_options = lz_block_options(3, LZ_DEFAULT_WINDOW_LOG);
+  cu_check(append_container(container, bytes + num_text_bytes, num_text_bytes / 2, &lz_options, &error));
+  BlockOptions plain_options = default_block_options();
+  cu_check(append_container(container, bytes + num_text_bytes + num_text_bytes / 2,
+                            num_bytes - num_text_bytes - num_text_bytes / 2, &plain_options, &error));
+  cu_check(append_container(container, NULL, 0, &plain_options, &error));
+  srand(23);
+  cu_check(container_file_holds(container, bytes, num_bytes));
+
+  // Patches inside a block, across blocks, at both ends, and with noise that is stored
+  uint64_t offsets[] = {100, 5000, num_text_bytes - 10, num_bytes - 300, 0, 2 * num_text_bytes};
+  size_t sizes[] = {1, 40000, 20, 300, 10, 9000};
+  bool matches = true;
+  for (int patch = 0; patch < 6 && matches; patch++)
+  {
+    uint8_t *new_bytes = malloc(sizes[patch]);
+    for (size_t idx = 0; idx < sizes[patch]; idx++)
+    {
+      new_bytes[idx] = patch == 5 ? (uint8_t)rand() : (uint8_t)('A' + (idx + patch) % 7);
+    }
+    const BlockOptions *a_options = patch % 2 == 0 ? &plain_options : &lz_options;
+    matches = patch_container(container, offsets[patch], new_bytes, sizes[patch], a_options, &error);
+    memcpy(bytes + offsets[patch], new_bytes, sizes[patch]);
+    matches = matches && container_file_holds(container, bytes, num_bytes);
+    free(new_bytes);
+  }
+  cu_check(matches);
+
+  // Ranges past the end, and files that are not block containers
+  uint8_t byte = 0;
+  error = NULL;
+  cu_check(!patch_container(container, num_bytes, &byte, 1, &plain_options, &error));
+  cu_check(error != NULL && strcmp(error, "patch runs past the end") == 0);
+  fclose(container);
+  FILE *other = tmpfile();
+  fwrite(text, 1, 100, other);
+  error = NULL;
+  cu_check(!append_container(other, text, 100, &plain_options, &error) && error != NULL);
+  fclose(other);
+
+  free(bytes);
+  free(text);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_archive_dedup()
+{
+  cu_start();
+  // -------------------------------
+  // Known XXH64 values: empty, short, and one stripe of four lanes and a tail
+  const char *phrase = "Nobody inspects the spammish repetition";
+  cu_check(xxhash64(NULL, 0, 0) == 0xEF46DB3751D8E999ull);
+  cu_check(xxhash64((const uint8_t *)"a", 1, 0) == 0xD24EC4F1A98C6E5Bull);
+  cu_check(xxhash64((const uint8_t *)phrase, strlen(phrase), 0) == 0xFBCEA83C8A378BF1ull);
+
+  // Files sharing chunks: a copy, a copy with a tail, a file repeating one chunk, an empty file
+  size_t num_text_bytes = 0;
+  uint8_t *text = read_test_file("./tests/bee-movie.txt", &num_text_bytes);
+  size_t chunk_size = 4096;
+  size_t num_chunks = num_text_bytes / chunk_size;
+  uint8_t *repeated = malloc(3 * chunk_size + 5);
+  for (int copy = 0; copy < 3; copy++)
+  {
+    memcpy(repeated + copy * chunk_size, text + chunk_size, chunk_size);
+  }
+  memcpy(repeated + 3 * chunk_size, "tail!", 5);
+  const uint8_t *files[] = {text, text, text, repeated, NULL};
+  size_t sizes[] = {num_text_bytes, num_text_bytes, num_chunks * chunk_size, 3 * chunk_size + 5, 0};
+  const char *names[] = {"bee", "copy", "whole chunks", "repeated", "empty"};
+
+  FILE *file = tmpfile();
+  BitWriter writer = {.file = file, .current_byte = 0, .num_bits_left = 8};
+  BlockOptions options = default_block_options();
+  ArchiveWriter archive_writer;
+  open_archive_writer(&archive_writer, &writer, &options, chunk_size);
+  for (int idx = 0; idx < 5; idx++)
+  {
+    add_archive_member(&archive_writer, names[idx], files[idx], sizes[idx]);
+  }
+  // The bee movie's chunks and the tail of the repeated file; nothing else is new
+  uint64_t num_stored = archive_writer.store.num_blocks;
+  cu_check(num_stored == num_chunks + 1 + 1);
+  cu_check(archive_writer.num_referenced_blocks == 2 * (num_chunks + 1) + num_chunks + 4);
+  close_archive_writer(&archive_writer);
+  fflush(file);
+
+  Archive archive;
+  const char *error = NULL;
+  cu_check(read_archive(file, &archive, &error));
+  cu_check(archive.num_blocks == num_stored && archive.num_members == 5);
+  bool matches = true;
+  for (size_t idx = 0; matches && idx < archive.num_members; idx++)
+  {
+    BitWriter output = open_memory_bit_writer(16);
+    matches = strcmp(archive.members[idx].name, names[idx]) == 0 && archive.members[idx].num_bytes == sizes[idx] &&
+              extract_archive_member(file, &archive, idx, &output, &error) && output.num_bytes == sizes[idx] &&
+              (sizes[idx] == 0 || memcmp(output.buffer, files[idx], sizes[idx]) == 0);
+    free(output.buffer);
+  }
+  cu_check(matches);
+  // The repeated file points at one block three times
+  cu_check(archive.members[3].num_blocks == 4 && archive.members[3].blocks[0] == archive.members[3].blocks[2]);
+  destroy_archive(&archive);
+  fclose(file);
+
+  // A block container is not an archive
+  BitWriter compressed = compress_to_memory(text, num_text_bytes, &options);
+  file = tmpfile();
+  fwrite(compressed.buffer, 1, compressed.num_bytes, file);
+  error = NULL;
+  cu_check(!read_archive(file, &archive, &error) && error != NULL);
+  fclose(file);
+  free(compressed.buffer);
+
+  free(repeated);
+  free(text);
+  // -------------------------------
+  cu_end();
+}
+
+// Write an archive of `num_files` files to a tmpfile, with a shared table if `freq` is not NULL
+static FILE *write_test_archive(const uint8_t **files, const size_t *sizes, int num_files, const Frequencies freq,
+                                uint64_t *a_num_block_bytes)
+{
+  FILE *file = tmpfile();
+  BitWriter writer = {.file = file, .current_byte = 0, .num_bits_left = 8};
+  BlockOptions options = default_block_options();
+  ArchiveWriter archive_writer;
+  open_archive_writer(&archive_writer, &writer, &options, DEFAULT_ARCHIVE_CHUNK_SIZE);
+  if (freq != NULL)
+  {
+    share_archive_table(&archive_writer, freq);
+  }
+  for (int idx = 0; idx < num_files; idx++)
+  {
+    char name[16];
+    snprintf(name, sizeof(name), "file%d", idx);
+    add_archive_member(&archive_writer, name, files[idx], sizes[idx]);
+  }
+  *a_num_block_bytes = archive_writer.num_block_bytes;
+  close_archive_writer(&archive_writer);
+  fflush(file);
+  return file;
+}
+
+static int _test_archive_shared_table()
+{
+  cu_start();
+  // -------------------------------
+  // Many small pieces of text, and one file with bytes the shared table has no codes for
+  size_t num_text_bytes = 0;
+  uint8_t *text = read_test_file("./tests/bee-movie.txt", &num_text_bytes);
+  enum { NUM_FILES = 200 };
+  const uint8_t *files[NUM_FILES + 1];
+  size_t sizes[NUM_FILES + 1];
+  Frequencies freq = {0};
+  srand(48);
+  for (int idx = 0; idx < NUM_FILES; idx++)
+  {
+    sizes[idx] = 40 + (size_t)rand() % 400;
+    files[idx] = text + (size_t)rand() % (num_text_bytes - sizes[idx]);
+    add_frequencies(freq, files[idx], sizes[idx]);
+  }
+  uint8_t odd[300];
+  for (size_t idx = 0; idx < sizeof(odd); idx++)
+  {
+    odd[idx] = idx % 3 == 0 ? (uint8_t)(0x80 + idx % 5) : text[idx];
+  }
+  files[NUM_FILES] = odd;
+  sizes[NUM_FILES] = sizeof(odd);
+
+  uint64_t num_own_bytes = 0;
+  uint64_t num_shared_bytes = 0;
+  FILE *own = write_test_archive(files, sizes, NUM_FILES + 1, NULL, &num_own_bytes);
+  FILE *shared = write_test_archive(files, sizes, NUM_FILES + 1, freq, &num_shared_bytes);
+  // A table is a large part of a small file's block
+  cu_check(num_shared_bytes < num_own_bytes * 7 / 8);
+
+  Archive archive;
+  const char *error = NULL;
+  cu_check(read_archive(own, &archive, &error) && archive.table_root == NULL);
+  destroy_archive(&archive);
+  cu_check(read_archive(shared, &archive, &error) && archive.table_root != NULL);
+  bool matches = archive.num_members == NUM_FILES + 1;
+  size_t num_repeats = 0;
+  for (size_t idx = 0; matches && idx < archive.num_members; idx++)
+  {
+    BitWriter output = open_memory_bit_writer(16);
+    matches = extract_archive_member(shared, &archive, idx, &output, &error) && output.num_bytes == sizes[idx] &&
+              memcmp(output.buffer, files[idx], sizes[idx]) == 0;
+    free(output.buffer);
+    BlockType type;
+    uint32_t num_bytes;
+    uint32_t num_payload_bytes;
+    matches = matches && read_block_header(shared, archive.block_offsets[archive.members[idx].blocks[0]], &type,
+                                           &num_bytes, &num_payload_bytes);
+    num_repeats += type == BLOCK_HUFFMAN_REPEAT;
+  }
+  cu_check(matches);
+  cu_check(num_repeats >= NUM_FILES * 9 / 10);
+  destroy_archive(&archive);
+  fclose(own);
+  fclose(shared);
+
+  free(text);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_tree_cache()
+{
+  cu_start();
+  // -------------------------------
+  // Pieces of text coded twice: the second time every table comes from the cache
+  size_t num_text_bytes = 0;
+  uint8_t *text = read_test_file("./tests/bee-movie.txt", &num_text_bytes);
+  TreeCache cache;
+  init_tree_cache(&cache, DEFAULT_TREE_CACHE_TOLERANCE);
+  BlockOptions options = default_block_options();
+  options.tree_cache = &cache;
+  size_t piece_size = 3000;
+  size_t num_pieces = 20;
+  bool matches = true;
+  for (int pass = 0; pass < 2; pass++)
+  {
+    for (size_t piece = 0; matches && piece < num_pieces; piece++)
+    {
+      BitWriter compressed = compress_to_memory(text + piece * piece_size, piece_size, &options);
+      matches = decodes_to(&compressed, text + piece * piece_size, piece_size);
+      free(compressed.buffer);
+    }
+    cu_check(matches);
+  }
+  cu_check(cache.stats.num_hits + cache.stats.num_misses + cache.stats.num_rejected == 2 * num_pieces);
+  cu_check(cache.stats.num_hits >= num_pieces && cache.num_tables > 0);
+
+  // A cached table moves the codes after it, which checkpoints must follow
+  options.index_interval = 500;
+  options.summaries = true;
+  BitWriter compressed = compress_to_memory(text, num_text_bytes, &options);
+  FILE *container = tmpfile();
+  fwrite(compressed.buffer, 1, compressed.num_bytes, container);
+  free(compressed.buffer);
+  srand(49);
+  cu_check(container_file_holds(container, text, num_text_bytes));
+  fclose(container);
+
+  // Read back from a file, tables are decoded when first looked up
+  BitWriter file_writer = open_memory_bit_writer(64);
+  write_tree_cache(&file_writer, &cache);
+  FILE *file = tmpfile();
+  fwrite(file_writer.buffer, 1, file_writer.num_bytes, file);
+  fflush(file);
+  TreeCache loaded;
+  init_tree_cache(&loaded, DEFAULT_TREE_CACHE_TOLERANCE);
+  const char *error = NULL;
+  cu_check(read_tree_cache(file, &loaded, &error) && loaded.num_tables == cache.num_tables);
+  size_t num_decoded = 0;
+  for (size_t idx = 0; idx < loaded.num_tables; idx++)
+  {
+    num_decoded += loaded.tables[idx].encoder != NULL;
+  }
+  cu_check(num_decoded == 0);
+  options = default_block_options();
+  options.tree_cache = &loaded;
+  compressed = compress_to_memory(text + piece_size, piece_size, &options);
+  cu_check(decodes_to(&compressed, text + piece_size, piece_size) && loaded.stats.num_hits == 1);
+  free(compressed.buffer);
+  destroy_tree_cache(&loaded);
+  fclose(file);
+
+  // A table that does not decode is rejected rather than written; a file that is not a cache is refused
+  memset(file_writer.buffer + 2 * sizeof(uint32_t) + 2 * sizeof(uint32_t) + 2, 0xff, 8);
+  file = tmpfile();
+  fwrite(file_writer.buffer, 1, file_writer.num_bytes, file);
+  fflush(file);
+  init_tree_cache(&loaded, DEFAULT_TREE_CACHE_TOLERANCE);
+  cu_check(read_tree_cache(file, &loaded, &error));
+  matches = true;
+  for (size_t piece = 0; matches && piece < num_pieces; piece++)
+  {
+    compressed = compress_to_memory(text + piece * piece_size, piece_size, &options);
+    matches = decodes_to(&compressed, text + piece * piece_size, piece_size);
+    free(compressed.buffer);
+  }
+  cu_check(matches);
+  destroy_tree_cache(&loaded);
+  fclose(file);
+  free(file_writer.buffer);
+  file = tmpfile();
+  fwrite(text, 1, 100, file);
+  init_tree_cache(&loaded, DEFAULT_TREE_CACHE_TOLERANCE);
+  error = NULL;
+  cu_check(!read_tree_cache(file, &loaded, &error) && error != NULL);
+  destroy_tree_cache(&loaded);
+  fclose(file);
+
+  destroy_tree_cache(&cache);
+  free(text);
+  // -------------------------------
+  cu_end();
+}
+
+int main()
+{
+  cu_start_tests();
+  cu_run(_test_blocks_empty);
+  cu_run(_test_blocks_binary);
+  cu_run(_test_blocks_single_symbol);
+  cu_run(_test_blocks_corpus);
+  cu_run(_test_blocks_split_on_drift);
+  cu_run(_test_blocks_repeat_table);
+  cu_run(_test_blocks_store_incompressible);
+  cu_run(_test_blocks_store_mixed);
+  cu_run(_test_rle_long_runs);
+  cu_run(_test_blocks_sparse_runs);
+  cu_run(_test_lz77_corpus);
+  cu_run(_test_lz77_window);
+  cu_run(_test_lz77_corrupt);
+  cu_run(_test_bwt_round_trip);
+  cu_run(_test_bwt_blocks);
+  cu_run(_test_bwt_parallel_blocks);
+  cu_run(_test_huff_decoder_long_codes);
+  cu_run(_test_order1_corpus);
+  cu_run(_test_order1_clusters);
+  cu_run(_test_words_corpus);
+  cu_run(_test_words_many_tokens);
+  cu_run(_test_tans_skewed);
+  cu_run(_test_tans_payload);
+  cu_run(_test_column_records);
+  cu_run(_test_column_payload);
+  cu_run(_test_dictionary_frames);
+  cu_run(_test_varints);
+  cu_run(_test_message_codec);
+  cu_run(_test_huff_buffers);
+  cu_run(_test_exact_sizes);
+  cu_run(_test_exact_sizes_with_tree_cache);
+  cu_run(_test_two_file_sizes);
+  cu_run(_test_parallel_encoder);
+  cu_run(_test_parallel_decoder);
+  cu_run(_test_range_reads);
+  cu_run(_test_code_search);
+  cu_run(_test_block_summaries);
+  cu_run(_test_append_and_patch);
+  cu_run(_test_archive_dedup);
+  cu_run(_test_archive_shared_table);
+  cu_run(_test_tree_cache);
+  cu_end_tests();
+  return EXIT_SUCCESS;
+}
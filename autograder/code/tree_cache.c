@@ -0,0 +1,342 @@
+#include "tree_cache.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// A table of 256 leaves takes 10 bits per leaf (see coding_table_bits(...))
+#define MAX_TABLE_BITS (10 * 256)
+
+static uint64_t _fingerprint(const Frequencies freq)
+{
+  uint64_t total = 0;
+  for (int ch = 0; ch < 256; ch++)
+  {
+    total += freq[ch];
+  }
+  uint8_t shape[256];
+  for (int ch = 0; ch < 256; ch++)
+  {
+    int code_bits = freq[ch] > 0 ? 64 - __builtin_clzll(total / freq[ch]) : 0;
+    shape[ch] = code_bits <= TREE_CACHE_RARE_BITS ? (uint8_t)((code_bits + 1) / 2) : 0;
+  }
+  return xxhash64(shape, sizeof(shape), 0);
+}
+
+void init_tree_cache(TreeCache *a_cache, double tolerance)
+{
+  *a_cache = (TreeCache){.tables = NULL,
+                         .num_tables = 0,
+                         .tables_capacity = 0,
+                         .slots = calloc(256, sizeof(size_t)),
+                         .num_slots = 256,
+                         .tolerance = tolerance,
+                         .stats = {0},
+                         .mapping = NULL,
+                         .mapping_size = 0,
+                         .base = NULL,
+                         .num_shadowed = 0};
+}
+
+void overlay_tree_cache(TreeCache *a_overlay, TreeCache *base)
+{
+  init_tree_cache(a_overlay, base->tolerance);
+  a_overlay->base = base;
+}
+
+// The slot of the table with this fingerprint, or the empty slot where it belongs
+static size_t *_find_slot(const TreeCache *a_cache, uint64_t fingerprint)
+{
+  size_t mask = a_cache->num_slots - 1;
+  size_t idx = fingerprint & mask;
+  while (a_cache->slots[idx] != 0 && a_cache->tables[a_cache->slots[idx] - 1].fingerprint != fingerprint)
+  {
+    idx = (idx + 1) & mask;
+  }
+  return &a_cache->slots[idx];
+}
+
+// The table with this fingerprint in the cache, or else in the caches it overlays, or NULL
+static CachedTable *_table_for(TreeCache *a_cache, uint64_t fingerprint)
+{
+  size_t slot = *_find_slot(a_cache, fingerprint);
+  if (slot != 0)
+  {
+    return &a_cache->tables[slot - 1];
+  }
+  return a_cache->base != NULL ? _table_for(a_cache->base, fingerprint) : NULL;
+}
+
+// The tables the cache would hold if its overlaid tables had been added to the caches below it
+static size_t _num_tables_through(const TreeCache *a_cache)
+{
+  size_t num_tables = a_cache->num_tables - a_cache->num_shadowed;
+  return a_cache->base != NULL ? num_tables + _num_tables_through(a_cache->base) : num_tables;
+}
+
+// Make room for this many tables at once, so that loading a file does not grow the cache step by step
+static void _reserve_tables(TreeCache *a_cache, size_t num_tables)
+{
+  if (num_tables > a_cache->tables_capacity)
+  {
+    a_cache->tables_capacity = num_tables;
+    a_cache->tables = realloc(a_cache->tables, a_cache->tables_capacity * sizeof(CachedTable));
+  }
+  size_t num_slots = a_cache->num_slots;
+  while (num_slots <= 2 * num_tables)
+  {
+    num_slots *= 2;
+  }
+  if (num_slots > a_cache->num_slots)
+  {
+    free(a_cache->slots);
+    a_cache->num_slots = num_slots;
+    a_cache->slots = calloc(a_cache->num_slots, sizeof(size_t));
+    for (size_t idx = 0; idx < a_cache->num_tables; idx++)
+    {
+      *_find_slot(a_cache, a_cache->tables[idx].fingerprint) = idx + 1;
+    }
+  }
+}
+
+/*
+ * The table to fill for this fingerprint: the one it has, its bits freed, or
+ * a new one, or NULL once the cache is full. The slots double before they
+ * are half full, so probes stay short.
+ */
+static CachedTable *_table_to_fill(TreeCache *a_cache, uint64_t fingerprint)
+{
+  size_t *slot = _find_slot(a_cache, fingerprint);
+  if (*slot != 0)
+  {
+    CachedTable *table = &a_cache->tables[*slot - 1];
+    if (table->owns_table)
+    {
+      free((uint8_t *)table->table);
+    }
+    free(table->encoder);
+    table->encoder = NULL;
+    return table;
+  }
+  bool shadows = a_cache->base != NULL && _table_for(a_cache->base, fingerprint) != NULL;
+  if (!shadows && _num_tables_through(a_cache) >= TREE_CACHE_MAX_TABLES)
+  {
+    return NULL;
+  }
+  a_cache->num_shadowed += shadows;
+  if (a_cache->num_tables == a_cache->tables_capacity)
+  {
+    a_cache->tables_capacity = a_cache->tables_capacity * 2 + 16;
+    a_cache->tables = realloc(a_cache->tables, a_cache->tables_capacity * sizeof(CachedTable));
+  }
+  CachedTable *table = &a_cache->tables[a_cache->num_tables++];
+  table->fingerprint = fingerprint;
+  table->encoder = NULL;
+  *slot = a_cache->num_tables;
+
+  _reserve_tables(a_cache, a_cache->num_tables);
+  return table;
+}
+
+// Decode a table mapped from a cache file, which must read back as a tree of two leaves or more, taking all its bits
+static bool _decode_table(CachedTable *a_table)
+{
+  BitReader reader = open_memory_bit_reader(a_table->table, (a_table->num_table_bits + 7) / 8);
+  TreeNode *root = read_coding_table(&reader);
+  bool ok = root != NULL && root->left != NULL &&
+            8 * reader.byte_idx - (reader.current_bit + 1) == a_table->num_table_bits;
+  if (ok)
+  {
+    a_table->encoder = malloc(sizeof(HuffEncoder));
+    build_huff_encoder(a_table->encoder, root);
+  }
+  destroy_huffman_tree(&root);
+  return ok;
+}
+
+const CachedTable *find_cached_table(TreeCache *a_cache, const Frequencies freq, uint64_t *a_num_bits)
+{
+  CachedTable *table = _table_for(a_cache, _fingerprint(freq));
+  if (table == NULL)
+  {
+    a_cache->stats.num_misses++;
+    return NULL;
+  }
+  if (table->encoder == NULL && !_decode_table(table))
+  {
+    a_cache->stats.num_rejected++;
+    return NULL;
+  }
+  for (int ch = 0; ch < 256; ch++)
+  {
+    if (freq[ch] > 0 && table->encoder->codes[ch].length == 0)
+    {
+      a_cache->stats.num_rejected++;
+      return NULL;
+    }
+  }
+  uint64_t num_bits = coded_bits(freq, table->encoder) + table->num_table_bits;
+  if (num_bits > (entropy_bits(freq) + coding_table_bits(freq)) * (1 + a_cache->tolerance))
+  {
+    a_cache->stats.num_rejected++;
+    return NULL;
+  }
+  a_cache->stats.num_hits++;
+  *a_num_bits = num_bits;
+  return table;
+}
+
+void add_cached_table(TreeCache *a_cache, const Frequencies freq, TreeNode *root)
+{
+  CachedTable *table = _table_to_fill(a_cache, _fingerprint(freq));
+  if (table == NULL)
+  {
+    return;
+  }
+  table->encoder = malloc(sizeof(HuffEncoder));
+  build_huff_encoder(table->encoder, root);
+  BitWriter writer = open_memory_bit_writer(MAX_TABLE_BITS / 8 + 1);
+  write_coding_table(root, &writer);
+  write_bits(&writer, 0, 1);
+  table->num_table_bits = (uint32_t)(8 * writer.num_bytes + 8 - writer.num_bits_left);
+  align_bit_writer(&writer);
+  table->table = writer.buffer;
+  table->owns_table = true;
+  a_cache->stats.num_added++;
+}
+
+void write_cached_table(BitWriter *a_writer, const CachedTable *a_table)
+{
+  uint32_t num_full_bytes = a_table->num_table_bits / 8;
+  for (uint32_t idx = 0; idx < num_full_bytes; idx++)
+  {
+    write_bits(a_writer, a_table->table[idx], 8);
+  }
+  uint8_t num_last_bits = a_table->num_table_bits % 8;
+  if (num_last_bits > 0)
+  {
+    write_bits(a_writer, a_table->table[num_full_bytes] >> (8 - num_last_bits), num_last_bits);
+  }
+}
+
+bool read_tree_cache(FILE *file, TreeCache *a_cache, const char **a_error)
+{
+  long size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+  void *mapping = size > 0 ? mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fileno(file), 0) : MAP_FAILED;
+  if (mapping == MAP_FAILED)
+  {
+    *a_error = "not a tree cache";
+    return false;
+  }
+  a_cache->mapping = mapping;
+  a_cache->mapping_size = (size_t)size;
+
+  // Only where each table is gets read here; see _decode_table(...)
+  BitReader reader = open_memory_bit_reader(mapping, (size_t)size);
+  if (read_uint32(&reader) != TREE_CACHE_MAGIC)
+  {
+    *a_error = "not a tree cache";
+    return false;
+  }
+  uint32_t num_tables = read_uint32(&reader);
+  bool ok = is_bit_reader_open(&reader);
+  // A table takes 10 bytes or more, so a count the file cannot hold reserves no more than it could
+  size_t max_tables = (size_t)size / 10 < TREE_CACHE_MAX_TABLES ? (size_t)size / 10 : TREE_CACHE_MAX_TABLES;
+  _reserve_tables(a_cache, num_tables < max_tables ? num_tables : max_tables);
+  for (uint32_t idx = 0; ok && idx < num_tables; idx++)
+  {
+    uint64_t fingerprint = read_uint32(&reader);
+    fingerprint |= (uint64_t)read_uint32(&reader) << 32;
+    uint64_t num_table_bits = read_varint(&reader);
+    size_t num_table_bytes = (num_table_bits + 7) / 8;
+    ok = is_bit_reader_open(&reader) && num_table_bits > 0 && num_table_bits <= MAX_TABLE_BITS &&
+         num_table_bytes <= reader.num_bytes - reader.byte_idx;
+    CachedTable *table = ok ? _table_to_fill(a_cache, fingerprint) : NULL;
+    if (table != NULL)
+    {
+      table->owns_table = false;
+      table->table = reader.buffer + reader.byte_idx;
+      table->num_table_bits = (uint32_t)num_table_bits;
+    }
+    reader.byte_idx += ok ? num_table_bytes : 0;
+  }
+  if (!ok)
+  {
+    *a_error = "corrupt tree cache";
+  }
+  return ok;
+}
+
+void write_tree_cache(BitWriter *a_writer, const TreeCache *a_cache)
+{
+  write_uint32(a_writer, TREE_CACHE_MAGIC);
+  write_uint32(a_writer, (uint32_t)a_cache->num_tables);
+  for (size_t idx = 0; idx < a_cache->num_tables; idx++)
+  {
+    const CachedTable *table = &a_cache->tables[idx];
+    write_uint32(a_writer, (uint32_t)table->fingerprint);
+    write_uint32(a_writer, (uint32_t)(table->fingerprint >> 32));
+    write_varint(a_writer, table->num_table_bits);
+    write_bytes(a_writer, table->table, (table->num_table_bits + 7) / 8);
+  }
+}
+
+bool load_tree_cache(const char *path, TreeCache *a_cache, double tolerance, const char **a_error)
+{
+  init_tree_cache(a_cache, tolerance);
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+  {
+    *a_error = strerror(errno);
+    return errno == ENOENT;
+  }
+  bool ok = read_tree_cache(file, a_cache, a_error);
+  fclose(file);
+  return ok;
+}
+
+bool save_tree_cache(const char *path, const TreeCache *a_cache, const char **a_error)
+{
+  if (a_cache->stats.num_added == 0)
+  {
+    return true;
+  }
+  char *temp_path = malloc(strlen(path) + 32);
+  sprintf(temp_path, "%s.%ld.tmp", path, (long)getpid());
+  BitWriter writer = open_bit_writer(temp_path);
+  bool ok = writer.file != NULL;
+  if (ok)
+  {
+    write_tree_cache(&writer, a_cache);
+    ok = fclose(writer.file) == 0 && rename(temp_path, path) == 0; // The file ends aligned, so no flush
+  }
+  if (!ok)
+  {
+    *a_error = strerror(errno);
+    remove(temp_path);
+  }
+  free(temp_path);
+  return ok;
+}
+
+void destroy_tree_cache(TreeCache *a_cache)
+{
+  for (size_t idx = 0; idx < a_cache->num_tables; idx++)
+  {
+    if (a_cache->tables[idx].owns_table)
+    {
+      free((uint8_t *)a_cache->tables[idx].table);
+    }
+    free(a_cache->tables[idx].encoder);
+  }
+  free(a_cache->tables);
+  free(a_cache->slots);
+  if (a_cache->mapping != NULL)
+  {
+    munmap(a_cache->mapping, a_cache->mapping_size);
+  }
+  *a_cache = (TreeCache){.tables = NULL, .slots = NULL, .mapping = NULL, .base = NULL};
+}
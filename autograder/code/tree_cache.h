@@ -0,0 +1,187 @@
+#ifndef TREE_CACHE_H
+#define TREE_CACHE_H
+
+#include "bit_tools.h"
+#include "huffman.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Coding tables kept from earlier blocks, so that a block whose histogram is
+ * shaped like one seen before reuses that table instead of building a tree
+ * and writing it out again. Tables are found by a fingerprint of the
+ * quantized histogram: for each byte value, about the length of its ideal
+ * code, floor(log2(total / count)) + 1, rounded up to an even number of bits,
+ * or 0 if that is over TREE_CACHE_RARE_BITS or the byte does not occur, so
+ * that a few stray bytes do not set otherwise alike blocks apart. Blocks with
+ * one fingerprint get similar trees, but not always the best one, so a
+ * cached table is used only if it has a code for every byte of the block and
+ * costs, codes and table together, within `tolerance` of the entropy plus a
+ * table of the block's own. It is written exactly as the block's own table
+ * would be, so decoders cannot tell the difference.
+ *
+ * A cache file is this magic word ("HUFT" in little-endian order) and the
+ * number of tables, both as uint32, then for each table its fingerprint as
+ * uint64, its size in bits as a varint, and its bits, padded to a byte. The
+ * file is mapped rather than read, and a table is decoded only when a block
+ * first looks it up, so that a process coding one small file pays for the
+ * tables it uses rather than for the whole cache.
+ */
+#define TREE_CACHE_MAGIC 0x54465548u
+
+// How much more than the entropy and an own table a cached table may cost, as a fraction
+#define DEFAULT_TREE_CACHE_TOLERANCE 0.02
+
+// Bytes whose ideal codes are longer than this are left out of fingerprints
+#define TREE_CACHE_RARE_BITS 8
+
+// The most tables a cache holds; later ones are not added
+#define TREE_CACHE_MAX_TABLES (1u << 16)
+
+/**
+ * A table in a cache.
+ */
+typedef struct _CachedTable
+{
+  uint64_t fingerprint;
+  HuffEncoder *encoder;    // NULL until the table is decoded
+  bool owns_table;         // Whether table was malloc'd rather than mapped from a cache file
+  const uint8_t *table;    // The table as write_coding_table(...) writes it, and its terminating 0 bit
+  uint32_t num_table_bits; // Bits of table
+} CachedTable;
+
+/**
+ * How often blocks found a table to reuse.
+ */
+typedef struct _TreeCacheStats
+{
+  uint64_t num_hits;     // Lookups that found a table good enough for the block
+  uint64_t num_misses;   // Lookups that found no table with the block's fingerprint
+  uint64_t num_rejected; // Lookups that found one, but it lacked a code the block needs or cost too much
+  uint64_t num_added;    // Tables added or replaced
+} TreeCacheStats;
+
+typedef struct _TreeCache
+{
+  CachedTable *tables;
+  size_t num_tables;
+  size_t tables_capacity;
+  size_t *slots; // Open addressing by fingerprint: 1 + the index of a table, or 0 for an empty slot
+  size_t num_slots;
+  double tolerance;
+  TreeCacheStats stats;
+  void *mapping; // The cache file read_tree_cache(...) mapped, or NULL
+  size_t mapping_size;
+  struct _TreeCache *base; // The cache this one overlays (see overlay_tree_cache(...)), or NULL
+  size_t num_shadowed;     // Tables here whose fingerprint base has too
+} TreeCache;
+
+/**
+ * @brief Set up an empty cache.
+ *
+ * @param a_cache the TreeCache to set up
+ * @param tolerance how much more than the entropy and an own table a cached
+ * table may cost, as a fraction (see DEFAULT_TREE_CACHE_TOLERANCE)
+ */
+void init_tree_cache(TreeCache *a_cache, double tolerance);
+
+/**
+ * @brief Set up an empty cache over `base`, for finding what coding with
+ * `base` would do without changing it. Lookups find the tables added to the
+ * overlay first, then those of `base`, as if they had been added to it; only
+ * the overlay counts them, and it stops adding where `base` would be full.
+ * `base` may still decode its tables (see read_tree_cache(...)).
+ *
+ * @param a_overlay the TreeCache to set up; destroy it before `base`
+ * @param base the cache to look in
+ */
+void overlay_tree_cache(TreeCache *a_overlay, TreeCache *base);
+
+/**
+ * @brief Find a table good enough for a block with histogram `freq`.
+ *
+ * @param a_cache the cache to look in; its stats count the lookup
+ * @param freq the histogram of the block, with at least two distinct bytes
+ * @param a_num_bits where to store the bits of the table and the block's codes
+ * @return const CachedTable* the table, valid until the next table is added,
+ * or NULL
+ */
+const CachedTable *find_cached_table(TreeCache *a_cache, const Frequencies freq, uint64_t *a_num_bits);
+
+/**
+ * @brief Add the table of the tree `root`, built for a block with histogram
+ * `freq`, replacing one with the same fingerprint.
+ *
+ * @param a_cache the cache to add to
+ * @param freq the histogram the tree was built for
+ * @param root the tree
+ */
+void add_cached_table(TreeCache *a_cache, const Frequencies freq, TreeNode *root);
+
+/**
+ * @brief Write a cached table to a block, as write_coding_table(...) and the
+ * terminating 0 bit would.
+ *
+ * @param a_writer the BitWriter to write to
+ * @param a_table the table from find_cached_table(...)
+ */
+void write_cached_table(BitWriter *a_writer, const CachedTable *a_table);
+
+/**
+ * @brief Add the tables of a cache file to an empty cache, mapping the file
+ * until the cache is destroyed. A table that does not decode is found to be
+ * corrupt only when it is looked up, and then counts as rejected.
+ *
+ * @param file the cache file, opened for reading
+ * @param a_cache the empty cache to add to
+ * @param a_error a pointer to a string that will be set to an error message
+ * @return bool false if the file is not a cache file or is malformed
+ */
+bool read_tree_cache(FILE *file, TreeCache *a_cache, const char **a_error);
+
+/**
+ * @brief Write the tables of a cache as a cache file. The file the cache was
+ * read from is still mapped, so write elsewhere (see save_tree_cache(...)).
+ *
+ * @param a_writer the byte-aligned BitWriter to write to
+ * @param a_cache the cache to write
+ */
+void write_tree_cache(BitWriter *a_writer, const TreeCache *a_cache);
+
+/**
+ * @brief Set up a cache from the cache file at `path`, or an empty one if
+ * there is no such file yet. Destroy it with destroy_tree_cache(...) even if
+ * this fails.
+ *
+ * @param path the path of the cache file
+ * @param a_cache the TreeCache to set up
+ * @param tolerance as for init_tree_cache(...)
+ * @param a_error a pointer to a string that will be set to an error message
+ * @return bool false if the file cannot be read or is not a cache file
+ */
+bool load_tree_cache(const char *path, TreeCache *a_cache, double tolerance, const char **a_error);
+
+/**
+ * @brief Write a cache back to the cache file at `path` if tables were added
+ * to it. The file is written beside `path` and renamed over it, since the
+ * cache may still map the old one, and so that runs sharing the file never
+ * read half of it.
+ *
+ * @param path the path of the cache file
+ * @param a_cache the cache to write
+ * @param a_error a pointer to a string that will be set to an error message
+ * @return bool false if the file cannot be written
+ */
+bool save_tree_cache(const char *path, const TreeCache *a_cache, const char **a_error);
+
+/**
+ * @brief Free the tables of a cache, and unmap its file.
+ *
+ * @param a_cache the cache to free
+ */
+void destroy_tree_cache(TreeCache *a_cache);
+
+#endif // TREE_CACHE_H
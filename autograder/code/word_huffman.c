@@ -0,0 +1,263 @@
+#include "word_huffman.h"
+#include "canonical_huffman.h"
+#include "huffman.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Longer runs are split, so that e.g. a long stretch of spaces repeats as a few tokens
+#define MAX_TOKEN_LENGTH 255
+
+// Letters, digits, and the bytes of non-ASCII UTF-8 characters
+static bool _is_word_byte(uint8_t byte)
+{
+  return (byte >= 'a' && byte <= 'z') || (byte >= 'A' && byte <= 'Z') || (byte >= '0' && byte <= '9') || byte >= 0x80;
+}
+
+static size_t _token_length(const uint8_t *bytes, size_t num_bytes)
+{
+  bool is_word = _is_word_byte(bytes[0]);
+  size_t length = 1;
+  while (length < num_bytes && length < MAX_TOKEN_LENGTH && _is_word_byte(bytes[length]) == is_word)
+  {
+    length++;
+  }
+  return length;
+}
+
+/*
+ * The distinct tokens of a block, found through an open-addressing hash
+ * table whose slots hold token numbers plus one (0 for an empty slot).
+ */
+typedef struct _Dictionary
+{
+  const uint8_t *bytes;
+  uint32_t *slots;
+  size_t num_slots; // A power of two, kept at least twice num_tokens
+  uint32_t *starts; // Where each token first occurs in `bytes`
+  uint8_t *lengths;
+  uint64_t *counts;
+  size_t num_tokens;
+  size_t capacity;
+} Dictionary;
+
+static uint64_t _hash(const uint8_t *bytes, size_t length)
+{
+  uint64_t hash = 14695981039346656037u; // FNV-1a
+  for (size_t idx = 0; idx < length; idx++)
+  {
+    hash = (hash ^ bytes[idx]) * 1099511628211u;
+  }
+  return hash;
+}
+
+static size_t _find_slot(const Dictionary *a_dict, const uint8_t *token, size_t length)
+{
+  size_t slot = _hash(token, length) & (a_dict->num_slots - 1);
+  while (a_dict->slots[slot] != 0)
+  {
+    uint32_t id = a_dict->slots[slot] - 1;
+    if (a_dict->lengths[id] == length && memcmp(a_dict->bytes + a_dict->starts[id], token, length) == 0)
+    {
+      break;
+    }
+    slot = (slot + 1) & (a_dict->num_slots - 1);
+  }
+  return slot;
+}
+
+static void _grow(Dictionary *a_dict)
+{
+  a_dict->capacity *= 2;
+  a_dict->starts = realloc(a_dict->starts, a_dict->capacity * sizeof(uint32_t));
+  a_dict->lengths = realloc(a_dict->lengths, a_dict->capacity);
+  a_dict->counts = realloc(a_dict->counts, a_dict->capacity * sizeof(uint64_t));
+
+  free(a_dict->slots);
+  a_dict->num_slots = 2 * a_dict->capacity;
+  a_dict->slots = calloc(a_dict->num_slots, sizeof(uint32_t));
+  for (size_t id = 0; id < a_dict->num_tokens; id++)
+  {
+    a_dict->slots[_find_slot(a_dict, a_dict->bytes + a_dict->starts[id], a_dict->lengths[id])] = (uint32_t)id + 1;
+  }
+}
+
+static uint32_t _intern(Dictionary *a_dict, size_t start, size_t length)
+{
+  size_t slot = _find_slot(a_dict, a_dict->bytes + start, length);
+  if (a_dict->slots[slot] == 0)
+  {
+    if (a_dict->num_tokens == a_dict->capacity)
+    {
+      _grow(a_dict);
+      slot = _find_slot(a_dict, a_dict->bytes + start, length);
+    }
+    uint32_t id = (uint32_t)a_dict->num_tokens++;
+    a_dict->starts[id] = (uint32_t)start;
+    a_dict->lengths[id] = (uint8_t)length;
+    a_dict->counts[id] = 0;
+    a_dict->slots[slot] = id + 1;
+  }
+  uint32_t id = a_dict->slots[slot] - 1;
+  a_dict->counts[id]++;
+  return id;
+}
+
+void words_write_payload(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes)
+{
+  size_t capacity = 1024;
+  Dictionary dict = {.bytes = bytes,
+                     .slots = calloc(2 * capacity, sizeof(uint32_t)),
+                     .num_slots = 2 * capacity,
+                     .starts = malloc(capacity * sizeof(uint32_t)),
+                     .lengths = malloc(capacity),
+                     .counts = calloc(capacity, sizeof(uint64_t)),
+                     .num_tokens = 0,
+                     .capacity = capacity};
+  uint32_t *coded = malloc((num_bytes + 1) * sizeof(uint32_t));
+  size_t num_coded = 0;
+  for (size_t pos = 0; pos < num_bytes;)
+  {
+    size_t length = _token_length(bytes + pos, num_bytes - pos);
+    coded[num_coded++] = _intern(&dict, pos, length);
+    pos += length;
+  }
+
+  // Renumber the tokens by code length, keeping first-occurrence order within a length
+  uint8_t *code_length = malloc(dict.num_tokens + 1);
+  huffman_code_lengths(dict.counts, dict.num_tokens, code_length);
+  uint32_t count[CANONICAL_MAX_CODE_LENGTH + 1] = {0};
+  uint8_t max_length = 0;
+  for (size_t id = 0; id < dict.num_tokens; id++)
+  {
+    count[code_length[id]]++;
+    max_length = code_length[id] > max_length ? code_length[id] : max_length;
+  }
+  uint32_t next_id[CANONICAL_MAX_CODE_LENGTH + 1];
+  uint32_t first_id = 0;
+  for (int length = 0; length <= CANONICAL_MAX_CODE_LENGTH; length++)
+  {
+    next_id[length] = first_id;
+    first_id += count[length];
+  }
+  uint32_t *new_id = malloc((dict.num_tokens + 1) * sizeof(uint32_t));
+  uint32_t *old_id = malloc((dict.num_tokens + 1) * sizeof(uint32_t));
+  uint8_t *sorted_lengths = malloc(dict.num_tokens + 1);
+  for (size_t id = 0; id < dict.num_tokens; id++)
+  {
+    new_id[id] = next_id[code_length[id]]++;
+    old_id[new_id[id]] = (uint32_t)id;
+    sorted_lengths[new_id[id]] = code_length[id];
+  }
+  uint64_t *codes = malloc((dict.num_tokens + 1) * sizeof(uint64_t));
+  canonical_codes(sorted_lengths, dict.num_tokens, codes);
+
+  // The dictionary: token lengths, then token bytes
+  uint8_t *token_codes = malloc(dict.num_tokens + 1);
+  uint8_t *dictionary_bytes = malloc(num_bytes + 1);
+  size_t num_dictionary_bytes = 0;
+  for (size_t idx = 0; idx < dict.num_tokens; idx++)
+  {
+    uint32_t id = old_id[idx];
+    token_codes[idx] = value_code(dict.lengths[id] - 1);
+    memcpy(dictionary_bytes + num_dictionary_bytes, bytes + dict.starts[id], dict.lengths[id]);
+    num_dictionary_bytes += dict.lengths[id];
+  }
+  write_uint32(a_writer, (uint32_t)dict.num_tokens);
+  write_uint32(a_writer, (uint32_t)num_coded);
+  write_huffman_section(a_writer, token_codes, dict.num_tokens);
+  for (size_t idx = 0; idx < dict.num_tokens; idx++)
+  {
+    uint32_t extra = dict.lengths[old_id[idx]] - 1 - value_code_base(token_codes[idx]);
+    write_code(a_writer, extra, value_code_extra_bits(token_codes[idx]));
+  }
+  write_huffman_section(a_writer, dictionary_bytes, num_dictionary_bytes);
+
+  write_bits(a_writer, max_length, 8);
+  for (int length = 1; length <= max_length; length++)
+  {
+    write_uint32(a_writer, count[length]);
+  }
+  for (size_t idx = 0; idx < num_coded; idx++)
+  {
+    uint32_t id = new_id[coded[idx]];
+    write_code(a_writer, codes[id], sorted_lengths[id]);
+  }
+
+  free(dictionary_bytes);
+  free(token_codes);
+  free(codes);
+  free(sorted_lengths);
+  free(old_id);
+  free(new_id);
+  free(code_length);
+  free(coded);
+  free(dict.slots);
+  free(dict.starts);
+  free(dict.lengths);
+  free(dict.counts);
+}
+
+bool words_read_payload(BitReader *a_reader, uint8_t *bytes, size_t num_bytes)
+{
+  uint32_t num_tokens = read_uint32(a_reader);
+  uint32_t num_coded = read_uint32(a_reader);
+  if (!is_bit_reader_open(a_reader) || num_tokens > num_coded || num_coded > num_bytes ||
+      (num_tokens == 0) != (num_bytes == 0))
+  {
+    return false;
+  }
+
+  // Where each token starts in the dictionary bytes, with one extra entry for the end
+  uint8_t *token_codes = malloc(num_tokens + 1);
+  uint32_t *starts = malloc((num_tokens + 1) * sizeof(uint32_t));
+  bool ok = read_huffman_section(a_reader, token_codes, num_tokens);
+  starts[0] = 0;
+  for (uint32_t idx = 0; ok && idx < num_tokens; idx++)
+  {
+    ok = token_codes[idx] < NUM_VALUE_CODES;
+    uint64_t length =
+        ok ? value_code_base(token_codes[idx]) + read_code(a_reader, value_code_extra_bits(token_codes[idx])) + 1 : 0;
+    ok = ok && length <= MAX_TOKEN_LENGTH && starts[idx] + length <= num_bytes;
+    starts[idx + 1] = ok ? starts[idx] + (uint32_t)length : 0;
+  }
+  free(token_codes);
+
+  uint8_t *dictionary_bytes = ok ? malloc(starts[num_tokens] + 1) : NULL;
+  ok = ok && read_huffman_section(a_reader, dictionary_bytes, starts[num_tokens]);
+
+  uint8_t max_length = read_bits(a_reader, 8);
+  uint8_t *lengths = malloc(num_tokens + 1);
+  uint32_t num_lengths = 0;
+  ok = ok && max_length <= CANONICAL_MAX_CODE_LENGTH;
+  for (int length = 1; ok && length <= max_length; length++)
+  {
+    uint32_t count = read_uint32(a_reader);
+    ok = count <= num_tokens - num_lengths;
+    memset(lengths + num_lengths, length, ok ? count : 0);
+    num_lengths += ok ? count : 0;
+  }
+  ok = ok && num_lengths == num_tokens;
+
+  CanonicalDecoder *decoder = calloc(1, sizeof(*decoder));
+  ok = ok && build_canonical_decoder(decoder, lengths, num_tokens);
+  size_t pos = 0;
+  for (uint32_t idx = 0; ok && idx < num_coded; idx++)
+  {
+    uint32_t id = canonical_decode(decoder, a_reader);
+    ok = id < num_tokens && starts[id + 1] - starts[id] <= num_bytes - pos;
+    if (ok)
+    {
+      memcpy(bytes + pos, dictionary_bytes + starts[id], starts[id + 1] - starts[id]);
+      pos += starts[id + 1] - starts[id];
+    }
+  }
+  ok = ok && pos == num_bytes && is_bit_reader_open(a_reader);
+
+  destroy_canonical_decoder(decoder);
+  free(decoder);
+  free(lengths);
+  free(dictionary_bytes);
+  free(starts);
+  return ok;
+}
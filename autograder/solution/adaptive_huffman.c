@@ -0,0 +1,197 @@
+#include "adaptive_huffman.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ROOT (ADAPTIVE_MAX_NODES - 1)
+
+void init_adaptive_model(AdaptiveModel *a_model)
+{
+  memset(a_model->nodes, 0, sizeof(a_model->nodes));
+  for (int symbol = 0; symbol < ADAPTIVE_NUM_SYMBOLS; symbol++)
+  {
+    a_model->leaf_of[symbol] = -1;
+  }
+  a_model->nodes[ROOT] = (AdaptiveNode){.weight = 0, .parent = -1, .left = -1, .right = -1, .symbol = -1};
+  a_model->nyt = ROOT;
+}
+
+// Point the children of the node at `idx` (or the symbol table) back at it
+static void _adopt(AdaptiveModel *a_model, int idx)
+{
+  AdaptiveNode *node = &a_model->nodes[idx];
+  if (node->left >= 0)
+  {
+    a_model->nodes[node->left].parent = idx;
+    a_model->nodes[node->right].parent = idx;
+  }
+  else if (node->symbol >= 0)
+  {
+    a_model->leaf_of[node->symbol] = idx;
+  }
+  else
+  {
+    a_model->nyt = idx;
+  }
+}
+
+// Exchange the subtrees rooted at `a` and `b`, leaving both parents in place
+static void _swap_nodes(AdaptiveModel *a_model, int a, int b)
+{
+  AdaptiveNode node_a = a_model->nodes[a];
+  AdaptiveNode node_b = a_model->nodes[b];
+  int parent_a = node_a.parent;
+  int parent_b = node_b.parent;
+
+  a_model->nodes[a] = node_b;
+  a_model->nodes[a].parent = parent_a;
+  a_model->nodes[b] = node_a;
+  a_model->nodes[b].parent = parent_b;
+  _adopt(a_model, a);
+  _adopt(a_model, b);
+}
+
+static void _update(AdaptiveModel *a_model, uint16_t symbol)
+{
+  int q = a_model->leaf_of[symbol];
+  if (q < 0)
+  {
+    // Split the NYT node into a new NYT node (left) and a leaf for symbol (right)
+    int p = a_model->nyt;
+    a_model->nodes[p].left = p - 2;
+    a_model->nodes[p].right = p - 1;
+    a_model->nodes[p - 2] = (AdaptiveNode){.weight = 0, .parent = p, .left = -1, .right = -1, .symbol = -1};
+    a_model->nodes[p - 1] = (AdaptiveNode){.weight = 0, .parent = p, .left = -1, .right = -1, .symbol = symbol};
+    a_model->leaf_of[symbol] = p - 1;
+    a_model->nyt = p - 2;
+    q = p - 1;
+  }
+
+  while (q != ROOT)
+  {
+    // Move q to the highest-numbered node of its weight, unless that is its parent
+    int leader = q;
+    while (leader + 1 < ADAPTIVE_MAX_NODES && a_model->nodes[leader + 1].weight == a_model->nodes[q].weight)
+    {
+      leader++;
+    }
+    if (leader == a_model->nodes[q].parent)
+    {
+      leader--;
+    }
+    if (leader != q)
+    {
+      _swap_nodes(a_model, q, leader);
+      q = leader;
+    }
+    a_model->nodes[q].weight++;
+    q = a_model->nodes[q].parent;
+  }
+  a_model->nodes[ROOT].weight++;
+}
+
+void adaptive_encode_symbol(AdaptiveModel *a_model, BitWriter *a_writer, uint16_t symbol)
+{
+  bool is_new = a_model->leaf_of[symbol] < 0;
+  int node = is_new ? a_model->nyt : a_model->leaf_of[symbol];
+
+  // The code is the path from the root, so collect it leaf-first and write it reversed
+  uint8_t path[ADAPTIVE_MAX_NODES];
+  int path_len = 0;
+  for (int q = node; q != ROOT; q = a_model->nodes[q].parent)
+  {
+    path[path_len++] = a_model->nodes[a_model->nodes[q].parent].right == q;
+  }
+  while (path_len > 0)
+  {
+    write_bits(a_writer, path[--path_len], 1);
+  }
+
+  if (is_new)
+  {
+    write_bits(a_writer, symbol >> 8, 1);
+    write_bits(a_writer, symbol & 0xff, 8);
+  }
+
+  _update(a_model, symbol);
+}
+
+uint16_t adaptive_decode_symbol(AdaptiveModel *a_model, BitReader *a_reader)
+{
+  int q = ROOT;
+  while (a_model->nodes[q].left >= 0)
+  {
+    if (!is_bit_reader_open(a_reader))
+    {
+      return ADAPTIVE_EOS;
+    }
+    q = read_bit(a_reader) ? a_model->nodes[q].right : a_model->nodes[q].left;
+  }
+
+  uint16_t symbol;
+  if (q == a_model->nyt)
+  {
+    if (!is_bit_reader_open(a_reader))
+    {
+      return ADAPTIVE_EOS;
+    }
+    symbol = read_bits(a_reader, 1) << 8;
+    symbol |= read_bits(a_reader, 8);
+    if (!is_bit_reader_open(a_reader) || symbol > ADAPTIVE_EOS)
+    {
+      return ADAPTIVE_EOS;
+    }
+  }
+  else
+  {
+    symbol = a_model->nodes[q].symbol;
+  }
+
+  if (symbol != ADAPTIVE_EOS)
+  {
+    _update(a_model, symbol);
+  }
+  return symbol;
+}
+
+uint64_t adaptive_compress_stream(FILE *uncompressed, BitWriter *a_writer)
+{
+  AdaptiveModel *model = malloc(sizeof(*model));
+  init_adaptive_model(model);
+
+  uint64_t num_bytes = 0;
+  for (int ch = getc(uncompressed); ch != EOF; ch = getc(uncompressed))
+  {
+    adaptive_encode_symbol(model, a_writer, (uint16_t)ch);
+    num_bytes++;
+  }
+  adaptive_encode_symbol(model, a_writer, ADAPTIVE_EOS);
+
+  free(model);
+  return num_bytes;
+}
+
+uint64_t adaptive_decode_stream(BitReader *a_reader, BitWriter *a_output)
+{
+  AdaptiveModel *model = malloc(sizeof(*model));
+  init_adaptive_model(model);
+
+  // A stream cut short would otherwise decode zero bits forever
+  uint64_t num_bytes = 0;
+  for (uint16_t symbol = adaptive_decode_symbol(model, a_reader);
+       symbol != ADAPTIVE_EOS && is_bit_reader_open(a_reader) && !a_output->overflowed;
+       symbol = adaptive_decode_symbol(model, a_reader))
+  {
+    write_bits(a_output, (uint8_t)symbol, 8);
+    num_bytes++;
+  }
+
+  free(model);
+  return num_bytes;
+}
+
+uint64_t adaptive_decompress_stream(BitReader *a_reader, FILE *uncompressed)
+{
+  BitWriter output = {.file = uncompressed, .current_byte = 0, .num_bits_left = 8};
+  return adaptive_decode_stream(a_reader, &output);
+}
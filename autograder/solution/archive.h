@@ -0,0 +1,170 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "bit_tools.h"
+#include "container.h"
+#include "huffman.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Archives of many similar files, where each distinct stretch of bytes is
+ * compressed and stored once. Every file is cut into chunks of `chunk_size`
+ * bytes, each chunk is keyed by a 128-bit hash of its bytes, and only chunks
+ * not seen before are coded, each as one self-contained block (see
+ * write_blocks(...)). A file is then a list of references to blocks.
+ *
+ * An archive is a container (see ContainerMode) of mode CONTAINER_ARCHIVE:
+ * the blocks, BLOCK_END, then the directory and its size and this magic word
+ * ("HUFA" in little-endian order), both as uint32. The directory is, as
+ * varints, the number of blocks and the size of each (header and payload),
+ * then the number of files and for each, the length of its name, the name,
+ * the number of its blocks, and each block number as a zigzag delta from one
+ * past the previous one, so that new blocks in order cost a byte each.
+ *
+ * Many small files each pay for a table of their own. So the files may
+ * instead share one table, built from their combined histogram and stored
+ * once, at the end of the directory, as a BLOCK_HUFFMAN block stores its
+ * own. Blocks then code with it as BLOCK_HUFFMAN_REPEAT, and a file still
+ * decodes without any other file's blocks.
+ */
+#define ARCHIVE_MAGIC 0x41465548u
+
+// The chunk size used unless another is given
+#define DEFAULT_ARCHIVE_CHUNK_SIZE (64u << 10)
+
+/**
+ * A file of an archive.
+ */
+typedef struct _ArchiveMember
+{
+  char *name;
+  uint64_t num_bytes;  // The size of the file
+  uint64_t *blocks;    // The numbers of its blocks, in order
+  size_t num_blocks;
+} ArchiveMember;
+
+/*
+ * The blocks stored so far, found by the hash of their bytes with open
+ * addressing, so that a lookup takes the same time however many there are.
+ */
+typedef struct _StoredChunk
+{
+  uint64_t hash[2];
+  uint64_t block; // UINT64_MAX for an empty slot
+} StoredChunk;
+
+typedef struct _ChunkStore
+{
+  StoredChunk *slots;
+  size_t capacity; // A power of two, at least twice num_blocks
+  size_t num_blocks;
+} ChunkStore;
+
+/**
+ * An archive being written.
+ */
+typedef struct _ArchiveWriter
+{
+  BitWriter *writer;
+  BlockOptions options;
+  size_t chunk_size;
+  ChunkStore store;
+  uint64_t *block_sizes; // The size of every block written, for the directory, store.num_blocks of them
+  size_t block_sizes_capacity;
+  ArchiveMember *members;
+  size_t num_members;
+  size_t members_capacity;
+  uint64_t num_referenced_blocks; // Chunks added, whether stored or found in the store
+  uint64_t num_block_bytes;       // Bytes of blocks written
+  Frequencies table_freq;         // The histogram the shared table is built from, if options.shared_table
+} ArchiveWriter;
+
+/**
+ * @brief Start an archive: write the container header.
+ *
+ * @param a_archive the ArchiveWriter to set up
+ * @param a_writer the byte-aligned BitWriter to write the archive to
+ * @param a_options the settings every block is coded with; `max_block_size`,
+ * `split_on_drift` and `self_contained` are set so that a chunk is one block
+ * @param chunk_size the bytes per chunk
+ */
+void open_archive_writer(ArchiveWriter *a_archive, BitWriter *a_writer, const BlockOptions *a_options,
+                         size_t chunk_size);
+
+/**
+ * @brief Code the files added from now on with one table, built from `freq`,
+ * which should count the bytes of all of them. Bytes it has no code for are
+ * coded as if there were no shared table.
+ *
+ * @param a_archive the ArchiveWriter from open_archive_writer(...), before
+ * any file is added
+ * @param freq the combined histogram of the files
+ */
+void share_archive_table(ArchiveWriter *a_archive, const Frequencies freq);
+
+/**
+ * @brief Add a file to an archive, writing blocks for the chunks of it that
+ * are not stored yet.
+ *
+ * @param a_archive the ArchiveWriter from open_archive_writer(...)
+ * @param name the name to store the file under
+ * @param bytes the bytes of the file
+ * @param num_bytes the number of bytes at bytes
+ */
+void add_archive_member(ArchiveWriter *a_archive, const char *name, const uint8_t *bytes, size_t num_bytes);
+
+/**
+ * @brief Finish an archive: write BLOCK_END and the directory, and free the
+ * writer. The BitWriter is left open.
+ *
+ * @param a_archive the ArchiveWriter from open_archive_writer(...)
+ */
+void close_archive_writer(ArchiveWriter *a_archive);
+
+/**
+ * The directory of an archive, as read back.
+ */
+typedef struct _Archive
+{
+  uint64_t *block_offsets; // Where each block starts, counted from the first block
+  size_t num_blocks;
+  ArchiveMember *members;
+  size_t num_members;
+  TreeNode *table_root; // The table the files share, or NULL
+} Archive;
+
+/**
+ * @brief Read the directory of an archive file.
+ *
+ * @param file the archive file, opened for reading
+ * @param a_archive the Archive to fill; destroy it with destroy_archive(...)
+ * @param a_error a pointer to a string that will be set to an error message
+ * @return bool false if the file is not an archive or its directory is malformed
+ */
+bool read_archive(FILE *file, Archive *a_archive, const char **a_error);
+
+/**
+ * @brief Decode one file of an archive.
+ *
+ * @param file the archive file, opened for reading
+ * @param a_archive the directory from read_archive(...)
+ * @param member the index of the file in a_archive->members
+ * @param a_output the byte-aligned BitWriter to write the file to
+ * @param a_error a pointer to a string that will be set to an error message
+ * @return bool false if a block is malformed
+ */
+bool extract_archive_member(FILE *file, const Archive *a_archive, size_t member, BitWriter *a_output,
+                            const char **a_error);
+
+/**
+ * @brief Free the directory of an archive.
+ *
+ * @param a_archive the Archive to free
+ */
+void destroy_archive(Archive *a_archive);
+
+#endif // ARCHIVE_H
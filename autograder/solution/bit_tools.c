@@ -1,17 +1,71 @@
 #include "bit_tools.h"
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
 BitWriter open_bit_writer(const char *path)
 {
   return (BitWriter){.file = fopen(path, "wb"), .current_byte = 0, .num_bits_left = 8};
 }
 
+BitWriter open_memory_bit_writer(size_t initial_capacity)
+{
+  initial_capacity = initial_capacity > 0 ? initial_capacity : 64;
+  return (BitWriter){.buffer = malloc(initial_capacity), .capacity = initial_capacity, .current_byte = 0, .num_bits_left = 8};
+}
+
+BitWriter open_fixed_bit_writer(uint8_t *buffer, size_t capacity)
+{
+  return (BitWriter){.buffer = buffer, .capacity = capacity, .fixed = true, .current_byte = 0, .num_bits_left = 8};
+}
+
+static bool _has_sink(BitWriter *a_writer)
+{
+  return a_writer->file != NULL || a_writer->buffer != NULL;
+}
+
+// Make room for `num_bytes` more bytes, or report that a fixed buffer is full
+static bool _reserve(BitWriter *a_writer, size_t num_bytes)
+{
+  if (a_writer->num_bytes + num_bytes > a_writer->capacity)
+  {
+    if (a_writer->fixed)
+    {
+      a_writer->overflowed = true;
+      return false;
+    }
+    size_t capacity = a_writer->capacity * 2;
+    while (capacity < a_writer->num_bytes + num_bytes)
+    {
+      capacity *= 2;
+    }
+    a_writer->buffer = realloc(a_writer->buffer, capacity);
+    a_writer->capacity = capacity;
+  }
+  return true;
+}
+
+static void _emit_byte(BitWriter *a_writer, uint8_t byte)
+{
+  if (a_writer->file != NULL)
+  {
+    fwrite(&byte, sizeof(byte), 1, a_writer->file);
+  }
+  else
+  {
+    if (_reserve(a_writer, 1))
+    {
+      a_writer->buffer[a_writer->num_bytes++] = byte;
+    }
+  }
+}
+
 void write_bits(BitWriter *a_writer, uint8_t bits, uint8_t num_bits_to_write)
 {
   assert(num_bits_to_write <= 8);
   assert(a_writer->num_bits_left >= 1 && a_writer->num_bits_left <= 8);
 
-  if (a_writer->file != NULL)
+  if (_has_sink(a_writer))
   {
     if (num_bits_to_write <= a_writer->num_bits_left)
     {
@@ -22,7 +76,7 @@ void write_bits(BitWriter *a_writer, uint8_t bits, uint8_t num_bits_to_write)
 
       if (a_writer->num_bits_left == 0)
       {
-        fwrite(&(a_writer->current_byte), sizeof(a_writer->current_byte), 1, a_writer->file);
+        _emit_byte(a_writer, a_writer->current_byte);
         a_writer->current_byte = 0;
         a_writer->num_bits_left = 8;
       }
@@ -33,7 +87,7 @@ void write_bits(BitWriter *a_writer, uint8_t bits, uint8_t num_bits_to_write)
       uint8_t mask = (1 << a_writer->num_bits_left) - 1;
       uint8_t bits_to_write = (bits >> (num_bits_to_write - a_writer->num_bits_left)) & mask;
       a_writer->current_byte |= bits_to_write;
-      fwrite(&(a_writer->current_byte), sizeof(a_writer->current_byte), 1, a_writer->file);
+      _emit_byte(a_writer, a_writer->current_byte);
       a_writer->current_byte = 0;
       int num_bits_left = num_bits_to_write - a_writer->num_bits_left;
       a_writer->num_bits_left = 8;
@@ -49,9 +103,74 @@ void write_bits(BitWriter *a_writer, uint8_t bits, uint8_t num_bits_to_write)
   assert(a_writer->num_bits_left >= 1 && a_writer->num_bits_left <= 8);
 }
 
+void write_code(BitWriter *a_writer, uint64_t bits, uint8_t num_bits_to_write)
+{
+  assert(num_bits_to_write <= 64);
+
+  // Leading partial chunk first, then whole bytes
+  uint8_t num_leading_bits = num_bits_to_write % 8;
+  if (num_leading_bits > 0)
+  {
+    write_bits(a_writer, (uint8_t)(bits >> (num_bits_to_write - num_leading_bits)), num_leading_bits);
+    num_bits_to_write -= num_leading_bits;
+  }
+  while (num_bits_to_write > 0)
+  {
+    num_bits_to_write -= 8;
+    write_bits(a_writer, (uint8_t)(bits >> num_bits_to_write), 8);
+  }
+}
+
+void write_uint32(BitWriter *a_writer, uint32_t value)
+{
+  for (int shift = 0; shift < 32; shift += 8)
+  {
+    write_bits(a_writer, (uint8_t)(value >> shift), 8);
+  }
+}
+
+void write_varint(BitWriter *a_writer, uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    write_bits(a_writer, (uint8_t)(value | 0x80), 8);
+    value >>= 7;
+  }
+  write_bits(a_writer, (uint8_t)value, 8);
+}
+
+void write_bytes(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes)
+{
+  assert(a_writer->num_bits_left == 8);
+
+  if (a_writer->file != NULL)
+  {
+    fwrite(bytes, 1, num_bytes, a_writer->file);
+  }
+  else if (a_writer->buffer != NULL && num_bytes > 0)
+  {
+    if (_reserve(a_writer, num_bytes))
+    {
+      memcpy(a_writer->buffer + a_writer->num_bytes, bytes, num_bytes);
+      a_writer->num_bytes += num_bytes;
+    }
+  }
+}
+
+void align_bit_writer(BitWriter *a_writer)
+{
+  if (a_writer->num_bits_left < 8)
+  {
+    write_bits(a_writer, 0, a_writer->num_bits_left);
+  }
+}
+
 void flush_bit_writer(BitWriter *a_writer)
 {
-  fwrite(&(a_writer->current_byte), sizeof(a_writer->current_byte), 1, a_writer->file);
+  if (_has_sink(a_writer))
+  {
+    _emit_byte(a_writer, a_writer->current_byte);
+  }
   a_writer->current_byte = 0;
   a_writer->num_bits_left = 8;
 }
@@ -59,7 +178,10 @@ void flush_bit_writer(BitWriter *a_writer)
 void close_bit_writer(BitWriter *a_writer)
 {
   flush_bit_writer(a_writer);
-  fclose(a_writer->file);
+  if (a_writer->file != NULL)
+  {
+    fclose(a_writer->file);
+  }
   a_writer->file = NULL;
 }
 
@@ -68,15 +190,47 @@ BitReader open_bit_reader(const char *path)
   return (BitReader){.file = fopen(path, "rb"), .current_byte = 0, .current_bit = -1};
 }
 
-uint8_t read_bit(BitReader *a_reader)
+BitReader open_memory_bit_reader(const uint8_t *buffer, size_t num_bytes)
 {
-  if (a_reader->current_bit < 0)
+  return (BitReader){.buffer = buffer, .num_bytes = num_bytes, .byte_idx = 0, .current_byte = 0, .current_bit = -1};
+}
+
+bool is_bit_reader_open(const BitReader *a_reader)
+{
+  return a_reader->file != NULL || a_reader->buffer != NULL;
+}
+
+// Fetch the next byte, or return EOF and detach the source at the end of the input
+static int _next_byte(BitReader *a_reader)
+{
+  if (a_reader->file != NULL)
   {
     int next_byte = fgetc(a_reader->file);
     if (next_byte == EOF)
     {
       fclose(a_reader->file);
       a_reader->file = NULL;
+    }
+    return next_byte;
+  }
+  if (a_reader->buffer != NULL)
+  {
+    if (a_reader->byte_idx < a_reader->num_bytes)
+    {
+      return a_reader->buffer[a_reader->byte_idx++];
+    }
+    a_reader->buffer = NULL;
+  }
+  return EOF;
+}
+
+uint8_t read_bit(BitReader *a_reader)
+{
+  if (a_reader->current_bit < 0)
+  {
+    int next_byte = _next_byte(a_reader);
+    if (next_byte == EOF)
+    {
       return 0;
     }
     else
@@ -103,6 +257,115 @@ uint8_t read_bits(BitReader *a_reader, uint8_t num_bits_to_read)
   return bits;
 }
 
+uint64_t read_code(BitReader *a_reader, uint8_t num_bits_to_read)
+{
+  uint64_t bits = 0;
+  for (uint8_t i = 0; i < num_bits_to_read; i++)
+  {
+    bits = (bits << 1) | read_bit(a_reader);
+  }
+  return bits;
+}
+
+uint32_t peek_bits(const BitReader *a_reader, uint8_t num_bits_to_peek)
+{
+  assert(num_bits_to_peek <= 32 && a_reader->file == NULL);
+
+  uint64_t window = 0;
+  int num_window_bits = 0;
+  if (a_reader->current_bit >= 0)
+  {
+    num_window_bits = a_reader->current_bit + 1;
+    window = a_reader->current_byte & ((1u << num_window_bits) - 1);
+  }
+  for (size_t idx = a_reader->byte_idx; num_window_bits < num_bits_to_peek; idx++)
+  {
+    uint8_t byte = a_reader->buffer != NULL && idx < a_reader->num_bytes ? a_reader->buffer[idx] : 0;
+    window = (window << 8) | byte;
+    num_window_bits += 8;
+  }
+  return (uint32_t)(window >> (num_window_bits - num_bits_to_peek));
+}
+
+void skip_bits(BitReader *a_reader, uint8_t num_bits_to_skip)
+{
+  if (a_reader->buffer == NULL)
+  {
+    for (uint8_t i = 0; i < num_bits_to_skip; i++)
+    {
+      read_bit(a_reader);
+    }
+    return;
+  }
+
+  // Same end-of-input behavior as reading: only moving past the last bit detaches the buffer
+  int num_bits_in_byte = a_reader->current_bit + 1;
+  if (num_bits_to_skip <= num_bits_in_byte)
+  {
+    a_reader->current_bit -= num_bits_to_skip;
+    return;
+  }
+  size_t num_bits = num_bits_to_skip - num_bits_in_byte;
+  size_t byte_idx = a_reader->byte_idx + num_bits / 8;
+  a_reader->current_bit = -1;
+  if (byte_idx > a_reader->num_bytes || (byte_idx == a_reader->num_bytes && num_bits % 8 > 0))
+  {
+    a_reader->byte_idx = a_reader->num_bytes;
+    a_reader->buffer = NULL;
+    return;
+  }
+  a_reader->byte_idx = byte_idx;
+  if (num_bits % 8 > 0)
+  {
+    a_reader->current_byte = a_reader->buffer[a_reader->byte_idx++];
+    a_reader->current_bit = 7 - num_bits % 8;
+  }
+}
+
+uint32_t read_uint32(BitReader *a_reader)
+{
+  uint32_t value = 0;
+  for (int shift = 0; shift < 32; shift += 8)
+  {
+    value |= (uint32_t)read_bits(a_reader, 8) << shift;
+  }
+  return value;
+}
+
+uint64_t read_varint(BitReader *a_reader)
+{
+  uint64_t value = 0;
+  for (int shift = 0; shift < 70; shift += 7)
+  {
+    uint8_t byte = read_bits(a_reader, 8);
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+    {
+      return value;
+    }
+  }
+  return UINT64_MAX;
+}
+
+size_t read_bytes(BitReader *a_reader, uint8_t *bytes, size_t num_bytes)
+{
+  a_reader->current_bit = -1;
+
+  size_t num_read = 0;
+  if (a_reader->file != NULL)
+  {
+    num_read = fread(bytes, 1, num_bytes, a_reader->file);
+  }
+  else if (a_reader->buffer != NULL)
+  {
+    size_t num_available = a_reader->num_bytes - a_reader->byte_idx;
+    num_read = num_bytes < num_available ? num_bytes : num_available;
+    memcpy(bytes, a_reader->buffer + a_reader->byte_idx, num_read);
+    a_reader->byte_idx += num_read;
+  }
+  return num_read;
+}
+
 void close_bit_reader(BitReader *a_reader)
 {
   if (a_reader->file != NULL)
@@ -110,4 +373,5 @@ void close_bit_reader(BitReader *a_reader)
     fclose(a_reader->file);
     a_reader->file = NULL;
   }
+  a_reader->buffer = NULL;
 }
@@ -0,0 +1,377 @@
+#include "bwt.h"
+#include "huffman.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * SA-IS (Nong, Zhang and Chan). Every suffix is S-type if it sorts before the
+ * suffix one position on and L-type otherwise; an LMS position is an S-type
+ * position just after an L-type one. Sorting the LMS substrings and then
+ * inducing the L-type and S-type suffixes from them sorts all suffixes, and
+ * the LMS substrings are sorted by recursing on a string of their names.
+ *
+ * `s` must end with a unique smallest symbol 0, and all symbols are below
+ * `alphabet_size`.
+ */
+#define IS_LMS(types, i) ((i) > 0 && (types)[i] && !(types)[(i) - 1])
+
+static void _bucket_bounds(const int32_t *s, size_t n, int alphabet_size, int32_t *buckets, bool ends)
+{
+  memset(buckets, 0, alphabet_size * sizeof(int32_t));
+  for (size_t i = 0; i < n; i++)
+  {
+    buckets[s[i]]++;
+  }
+  int32_t sum = 0;
+  for (int c = 0; c < alphabet_size; c++)
+  {
+    sum += buckets[c];
+    buckets[c] = ends ? sum : sum - buckets[c];
+  }
+}
+
+static void _induce(const int32_t *s, const uint8_t *types, int32_t *sa, size_t n, int alphabet_size,
+                    int32_t *buckets)
+{
+  // L-type suffixes, left to right from the bucket starts
+  _bucket_bounds(s, n, alphabet_size, buckets, false);
+  for (size_t i = 0; i < n; i++)
+  {
+    if (sa[i] > 0 && !types[sa[i] - 1])
+    {
+      sa[buckets[s[sa[i] - 1]]++] = sa[i] - 1;
+    }
+  }
+  // S-type suffixes, right to left from the bucket ends
+  _bucket_bounds(s, n, alphabet_size, buckets, true);
+  for (size_t i = n; i-- > 0;)
+  {
+    if (sa[i] > 0 && types[sa[i] - 1])
+    {
+      sa[--buckets[s[sa[i] - 1]]] = sa[i] - 1;
+    }
+  }
+}
+
+static void _sais(const int32_t *s, int32_t *sa, size_t n, int alphabet_size)
+{
+  if (n == 1)
+  {
+    sa[0] = 0;
+    return;
+  }
+
+  uint8_t *types = malloc(n); // 1 for S-type
+  types[n - 1] = 1;
+  types[n - 2] = 0;
+  for (size_t i = n - 2; i-- > 0;)
+  {
+    types[i] = s[i] < s[i + 1] || (s[i] == s[i + 1] && types[i + 1]);
+  }
+  int32_t *buckets = malloc(alphabet_size * sizeof(int32_t));
+
+  // Put the LMS positions at the ends of their buckets, then induce to sort the LMS substrings
+  _bucket_bounds(s, n, alphabet_size, buckets, true);
+  memset(sa, 0xff, n * sizeof(int32_t));
+  for (size_t i = 1; i < n; i++)
+  {
+    if (IS_LMS(types, i))
+    {
+      sa[--buckets[s[i]]] = (int32_t)i;
+    }
+  }
+  _induce(s, types, sa, n, alphabet_size, buckets);
+
+  // Move the sorted LMS positions to the front and name each distinct LMS substring
+  size_t num_lms = 0;
+  for (size_t i = 0; i < n; i++)
+  {
+    if (IS_LMS(types, sa[i]))
+    {
+      sa[num_lms++] = sa[i];
+    }
+  }
+  memset(sa + num_lms, 0xff, (n - num_lms) * sizeof(int32_t));
+  int32_t num_names = 0;
+  int32_t prev = -1;
+  for (size_t i = 0; i < num_lms; i++)
+  {
+    int32_t pos = sa[i];
+    bool differs = prev < 0;
+    for (size_t d = 0; !differs; d++)
+    {
+      if (s[pos + d] != s[prev + d] || types[pos + d] != types[prev + d])
+      {
+        differs = true;
+      }
+      else if (d > 0 && (IS_LMS(types, pos + d) || IS_LMS(types, prev + d)))
+      {
+        break;
+      }
+    }
+    if (differs)
+    {
+      num_names++;
+      prev = pos;
+    }
+    // LMS positions are at least two apart, so pos / 2 gives each its own slot
+    sa[num_lms + pos / 2] = num_names - 1;
+  }
+  for (size_t i = n, j = n; i-- > num_lms;)
+  {
+    if (sa[i] >= 0)
+    {
+      sa[--j] = sa[i];
+    }
+  }
+
+  // Sort the LMS suffixes: directly if their names are distinct, by recursion if not
+  int32_t *reduced = sa + n - num_lms;
+  if ((size_t)num_names < num_lms)
+  {
+    _sais(reduced, sa, num_lms, num_names);
+  }
+  else
+  {
+    for (size_t i = 0; i < num_lms; i++)
+    {
+      sa[reduced[i]] = (int32_t)i;
+    }
+  }
+
+  // Map the sorted ranks back to positions and induce the full order from them
+  for (size_t i = 1, j = 0; i < n; i++)
+  {
+    if (IS_LMS(types, i))
+    {
+      reduced[j++] = (int32_t)i;
+    }
+  }
+  for (size_t i = 0; i < num_lms; i++)
+  {
+    sa[i] = reduced[sa[i]];
+  }
+  memset(sa + num_lms, 0xff, (n - num_lms) * sizeof(int32_t));
+  _bucket_bounds(s, n, alphabet_size, buckets, true);
+  for (size_t i = num_lms; i-- > 0;)
+  {
+    int32_t pos = sa[i];
+    sa[i] = -1;
+    sa[--buckets[s[pos]]] = pos;
+  }
+  _induce(s, types, sa, n, alphabet_size, buckets);
+
+  free(types);
+  free(buckets);
+}
+
+size_t bwt_forward(const uint8_t *bytes, size_t num_bytes, uint8_t *last_column)
+{
+  // Shift the bytes up by one so that 0 can be the end marker
+  int32_t *s = malloc((num_bytes + 1) * sizeof(int32_t));
+  for (size_t i = 0; i < num_bytes; i++)
+  {
+    s[i] = bytes[i] + 1;
+  }
+  s[num_bytes] = 0;
+  int32_t *sa = malloc((num_bytes + 1) * sizeof(int32_t));
+  _sais(s, sa, num_bytes + 1, 257);
+
+  size_t primary_index = 0;
+  for (size_t i = 0, j = 0; i <= num_bytes; i++)
+  {
+    if (sa[i] == 0)
+    {
+      primary_index = i;
+    }
+    else
+    {
+      last_column[j++] = bytes[sa[i] - 1];
+    }
+  }
+
+  free(s);
+  free(sa);
+  return primary_index;
+}
+
+bool bwt_inverse(const uint8_t *last_column, size_t num_bytes, size_t primary_index, uint8_t *bytes)
+{
+  if (num_bytes == 0)
+  {
+    return true;
+  }
+  // Row 0 is the suffix holding only the end marker, so the marker itself is never in row 0
+  if (primary_index < 1 || primary_index > num_bytes)
+  {
+    return false;
+  }
+
+  // first[c] is the first row starting with byte c, after the end marker's row
+  size_t first[256] = {0};
+  for (size_t i = 0; i < num_bytes; i++)
+  {
+    first[last_column[i]]++;
+  }
+  size_t sum = 1;
+  for (int c = 0; c < 256; c++)
+  {
+    size_t count = first[c];
+    first[c] = sum;
+    sum += count;
+  }
+
+  // next_row[row] is the row of the suffix one byte longer than the suffix in `row`
+  uint32_t *next_row = malloc((num_bytes + 1) * sizeof(uint32_t));
+  for (size_t row = 0; row <= num_bytes; row++)
+  {
+    if (row != primary_index)
+    {
+      next_row[row] = (uint32_t)first[last_column[row < primary_index ? row : row - 1]]++;
+    }
+  }
+
+  bool ok = true;
+  size_t row = 0;
+  for (size_t i = num_bytes; i-- > 0;)
+  {
+    if (row == primary_index)
+    {
+      ok = false;
+      break;
+    }
+    bytes[i] = last_column[row < primary_index ? row : row - 1];
+    row = next_row[row];
+  }
+
+  free(next_row);
+  return ok && row == primary_index;
+}
+
+void bwt_write_payload(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes)
+{
+  uint8_t *transformed = malloc(num_bytes + 1);
+  size_t primary_index = bwt_forward(bytes, num_bytes, transformed);
+
+  // Move-to-front, with each run of zeros collapsed into one 0 and its length
+  uint8_t order[256];
+  for (int c = 0; c < 256; c++)
+  {
+    order[c] = (uint8_t)c;
+  }
+  uint8_t *values = transformed; // Never longer than the column it overwrites
+  uint32_t *run_lengths = malloc((num_bytes + 1) * sizeof(uint32_t));
+  size_t num_values = 0;
+  size_t num_runs = 0;
+  for (size_t i = 0; i < num_bytes; i++)
+  {
+    uint8_t byte = transformed[i];
+    uint8_t rank = 0;
+    while (order[rank] != byte)
+    {
+      rank++;
+    }
+    memmove(order + 1, order, rank);
+    order[0] = byte;
+
+    if (rank > 0)
+    {
+      values[num_values++] = rank;
+    }
+    else if (num_values > 0 && values[num_values - 1] == 0)
+    {
+      run_lengths[num_runs - 1]++;
+    }
+    else
+    {
+      values[num_values++] = 0;
+      run_lengths[num_runs++] = 1;
+    }
+  }
+
+  uint8_t *run_codes = malloc(num_runs + 1);
+  for (size_t i = 0; i < num_runs; i++)
+  {
+    run_codes[i] = value_code(run_lengths[i] - 1);
+  }
+
+  write_uint32(a_writer, (uint32_t)primary_index);
+  write_uint32(a_writer, (uint32_t)num_values);
+  write_uint32(a_writer, (uint32_t)num_runs);
+  write_huffman_section(a_writer, values, num_values);
+  write_huffman_section(a_writer, run_codes, num_runs);
+  for (size_t i = 0; i < num_runs; i++)
+  {
+    write_code(a_writer, run_lengths[i] - 1 - value_code_base(run_codes[i]), value_code_extra_bits(run_codes[i]));
+  }
+
+  free(run_codes);
+  free(run_lengths);
+  free(transformed);
+}
+
+bool bwt_read_payload(BitReader *a_reader, uint8_t *bytes, size_t num_bytes)
+{
+  uint32_t primary_index = read_uint32(a_reader);
+  uint32_t num_values = read_uint32(a_reader);
+  uint32_t num_runs = read_uint32(a_reader);
+  if (!is_bit_reader_open(a_reader) || num_values > num_bytes || num_runs > num_values)
+  {
+    return false;
+  }
+
+  uint8_t *values = malloc(num_values + 1);
+  uint8_t *run_codes = malloc(num_runs + 1);
+  bool ok = read_huffman_section(a_reader, values, num_values) &&
+            read_huffman_section(a_reader, run_codes, num_runs);
+
+  uint8_t *transformed = malloc(num_bytes + 1);
+  uint8_t order[256];
+  for (int c = 0; c < 256; c++)
+  {
+    order[c] = (uint8_t)c;
+  }
+  size_t pos = 0;
+  size_t run_idx = 0;
+  for (size_t i = 0; ok && i < num_values; i++)
+  {
+    uint8_t rank = values[i];
+    if (rank == 0)
+    {
+      if (run_idx == num_runs || run_codes[run_idx] >= NUM_VALUE_CODES)
+      {
+        ok = false;
+        break;
+      }
+      uint8_t code = run_codes[run_idx++];
+      uint64_t run_length = value_code_base(code) + read_code(a_reader, value_code_extra_bits(code)) + 1;
+      if (run_length > num_bytes - pos)
+      {
+        ok = false;
+        break;
+      }
+      memset(transformed + pos, order[0], run_length);
+      pos += run_length;
+      continue;
+    }
+
+    if (pos == num_bytes)
+    {
+      ok = false;
+      break;
+    }
+    uint8_t byte = order[rank];
+    memmove(order + 1, order, rank);
+    order[0] = byte;
+    transformed[pos++] = byte;
+  }
+
+  ok = ok && pos == num_bytes && run_idx == num_runs && is_bit_reader_open(a_reader) &&
+       bwt_inverse(transformed, num_bytes, primary_index, bytes);
+
+  free(transformed);
+  free(run_codes);
+  free(values);
+  return ok;
+}
@@ -0,0 +1,310 @@
+#include "canonical_huffman.h"
+#include "min_heap.h"
+#include "huffman.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+void huffman_code_lengths(const uint64_t *counts, size_t num_symbols, uint8_t *lengths)
+{
+  memset(lengths, 0, num_symbols);
+
+  // Leaves are nodes 0 to num_leaves - 1, and each merge adds the next node
+  uint32_t *leaf_symbol = malloc((num_symbols + 1) * sizeof(uint32_t));
+  size_t num_leaves = 0;
+  for (size_t symbol = 0; symbol < num_symbols; symbol++)
+  {
+    if (counts[symbol] > 0)
+    {
+      leaf_symbol[num_leaves++] = (uint32_t)symbol;
+    }
+  }
+  if (num_leaves <= 1)
+  {
+    if (num_leaves == 1)
+    {
+      lengths[leaf_symbol[0]] = 1;
+    }
+    free(leaf_symbol);
+    return;
+  }
+
+  size_t num_nodes = 2 * num_leaves - 1;
+  uint32_t *parent = malloc(num_nodes * sizeof(uint32_t));
+  MinHeap heap = create_min_heap(num_leaves);
+  for (size_t leaf = 0; leaf < num_leaves; leaf++)
+  {
+    heap_push(&heap, counts[leaf_symbol[leaf]], (uint32_t)leaf);
+  }
+  for (size_t node = num_leaves; node < num_nodes; node++)
+  {
+    HeapEntry left = heap_pop(&heap);
+    HeapEntry right = heap_pop(&heap);
+    parent[left.value] = (uint32_t)node;
+    parent[right.value] = (uint32_t)node;
+    heap_push(&heap, left.key + right.key, (uint32_t)node);
+  }
+  destroy_min_heap(&heap);
+
+  // A parent is always numbered after its children, so depths can be filled from the root down
+  uint8_t *depth = malloc(num_nodes);
+  depth[num_nodes - 1] = 0;
+  for (size_t node = num_nodes - 1; node-- > 0;)
+  {
+    depth[node] = depth[parent[node]] + 1;
+  }
+  for (size_t leaf = 0; leaf < num_leaves; leaf++)
+  {
+    assert(depth[leaf] <= CANONICAL_MAX_CODE_LENGTH);
+    lengths[leaf_symbol[leaf]] = depth[leaf];
+  }
+
+  free(depth);
+  free(parent);
+  free(leaf_symbol);
+}
+
+// Fill first_code[length] from the number of codes of each length
+static void _first_codes(const uint32_t *count, uint64_t *first_code)
+{
+  first_code[0] = 0;
+  uint64_t code = 0;
+  for (int length = 1; length <= CANONICAL_MAX_CODE_LENGTH; length++)
+  {
+    code = (code + count[length - 1]) << 1;
+    first_code[length] = code;
+  }
+}
+
+void canonical_codes(const uint8_t *lengths, size_t num_symbols, uint64_t *codes)
+{
+  uint32_t count[CANONICAL_MAX_CODE_LENGTH + 1] = {0};
+  for (size_t symbol = 0; symbol < num_symbols; symbol++)
+  {
+    count[lengths[symbol]]++;
+  }
+  count[0] = 0;
+
+  uint64_t next_code[CANONICAL_MAX_CODE_LENGTH + 1];
+  _first_codes(count, next_code);
+  for (size_t symbol = 0; symbol < num_symbols; symbol++)
+  {
+    codes[symbol] = lengths[symbol] > 0 ? next_code[lengths[symbol]]++ : 0;
+  }
+}
+
+bool build_canonical_decoder(CanonicalDecoder *a_decoder, const uint8_t *lengths, size_t num_symbols)
+{
+  memset(a_decoder->count, 0, sizeof(a_decoder->count));
+  a_decoder->max_length = 0;
+  a_decoder->sorted_symbols = NULL;
+  for (size_t symbol = 0; symbol < num_symbols; symbol++)
+  {
+    if (lengths[symbol] > CANONICAL_MAX_CODE_LENGTH)
+    {
+      return false;
+    }
+    a_decoder->count[lengths[symbol]]++;
+    a_decoder->max_length = lengths[symbol] > a_decoder->max_length ? lengths[symbol] : a_decoder->max_length;
+  }
+  a_decoder->count[0] = 0;
+
+  // Kraft's inequality: the codes of each length take count / 2^length of the code space
+  uint64_t space = (uint64_t)1 << CANONICAL_MAX_CODE_LENGTH;
+  for (int length = 1; length <= a_decoder->max_length; length++)
+  {
+    uint64_t needed_per_code = (uint64_t)1 << (CANONICAL_MAX_CODE_LENGTH - length);
+    if (a_decoder->count[length] > space / needed_per_code)
+    {
+      return false;
+    }
+    space -= a_decoder->count[length] * needed_per_code;
+  }
+
+  _first_codes(a_decoder->count, a_decoder->first_code);
+  uint32_t next_index[CANONICAL_MAX_CODE_LENGTH + 1];
+  uint32_t index = 0;
+  for (int length = 0; length <= CANONICAL_MAX_CODE_LENGTH; length++)
+  {
+    a_decoder->first_index[length] = index;
+    next_index[length] = index;
+    index += a_decoder->count[length];
+  }
+  a_decoder->sorted_symbols = malloc((index + 1) * sizeof(uint32_t));
+  for (size_t symbol = 0; symbol < num_symbols; symbol++)
+  {
+    if (lengths[symbol] > 0)
+    {
+      a_decoder->sorted_symbols[next_index[lengths[symbol]]++] = (uint32_t)symbol;
+    }
+  }
+
+  // Every index that starts with a short code leads to its symbol
+  memset(a_decoder->lookup_length, 0, sizeof(a_decoder->lookup_length));
+  for (int length = 1; length <= CANONICAL_LOOKUP_BITS && length <= a_decoder->max_length; length++)
+  {
+    for (uint32_t idx = 0; idx < a_decoder->count[length]; idx++)
+    {
+      uint32_t first_entry = (uint32_t)(a_decoder->first_code[length] + idx) << (CANONICAL_LOOKUP_BITS - length);
+      for (uint32_t entry = 0; entry < (1u << (CANONICAL_LOOKUP_BITS - length)); entry++)
+      {
+        a_decoder->lookup_symbol[first_entry + entry] = a_decoder->sorted_symbols[a_decoder->first_index[length] + idx];
+        a_decoder->lookup_length[first_entry + entry] = (uint8_t)length;
+      }
+    }
+  }
+  return true;
+}
+
+uint32_t canonical_decode(const CanonicalDecoder *a_decoder, BitReader *a_reader)
+{
+  uint32_t bits = peek_bits(a_reader, CANONICAL_LOOKUP_BITS);
+  if (a_decoder->lookup_length[bits] > 0)
+  {
+    skip_bits(a_reader, a_decoder->lookup_length[bits]);
+    return a_decoder->lookup_symbol[bits];
+  }
+
+  uint64_t code = 0;
+  for (int length = 1; length <= a_decoder->max_length; length++)
+  {
+    code = (code << 1) | read_bit(a_reader);
+    if (code - a_decoder->first_code[length] < a_decoder->count[length])
+    {
+      return a_decoder->sorted_symbols[a_decoder->first_index[length] + (code - a_decoder->first_code[length])];
+    }
+  }
+  return CANONICAL_INVALID_SYMBOL;
+}
+
+void destroy_canonical_decoder(CanonicalDecoder *a_decoder)
+{
+  free(a_decoder->sorted_symbols);
+  a_decoder->sorted_symbols = NULL;
+}
+
+void write_canonical_table(BitWriter *a_writer, const uint8_t *lengths, size_t num_symbols)
+{
+  uint32_t count[CANONICAL_MAX_CODE_LENGTH + 1] = {0};
+  uint8_t max_length = 0;
+  for (size_t symbol = 0; symbol < num_symbols; symbol++)
+  {
+    count[lengths[symbol]]++;
+    max_length = lengths[symbol] > max_length ? lengths[symbol] : max_length;
+  }
+  write_bits(a_writer, max_length, 8);
+  for (int length = 1; length <= max_length; length++)
+  {
+    write_uint32(a_writer, count[length]);
+  }
+
+  // Each gap is the distance from the previous symbol of the same length, less one
+  size_t num_used = num_symbols - count[0];
+  uint8_t *gap_codes = malloc(num_used + 1);
+  uint32_t *gap_extras = malloc((num_used + 1) * sizeof(uint32_t));
+  size_t num_gaps = 0;
+  for (int length = 1; length <= max_length; length++)
+  {
+    size_t next = 0;
+    for (size_t symbol = 0; symbol < num_symbols; symbol++)
+    {
+      if (lengths[symbol] == length)
+      {
+        gap_codes[num_gaps] = value_code((uint32_t)(symbol - next));
+        gap_extras[num_gaps++] = (uint32_t)(symbol - next);
+        next = symbol + 1;
+      }
+    }
+  }
+  write_huffman_section(a_writer, gap_codes, num_gaps);
+  for (size_t idx = 0; idx < num_gaps; idx++)
+  {
+    write_code(a_writer, gap_extras[idx] - value_code_base(gap_codes[idx]), value_code_extra_bits(gap_codes[idx]));
+  }
+  free(gap_extras);
+  free(gap_codes);
+}
+
+bool read_canonical_table(BitReader *a_reader, uint8_t *lengths, size_t num_symbols)
+{
+  memset(lengths, 0, num_symbols);
+  uint8_t max_length = read_bits(a_reader, 8);
+  if (max_length > CANONICAL_MAX_CODE_LENGTH)
+  {
+    return false;
+  }
+  uint32_t count[CANONICAL_MAX_CODE_LENGTH + 1] = {0};
+  size_t num_used = 0;
+  for (int length = 1; length <= max_length; length++)
+  {
+    count[length] = read_uint32(a_reader);
+    num_used += count[length];
+    if (num_used > num_symbols)
+    {
+      return false;
+    }
+  }
+
+  uint8_t *gap_codes = malloc(num_used + 1);
+  bool ok = is_bit_reader_open(a_reader) && read_huffman_section(a_reader, gap_codes, num_used);
+  size_t idx = 0;
+  for (int length = 1; ok && length <= max_length; length++)
+  {
+    uint64_t next = 0;
+    for (uint32_t code_idx = 0; ok && code_idx < count[length]; code_idx++, idx++)
+    {
+      ok = gap_codes[idx] < NUM_VALUE_CODES;
+      uint64_t symbol =
+          ok ? next + value_code_base(gap_codes[idx]) + read_code(a_reader, value_code_extra_bits(gap_codes[idx])) : 0;
+      ok = ok && symbol < num_symbols && lengths[symbol] == 0;
+      if (ok)
+      {
+        lengths[symbol] = (uint8_t)length;
+        next = symbol + 1;
+      }
+    }
+  }
+  free(gap_codes);
+  return ok && is_bit_reader_open(a_reader);
+}
+
+void write_canonical_section(BitWriter *a_writer, const uint16_t *symbols, size_t num_symbols)
+{
+  uint64_t *counts = calloc(CANONICAL_SECTION_SYMBOLS, sizeof(uint64_t));
+  for (size_t idx = 0; idx < num_symbols; idx++)
+  {
+    counts[symbols[idx]]++;
+  }
+  uint8_t *lengths = malloc(CANONICAL_SECTION_SYMBOLS);
+  huffman_code_lengths(counts, CANONICAL_SECTION_SYMBOLS, lengths);
+  uint64_t *codes = (uint64_t *)counts; // The counts are not needed once the lengths are known
+  canonical_codes(lengths, CANONICAL_SECTION_SYMBOLS, codes);
+
+  write_canonical_table(a_writer, lengths, CANONICAL_SECTION_SYMBOLS);
+  for (size_t idx = 0; idx < num_symbols; idx++)
+  {
+    write_code(a_writer, codes[symbols[idx]], lengths[symbols[idx]]);
+  }
+  free(lengths);
+  free(codes);
+}
+
+bool read_canonical_section(BitReader *a_reader, uint16_t *symbols, size_t num_symbols)
+{
+  uint8_t *lengths = malloc(CANONICAL_SECTION_SYMBOLS);
+  CanonicalDecoder *decoder = calloc(1, sizeof(*decoder));
+  bool ok = read_canonical_table(a_reader, lengths, CANONICAL_SECTION_SYMBOLS) &&
+            build_canonical_decoder(decoder, lengths, CANONICAL_SECTION_SYMBOLS) &&
+            (decoder->max_length > 0 || num_symbols == 0);
+  for (size_t idx = 0; ok && idx < num_symbols; idx++)
+  {
+    uint32_t symbol = canonical_decode(decoder, a_reader);
+    ok = symbol != CANONICAL_INVALID_SYMBOL;
+    symbols[idx] = (uint16_t)symbol;
+  }
+  destroy_canonical_decoder(decoder);
+  free(decoder);
+  free(lengths);
+  return ok && is_bit_reader_open(a_reader);
+}
@@ -0,0 +1,82 @@
+#ifndef CODE_SEARCH_H
+#define CODE_SEARCH_H
+
+#include "huffman.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Searching compressed data for a byte pattern without decompressing it.
+ * Under one coding table a pattern has exactly one coded form, the
+ * concatenation of its codes, and wherever the pattern occurs that bit string
+ * occurs starting at a code boundary. So the codes are first scanned for the
+ * leading bits of that string at every bit offset, a byte at a time, with
+ * tables of the offsets into each byte (and into the byte before it) where
+ * those bits could start. Codes with no candidate cannot hold the pattern
+ * and are never decoded, and a table that lacks a code for one of its bytes
+ * rules out the whole block at once.
+ *
+ * A candidate is a match only if it starts on a code boundary. Boundaries are
+ * found by walking the codes (counting them, several per table lookup,
+ * without storing the bytes) from the nearest known one: the start of the
+ * block, or a checkpoint of the container's index (see compress -i). The walk
+ * stops after the last candidate.
+ *
+ * Blocks that are not plain Huffman codes (LZ77, BWT, ...) and adaptive
+ * containers are decoded and searched as bytes. Matches that straddle two
+ * blocks are found from the first and last bytes of each block, which are
+ * decoded only when the next block could continue a partial match.
+ */
+
+/**
+ * How much work a search did, for judging how well the coded form filtered.
+ */
+typedef struct _SearchStats
+{
+  uint64_t num_blocks;         // Blocks searched; the two-file format counts as one
+  uint64_t num_skipped_blocks; // Blocks ruled out from their codes alone
+  uint64_t num_candidates;     // Places whose bits matched, whether or not on a code boundary
+  uint64_t num_walked_codes;   // Codes walked to find boundaries
+  uint64_t num_plain_bytes;    // Bytes of blocks searched as bytes rather than as codes
+} SearchStats;
+
+/**
+ * @brief Find every occurrence of `pattern` in the codes of the original
+ * two-file format, including overlapping ones.
+ *
+ * @param root the root of the Huffman tree the codes were written with
+ * @param codes the codes, starting at their first bit
+ * @param num_code_bytes the number of bytes at codes
+ * @param num_symbols the number of bytes the codes decode to
+ * @param pattern the bytes to look for
+ * @param pattern_size the number of bytes at pattern
+ * @param a_offsets where to store a malloc'd array of the uncompressed offsets
+ * of the matches, in order
+ * @param a_num_offsets where to store the number of matches
+ * @param a_stats where to add the work done, or NULL
+ */
+void search_huffman_codes(TreeNode *root, const uint8_t *codes, size_t num_code_bytes, uint64_t num_symbols,
+                          const uint8_t *pattern, size_t pattern_size, uint64_t **a_offsets, size_t *a_num_offsets,
+                          SearchStats *a_stats);
+
+/**
+ * @brief Find every occurrence of `pattern` in a container file, including
+ * overlapping ones.
+ *
+ * @param container the container file, opened for reading
+ * @param pattern the bytes to look for
+ * @param pattern_size the number of bytes at pattern
+ * @param a_offsets where to store a malloc'd array of the uncompressed offsets
+ * of the matches, in order
+ * @param a_num_offsets where to store the number of matches
+ * @param a_stats where to add the work done, or NULL
+ * @param a_error a pointer to a string that will be set to an error message
+ * @return bool false if the container is malformed
+ */
+bool search_container(FILE *container, const uint8_t *pattern, size_t pattern_size, uint64_t **a_offsets,
+                      size_t *a_num_offsets, SearchStats *a_stats, const char **a_error);
+
+#endif // CODE_SEARCH_H
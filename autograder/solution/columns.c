@@ -0,0 +1,109 @@
+#include "columns.h"
+#include "huffman.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The columns of a block lie one after another: column c holds num_records
+ * bytes, and one more for each of the first num_tail columns, which the last,
+ * cut-short record reaches.
+ */
+typedef struct _ColumnLayout
+{
+  size_t width;
+  size_t num_records; // Whole records
+  size_t num_tail;    // Bytes of the cut-short record
+} ColumnLayout;
+
+static size_t _column_start(const ColumnLayout *a_layout, size_t column)
+{
+  return column * a_layout->num_records + (column < a_layout->num_tail ? column : a_layout->num_tail);
+}
+
+static size_t _column_size(const ColumnLayout *a_layout, size_t column)
+{
+  return a_layout->num_records + (column < a_layout->num_tail);
+}
+
+/*
+ * Records are read in order and each byte goes to the end of its column, so
+ * the input is read once, sequentially, and every column is written
+ * sequentially too. Only the last record may be cut short.
+ */
+static void _gather_columns(const uint8_t *records, uint8_t *columns, const ColumnLayout *a_layout)
+{
+  size_t starts[COLUMNS_MAX_WIDTH];
+  for (size_t column = 0; column < a_layout->width; column++)
+  {
+    starts[column] = _column_start(a_layout, column);
+  }
+  size_t num_bytes = a_layout->num_records * a_layout->width + a_layout->num_tail;
+  for (size_t record = 0; record * a_layout->width < num_bytes; record++)
+  {
+    const uint8_t *in = records + record * a_layout->width;
+    size_t record_width = record < a_layout->num_records ? a_layout->width : a_layout->num_tail;
+    for (size_t column = 0; column < record_width; column++)
+    {
+      columns[starts[column] + record] = in[column];
+    }
+  }
+}
+
+// The inverse of _gather_columns(...)
+static void _scatter_columns(const uint8_t *columns, uint8_t *records, const ColumnLayout *a_layout)
+{
+  size_t starts[COLUMNS_MAX_WIDTH];
+  for (size_t column = 0; column < a_layout->width; column++)
+  {
+    starts[column] = _column_start(a_layout, column);
+  }
+  size_t num_bytes = a_layout->num_records * a_layout->width + a_layout->num_tail;
+  for (size_t record = 0; record * a_layout->width < num_bytes; record++)
+  {
+    uint8_t *out = records + record * a_layout->width;
+    size_t record_width = record < a_layout->num_records ? a_layout->width : a_layout->num_tail;
+    for (size_t column = 0; column < record_width; column++)
+    {
+      out[column] = columns[starts[column] + record];
+    }
+  }
+}
+
+void columns_write_payload(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes, size_t record_width)
+{
+  ColumnLayout layout = {.width = record_width < num_bytes ? record_width : num_bytes};
+  layout.num_records = num_bytes / layout.width;
+  layout.num_tail = num_bytes % layout.width;
+  uint8_t *columns = malloc(num_bytes);
+  _gather_columns(bytes, columns, &layout);
+
+  write_varint(a_writer, layout.width);
+  for (size_t column = 0; column < layout.width; column++)
+  {
+    write_huffman_section(a_writer, columns + _column_start(&layout, column), _column_size(&layout, column));
+  }
+  free(columns);
+}
+
+bool columns_read_payload(BitReader *a_reader, uint8_t *bytes, size_t num_bytes)
+{
+  uint64_t width = read_varint(a_reader);
+  if (width == 0 || width > COLUMNS_MAX_WIDTH || width > num_bytes)
+  {
+    return false;
+  }
+  ColumnLayout layout = {.width = width, .num_records = num_bytes / width, .num_tail = num_bytes % width};
+  uint8_t *columns = malloc(num_bytes);
+  bool ok = true;
+  for (size_t column = 0; ok && column < layout.width; column++)
+  {
+    ok = read_huffman_section(a_reader, columns + _column_start(&layout, column), _column_size(&layout, column));
+  }
+  if (ok)
+  {
+    _scatter_columns(columns, bytes, &layout);
+  }
+  free(columns);
+  return ok && is_bit_reader_open(a_reader);
+}
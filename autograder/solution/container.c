@@ -0,0 +1,1706 @@
+#include "container.h"
+#include "adaptive_huffman.h"
+#include "huffman.h"
+#include "rle.h"
+#include "lz77.h"
+#include "bwt.h"
+#include "context_huffman.h"
+#include "word_huffman.h"
+#include "tans.h"
+#include "columns.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#define DEFAULT_SEGMENT_SIZE (4u << 10)
+#define DEFAULT_MAX_BLOCK_SIZE (1u << 20)
+#define LZ_BLOCK_SIZE (4u << 20)
+#define BWT_BLOCK_SIZE (900u << 10)
+#define WORD_BLOCK_SIZE (8u << 20)
+
+BlockOptions default_block_options(void)
+{
+  return (BlockOptions){.segment_size = DEFAULT_SEGMENT_SIZE, .max_block_size = DEFAULT_MAX_BLOCK_SIZE, .split_on_drift = true};
+}
+
+BlockOptions lz_block_options(int level, int window_log)
+{
+  // Splitting on drift would cut matches short for a table that literals rarely need
+  return (BlockOptions){.segment_size = DEFAULT_SEGMENT_SIZE,
+                        .max_block_size = LZ_BLOCK_SIZE,
+                        .split_on_drift = false,
+                        .lz_level = level,
+                        .lz_window_log = window_log};
+}
+
+BlockOptions bwt_block_options(void)
+{
+  return (BlockOptions){.segment_size = DEFAULT_SEGMENT_SIZE, .max_block_size = BWT_BLOCK_SIZE, .bwt = true};
+}
+
+BlockOptions word_block_options(void)
+{
+  return (BlockOptions){.segment_size = DEFAULT_SEGMENT_SIZE, .max_block_size = WORD_BLOCK_SIZE, .words = true};
+}
+
+void write_container_header(BitWriter *a_writer, ContainerMode mode)
+{
+  write_uint32(a_writer, CONTAINER_MAGIC);
+  write_bits(a_writer, (uint8_t)mode, 8);
+}
+
+/*
+ * The encoder remembers the last table it wrote so that later blocks can
+ * reuse it with BLOCK_HUFFMAN_REPEAT.
+ */
+typedef struct _BlockEncoderState
+{
+  bool has_table;
+  Frequencies table_freq; // Which characters the last table has codes for
+  HuffEncoder table;
+  TreeCache *cache; // Where BLOCK_HUFFMAN blocks look for a table before building one, or NULL
+} BlockEncoderState;
+
+static void _write_block(BitWriter *a_writer, BlockType type, size_t num_bytes, BitWriter *a_payload)
+{
+  align_bit_writer(a_payload);
+  write_bits(a_writer, (uint8_t)type, 8);
+  write_uint32(a_writer, (uint32_t)num_bytes);
+  write_uint32(a_writer, (uint32_t)a_payload->num_bytes);
+  write_bytes(a_writer, a_payload->buffer, a_payload->num_bytes);
+}
+
+static bool _table_covers(const Frequencies table_freq, const Frequencies freqs)
+{
+  for (int ch = 0; ch < 256; ch++)
+  {
+    if (freqs[ch] > 0 && table_freq[ch] == 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void _write_stored_block(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes)
+{
+  write_bits(a_writer, BLOCK_STORED, 8);
+  write_uint32(a_writer, (uint32_t)num_bytes);
+  write_uint32(a_writer, (uint32_t)num_bytes);
+  write_bytes(a_writer, bytes, num_bytes);
+}
+
+/*
+ * A byte that fills at least half of a block may be coded more cheaply, and
+ * decoded with fewer steps, as runs (see rle.h) than one code per byte.
+ */
+static int _dominant_symbol(const Frequencies freq, size_t num_bytes)
+{
+  for (int ch = 0; ch < 256; ch++)
+  {
+    if (2 * freq[ch] >= num_bytes)
+    {
+      return ch;
+    }
+  }
+  return -1;
+}
+
+static int _num_distinct(const Frequencies freq)
+{
+  int num_distinct = 0;
+  for (int ch = 0; ch < 256; ch++)
+  {
+    num_distinct += freq[ch] > 0;
+  }
+  return num_distinct;
+}
+
+/*
+ * A run-length candidate for a block: the block with the runs of `symbol`
+ * shortened, and the Huffman code for what is left.
+ */
+typedef struct _RunCandidate
+{
+  uint8_t symbol;
+  uint8_t *encoded;
+  size_t num_encoded_bytes;
+  TreeNode *root;
+  HuffEncoder encoder;
+  uint64_t num_bits;
+} RunCandidate;
+
+static void _make_run_candidate(RunCandidate *a_candidate, const uint8_t *bytes, size_t num_bytes, uint8_t symbol)
+{
+  a_candidate->symbol = symbol;
+  a_candidate->encoded = malloc(2 * num_bytes);
+  a_candidate->num_encoded_bytes = rle_encode_runs(bytes, num_bytes, symbol, a_candidate->encoded);
+
+  Frequencies encoded_freq = {0};
+  add_frequencies(encoded_freq, a_candidate->encoded, a_candidate->num_encoded_bytes);
+  a_candidate->root = make_huffman_tree(encoded_freq);
+  build_huff_encoder(&a_candidate->encoder, a_candidate->root);
+  a_candidate->num_bits = 8 + 32 + coded_bits(encoded_freq, &a_candidate->encoder) + coding_table_bits(encoded_freq);
+}
+
+/*
+ * The coding _choose_block(...) picked for a block, with whatever its
+ * payload is written from, and the exact size of that payload.
+ */
+typedef struct _BlockChoice
+{
+  BlockType type;
+  uint64_t num_payload_bytes;
+  TreeNode *root;             // The tree of a BLOCK_HUFFMAN block, unless it has a cached table
+  const CachedTable *cached;  // The cached table of a BLOCK_HUFFMAN block, or NULL
+  HuffEncoder encoder;
+  RunCandidate runs; // The runs of a BLOCK_RLE block
+} BlockChoice;
+
+static void _choose_block(BlockChoice *a_choice, const uint8_t *bytes, size_t num_bytes, Frequencies freq,
+                          const BitWriter *a_transformed, BlockType transformed_type, BlockEncoderState *a_state)
+{
+  *a_choice = (BlockChoice){.root = NULL, .cached = NULL, .runs = {.encoded = NULL, .root = NULL}};
+  if (_num_distinct(freq) == 1)
+  {
+    a_choice->type = BLOCK_FILL;
+    a_choice->num_payload_bytes = 1;
+    return;
+  }
+
+  // Repetition or context can make even high-entropy bytes shrink, so a front-end's payload competes with storing
+  uint64_t transformed_bits = a_transformed->buffer != NULL ? 8 * (uint64_t)a_transformed->num_bytes : UINT64_MAX;
+
+  // No prefix code beats the entropy, so don't build a tree for data that cannot shrink; a repeated table is free
+  uint64_t stored_bits = 8 * (uint64_t)num_bytes;
+  bool can_repeat = a_state->has_table && _table_covers(a_state->table_freq, freq);
+  if (entropy_bits(freq) + (can_repeat ? 0 : coding_table_bits(freq)) >= stored_bits)
+  {
+    a_choice->type = transformed_bits < stored_bits ? transformed_type : BLOCK_STORED;
+    a_choice->num_payload_bytes = transformed_bits < stored_bits ? a_transformed->num_bytes : num_bytes;
+    return;
+  }
+
+  uint64_t own_bits = 0;
+  a_choice->cached = a_state->cache != NULL ? find_cached_table(a_state->cache, freq, &own_bits) : NULL;
+  if (a_choice->cached != NULL)
+  {
+    a_choice->encoder = *a_choice->cached->encoder;
+  }
+  else
+  {
+    a_choice->root = make_huffman_tree(freq);
+    build_huff_encoder(&a_choice->encoder, a_choice->root);
+    own_bits = coded_bits(freq, &a_choice->encoder) + coding_table_bits(freq);
+  }
+  uint64_t repeat_bits = can_repeat ? coded_bits(freq, &a_state->table) : UINT64_MAX;
+  int dominant_symbol = _dominant_symbol(freq, num_bytes);
+  a_choice->runs.num_bits = UINT64_MAX;
+  if (dominant_symbol >= 0)
+  {
+    _make_run_candidate(&a_choice->runs, bytes, num_bytes, (uint8_t)dominant_symbol);
+  }
+  uint64_t run_bits = a_choice->runs.num_bits;
+
+  uint64_t num_bits;
+  if (transformed_bits < stored_bits && transformed_bits < own_bits && transformed_bits < repeat_bits &&
+      transformed_bits < run_bits)
+  {
+    a_choice->type = transformed_type;
+    num_bits = transformed_bits;
+  }
+  else if (stored_bits <= own_bits && stored_bits <= repeat_bits && stored_bits <= run_bits)
+  {
+    a_choice->type = BLOCK_STORED;
+    num_bits = stored_bits;
+  }
+  else if (run_bits < own_bits && run_bits < repeat_bits)
+  {
+    a_choice->type = BLOCK_RLE;
+    num_bits = run_bits;
+  }
+  else if (repeat_bits <= own_bits)
+  {
+    a_choice->type = BLOCK_HUFFMAN_REPEAT;
+    num_bits = repeat_bits;
+  }
+  else
+  {
+    a_choice->type = BLOCK_HUFFMAN;
+    num_bits = own_bits;
+    a_state->has_table = true;
+    memcpy(a_state->table_freq, freq, sizeof(Frequencies));
+    a_state->table = a_choice->encoder;
+    if (a_state->cache != NULL && a_choice->cached == NULL)
+    {
+      add_cached_table(a_state->cache, freq, a_choice->root);
+    }
+  }
+  a_choice->num_payload_bytes = (num_bits + 7) / 8;
+}
+
+static void _destroy_block_choice(BlockChoice *a_choice)
+{
+  free(a_choice->runs.encoded);
+  destroy_huffman_tree(&a_choice->runs.root);
+  destroy_huffman_tree(&a_choice->root);
+}
+
+static void _encode_block(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes, const BlockChoice *a_choice,
+                          BitWriter *a_transformed, const BlockEncoderState *a_state)
+{
+  BitWriter payload = {.buffer = NULL};
+  switch (a_choice->type)
+  {
+  case BLOCK_STORED:
+    _write_stored_block(a_writer, bytes, num_bytes);
+    break;
+  case BLOCK_FILL:
+    payload = open_memory_bit_writer(1);
+    write_bits(&payload, bytes[0], 8);
+    _write_block(a_writer, BLOCK_FILL, num_bytes, &payload);
+    break;
+  case BLOCK_RLE:
+    payload = open_memory_bit_writer(a_choice->num_payload_bytes);
+    write_bits(&payload, a_choice->runs.symbol, 8);
+    write_uint32(&payload, (uint32_t)a_choice->runs.num_encoded_bytes);
+    write_huffman_section(&payload, a_choice->runs.encoded, a_choice->runs.num_encoded_bytes);
+    _write_block(a_writer, BLOCK_RLE, num_bytes, &payload);
+    break;
+  case BLOCK_HUFFMAN_REPEAT:
+    payload = open_memory_bit_writer(a_choice->num_payload_bytes);
+    write_symbols(&payload, &a_state->table, bytes, num_bytes);
+    _write_block(a_writer, BLOCK_HUFFMAN_REPEAT, num_bytes, &payload);
+    break;
+  case BLOCK_HUFFMAN:
+    payload = open_memory_bit_writer(a_choice->num_payload_bytes);
+    if (a_choice->cached != NULL)
+    {
+      write_cached_table(&payload, a_choice->cached);
+    }
+    else
+    {
+      write_coding_table(a_choice->root, &payload);
+      write_bits(&payload, 0, 1);
+    }
+    write_symbols(&payload, &a_choice->encoder, bytes, num_bytes);
+    _write_block(a_writer, BLOCK_HUFFMAN, num_bytes, &payload);
+    break;
+  default: // The front-end's payload
+    _write_block(a_writer, a_choice->type, num_bytes, a_transformed);
+    break;
+  }
+  free(payload.buffer);
+}
+
+/*
+ * Grow a block one segment at a time from the start of `bytes`. Splitting
+ * before a segment saves about H(block + segment) - H(block) - H(segment) bits
+ * (the cost of coding both with one tree instead of two) but costs a table and
+ * a block header, so the block ends where the saving exceeds that cost.
+ */
+static size_t _next_block_size(const uint8_t *bytes, size_t num_bytes, const BlockOptions *a_options,
+                               Frequencies block_freq)
+{
+  size_t limit = num_bytes < a_options->max_block_size ? num_bytes : a_options->max_block_size;
+  size_t block_size = a_options->split_on_drift && a_options->segment_size < limit ? a_options->segment_size : limit;
+  memset(block_freq, 0, sizeof(Frequencies));
+  add_frequencies(block_freq, bytes, block_size);
+
+  while (block_size < limit)
+  {
+    size_t segment_size = limit - block_size < a_options->segment_size ? limit - block_size : a_options->segment_size;
+    Frequencies segment_freq = {0};
+    add_frequencies(segment_freq, bytes + block_size, segment_size);
+
+    Frequencies merged_freq;
+    for (int ch = 0; ch < 256; ch++)
+    {
+      merged_freq[ch] = block_freq[ch] + segment_freq[ch];
+    }
+    double split_saving = entropy_bits(merged_freq) - entropy_bits(block_freq) - entropy_bits(segment_freq);
+    if (split_saving > coding_table_bits(segment_freq) + BLOCK_HEADER_BITS)
+    {
+      break;
+    }
+
+    memcpy(block_freq, merged_freq, sizeof(Frequencies));
+    block_size += segment_size;
+  }
+
+  return block_size;
+}
+
+/*
+ * A block, and the smallest payload the enabled front-ends (LZ77, BWT,
+ * order-1 contexts, words, tANS, columns) made of it. Front-ends are the slow part of encoding and
+ * never look at other blocks, so every block's payload is built on a pool of
+ * threads before the blocks are coded in order.
+ */
+typedef struct _PlannedBlock
+{
+  size_t offset;
+  size_t num_bytes;
+  Frequencies freq; // Counted while planning, so coding and summaries need not count again
+  BitWriter transformed;
+  BlockType transformed_type;
+} PlannedBlock;
+
+typedef struct _TransformWorker
+{
+  pthread_t thread;
+  bool started;
+  const uint8_t *bytes;
+  PlannedBlock *blocks;
+  size_t num_blocks;
+  size_t first_block; // This worker takes every stride-th block from here
+  size_t stride;
+  const BlockOptions *options;
+} TransformWorker;
+
+static bool _has_front_end(const BlockOptions *a_options)
+{
+  return a_options->bwt || a_options->lz_level > 0 || a_options->order1 || a_options->words ||
+         a_options->tans || a_options->record_width > 0;
+}
+
+static void _keep_smaller(PlannedBlock *a_block, BitWriter *a_payload, BlockType type)
+{
+  align_bit_writer(a_payload);
+  if (a_block->transformed.buffer == NULL || a_payload->num_bytes < a_block->transformed.num_bytes)
+  {
+    free(a_block->transformed.buffer);
+    a_block->transformed = *a_payload;
+    a_block->transformed_type = type;
+  }
+  else
+  {
+    free(a_payload->buffer);
+  }
+}
+
+static void *_run_transform_worker(void *a_worker)
+{
+  TransformWorker *worker = a_worker;
+  const BlockOptions *options = worker->options;
+  for (size_t idx = worker->first_block; idx < worker->num_blocks; idx += worker->stride)
+  {
+    PlannedBlock *block = &worker->blocks[idx];
+    const uint8_t *bytes = worker->bytes + block->offset;
+    if (options->bwt)
+    {
+      BitWriter payload = open_memory_bit_writer(block->num_bytes / 2);
+      bwt_write_payload(&payload, bytes, block->num_bytes);
+      _keep_smaller(block, &payload, BLOCK_BWT);
+    }
+    else if (options->lz_level > 0)
+    {
+      LzOptions lz_options = {.level = options->lz_level, .window_log = options->lz_window_log};
+      BitWriter payload = open_memory_bit_writer(block->num_bytes / 2);
+      lz77_write_payload(&payload, bytes, block->num_bytes, &lz_options);
+      _keep_smaller(block, &payload, BLOCK_LZ77);
+    }
+    if (options->order1)
+    {
+      BitWriter payload = open_memory_bit_writer(block->num_bytes / 2);
+      context_write_payload(&payload, bytes, block->num_bytes);
+      _keep_smaller(block, &payload, BLOCK_CONTEXT);
+    }
+    if (options->words)
+    {
+      BitWriter payload = open_memory_bit_writer(block->num_bytes / 2);
+      words_write_payload(&payload, bytes, block->num_bytes);
+      _keep_smaller(block, &payload, BLOCK_WORDS);
+    }
+    if (options->tans)
+    {
+      BitWriter payload = open_memory_bit_writer(block->num_bytes / 2);
+      tans_write_payload(&payload, bytes, block->num_bytes, block->freq);
+      _keep_smaller(block, &payload, BLOCK_TANS);
+    }
+    if (options->record_width > 0)
+    {
+      BitWriter payload = open_memory_bit_writer(block->num_bytes / 2);
+      columns_write_payload(&payload, bytes, block->num_bytes, options->record_width);
+      _keep_smaller(block, &payload, BLOCK_COLUMNS);
+    }
+  }
+  return NULL;
+}
+
+static void _build_transforms(const uint8_t *bytes, PlannedBlock *blocks, size_t num_blocks,
+                              const BlockOptions *a_options)
+{
+  long num_threads = a_options->num_threads > 0 ? a_options->num_threads : sysconf(_SC_NPROCESSORS_ONLN);
+  num_threads = num_threads < 1 ? 1 : (size_t)num_threads > num_blocks ? (long)num_blocks : num_threads;
+
+  TransformWorker *workers = malloc(num_threads * sizeof(TransformWorker));
+  for (long idx = 0; idx < num_threads; idx++)
+  {
+    workers[idx] = (TransformWorker){.bytes = bytes,
+                                     .blocks = blocks,
+                                     .num_blocks = num_blocks,
+                                     .first_block = idx,
+                                     .stride = num_threads,
+                                     .options = a_options};
+  }
+  // The calling thread is worker 0; a worker that cannot be started runs here too
+  for (long idx = 1; idx < num_threads; idx++)
+  {
+    workers[idx].started = pthread_create(&workers[idx].thread, NULL, _run_transform_worker, &workers[idx]) == 0;
+  }
+  _run_transform_worker(&workers[0]);
+  for (long idx = 1; idx < num_threads; idx++)
+  {
+    if (workers[idx].started)
+    {
+      pthread_join(workers[idx].thread, NULL);
+    }
+    else
+    {
+      _run_transform_worker(&workers[idx]);
+    }
+  }
+  free(workers);
+}
+
+// Split `bytes` into blocks and build their front-end payloads
+static PlannedBlock *_plan_blocks(const uint8_t *bytes, size_t num_bytes, const BlockOptions *a_options,
+                                  size_t *a_num_blocks)
+{
+  size_t capacity = 16;
+  PlannedBlock *blocks = malloc(capacity * sizeof(PlannedBlock));
+  size_t num_blocks = 0;
+  size_t offset = 0;
+  while (offset < num_bytes)
+  {
+    if (num_blocks == capacity)
+    {
+      capacity *= 2;
+      blocks = realloc(blocks, capacity * sizeof(PlannedBlock));
+    }
+    PlannedBlock *block = &blocks[num_blocks++];
+    size_t block_size = _next_block_size(bytes + offset, num_bytes - offset, a_options, block->freq);
+    block->offset = offset;
+    block->num_bytes = block_size;
+    block->transformed = (BitWriter){.buffer = NULL};
+    block->transformed_type = BLOCK_END;
+    offset += block_size;
+  }
+
+  if (num_blocks > 0 && _has_front_end(a_options))
+  {
+    _build_transforms(bytes, blocks, num_blocks, a_options);
+  }
+  *a_num_blocks = num_blocks;
+  return blocks;
+}
+
+/*
+ * The checkpoints of an index, gathered as blocks are chosen.
+ */
+typedef struct _CheckpointList
+{
+  Checkpoint *checkpoints;
+  size_t num_checkpoints;
+  size_t capacity;
+} CheckpointList;
+
+static void _add_checkpoint(CheckpointList *a_list, Checkpoint checkpoint)
+{
+  if (a_list->num_checkpoints == a_list->capacity)
+  {
+    a_list->capacity = a_list->capacity * 2 + 16;
+    a_list->checkpoints = realloc(a_list->checkpoints, a_list->capacity * sizeof(Checkpoint));
+  }
+  a_list->checkpoints[a_list->num_checkpoints++] = checkpoint;
+}
+
+// A checkpoint at the start of the block, and every `interval` bytes (if any) into it where it is coded with a tree
+static void _add_block_checkpoints(CheckpointList *a_list, const BlockChoice *a_choice, const BlockEncoderState *a_state,
+                                   const uint8_t *bytes, size_t num_bytes, const Frequencies freq, Checkpoint start,
+                                   size_t interval)
+{
+  _add_checkpoint(a_list, start);
+  if (interval == 0 || (a_choice->type != BLOCK_HUFFMAN && a_choice->type != BLOCK_HUFFMAN_REPEAT))
+  {
+    return;
+  }
+  const HuffEncoder *encoder = a_choice->type == BLOCK_HUFFMAN ? &a_choice->encoder : &a_state->table;
+  uint64_t bit_offset = a_choice->type != BLOCK_HUFFMAN ? 0
+                        : a_choice->cached != NULL ? a_choice->cached->num_table_bits
+                                                   : coding_table_bits(freq);
+  for (size_t idx = 0; idx < num_bytes; idx++)
+  {
+    if (idx > 0 && idx % interval == 0)
+    {
+      _add_checkpoint(a_list, (Checkpoint){.offset = start.offset + idx,
+                                           .block_offset = start.block_offset,
+                                           .table_offset = start.table_offset,
+                                           .bit_offset = bit_offset});
+    }
+    bit_offset += encoder->codes[bytes[idx]].length;
+  }
+}
+
+static int _varint_size(uint64_t value)
+{
+  int size = 1;
+  while (value >= 0x80)
+  {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+// The bytes of the index, not counting the length and magic words after it
+static uint64_t _index_size(const CheckpointList *a_list)
+{
+  uint64_t size = 0;
+  for (size_t idx = 0; idx < a_list->num_checkpoints; idx++)
+  {
+    const Checkpoint *checkpoint = &a_list->checkpoints[idx];
+    size += _varint_size(checkpoint->offset) + _varint_size(checkpoint->block_offset) +
+            _varint_size(checkpoint->table_offset) + _varint_size(checkpoint->bit_offset);
+  }
+  return size;
+}
+
+static void _write_index(BitWriter *a_writer, const CheckpointList *a_list)
+{
+  for (size_t idx = 0; idx < a_list->num_checkpoints; idx++)
+  {
+    const Checkpoint *checkpoint = &a_list->checkpoints[idx];
+    write_varint(a_writer, checkpoint->offset);
+    write_varint(a_writer, checkpoint->block_offset);
+    write_varint(a_writer, checkpoint->table_offset);
+    write_varint(a_writer, checkpoint->bit_offset);
+  }
+  write_uint32(a_writer, (uint32_t)_index_size(a_list));
+  write_uint32(a_writer, CONTAINER_INDEX_MAGIC);
+}
+
+/*
+ * The histograms of block summaries, gathered as blocks are planned.
+ */
+typedef struct _SummaryList
+{
+  BlockSummary *summaries;
+  size_t num_summaries;
+  size_t capacity;
+} SummaryList;
+
+static void _add_summary(SummaryList *a_list, uint64_t offset, uint64_t num_bytes, const Frequencies freq)
+{
+  if (a_list->num_summaries == a_list->capacity)
+  {
+    a_list->capacity = a_list->capacity * 2 + 16;
+    a_list->summaries = realloc(a_list->summaries, a_list->capacity * sizeof(BlockSummary));
+  }
+  BlockSummary *summary = &a_list->summaries[a_list->num_summaries++];
+  summary->offset = offset;
+  summary->num_bytes = num_bytes;
+  memcpy(summary->freq, freq, sizeof(Frequencies));
+}
+
+// The summary of one block: its number of distinct bytes, then the gap to each and its count
+static uint64_t _summary_size(const Frequencies freq)
+{
+  uint64_t size = _varint_size(_num_distinct(freq));
+  int last = -1;
+  for (int ch = 0; ch < 256; ch++)
+  {
+    if (freq[ch] > 0)
+    {
+      size += _varint_size(ch - last - 1) + _varint_size(freq[ch]);
+      last = ch;
+    }
+  }
+  return size;
+}
+
+static void _write_summary(BitWriter *a_writer, const Frequencies freq)
+{
+  write_varint(a_writer, _num_distinct(freq));
+  int last = -1;
+  for (int ch = 0; ch < 256; ch++)
+  {
+    if (freq[ch] > 0)
+    {
+      write_varint(a_writer, ch - last - 1);
+      write_varint(a_writer, freq[ch]);
+      last = ch;
+    }
+  }
+}
+
+/*
+ * Choose the coding of every block and write the blocks to `a_writer`, or
+ * with no writer, only add up the bytes they would take. Blocks start with no
+ * table to repeat, so they never depend on blocks written before them; self-
+ * contained blocks each start over, from the shared table if there is one. With
+ * lists, add the checkpoints and summaries of the blocks, their offsets
+ * counted from the first of them.
+ */
+static uint64_t _code_block_list(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes,
+                                 const BlockOptions *a_options, CheckpointList *a_index, SummaryList *a_summaries)
+{
+  size_t num_blocks = 0;
+  PlannedBlock *blocks = _plan_blocks(bytes, num_bytes, a_options, &num_blocks);
+
+  uint64_t size = 0;
+  uint64_t table_offset = 0;
+  // Sizing leaves the cache as it was, so the tables that coding would add to it go to an overlay
+  TreeCache overlay = {.tables = NULL, .slots = NULL, .mapping = NULL, .base = NULL};
+  bool sizing_with_cache = a_writer == NULL && a_options->tree_cache != NULL;
+  if (sizing_with_cache)
+  {
+    overlay_tree_cache(&overlay, a_options->tree_cache);
+  }
+  BlockEncoderState start = {.has_table = a_options->self_contained && a_options->shared_table != NULL,
+                             .cache = sizing_with_cache ? &overlay : a_options->tree_cache};
+  if (start.has_table)
+  {
+    memcpy(start.table_freq, *a_options->shared_table, sizeof(Frequencies));
+    TreeNode *root = make_huffman_tree(start.table_freq);
+    build_huff_encoder(&start.table, root);
+    destroy_huffman_tree(&root);
+  }
+  BlockEncoderState state = start;
+  for (size_t idx = 0; idx < num_blocks; idx++)
+  {
+    const uint8_t *block_bytes = bytes + blocks[idx].offset;
+    uint64_t *block_freq = blocks[idx].freq;
+    if (a_options->self_contained)
+    {
+      state = start;
+    }
+    BlockChoice choice;
+    _choose_block(&choice, block_bytes, blocks[idx].num_bytes, block_freq, &blocks[idx].transformed,
+                  blocks[idx].transformed_type, &state);
+    table_offset = choice.type == BLOCK_HUFFMAN ? size : table_offset;
+    if (a_index != NULL)
+    {
+      Checkpoint start = {.offset = blocks[idx].offset, .block_offset = size, .table_offset = table_offset, .bit_offset = 0};
+      _add_block_checkpoints(a_index, &choice, &state, block_bytes, blocks[idx].num_bytes, block_freq, start,
+                             a_options->index_interval);
+    }
+    if (a_summaries != NULL)
+    {
+      _add_summary(a_summaries, blocks[idx].offset, blocks[idx].num_bytes, block_freq);
+    }
+    if (a_writer != NULL)
+    {
+      _encode_block(a_writer, block_bytes, blocks[idx].num_bytes, &choice, &blocks[idx].transformed, &state);
+    }
+    size += BLOCK_HEADER_BITS / 8 + choice.num_payload_bytes;
+    _destroy_block_choice(&choice);
+    free(blocks[idx].transformed.buffer);
+  }
+  free(blocks);
+  if (sizing_with_cache)
+  {
+    destroy_tree_cache(&overlay);
+  }
+  return size;
+}
+
+/*
+ * Write what follows the blocks: BLOCK_END, then the summaries and the index
+ * if there are lists for them, or with no writer, only add up their bytes.
+ */
+static uint64_t _write_trailers(BitWriter *a_writer, const SummaryList *a_summaries, const CheckpointList *a_index)
+{
+  uint64_t size = 1; // BLOCK_END
+  if (a_writer != NULL)
+  {
+    write_bits(a_writer, BLOCK_END, 8);
+  }
+  if (a_summaries != NULL)
+  {
+    uint64_t summaries_size = 0;
+    for (size_t idx = 0; idx < a_summaries->num_summaries; idx++)
+    {
+      summaries_size += _summary_size(a_summaries->summaries[idx].freq);
+    }
+    size += summaries_size + 2 * sizeof(uint32_t);
+    for (size_t idx = 0; a_writer != NULL && idx < a_summaries->num_summaries; idx++)
+    {
+      _write_summary(a_writer, a_summaries->summaries[idx].freq);
+    }
+    if (a_writer != NULL)
+    {
+      write_uint32(a_writer, (uint32_t)summaries_size);
+      write_uint32(a_writer, CONTAINER_SUMMARY_MAGIC);
+    }
+  }
+  if (a_index != NULL)
+  {
+    size += _index_size(a_index) + 2 * sizeof(uint32_t);
+    if (a_writer != NULL)
+    {
+      _write_index(a_writer, a_index);
+    }
+  }
+  return size;
+}
+
+static uint64_t _code_blocks(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes,
+                             const BlockOptions *a_options)
+{
+  CheckpointList index = {.checkpoints = NULL, .num_checkpoints = 0, .capacity = 0};
+  SummaryList summaries = {.summaries = NULL, .num_summaries = 0, .capacity = 0};
+  CheckpointList *index_list = a_options->index_interval > 0 ? &index : NULL;
+  SummaryList *summary_list = a_options->summaries ? &summaries : NULL;
+  uint64_t size = _code_block_list(a_writer, bytes, num_bytes, a_options, index_list, summary_list);
+  size += _write_trailers(a_writer, summary_list, index_list);
+  free(index.checkpoints);
+  free(summaries.summaries);
+  return size;
+}
+
+void compress_blocks(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes, const BlockOptions *a_options)
+{
+  _code_blocks(a_writer, bytes, num_bytes, a_options);
+}
+
+uint64_t write_blocks(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes, const BlockOptions *a_options)
+{
+  return _code_block_list(a_writer, bytes, num_bytes, a_options, NULL, NULL);
+}
+
+uint64_t compressed_blocks_size(const uint8_t *bytes, size_t num_bytes, const BlockOptions *a_options)
+{
+  // The same choices compress_blocks(...) makes, counted instead of written
+  return _code_blocks(NULL, bytes, num_bytes, a_options);
+}
+
+bool decode_block(BlockType type, const uint8_t *payload, uint32_t num_payload_bytes, uint8_t *bytes,
+                  uint32_t num_bytes, TreeNode **a_table_root, const char **a_error)
+{
+  bool ok = true;
+  BitReader payload_reader = open_memory_bit_reader(payload, num_payload_bytes);
+  switch (type)
+  {
+  case BLOCK_STORED:
+    ok = num_payload_bytes == num_bytes;
+    if (!ok)
+    {
+      *a_error = "stored block size mismatch";
+      break;
+    }
+    memcpy(bytes, payload, num_bytes);
+    break;
+  case BLOCK_HUFFMAN:
+    destroy_huffman_tree(a_table_root);
+    *a_table_root = read_coding_table(&payload_reader);
+    if (*a_table_root == NULL && num_bytes > 0)
+    {
+      *a_error = "empty coding table";
+      ok = false;
+      break;
+    }
+    read_symbols(&payload_reader, *a_table_root, bytes, num_bytes);
+    break;
+  case BLOCK_HUFFMAN_REPEAT:
+    if (*a_table_root == NULL)
+    {
+      *a_error = "repeated table before any table";
+      ok = false;
+      break;
+    }
+    read_symbols(&payload_reader, *a_table_root, bytes, num_bytes);
+    break;
+  case BLOCK_FILL:
+    memset(bytes, read_bits(&payload_reader, 8), num_bytes);
+    break;
+  case BLOCK_RLE:
+  {
+    uint8_t symbol = read_bits(&payload_reader, 8);
+    uint32_t num_encoded_bytes = read_uint32(&payload_reader);
+    uint8_t *encoded = num_encoded_bytes <= 2 * (uint64_t)num_bytes ? malloc(num_encoded_bytes + 1) : NULL;
+    ok = encoded != NULL && read_huffman_section(&payload_reader, encoded, num_encoded_bytes) &&
+         rle_decode_runs(encoded, num_encoded_bytes, symbol, bytes, num_bytes);
+    if (!ok)
+    {
+      *a_error = "corrupt run-length block";
+    }
+    free(encoded);
+    break;
+  }
+  case BLOCK_LZ77:
+    ok = lz77_read_payload(&payload_reader, bytes, num_bytes);
+    if (!ok)
+    {
+      *a_error = "corrupt LZ77 block";
+    }
+    break;
+  case BLOCK_BWT:
+    ok = bwt_read_payload(&payload_reader, bytes, num_bytes);
+    if (!ok)
+    {
+      *a_error = "corrupt BWT block";
+    }
+    break;
+  case BLOCK_CONTEXT:
+    ok = context_read_payload(&payload_reader, bytes, num_bytes);
+    if (!ok)
+    {
+      *a_error = "corrupt order-1 block";
+    }
+    break;
+  case BLOCK_WORDS:
+    ok = words_read_payload(&payload_reader, bytes, num_bytes);
+    if (!ok)
+    {
+      *a_error = "corrupt word block";
+    }
+    break;
+  case BLOCK_TANS:
+    ok = tans_read_payload(&payload_reader, bytes, num_bytes);
+    if (!ok)
+    {
+      *a_error = "corrupt tANS block";
+    }
+    break;
+  case BLOCK_COLUMNS:
+    ok = columns_read_payload(&payload_reader, bytes, num_bytes);
+    if (!ok)
+    {
+      *a_error = "corrupt column block";
+    }
+    break;
+  default:
+    *a_error = "unknown block type";
+    ok = false;
+    break;
+  }
+  return ok;
+}
+
+static bool _decompress_blocks(BitReader *a_reader, BitWriter *a_output, const char **a_error)
+{
+  TreeNode *table_root = NULL;
+  bool ok = true;
+
+  while (ok)
+  {
+    BlockType type = read_bits(a_reader, 8);
+    if (!is_bit_reader_open(a_reader))
+    {
+      *a_error = "truncated container";
+      ok = false;
+      break;
+    }
+    if (type == BLOCK_END)
+    {
+      break;
+    }
+
+    uint32_t num_bytes = read_uint32(a_reader);
+    uint32_t num_payload_bytes = read_uint32(a_reader);
+    if (num_bytes > MAX_DECODED_BLOCK_SIZE || num_payload_bytes > MAX_DECODED_BLOCK_SIZE)
+    {
+      *a_error = "block too large";
+      ok = false;
+      break;
+    }
+    if (type == BLOCK_STORED && num_payload_bytes != num_bytes)
+    {
+      *a_error = "stored block size mismatch";
+      ok = false;
+      break;
+    }
+    uint8_t *payload = malloc(num_payload_bytes + 1);
+    if (read_bytes(a_reader, payload, num_payload_bytes) != num_payload_bytes)
+    {
+      *a_error = "truncated block";
+      free(payload);
+      ok = false;
+      break;
+    }
+    if (type == BLOCK_STORED) // The payload is the output; no decoding or copying needed
+    {
+      write_bytes(a_output, payload, num_payload_bytes);
+      free(payload);
+      if (a_output->overflowed)
+      {
+        *a_error = "output buffer too small";
+        ok = false;
+      }
+      continue;
+    }
+
+    uint8_t *bytes = malloc(num_bytes + 1);
+    ok = decode_block(type, payload, num_payload_bytes, bytes, num_bytes, &table_root, a_error);
+    if (ok)
+    {
+      write_bytes(a_output, bytes, num_bytes);
+      if (a_output->overflowed)
+      {
+        *a_error = "output buffer too small";
+        ok = false;
+      }
+    }
+    free(bytes);
+    free(payload);
+  }
+
+  destroy_huffman_tree(&table_root);
+  return ok;
+}
+
+bool decode_container(BitReader *a_reader, BitWriter *a_output, const char **a_error)
+{
+  ContainerMode mode = read_bits(a_reader, 8);
+  switch (mode)
+  {
+  case CONTAINER_ADAPTIVE:
+    adaptive_decode_stream(a_reader, a_output);
+    if (!is_bit_reader_open(a_reader))
+    {
+      *a_error = "truncated container";
+      return false;
+    }
+    if (a_output->overflowed)
+    {
+      *a_error = "output buffer too small";
+      return false;
+    }
+    return true;
+  case CONTAINER_BLOCKS:
+    return _decompress_blocks(a_reader, a_output, a_error);
+  case CONTAINER_ARCHIVE:
+    *a_error = "an archive of several files; extract them with harc";
+    return false;
+  default:
+    *a_error = "unknown container mode";
+    return false;
+  }
+}
+
+bool decompress_container(BitReader *a_reader, FILE *uncompressed, const char **a_error)
+{
+  BitWriter output = {.file = uncompressed, .current_byte = 0, .num_bits_left = 8};
+  return decode_container(a_reader, &output, a_error);
+}
+
+bool read_block_header(FILE *container, uint64_t block_offset, BlockType *a_type, uint32_t *a_num_bytes,
+                       uint32_t *a_num_payload_bytes)
+{
+  uint8_t header[BLOCK_HEADER_BITS / 8];
+  if (fseek(container, CONTAINER_HEADER_BYTES + block_offset, SEEK_SET) != 0 || fread(header, 1, 1, container) != 1 ||
+      header[0] == BLOCK_END || fread(header + 1, 1, sizeof(header) - 1, container) != sizeof(header) - 1)
+  {
+    return false;
+  }
+  *a_type = header[0];
+  *a_num_bytes = header[1] | header[2] << 8 | header[3] << 16 | (uint32_t)header[4] << 24;
+  *a_num_payload_bytes = header[5] | header[6] << 8 | header[7] << 16 | (uint32_t)header[8] << 24;
+  return true;
+}
+
+uint8_t *read_block_payload(FILE *container, uint32_t num_payload_bytes)
+{
+  if (num_payload_bytes > MAX_DECODED_BLOCK_SIZE)
+  {
+    return NULL;
+  }
+  uint8_t *payload = malloc(num_payload_bytes + 1);
+  if (fread(payload, 1, num_payload_bytes, container) != num_payload_bytes)
+  {
+    free(payload);
+    return NULL;
+  }
+  return payload;
+}
+
+/*
+ * Read the list of a trailer that ends at `end` bytes into the file: the list,
+ * its size and `magic`, both as uint32. NULL without setting *a_error if the
+ * file has no such trailer there, or with it set to `corrupt_error` if the
+ * size is wrong.
+ */
+static uint8_t *_read_trailer(FILE *container, long end, uint32_t magic, const char *corrupt_error, uint32_t *a_size,
+                              const char **a_error)
+{
+  uint8_t footer[2 * sizeof(uint32_t)];
+  if (end < (long)sizeof(footer) || fseek(container, end - sizeof(footer), SEEK_SET) != 0 ||
+      fread(footer, 1, sizeof(footer), container) != sizeof(footer))
+  {
+    return NULL;
+  }
+  BitReader footer_reader = open_memory_bit_reader(footer, sizeof(footer));
+  uint32_t size = read_uint32(&footer_reader);
+  if (read_uint32(&footer_reader) != magic)
+  {
+    return NULL;
+  }
+
+  uint8_t *list = size <= (uint64_t)end - sizeof(footer) ? malloc(size + 1) : NULL;
+  if (list == NULL || fseek(container, end - (long)(sizeof(footer) + size), SEEK_SET) != 0 ||
+      fread(list, 1, size, container) != size)
+  {
+    *a_error = corrupt_error;
+    free(list);
+    return NULL;
+  }
+  *a_size = size;
+  return list;
+}
+
+static long _file_size(FILE *container)
+{
+  return fseek(container, 0, SEEK_END) == 0 ? ftell(container) : 0;
+}
+
+static bool _read_index(FILE *container, CheckpointList *a_list, const char **a_error)
+{
+  uint32_t index_size = 0;
+  uint8_t *index = _read_trailer(container, _file_size(container), CONTAINER_INDEX_MAGIC, "corrupt index",
+                                 &index_size, a_error);
+  if (index == NULL)
+  {
+    return false; // Containers without an index end with BLOCK_END or the summaries
+  }
+  BitReader reader = open_memory_bit_reader(index, index_size);
+  while (reader.byte_idx < index_size)
+  {
+    Checkpoint checkpoint;
+    checkpoint.offset = read_varint(&reader);
+    checkpoint.block_offset = read_varint(&reader);
+    checkpoint.table_offset = read_varint(&reader);
+    checkpoint.bit_offset = read_varint(&reader);
+    _add_checkpoint(a_list, checkpoint);
+  }
+  free(index);
+  if (!is_bit_reader_open(&reader))
+  {
+    *a_error = "corrupt index";
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Add a checkpoint at the start of every block, found by walking the block
+ * headers, and return where the walk stopped, as the checkpoint that would
+ * follow the last block: at BLOCK_END, unless the file is truncated.
+ */
+static Checkpoint _walk_blocks(FILE *container, CheckpointList *a_list)
+{
+  Checkpoint next = {.offset = 0, .block_offset = 0, .table_offset = 0, .bit_offset = 0};
+  BlockType type;
+  uint32_t num_bytes;
+  uint32_t num_payload_bytes;
+  while (read_block_header(container, next.block_offset, &type, &num_bytes, &num_payload_bytes))
+  {
+    next.table_offset = type == BLOCK_HUFFMAN ? next.block_offset : next.table_offset;
+    _add_checkpoint(a_list, next);
+    next.offset += num_bytes;
+    next.block_offset += BLOCK_HEADER_BITS / 8 + num_payload_bytes;
+  }
+  return next;
+}
+
+bool read_checkpoints(FILE *container, Checkpoint **a_checkpoints, size_t *a_num_checkpoints, const char **a_error)
+{
+  CheckpointList list = {.checkpoints = NULL, .num_checkpoints = 0, .capacity = 0};
+  const char *error = NULL;
+  if (!_read_index(container, &list, &error))
+  {
+    if (error != NULL)
+    {
+      *a_error = error;
+      free(list.checkpoints);
+      return false;
+    }
+
+    // No index, so every block is a checkpoint
+    _walk_blocks(container, &list);
+  }
+  *a_checkpoints = list.checkpoints;
+  *a_num_checkpoints = list.num_checkpoints;
+  return true;
+}
+
+// Like read_block_summaries(...), but leave *a_error alone if the file has no summaries
+static bool _read_summaries(FILE *container, BlockSummary **a_summaries, size_t *a_num_summaries, const char **a_error)
+{
+  *a_summaries = NULL;
+  *a_num_summaries = 0;
+
+  // The summaries end where the index starts, if there is one
+  long end = _file_size(container);
+  uint32_t size = 0;
+  const char *error = NULL;
+  uint8_t *trailer = _read_trailer(container, end, CONTAINER_INDEX_MAGIC, "corrupt index", &size, &error);
+  if (trailer != NULL)
+  {
+    end -= size + 2 * sizeof(uint32_t);
+    free(trailer);
+  }
+  if (error == NULL)
+  {
+    trailer = _read_trailer(container, end, CONTAINER_SUMMARY_MAGIC, "corrupt block summaries", &size, &error);
+  }
+  if (trailer == NULL)
+  {
+    *a_error = error != NULL ? error : *a_error;
+    return false;
+  }
+
+  size_t capacity = 0;
+  uint64_t offset = 0;
+  bool ok = true;
+  BitReader reader = open_memory_bit_reader(trailer, size);
+  while (ok && reader.byte_idx < size)
+  {
+    if (*a_num_summaries == capacity)
+    {
+      capacity = capacity * 2 + 16;
+      *a_summaries = realloc(*a_summaries, capacity * sizeof(BlockSummary));
+    }
+    BlockSummary *summary = &(*a_summaries)[(*a_num_summaries)++];
+    memset(summary, 0, sizeof(BlockSummary));
+    summary->offset = offset;
+    uint64_t num_distinct = read_varint(&reader);
+    uint64_t ch = UINT64_MAX; // One before the first byte, so that every gap counts from the last byte plus one
+    for (uint64_t idx = 0; ok && idx < num_distinct; idx++)
+    {
+      ch += read_varint(&reader) + 1;
+      uint64_t count = read_varint(&reader);
+      ok = ch < 256 && count <= MAX_DECODED_BLOCK_SIZE && is_bit_reader_open(&reader);
+      if (ok)
+      {
+        summary->freq[ch] = count;
+        summary->num_bytes += count;
+      }
+    }
+    offset += summary->num_bytes;
+  }
+  free(trailer);
+  if (!ok || !is_bit_reader_open(&reader))
+  {
+    *a_error = "corrupt block summaries";
+    free(*a_summaries);
+    *a_summaries = NULL;
+    *a_num_summaries = 0;
+    return false;
+  }
+  return true;
+}
+
+bool read_block_summaries(FILE *container, BlockSummary **a_summaries, size_t *a_num_summaries, const char **a_error)
+{
+  const char *error = NULL;
+  if (!_read_summaries(container, a_summaries, a_num_summaries, &error))
+  {
+    *a_error = error != NULL ? error : "no block summaries";
+    return false;
+  }
+  return true;
+}
+
+void add_block_summaries(const BlockSummary *summaries, size_t first_block, size_t num_blocks, Frequencies freq)
+{
+  for (size_t idx = first_block; idx < first_block + num_blocks; idx++)
+  {
+    for (int ch = 0; ch < 256; ch++)
+    {
+      freq[ch] += summaries[idx].freq[ch];
+    }
+  }
+}
+
+// Read the table of the BLOCK_HUFFMAN block at `table_offset`
+static TreeNode *_read_block_table(FILE *container, uint64_t table_offset)
+{
+  BlockType type;
+  uint32_t num_bytes;
+  uint32_t num_payload_bytes;
+  if (!read_block_header(container, table_offset, &type, &num_bytes, &num_payload_bytes) || type != BLOCK_HUFFMAN)
+  {
+    return NULL;
+  }
+  uint8_t *payload = read_block_payload(container, num_payload_bytes);
+  if (payload == NULL)
+  {
+    return NULL;
+  }
+  BitReader reader = open_memory_bit_reader(payload, num_payload_bytes);
+  TreeNode *root = read_coding_table(&reader);
+  free(payload);
+  return root;
+}
+
+bool read_container_range(FILE *container, const Checkpoint *checkpoints, size_t num_checkpoints, uint64_t offset,
+                          size_t num_bytes, uint8_t *dst, size_t *a_num_read, const char **a_error)
+{
+  *a_num_read = 0;
+  if (num_checkpoints == 0 || num_bytes == 0)
+  {
+    return true;
+  }
+
+  // The last checkpoint at or before `offset`, and the start of its block
+  size_t low = 0;
+  size_t high = num_checkpoints;
+  while (high - low > 1)
+  {
+    size_t middle = low + (high - low) / 2;
+    low = checkpoints[middle].offset <= offset ? middle : low;
+    high = checkpoints[middle].offset <= offset ? high : middle;
+  }
+  const Checkpoint *checkpoint = &checkpoints[low];
+  size_t block_start = low;
+  while (block_start > 0 && checkpoints[block_start].bit_offset > 0)
+  {
+    block_start--;
+  }
+
+  TreeNode *table_root = NULL;
+  uint64_t block_offset = checkpoint->block_offset;
+  uint64_t block_raw_offset = checkpoints[block_start].offset;
+  uint64_t end = offset + num_bytes;
+  bool first = true;
+  bool ok = true;
+  BlockType type;
+  uint32_t block_bytes;
+  uint32_t num_payload_bytes;
+  while (ok && block_raw_offset < end &&
+         read_block_header(container, block_offset, &type, &block_bytes, &num_payload_bytes))
+  {
+    uint8_t *payload = block_bytes <= MAX_DECODED_BLOCK_SIZE ? read_block_payload(container, num_payload_bytes) : NULL;
+    if (payload == NULL)
+    {
+      *a_error = "truncated block";
+      ok = false;
+      break;
+    }
+    if (type == BLOCK_HUFFMAN_REPEAT && table_root == NULL)
+    {
+      // No table since the checkpoint, so the one in effect there
+      table_root = _read_block_table(container, checkpoint->table_offset);
+    }
+
+    // Mid-block checkpoints resume the codes where they are, the rest decode the whole block
+    uint64_t decoded_offset = block_raw_offset;
+    uint8_t *bytes = malloc(block_bytes + 1);
+    uint32_t num_decoded = block_bytes;
+    if (first && checkpoint->bit_offset > 0)
+    {
+      BitReader reader = open_memory_bit_reader(payload, num_payload_bytes);
+      if (type == BLOCK_HUFFMAN)
+      {
+        destroy_huffman_tree(&table_root);
+        table_root = read_coding_table(&reader);
+      }
+      decoded_offset = checkpoint->offset;
+      uint64_t decoded_end = block_raw_offset + block_bytes < end ? block_raw_offset + block_bytes : end;
+      ok = table_root != NULL && decoded_offset <= decoded_end && checkpoint->bit_offset <= 8 * (uint64_t)num_payload_bytes;
+      if (ok)
+      {
+        num_decoded = decoded_end - decoded_offset;
+        reader = open_memory_bit_reader(payload + checkpoint->bit_offset / 8, num_payload_bytes - checkpoint->bit_offset / 8);
+        skip_bits(&reader, checkpoint->bit_offset % 8);
+        read_symbols(&reader, table_root, bytes, num_decoded);
+      }
+      else
+      {
+        *a_error = "corrupt checkpoint";
+      }
+    }
+    else
+    {
+      ok = decode_block(type, payload, num_payload_bytes, bytes, block_bytes, &table_root, a_error);
+    }
+
+    if (ok && decoded_offset > offset + *a_num_read)
+    {
+      *a_error = "corrupt checkpoint";
+      ok = false;
+    }
+
+    // Copy the part of the decoded bytes that falls in the range
+    if (ok && decoded_offset + num_decoded > offset)
+    {
+      uint64_t copy_start = offset > decoded_offset ? offset - decoded_offset : 0;
+      uint64_t copy_end = end - decoded_offset < num_decoded ? end - decoded_offset : num_decoded;
+      memcpy(dst + (decoded_offset + copy_start - offset), bytes + copy_start, copy_end - copy_start);
+      *a_num_read = decoded_offset + copy_end - offset;
+    }
+    free(bytes);
+    free(payload);
+    block_raw_offset += block_bytes;
+    block_offset += BLOCK_HEADER_BITS / 8 + num_payload_bytes;
+    first = false;
+  }
+
+  destroy_huffman_tree(&table_root);
+  return ok;
+}
+
+/*
+ * Where the blocks of a container file are, and the trailers that follow
+ * them, read before the file is changed.
+ */
+typedef struct _ContainerLayout
+{
+  CheckpointList blocks;   // The start of every block, then where BLOCK_END is
+  size_t num_blocks;       // The number of blocks, one less than blocks.num_checkpoints
+  bool has_index;          // Whether the file ends with an index
+  CheckpointList index;    // The index, if it has one
+  BlockSummary *summaries; // One per block, or NULL if the file has no summaries
+} ContainerLayout;
+
+static void _destroy_layout(ContainerLayout *a_layout)
+{
+  free(a_layout->blocks.checkpoints);
+  free(a_layout->index.checkpoints);
+  free(a_layout->summaries);
+}
+
+static bool _read_layout(FILE *container, ContainerLayout *a_layout, const char **a_error)
+{
+  *a_layout = (ContainerLayout){.blocks = {.checkpoints = NULL, .num_checkpoints = 0, .capacity = 0},
+                                .index = {.checkpoints = NULL, .num_checkpoints = 0, .capacity = 0},
+                                .summaries = NULL};
+  uint8_t header[CONTAINER_HEADER_BYTES];
+  rewind(container);
+  if (fread(header, 1, sizeof(header), container) != sizeof(header) ||
+      (header[0] | header[1] << 8 | header[2] << 16 | (uint32_t)header[3] << 24) != CONTAINER_MAGIC ||
+      header[4] != CONTAINER_BLOCKS)
+  {
+    *a_error = "not a block container";
+    return false;
+  }
+
+  // Every payload must be there, and the blocks must end with BLOCK_END
+  Checkpoint end = _walk_blocks(container, &a_layout->blocks);
+  a_layout->num_blocks = a_layout->blocks.num_checkpoints;
+  _add_checkpoint(&a_layout->blocks, end);
+  if (fseek(container, CONTAINER_HEADER_BYTES + end.block_offset, SEEK_SET) != 0 || getc(container) != BLOCK_END)
+  {
+    *a_error = "truncated block";
+    return false;
+  }
+
+  const char *error = NULL;
+  a_layout->has_index = _read_index(container, &a_layout->index, &error);
+  size_t num_summaries = 0;
+  if (error == NULL && _read_summaries(container, &a_layout->summaries, &num_summaries, &error) &&
+      num_summaries != a_layout->num_blocks)
+  {
+    error = "corrupt block summaries";
+  }
+  if (error != NULL)
+  {
+    *a_error = error;
+    return false;
+  }
+  return true;
+}
+
+// Move `num_bytes` bytes of the file from `from` to `to`, a chunk at a time, from the end if they move up
+static bool _move_file_bytes(FILE *file, uint64_t from, uint64_t to, uint64_t num_bytes)
+{
+  size_t chunk_size = 1 << 20;
+  uint8_t *chunk = malloc(chunk_size);
+  bool ok = true;
+  for (uint64_t done = 0; ok && done < num_bytes && from != to;)
+  {
+    size_t size = num_bytes - done < chunk_size ? num_bytes - done : chunk_size;
+    uint64_t start = to > from ? num_bytes - done - size : done;
+    ok = fseek(file, from + start, SEEK_SET) == 0 && fread(chunk, 1, size, file) == size &&
+         fseek(file, to + start, SEEK_SET) == 0 && fwrite(chunk, 1, size, file) == size;
+    done += size;
+  }
+  free(chunk);
+  return ok;
+}
+
+/*
+ * The block at `repeat` with the table it repeats put in front of its codes,
+ * as a BLOCK_HUFFMAN block, so that it decodes the same after the blocks
+ * before it change. Nothing is decoded but the table: the codes are copied
+ * bit for bit, `table_bits` later than they were.
+ */
+static bool _own_table_block(FILE *container, Checkpoint repeat, BitWriter *a_block, uint64_t *a_table_bits)
+{
+  BlockType type;
+  uint32_t num_bytes;
+  uint32_t num_payload_bytes;
+  uint8_t *table = NULL;
+  uint8_t *codes = NULL;
+  if (read_block_header(container, repeat.table_offset, &type, &num_bytes, &num_payload_bytes) &&
+      type == BLOCK_HUFFMAN)
+  {
+    table = read_block_payload(container, num_payload_bytes);
+  }
+  BitReader table_reader = open_memory_bit_reader(table, table != NULL ? num_payload_bytes : 0);
+  TreeNode *root = table != NULL ? read_coding_table(&table_reader) : NULL;
+  bool ok = root != NULL && is_bit_reader_open(&table_reader) &&
+            read_block_header(container, repeat.block_offset, &type, &num_bytes, &num_payload_bytes);
+  codes = ok ? read_block_payload(container, num_payload_bytes) : NULL;
+  if (codes != NULL)
+  {
+    *a_table_bits = 8 * table_reader.byte_idx - (table_reader.current_bit + 1);
+    BitWriter payload = open_memory_bit_writer(*a_table_bits / 8 + num_payload_bytes + 1);
+    table_reader = open_memory_bit_reader(table, *a_table_bits / 8 + 1);
+    for (uint64_t bit = 0; bit < *a_table_bits; bit += 8)
+    {
+      uint8_t num_bits = *a_table_bits - bit < 8 ? *a_table_bits - bit : 8;
+      write_bits(&payload, read_bits(&table_reader, num_bits), num_bits);
+    }
+    for (uint32_t idx = 0; idx < num_payload_bytes; idx++)
+    {
+      write_bits(&payload, codes[idx], 8);
+    }
+    *a_block = open_memory_bit_writer(BLOCK_HEADER_BITS / 8 + payload.num_bytes + 1);
+    _write_block(a_block, BLOCK_HUFFMAN, num_bytes, &payload);
+    free(payload.buffer);
+  }
+  destroy_huffman_tree(&root);
+  free(table);
+  free(codes);
+  return codes != NULL;
+}
+
+/*
+ * Replace blocks [first_block, end_block) of a container file with the blocks
+ * of `bytes`, move the blocks after them, and write the trailers again with
+ * the checkpoints and summaries of the new blocks in place of the old ones.
+ * The new blocks may end with a different table than the old ones did, so
+ * the first block after them to repeat the old table, `repeat_block` (or
+ * num_blocks if there is none), gets its own copy of it. The file keeps its
+ * index and summaries, and gains an index with `index_interval`.
+ */
+static bool _splice_blocks(FILE *container, const ContainerLayout *a_layout, size_t first_block, size_t end_block,
+                           size_t repeat_block, const uint8_t *bytes, size_t num_bytes, const BlockOptions *a_options,
+                           const char **a_error)
+{
+  const Checkpoint *blocks = a_layout->blocks.checkpoints;
+  Checkpoint start = blocks[first_block];
+  Checkpoint end = blocks[end_block];
+  Checkpoint repeat = blocks[repeat_block];
+  Checkpoint container_end = blocks[a_layout->num_blocks];
+  bool has_repeat = repeat_block < a_layout->num_blocks;
+  uint64_t repeat_end = has_repeat ? blocks[repeat_block + 1].block_offset : repeat.block_offset;
+
+  BitWriter repeat_writer = {.buffer = NULL, .num_bytes = 0};
+  uint64_t table_bits = 0;
+  if (has_repeat && !_own_table_block(container, repeat, &repeat_writer, &table_bits))
+  {
+    *a_error = "repeated table before any table";
+    return false;
+  }
+
+  bool has_index = a_layout->has_index || a_options->index_interval > 0;
+  bool has_summaries = a_layout->summaries != NULL || (a_layout->num_blocks == 0 && a_options->summaries);
+  CheckpointList new_index = {.checkpoints = NULL, .num_checkpoints = 0, .capacity = 0};
+  SummaryList new_summaries = {.summaries = NULL, .num_summaries = 0, .capacity = 0};
+  BitWriter encoded = open_memory_bit_writer(num_bytes / 2 + 64);
+  uint64_t size = _code_block_list(&encoded, bytes, num_bytes, a_options, has_index ? &new_index : NULL,
+                                   has_summaries ? &new_summaries : NULL);
+
+  // How far the blocks after the new ones move, and those after the one that gets its own table
+  int64_t shift = (int64_t)size - (int64_t)(end.block_offset - start.block_offset);
+  int64_t repeat_shift = shift + (int64_t)repeat_writer.num_bytes - (int64_t)(repeat_end - repeat.block_offset);
+  int64_t raw_shift = (int64_t)num_bytes - (int64_t)(end.offset - start.offset);
+
+  // The old checkpoints before and after the replaced blocks, and the new ones between them
+  CheckpointList index = {.checkpoints = NULL, .num_checkpoints = 0, .capacity = 0};
+  const CheckpointList *old_index = a_layout->has_index ? &a_layout->index : &a_layout->blocks;
+  size_t num_old = a_layout->has_index ? old_index->num_checkpoints : a_layout->num_blocks;
+  size_t num_before = 0;
+  while (has_index && num_before < num_old && old_index->checkpoints[num_before].block_offset < start.block_offset)
+  {
+    _add_checkpoint(&index, old_index->checkpoints[num_before++]);
+  }
+
+  // Until the first new table, the one before the new blocks is in effect
+  uint64_t table_offset = first_block > 0 ? blocks[first_block - 1].table_offset : 0;
+  size_t next = 0;
+  for (uint64_t block_offset = 0; block_offset < size;)
+  {
+    const uint8_t *header = encoded.buffer + block_offset;
+    table_offset = header[0] == BLOCK_HUFFMAN ? start.block_offset + block_offset : table_offset;
+    for (; next < new_index.num_checkpoints && new_index.checkpoints[next].block_offset == block_offset; next++)
+    {
+      Checkpoint checkpoint = new_index.checkpoints[next];
+      checkpoint.offset += start.offset;
+      checkpoint.block_offset += start.block_offset;
+      checkpoint.table_offset = table_offset;
+      _add_checkpoint(&index, checkpoint);
+    }
+    block_offset += BLOCK_HEADER_BITS / 8 + (header[5] | header[6] << 8 | header[7] << 16 | (uint32_t)header[8] << 24);
+  }
+  for (size_t idx = num_before; has_index && idx < num_old; idx++)
+  {
+    Checkpoint checkpoint = old_index->checkpoints[idx];
+    if (checkpoint.block_offset < end.block_offset)
+    {
+      continue;
+    }
+    if (has_repeat && checkpoint.block_offset == repeat.block_offset)
+    {
+      table_offset = repeat.block_offset + shift;
+      checkpoint.bit_offset += checkpoint.bit_offset > 0 ? table_bits : 0;
+    }
+    // Tables before the blocks that moved are replaced by the new blocks' or the copy
+    bool moved_table = checkpoint.table_offset >= end.block_offset;
+    checkpoint.table_offset = !moved_table                              ? table_offset
+                              : checkpoint.table_offset >= repeat_end ? checkpoint.table_offset + repeat_shift
+                                                                      : checkpoint.table_offset + shift;
+    checkpoint.offset += raw_shift;
+    checkpoint.block_offset += checkpoint.block_offset >= repeat_end ? repeat_shift : shift;
+    _add_checkpoint(&index, checkpoint);
+  }
+
+  SummaryList summaries = {.summaries = NULL, .num_summaries = 0, .capacity = 0};
+  for (size_t idx = 0; a_layout->summaries != NULL && idx < first_block; idx++)
+  {
+    _add_summary(&summaries, a_layout->summaries[idx].offset, a_layout->summaries[idx].num_bytes,
+                 a_layout->summaries[idx].freq);
+  }
+  for (size_t idx = 0; idx < new_summaries.num_summaries; idx++)
+  {
+    _add_summary(&summaries, new_summaries.summaries[idx].offset + start.offset, new_summaries.summaries[idx].num_bytes,
+                 new_summaries.summaries[idx].freq);
+  }
+  for (size_t idx = end_block; a_layout->summaries != NULL && idx < a_layout->num_blocks; idx++)
+  {
+    _add_summary(&summaries, a_layout->summaries[idx].offset + raw_shift, a_layout->summaries[idx].num_bytes,
+                 a_layout->summaries[idx].freq);
+  }
+  BitWriter trailers = open_memory_bit_writer(64);
+  _write_trailers(&trailers, has_summaries ? &summaries : NULL, has_index ? &index : NULL);
+
+  /*
+   * The blocks after the replaced ones move first, so that neither they nor
+   * the trailers are overwritten: of the stretches before and after the
+   * copied table, the one after moves first if it moves up.
+   */
+  uint64_t before_repeat = CONTAINER_HEADER_BYTES + end.block_offset;
+  uint64_t after_repeat = CONTAINER_HEADER_BYTES + repeat_end;
+  uint64_t num_before_repeat = repeat.block_offset - end.block_offset;
+  uint64_t num_after_repeat = container_end.block_offset - repeat_end;
+  bool ok = true;
+  if (repeat_shift > 0)
+  {
+    ok = _move_file_bytes(container, after_repeat, after_repeat + repeat_shift, num_after_repeat) &&
+         _move_file_bytes(container, before_repeat, before_repeat + shift, num_before_repeat);
+  }
+  else
+  {
+    ok = _move_file_bytes(container, before_repeat, before_repeat + shift, num_before_repeat) &&
+         _move_file_bytes(container, after_repeat, after_repeat + repeat_shift, num_after_repeat);
+  }
+  uint64_t file_size = CONTAINER_HEADER_BYTES + container_end.block_offset + repeat_shift + trailers.num_bytes;
+  ok = ok && fseek(container, CONTAINER_HEADER_BYTES + start.block_offset, SEEK_SET) == 0 &&
+       fwrite(encoded.buffer, 1, size, container) == size &&
+       fseek(container, CONTAINER_HEADER_BYTES + repeat.block_offset + shift, SEEK_SET) == 0 &&
+       (repeat_writer.num_bytes == 0 ||
+        fwrite(repeat_writer.buffer, 1, repeat_writer.num_bytes, container) == repeat_writer.num_bytes) &&
+       fseek(container, CONTAINER_HEADER_BYTES + container_end.block_offset + repeat_shift, SEEK_SET) == 0 &&
+       fwrite(trailers.buffer, 1, trailers.num_bytes, container) == trailers.num_bytes && fflush(container) == 0 &&
+       ftruncate(fileno(container), file_size) == 0;
+  if (!ok)
+  {
+    *a_error = strerror(errno);
+  }
+
+  free(encoded.buffer);
+  free(repeat_writer.buffer);
+  free(trailers.buffer);
+  free(new_index.checkpoints);
+  free(new_summaries.summaries);
+  free(index.checkpoints);
+  free(summaries.summaries);
+  return ok;
+}
+
+bool append_container(FILE *container, const uint8_t *bytes, size_t num_bytes, const BlockOptions *a_options,
+                      const char **a_error)
+{
+  ContainerLayout layout;
+  bool ok = _read_layout(container, &layout, a_error);
+  if (ok && num_bytes > 0)
+  {
+    ok = _splice_blocks(container, &layout, layout.num_blocks, layout.num_blocks, layout.num_blocks, bytes, num_bytes,
+                        a_options, a_error);
+  }
+  _destroy_layout(&layout);
+  return ok;
+}
+
+bool patch_container(FILE *container, uint64_t offset, const uint8_t *bytes, size_t num_bytes,
+                     const BlockOptions *a_options, const char **a_error)
+{
+  ContainerLayout layout;
+  if (!_read_layout(container, &layout, a_error))
+  {
+    _destroy_layout(&layout);
+    return false;
+  }
+  const Checkpoint *blocks = layout.blocks.checkpoints;
+  if (offset + num_bytes > blocks[layout.num_blocks].offset || offset + num_bytes < offset)
+  {
+    *a_error = "patch runs past the end";
+    _destroy_layout(&layout);
+    return false;
+  }
+  if (num_bytes == 0)
+  {
+    _destroy_layout(&layout);
+    return true;
+  }
+
+  // The blocks holding the range, and the first block after them to repeat a table, if no table comes before it
+  size_t first_block = 0;
+  while (blocks[first_block + 1].offset <= offset)
+  {
+    first_block++;
+  }
+  size_t end_block = first_block + 1;
+  while (blocks[end_block].offset < offset + num_bytes)
+  {
+    end_block++;
+  }
+  size_t repeat_block = end_block;
+  BlockType type = BLOCK_END;
+  uint32_t block_bytes;
+  uint32_t num_payload_bytes;
+  while (repeat_block < layout.num_blocks &&
+         read_block_header(container, blocks[repeat_block].block_offset, &type, &block_bytes, &num_payload_bytes) &&
+         type != BLOCK_HUFFMAN && type != BLOCK_HUFFMAN_REPEAT)
+  {
+    repeat_block++;
+  }
+  repeat_block = type == BLOCK_HUFFMAN_REPEAT ? repeat_block : layout.num_blocks;
+
+  // Decode them, change the range, and code them again
+  size_t num_range_bytes = blocks[end_block].offset - blocks[first_block].offset;
+  uint8_t *range_bytes = malloc(num_range_bytes + 1);
+  size_t num_read = 0;
+  const CheckpointList *checkpoints = layout.has_index ? &layout.index : &layout.blocks;
+  bool ok = read_container_range(container, checkpoints->checkpoints,
+                                 layout.has_index ? checkpoints->num_checkpoints : layout.num_blocks,
+                                 blocks[first_block].offset, num_range_bytes, range_bytes, &num_read, a_error);
+  if (ok && num_read != num_range_bytes)
+  {
+    *a_error = "truncated block";
+    ok = false;
+  }
+  if (ok)
+  {
+    memcpy(range_bytes + (offset - blocks[first_block].offset), bytes, num_bytes);
+    ok = _splice_blocks(container, &layout, first_block, end_block, repeat_block, range_bytes, num_range_bytes,
+                        a_options, a_error);
+  }
+  free(range_bytes);
+  _destroy_layout(&layout);
+  return ok;
+}
@@ -0,0 +1,382 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include "bit_tools.h"
+#include "huffman.h"
+#include "tree_cache.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Self-describing compressed files start with this 32-bit word ("HUFC" in
+ * little-endian order), followed by a one-byte ContainerMode. Files written by
+ * the original two-file format start with their byte count instead.
+ */
+#define CONTAINER_MAGIC 0x43465548u
+
+// The magic word and the mode byte
+#define CONTAINER_HEADER_BYTES 5
+
+/**
+ * The layout of the data following the container header.
+ */
+typedef enum _ContainerMode
+{
+  CONTAINER_ADAPTIVE = 1, // One-pass FGK adaptive Huffman, ends with an end-of-stream symbol
+  CONTAINER_BLOCKS = 2,   // A sequence of blocks (see BlockType), ends with BLOCK_END
+  CONTAINER_ARCHIVE = 3,  // Blocks shared by the files of an archive (see archive.h)
+} ContainerMode;
+
+/*
+ * Every block starts with a one-byte BlockType, then (except for BLOCK_END)
+ * the number of uncompressed bytes and the number of payload bytes, both as
+ * little-endian uint32. Payloads are byte-aligned, so a reader can skip a
+ * block, or hand it to another thread, without decoding it.
+ */
+#define BLOCK_HEADER_BITS (8 + 32 + 32)
+
+// Readers refuse blocks claiming more than this many bytes instead of trying to allocate them
+#define MAX_DECODED_BLOCK_SIZE (1u << 30)
+
+/**
+ * How the payload of a block is coded.
+ */
+typedef enum _BlockType
+{
+  BLOCK_END = 0,            // No header fields or payload; the container ends here
+  BLOCK_HUFFMAN = 1,        // A coding table, one 0 bit, then the codes
+  BLOCK_HUFFMAN_REPEAT = 2, // Codes only, using the table of the last BLOCK_HUFFMAN
+  BLOCK_STORED = 3,         // The uncompressed bytes themselves
+  BLOCK_FILL = 4,           // One byte, repeated for the whole block
+  BLOCK_RLE = 5,            // The run symbol, the uint32 length of the run-length coded
+                            // bytes (see rle.h), then their table, one 0 bit, and codes
+  BLOCK_LZ77 = 6,           // Literals and back-references (see lz77.h)
+  BLOCK_BWT = 7,            // Burrows-Wheeler transform and move-to-front (see bwt.h)
+  BLOCK_CONTEXT = 8,        // A table per cluster of previous bytes (see context_huffman.h)
+  BLOCK_WORDS = 9,          // A dictionary of word tokens and their codes (see word_huffman.h)
+  BLOCK_TANS = 10,          // Normalized counts and tANS states (see tans.h)
+  BLOCK_COLUMNS = 11,       // A table per byte of fixed-width records (see columns.h)
+} BlockType;
+
+/**
+ * Settings for compress_blocks(...).
+ */
+typedef struct _BlockOptions
+{
+  size_t segment_size;   // Block boundaries fall on multiples of this
+  size_t max_block_size; // Longer stretches are split even if statistics agree
+  bool split_on_drift;   // Start a new block when the byte distribution shifts
+  int lz_level;          // Try BLOCK_LZ77 with this match finder level; 0 to never use it
+  int lz_window_log;     // The match finder window (see LzOptions)
+  bool bwt;              // Try BLOCK_BWT; takes the place of lz_level
+  bool order1;           // Try BLOCK_CONTEXT as well
+  bool words;            // Try BLOCK_WORDS as well
+  bool tans;             // Try BLOCK_TANS as well
+  size_t record_width;   // Try BLOCK_COLUMNS with records of this many bytes; 0 to never use it
+  int num_threads;       // Threads building LZ77, BWT, order-1, word, tANS and column payloads; 0 for one per core
+  size_t index_interval; // Follow BLOCK_END with an index of checkpoints this many bytes apart; 0 for none
+  bool summaries;        // Follow BLOCK_END with the histogram of every block (see BlockSummary)
+  bool self_contained;   // Never use BLOCK_HUFFMAN_REPEAT, so that every block decodes on its own
+  // With self_contained, a table of these frequencies that every block may repeat, stored apart from the blocks
+  const Frequencies *shared_table;
+  // Reuse tables from this cache where they are good enough, and add the ones built; NULL for none
+  TreeCache *tree_cache;
+} BlockOptions;
+
+/*
+ * Block summaries let a reader count bytes without decoding any block. They
+ * follow BLOCK_END (before the index, if there is one) as one entry per block:
+ * the number of distinct bytes as a varint, then for each of them in order
+ * the gap from the previous one (less one) and its count, both varints. Then
+ * come the number of bytes in the entries and this magic word ("HUFS" in
+ * little-endian order), both as uint32.
+ */
+#define CONTAINER_SUMMARY_MAGIC 0x53465548u
+
+/**
+ * The histogram of one block, as read from the block summaries.
+ */
+typedef struct _BlockSummary
+{
+  uint64_t offset;    // The uncompressed offset of the first byte of the block
+  uint64_t num_bytes; // The number of bytes the block decodes to
+  Frequencies freq;   // How often each byte occurs in the block
+} BlockSummary;
+
+/*
+ * An index lets a reader start decoding near any uncompressed offset instead
+ * of at the start. It follows BLOCK_END as a list of checkpoints, each four
+ * varints (see Checkpoint), then the number of bytes in the list and this
+ * magic word ("HUFX" in little-endian order), both as uint32. Readers that do
+ * not know about the index stop at BLOCK_END and never see it.
+ */
+#define CONTAINER_INDEX_MAGIC 0x58465548u
+
+/**
+ * A place where decoding can start: the start of every block, and every
+ * `index_interval` bytes into blocks coded with a tree. Offsets into the
+ * container count from the first block.
+ */
+typedef struct _Checkpoint
+{
+  uint64_t offset;       // The uncompressed offset decoding resumes at
+  uint64_t block_offset; // The header of the block holding it
+  uint64_t table_offset; // The header of the BLOCK_HUFFMAN block whose table codes it
+  uint64_t bit_offset;   // Where the codes resume within the payload; 0 at the start of a block
+} Checkpoint;
+
+/**
+ * @brief The options used by `compress -b`.
+ *
+ * @return BlockOptions
+ */
+BlockOptions default_block_options(void);
+
+/**
+ * @brief The options used by `compress -z`: long blocks, so that matches can
+ * reach far back, each tried with the LZ77 front-end.
+ *
+ * @param level the match finder level, 1 to LZ_MAX_LEVEL
+ * @param window_log the match finder window, LZ_MIN_WINDOW_LOG to LZ_MAX_WINDOW_LOG
+ * @return BlockOptions
+ */
+BlockOptions lz_block_options(int level, int window_log);
+
+/**
+ * @brief The options used by `compress -j`: blocks about the size bzip2
+ * uses, each tried with the Burrows-Wheeler pipeline.
+ *
+ * @return BlockOptions
+ */
+BlockOptions bwt_block_options(void);
+
+/**
+ * @brief The options used by `compress -t`: long blocks, so that each
+ * dictionary serves many tokens, each tried as word tokens.
+ *
+ * @return BlockOptions
+ */
+BlockOptions word_block_options(void);
+
+/**
+ * @brief Write the magic word and `mode`. The writer must not hold any
+ * pending bits.
+ *
+ * @param a_writer the BitWriter that the compressed data will be written to
+ * @param mode the layout of the data that follows
+ */
+void write_container_header(BitWriter *a_writer, ContainerMode mode);
+
+/**
+ * @brief Write `num_bytes` bytes as a sequence of blocks followed by
+ * BLOCK_END. With `split_on_drift`, a new block (and coding table) is started
+ * at a segment whose distribution differs from the current block by more than
+ * the cost of the new table, as estimated from the entropy of the histograms.
+ * A block whose bytes are coded as cheaply by the previous block's table
+ * reuses it instead of writing its own, and a block that would not shrink
+ * (judged first from its entropy, before any tree is built) is stored as is.
+ * A block of one repeated byte becomes BLOCK_FILL, and a block that one byte
+ * dominates has that byte's runs shortened first if that is cheaper. With
+ * `lz_level`, `bwt`, `order1`, `words` or `tans`, a block is also passed through those
+ * front-ends (on `num_threads` threads, since blocks are independent) and the
+ * smallest payload is kept. The histograms counted while splitting are reused
+ * to choose each coding, and with `summaries` they are also written out.
+ *
+ * @param a_writer the BitWriter to write to, just past the container header
+ * @param bytes the bytes to compress
+ * @param num_bytes the number of bytes to compress
+ * @param a_options the splitting settings
+ */
+void compress_blocks(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes, const BlockOptions *a_options);
+
+/**
+ * @brief Like compress_blocks(...), but write only the blocks, without
+ * BLOCK_END or anything after it, for writers that gather blocks from several
+ * inputs into one sequence. The first block never repeats a table, so the
+ * blocks decode on their own wherever they end up, or, with
+ * `self_contained` and a `shared_table`, with only that table.
+ *
+ * @param a_writer the byte-aligned BitWriter to write to
+ * @param bytes the bytes to compress
+ * @param num_bytes the number of bytes to compress
+ * @param a_options the splitting settings; `index_interval` and `summaries` are ignored
+ * @return uint64_t the number of bytes written
+ */
+uint64_t write_blocks(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes, const BlockOptions *a_options);
+
+/**
+ * @brief The exact number of bytes compress_blocks(...) writes for `bytes`
+ * to a byte-aligned writer, without writing them. Blocks are planned and
+ * chosen as compress_blocks(...) would, but only their sizes are summed: the
+ * size of a Huffman payload follows from the code lengths and the counts
+ * (see coded_bits(...) and coding_table_bits(...)). Front-end payloads are
+ * built to be measured, so with front-ends enabled this costs about as much
+ * as compressing. A tree cache in `a_options` is looked in as coding would,
+ * but not added to and its stats not counted (see overlay_tree_cache(...)).
+ *
+ * @param bytes the bytes to compress
+ * @param num_bytes the number of bytes to compress
+ * @param a_options the splitting settings
+ * @return uint64_t
+ */
+uint64_t compressed_blocks_size(const uint8_t *bytes, size_t num_bytes, const BlockOptions *a_options);
+
+/**
+ * @brief Decode the payload of one block.
+ *
+ * @param type the block type
+ * @param payload the payload
+ * @param num_payload_bytes the number of bytes at payload
+ * @param bytes where to store the decoded bytes
+ * @param num_bytes the number of bytes the block decodes to
+ * @param a_table_root the table of the last BLOCK_HUFFMAN block, replaced when
+ * this is one; destroy it once done with the container
+ * @param a_error a pointer to a string that will be set to an error message
+ * @return bool false if the payload is malformed
+ */
+bool decode_block(BlockType type, const uint8_t *payload, uint32_t num_payload_bytes, uint8_t *bytes,
+                  uint32_t num_bytes, TreeNode **a_table_root, const char **a_error);
+
+/**
+ * @brief Decode the container that follows an already-consumed magic word and
+ * write the uncompressed bytes to `uncompressed`.
+ *
+ * @param a_reader the BitReader positioned just past the magic word
+ * @param uncompressed the stream to write the decoded bytes to
+ * @param a_error a pointer to a string that will be set to an error message
+ * @return bool false if the container is malformed
+ */
+bool decompress_container(BitReader *a_reader, FILE *uncompressed, const char **a_error);
+
+/**
+ * @brief Like decompress_container(...), but write the uncompressed bytes to
+ * any BitWriter, such as a memory sink.
+ *
+ * @param a_reader the BitReader positioned just past the magic word
+ * @param a_output the byte-aligned BitWriter to write the decoded bytes to
+ * @param a_error a pointer to a string that will be set to an error message
+ * @return bool false if the container is malformed or a fixed output overflowed
+ */
+bool decode_container(BitReader *a_reader, BitWriter *a_output, const char **a_error);
+
+/**
+ * @brief Read the header of the block at `block_offset` in a block container
+ * file, leaving the file positioned at its payload.
+ *
+ * @param container the container file, opened for reading
+ * @param block_offset the offset of the block header, counted from the first block
+ * @param a_type where to store the block type
+ * @param a_num_bytes where to store the number of bytes the block decodes to
+ * @param a_num_payload_bytes where to store the number of payload bytes
+ * @return bool false at BLOCK_END or the end of the file
+ */
+bool read_block_header(FILE *container, uint64_t block_offset, BlockType *a_type, uint32_t *a_num_bytes,
+                       uint32_t *a_num_payload_bytes);
+
+/**
+ * @brief Read the payload of the block whose header was just read.
+ *
+ * @param container the container file, positioned by read_block_header(...)
+ * @param num_payload_bytes the number of payload bytes
+ * @return uint8_t* a malloc'd copy of the payload, or NULL if it is truncated
+ * or implausibly large
+ */
+uint8_t *read_block_payload(FILE *container, uint32_t num_payload_bytes);
+
+/**
+ * @brief Load the checkpoints of a block container file: its index if it
+ * has one, or else the start of every block, found by walking the block
+ * headers.
+ *
+ * @param container the container file, opened for reading
+ * @param a_checkpoints where to store a malloc'd array of checkpoints, in order
+ * @param a_num_checkpoints where to store the number of checkpoints
+ * @param a_error a pointer to a string that will be set to an error message
+ * @return bool false if the index is malformed
+ */
+bool read_checkpoints(FILE *container, Checkpoint **a_checkpoints, size_t *a_num_checkpoints, const char **a_error);
+
+/**
+ * @brief Load the block summaries of a block container file, written by
+ * compress_blocks(...) with `summaries`. Only the trailer is read.
+ *
+ * @param container the container file, opened for reading
+ * @param a_summaries where to store a malloc'd array of summaries, one per block in order
+ * @param a_num_summaries where to store the number of summaries
+ * @param a_error a pointer to a string that will be set to an error message
+ * @return bool false if the file has no summaries or they are malformed
+ */
+bool read_block_summaries(FILE *container, BlockSummary **a_summaries, size_t *a_num_summaries, const char **a_error);
+
+/**
+ * @brief Add the histograms of a range of blocks to `freq`. Counts, and the
+ * entropy of the range (see entropy_bits(...)), follow from the sum.
+ *
+ * @param summaries the summaries from read_block_summaries(...)
+ * @param first_block the index of the first block of the range
+ * @param num_blocks the number of blocks in the range
+ * @param freq the histogram to add to
+ */
+void add_block_summaries(const BlockSummary *summaries, size_t first_block, size_t num_blocks, Frequencies freq);
+
+/**
+ * @brief Decode `num_bytes` bytes from uncompressed offset `offset` on,
+ * starting from the last checkpoint before them.
+ *
+ * @param container the container file, opened for reading
+ * @param checkpoints the checkpoints from read_checkpoints(...)
+ * @param num_checkpoints the number of checkpoints
+ * @param offset the uncompressed offset of the first byte to read
+ * @param num_bytes the number of bytes to read
+ * @param dst where to store the bytes read
+ * @param a_num_read where to store the number of bytes read, fewer than
+ * num_bytes if the range runs past the end
+ * @param a_error a pointer to a string that will be set to an error message
+ * @return bool false if the container is malformed
+ */
+bool read_container_range(FILE *container, const Checkpoint *checkpoints, size_t num_checkpoints, uint64_t offset,
+                          size_t num_bytes, uint8_t *dst, size_t *a_num_read, const char **a_error);
+
+/**
+ * @brief Add `bytes` to the end of a block container file as new blocks,
+ * without touching the blocks already there. The new blocks never repeat an
+ * old table, so they decode on their own. The index and summaries are written
+ * again after them, extended with the new blocks: the file keeps them if it
+ * has them, and gains an index with `index_interval`. Summaries are only
+ * started on a file with no blocks, since the old blocks would have to be
+ * decoded to count them.
+ *
+ * @param container the container file, opened for reading and writing
+ * @param bytes the bytes to add
+ * @param num_bytes the number of bytes to add
+ * @param a_options the settings the new blocks are coded with
+ * @param a_error a pointer to a string that will be set to an error message
+ * @return bool false if the file is not a well-formed block container or
+ * could not be written
+ */
+bool append_container(FILE *container, const uint8_t *bytes, size_t num_bytes, const BlockOptions *a_options,
+                      const char **a_error);
+
+/**
+ * @brief Overwrite `num_bytes` uncompressed bytes of a block container file
+ * from `offset` on. Only the blocks holding them (and any blocks after those
+ * that repeat a table from before them) are decoded and coded again; the
+ * blocks after them are moved, not decoded, and the trailers are written
+ * again as with append_container(...).
+ *
+ * @param container the container file, opened for reading and writing
+ * @param offset the uncompressed offset of the first byte to change
+ * @param bytes the new bytes
+ * @param num_bytes the number of bytes to change
+ * @param a_options the settings the changed blocks are coded with
+ * @param a_error a pointer to a string that will be set to an error message
+ * @return bool false if the range runs past the end, or the file is not a
+ * well-formed block container or could not be written
+ */
+bool patch_container(FILE *container, uint64_t offset, const uint8_t *bytes, size_t num_bytes,
+                     const BlockOptions *a_options, const char **a_error);
+
+#endif // CONTAINER_H
@@ -0,0 +1,45 @@
+#ifndef CONTEXT_HUFFMAN_H
+#define CONTEXT_HUFFMAN_H
+
+#include "bit_tools.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// More tables rarely pay for themselves, and each one costs the decoder a HuffDecoder
+#define CONTEXT_MAX_CLUSTERS 32
+
+/**
+ * @brief Write `bytes` with order-1 Huffman coding: each byte is coded with
+ * a tree chosen by the byte before it (0 before the first byte).
+ *
+ * One tree per previous byte would cost more in tables than it saves on
+ * small blocks, so the 256 contexts are grouped into at most
+ * CONTEXT_MAX_CLUSTERS clusters that share a tree. Starting from one cluster
+ * per context that occurs, the two clusters whose merge costs the fewest bits
+ * (as estimated from the entropy of their histograms plus the table they
+ * save) are merged until no merge saves bits and the limit is met.
+ *
+ * The payload is the number of clusters (one byte), a Huffman section (see
+ * write_huffman_section(...)) of the cluster of every context, the coding
+ * table of each cluster followed by one 0 bit, then the codes.
+ *
+ * @param a_writer the BitWriter to write the payload to
+ * @param bytes the bytes to compress
+ * @param num_bytes the number of bytes to compress
+ */
+void context_write_payload(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes);
+
+/**
+ * @brief Decode a payload written by context_write_payload(...), one table
+ * lookup per byte for all but the longest codes (see HuffDecoder).
+ *
+ * @param a_reader the memory BitReader positioned at the payload
+ * @param bytes where to store the decoded bytes
+ * @param num_bytes the number of bytes the payload decodes to
+ * @return bool false if the payload is malformed
+ */
+bool context_read_payload(BitReader *a_reader, uint8_t *bytes, size_t num_bytes);
+
+#endif // CONTEXT_HUFFMAN_H
@@ -1,101 +1,256 @@
 #include "huffman.h"
+#include "container.h"
+#include "dictionary.h"
+#include "parallel_huffman.h"
+#include "utils.h"
+#include <inttypes.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 
-size_t list_size(PQNode *a_head)
+/*
+ * A path of "-" names standard input (for the compressed stream) or standard
+ * output (for the uncompressed bytes), so that decompression can sit in a pipe
+ * without a temporary file.
+ */
+static bool _is_std_stream(const char *path)
 {
-  size_t size = 0;
-  while (a_head != NULL)
+  return strcmp(path, "-") == 0;
+}
+
+static void _print_usage(const char *program)
+{
+  printf("Usage: %s [-p <threads>] <compressed_file|-> <coding_table_file> [<uncompressed_filename>|-]\n", program);
+  printf("       %s [-r <offset>:<length>] <container_file|-> [<uncompressed_filename>|-]\n", program);
+  printf("       %s -d <dictionary_file> <frame_file|-> [<uncompressed_filename>|-]\n", program);
+  printf("  -p           threads for the two-file format (default one per core)\n");
+  printf("  -r           only the bytes from offset on, decoded from the nearest checkpoint (see compress -i)\n");
+}
+
+static int _decompress_two_file(BitReader *a_reader, uint32_t num_uncompressed_bytes, const char *table_path,
+                                FILE *uncompressed, int num_threads)
+{
+  if (_is_std_stream(table_path))
+  {
+    fprintf(stderr, "Error: the coding table must be read from a file\n");
+    return EXIT_FAILURE;
+  }
+
+  BitReader table_reader = open_bit_reader(table_path);
+  if (table_reader.file == NULL)
   {
-    size++;
-    a_head = a_head->next;
+    fprintf(stderr, "Error: %s: %s\n", table_path, strerror(errno));
+    return EXIT_FAILURE;
+  }
+  TreeNode *reconstructed_root = read_coding_table(&table_reader);
+  close_bit_reader(&table_reader);
+
+  if (reconstructed_root == NULL && num_uncompressed_bytes > 0)
+  {
+    fprintf(stderr, "Error: %s: empty coding table\n", table_path);
+    return EXIT_FAILURE;
   }
-  return size;
+  read_compressed_parallel(a_reader, uncompressed, reconstructed_root, num_uncompressed_bytes, num_threads);
+  destroy_huffman_tree(&reconstructed_root);
+  return EXIT_SUCCESS;
 }
 
-TreeNode *reconstruct_huffman_tree(BitReader *a_reader)
+// A frame is read whole, since it is message-sized and its decoder wants a memory reader
+static int _decompress_dictionary(FILE *compressed, const char *dictionary_path, FILE *uncompressed)
 {
-  PQNode *stack = NULL;
-  PQNode *allocated_stack_nodes = NULL;
-  while (a_reader->file != NULL)
+  BitReader dictionary_reader = open_bit_reader(dictionary_path);
+  if (dictionary_reader.file == NULL)
   {
-    uint8_t bit = read_bit(a_reader);
-    if (bit == 1) // Leaf node
+    fprintf(stderr, "Error: %s: %s\n", dictionary_path, strerror(errno));
+    return EXIT_FAILURE;
+  }
+  HuffDictionary dictionary;
+  const char *error = NULL;
+  bool loaded = read_dictionary(&dictionary_reader, &dictionary, &error);
+  close_bit_reader(&dictionary_reader);
+  if (!loaded)
+  {
+    fprintf(stderr, "Error: %s: %s\n", dictionary_path, error);
+    return EXIT_FAILURE;
+  }
+
+  size_t num_frame_bytes = 0;
+  uint8_t *frame = read_stream(compressed, &num_frame_bytes);
+  BitReader reader = open_memory_bit_reader(frame, num_frame_bytes);
+  uint8_t *bytes = NULL;
+  size_t num_bytes = 0;
+  int status = EXIT_SUCCESS;
+  if (read_dictionary_frame(&reader, &dictionary, &bytes, &num_bytes, &error))
+  {
+    fwrite(bytes, 1, num_bytes, uncompressed);
+  }
+  else
+  {
+    fprintf(stderr, "Error: %s\n", error);
+    status = EXIT_FAILURE;
+  }
+  free(bytes);
+  free(frame);
+  destroy_dictionary(&dictionary);
+  return status;
+}
+
+// Read a range in pieces, so that a long one needs no buffer of its length
+static int _decompress_range(FILE *container, const char *path, uint64_t offset, uint64_t length, FILE *uncompressed)
+{
+  Checkpoint *checkpoints = NULL;
+  size_t num_checkpoints = 0;
+  const char *error = NULL;
+  if (!read_checkpoints(container, &checkpoints, &num_checkpoints, &error))
+  {
+    fprintf(stderr, "Error: %s: %s\n", path, error);
+    return EXIT_FAILURE;
+  }
+
+  int status = EXIT_SUCCESS;
+  size_t piece_size = 1u << 20;
+  uint8_t *piece = malloc(piece_size);
+  while (length > 0)
+  {
+    size_t num_read = 0;
+    size_t num_wanted = length < piece_size ? length : piece_size;
+    if (!read_container_range(container, checkpoints, num_checkpoints, offset, num_wanted, piece, &num_read, &error))
     {
-      uint8_t c = read_bits(a_reader, 8);
-      TreeNode *new_tree_node = malloc(sizeof(*new_tree_node));
-      *new_tree_node = (TreeNode){.character = (uchar)c, .frequency = 0, .left = NULL, .right = NULL};
-      stack_push(&stack, new_tree_node);
+      fprintf(stderr, "Error: %s: %s\n", path, error);
+      status = EXIT_FAILURE;
+      break;
     }
-    else // Internal Node
+    fwrite(piece, 1, num_read, uncompressed);
+    if (num_read < num_wanted)
     {
-      if (list_size(stack) == 1)
-      {
-        PQNode *stack_node = stack_pop(&stack);
-        TreeNode *huffman_tree = stack_node->a_value;
-        destroy_list(&allocated_stack_nodes, NULL);
-        free(stack_node);
-        return huffman_tree;
-      }
-      PQNode *right = stack_pop(&stack);
-      PQNode *left = stack_pop(&stack);
-      TreeNode *right_tree_node = right->a_value;
-      TreeNode *left_tree_node = left->a_value;
-      TreeNode *new_tree_node = malloc(sizeof(*new_tree_node));
-      *new_tree_node = (TreeNode){.character = '\0', .frequency = 0, .left = left_tree_node, .right = right_tree_node};
-      stack_push(&stack, new_tree_node);
-      stack_push(&allocated_stack_nodes, left);
-      stack_push(&allocated_stack_nodes, right);
+      break;
     }
+    offset += num_read;
+    length -= num_read;
   }
-
-  return NULL;
+  free(piece);
+  free(checkpoints);
+  return status;
 }
 
-void decompress(BitReader *a_reader, FILE *uncompressed, TreeNode *root)
+int main(int argc, char *argv[])
 {
-  uint32_t num_uncompressed_bytes;
-  fread(&num_uncompressed_bytes, sizeof(uint32_t), 1, a_reader->file);
-
-  uint32_t num_bytes_written = 0;
-  TreeNode *curr = root;
-
-  while (num_bytes_written < num_uncompressed_bytes)
+  const char *dictionary_path = NULL;
+  int num_threads = 0;
+  bool has_range = false;
+  uint64_t range_offset = 0;
+  uint64_t range_length = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "d:p:r:")) != -1)
   {
-    while (curr->left != NULL && curr->right != NULL)
+    switch (opt)
     {
-      uint8_t bit = read_bit(a_reader);
-      if (bit == 0)
+    case 'd':
+      dictionary_path = optarg;
+      break;
+    case 'p':
+      num_threads = atoi(optarg);
+      if (num_threads < 1)
       {
-        curr = curr->left;
+        _print_usage(argv[0]);
+        return EXIT_FAILURE;
       }
-      else
+      break;
+    case 'r':
+      has_range = sscanf(optarg, "%" SCNu64 ":%" SCNu64, &range_offset, &range_length) == 2;
+      if (!has_range)
       {
-        curr = curr->right;
+        _print_usage(argv[0]);
+        return EXIT_FAILURE;
       }
+      break;
+    default:
+      _print_usage(argv[0]);
+      return EXIT_FAILURE;
     }
-    fwrite(&(curr->character), sizeof(curr->character), 1, uncompressed);
-    num_bytes_written++;
-    curr = root;
   }
-}
+  int num_args = argc - optind;
+  char **args = argv + optind;
+  if (num_args < 1 || num_args > 3)
+  {
+    _print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
 
-int main(int argc, char *argv[])
-{
-  if (argc != 4)
+  const char *compressed_path = args[0];
+  BitReader compressed_reader = _is_std_stream(compressed_path)
+                                    ? (BitReader){.file = stdin, .current_byte = 0, .current_bit = -1}
+                                    : open_bit_reader(compressed_path);
+  if (compressed_reader.file == NULL)
   {
-    printf("Usage: %s <compressed_file> <coding_table_file> <uncompressed_filename>\n", argv[0]);
+    fprintf(stderr, "Error: %s: %s\n", compressed_path, strerror(errno));
     return EXIT_FAILURE;
   }
 
-  BitReader table_reader = open_bit_reader(argv[2]);
-  TreeNode *reconstructed_root = reconstruct_huffman_tree(&table_reader);
-  BitReader compressed_reader = open_bit_reader(argv[1]);
-  FILE *uncompressed = fopen(argv[3], "w");
-  decompress(&compressed_reader, uncompressed, reconstructed_root);
-  destroy_huffman_tree(&reconstructed_root);
-  close_bit_reader(&table_reader);
-  fclose(uncompressed);
+  /*
+   * Containers start with CONTAINER_MAGIC and the two-file format with its
+   * byte count. Three arguments can only be the two files and the output, so
+   * the first word is sniffed only when fewer are given. The one legacy
+   * input that starts like a container is 1,128,617,288 bytes long (the magic
+   * as a byte count); its two files decode only with the output named.
+   */
+  uint32_t first_word = 0;
+  bool is_container = dictionary_path == NULL &&
+                      fread(&first_word, sizeof(first_word), 1, compressed_reader.file) == 1 && num_args < 3 &&
+                      first_word == CONTAINER_MAGIC;
+  int num_positional = is_container || dictionary_path != NULL ? 1 : 2;
+  if (num_args < num_positional || num_args > num_positional + 1 || (has_range && !is_container) ||
+      (has_range && compressed_reader.file == stdin))
+  {
+    _print_usage(argv[0]);
+    close_bit_reader(&compressed_reader);
+    return EXIT_FAILURE;
+  }
 
-  return EXIT_SUCCESS;
-}
\ No newline at end of file
+  const char *uncompressed_path = num_args == num_positional + 1 ? args[num_positional] : "-";
+  FILE *uncompressed = _is_std_stream(uncompressed_path) ? stdout : fopen(uncompressed_path, "w");
+  if (uncompressed == NULL)
+  {
+    fprintf(stderr, "Error: %s: %s\n", uncompressed_path, strerror(errno));
+    close_bit_reader(&compressed_reader);
+    return EXIT_FAILURE;
+  }
+
+  int status = EXIT_SUCCESS;
+  if (dictionary_path != NULL)
+  {
+    status = _decompress_dictionary(compressed_reader.file, dictionary_path, uncompressed);
+  }
+  else if (has_range)
+  {
+    status = _decompress_range(compressed_reader.file, compressed_path, range_offset, range_length, uncompressed);
+  }
+  else if (is_container)
+  {
+    const char *error = NULL;
+    if (!decompress_container(&compressed_reader, uncompressed, &error))
+    {
+      fprintf(stderr, "Error: %s: %s\n", compressed_path, error);
+      status = EXIT_FAILURE;
+    }
+  }
+  else
+  {
+    status = _decompress_two_file(&compressed_reader, first_word, args[1], uncompressed, num_threads);
+  }
+
+  if (compressed_reader.file != stdin)
+  {
+    close_bit_reader(&compressed_reader);
+  }
+  if (uncompressed != stdout)
+  {
+    fclose(uncompressed);
+  }
+  else
+  {
+    fflush(stdout);
+  }
+
+  return status;
+}
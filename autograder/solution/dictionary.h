@@ -0,0 +1,97 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include "huffman.h"
+#include "bit_tools.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Pretrained coding tables for inputs too small to carry their own. A
+ * message of a few dozen bytes costs about as much in coding table as in
+ * codes, so a table trained once on similar data (see `train`) is shared by
+ * the compressor and the decompressor and never written with the data.
+ *
+ * A dictionary file is this magic word ("HUFD" in little-endian order), the
+ * dictionary id (uint32), then the coding table and one 0 bit.
+ */
+#define DICTIONARY_MAGIC 0x44465548u
+
+/**
+ * A loaded dictionary, ready to code with.
+ */
+typedef struct _HuffDictionary
+{
+  uint32_t id; // A hash of the coding table, so that a frame can name the table it needs
+  TreeNode *root;
+  HuffEncoder encoder;
+} HuffDictionary;
+
+/**
+ * @brief Build the tree of a dictionary from the byte counts of a sample
+ * corpus. Every byte gets a code, even those the corpus never uses, so that
+ * any input can be coded with the dictionary.
+ *
+ * @param freq the byte counts of the corpus (see calc_frequencies(...))
+ * @return TreeNode* the root of a tree with 256 leaves
+ */
+TreeNode *train_dictionary_tree(const Frequencies freq);
+
+/**
+ * @brief Write a dictionary file for the tree `root`.
+ *
+ * @param a_writer the BitWriter to write the dictionary to
+ * @param root the tree, as made by train_dictionary_tree(...)
+ */
+void write_dictionary(BitWriter *a_writer, TreeNode *root);
+
+/**
+ * @brief Load a dictionary file written by write_dictionary(...).
+ *
+ * @param a_reader the BitReader positioned at the magic word
+ * @param a_dictionary the dictionary to fill; destroy it with destroy_dictionary(...)
+ * @param a_error a pointer to a string that will be set to an error message
+ * @return bool false if the input is not a dictionary
+ */
+bool read_dictionary(BitReader *a_reader, HuffDictionary *a_dictionary, const char **a_error);
+
+/**
+ * @brief Free the tree of a dictionary loaded by read_dictionary(...).
+ *
+ * @param a_dictionary the dictionary to destroy
+ */
+void destroy_dictionary(HuffDictionary *a_dictionary);
+
+/**
+ * @brief Write `bytes` as a dictionary frame: the low 16 bits of the
+ * dictionary id, the number of bytes (see write_varint(...)), one bit, then
+ * the codes. Where the codes would take more bits than the bytes themselves,
+ * the bit is 1 and the bytes follow as they are from the next byte boundary,
+ * so a frame is never more than a few bytes larger than its input.
+ * A frame has no container header, since at message sizes the header would be
+ * much of the output; the reader must be told to expect one.
+ *
+ * @param a_writer the BitWriter to write the frame to
+ * @param a_dictionary the dictionary to code with
+ * @param bytes the bytes to compress
+ * @param num_bytes the number of bytes to compress
+ */
+void write_dictionary_frame(BitWriter *a_writer, const HuffDictionary *a_dictionary, const uint8_t *bytes,
+                            size_t num_bytes);
+
+/**
+ * @brief Decode a frame written by write_dictionary_frame(...).
+ *
+ * @param a_reader the memory BitReader positioned at the frame
+ * @param a_dictionary the dictionary the frame was written with
+ * @param a_bytes where to store a malloc'd buffer of the decoded bytes
+ * @param a_num_bytes where to store the number of decoded bytes
+ * @param a_error a pointer to a string that will be set to an error message
+ * @return bool false if the frame names another dictionary or is malformed
+ */
+bool read_dictionary_frame(BitReader *a_reader, const HuffDictionary *a_dictionary, uint8_t **a_bytes,
+                           size_t *a_num_bytes, const char **a_error);
+
+#endif // DICTIONARY_H
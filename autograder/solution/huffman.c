@@ -1,4 +1,5 @@
 #include "huffman.h"
+#include <math.h>
 
 #define MAX_TREE_HT 100
 #define NUM_CHARS 256
@@ -25,59 +26,76 @@ bool calc_frequencies(Frequencies freqs, const char *path, const char **a_error)
   return true;
 }
 
-static int _cmp_node(const void *a, const void *b)
+// Leaves in (frequency, character) order
+static int _cmp_leaf(const void *a, const void *b)
 {
-  TreeNode *x = (TreeNode *)a;
-  TreeNode *y = (TreeNode *)b;
-  return (int)(x->frequency == y->frequency) ? (x->character - y->character) : (x->frequency - y->frequency);
+  const TreeNode *x = *(TreeNode *const *)a;
+  const TreeNode *y = *(TreeNode *const *)b;
+  if (x->frequency != y->frequency)
+  {
+    return x->frequency < y->frequency ? -1 : 1;
+  }
+  return x->character - y->character;
 }
 
-TreeNode *make_huffman_tree(Frequencies freq)
+/*
+ * Merged nodes are made in order of frequency, so the lowest node is at the
+ * front of either the sorted leaves or the merged nodes. Merged nodes rank
+ * as character 0, and come after a leaf with the same frequency and
+ * character since that leaf was queued first.
+ */
+static TreeNode *_take_lowest(TreeNode **leaves, size_t *a_next_leaf, size_t num_leaves, TreeNode **merged,
+                              size_t *a_next_merged, size_t num_merged)
 {
-  PQNode *head = NULL;
+  if (*a_next_merged < num_merged)
+  {
+    TreeNode *node = merged[*a_next_merged];
+    TreeNode *leaf = *a_next_leaf < num_leaves ? leaves[*a_next_leaf] : NULL;
+    if (leaf == NULL || node->frequency < leaf->frequency ||
+        (node->frequency == leaf->frequency && leaf->character > 0))
+    {
+      (*a_next_merged)++;
+      return node;
+    }
+  }
+  return leaves[(*a_next_leaf)++];
+}
 
+TreeNode *make_huffman_tree(Frequencies freq)
+{
+  // Sorting the leaves once and queueing the merged nodes separately takes O(n log n)
+  TreeNode *leaves[256];
+  size_t num_leaves = 0;
   for (int freq_idx = 0; freq_idx < 256; freq_idx++)
   {
     if (freq[(uchar)freq_idx] > 0)
     {
       TreeNode *new_node = malloc(sizeof(*new_node));
       *new_node = (TreeNode){.character = freq_idx, .frequency = freq[freq_idx], .left = NULL, .right = NULL};
-      pq_enqueue(&head, new_node, _cmp_node);
+      leaves[num_leaves++] = new_node;
     }
   }
 
-  if (head == NULL)
+  if (num_leaves == 0)
   {
     return NULL;
   }
+  qsort(leaves, num_leaves, sizeof(TreeNode *), _cmp_leaf);
 
-  if (head->next == NULL)
-  {
-    return head->a_value;
-  }
-
-  PQNode *allocated_heap_nodes = NULL; // List to keep track of allocated PQNodes
-
-  while (head != NULL && head->next != NULL)
+  TreeNode *merged[255];
+  size_t num_merged = 0;
+  size_t next_leaf = 0;
+  size_t next_merged = 0;
+  while ((num_leaves - next_leaf) + (num_merged - next_merged) > 1)
   {
-    PQNode *left = pq_dequeue(&head);
-    PQNode *right = pq_dequeue(&head);
-    TreeNode *left_treenode = left->a_value;
-    TreeNode *right_treenode = right->a_value;
+    TreeNode *left = _take_lowest(leaves, &next_leaf, num_leaves, merged, &next_merged, num_merged);
+    TreeNode *right = _take_lowest(leaves, &next_leaf, num_leaves, merged, &next_merged, num_merged);
     TreeNode *new_node = malloc(sizeof(*new_node));
-    *new_node = (TreeNode){.character = '\0', .frequency = left_treenode->frequency + right_treenode->frequency, .left = left_treenode, .right = right_treenode};
-    pq_enqueue(&head, new_node, _cmp_node);
-    stack_push(&allocated_heap_nodes, left);  // Keep track of allocated left PQNode
-    stack_push(&allocated_heap_nodes, right); // Keep track of allocated right PQNode
+    *new_node = (TreeNode){.character = '\0', .frequency = left->frequency + right->frequency, .left = left, .right = right};
+    merged[num_merged++] = new_node;
   }
 
-  PQNode *pq_head = pq_dequeue(&head);
-  TreeNode *huffman_tree = pq_head->a_value;
-  free(pq_head);
-
-  destroy_list(&allocated_heap_nodes, NULL); // Free the list itself
-
-  return huffman_tree;
+  return num_merged > 0 ? merged[num_merged - 1] : leaves[0];
 }
 
 void destroy_huffman_tree(TreeNode **a_root)
@@ -154,12 +172,23 @@ void _store_codes(TreeNode *root, uchar *arr, int top)
 // Function to build the Huffman table from the tree
 void build_huffman_table(TreeNode *root)
 {
+  for (int ch = 0; ch < NUM_CHARS; ch++)
+  {
+    free(huffman_table[ch]); // Drop the codes left over from a previous tree
+    huffman_table[ch] = NULL;
+  }
+
   uchar arr[MAX_TREE_HT];
   _store_codes(root, arr, 0);
 }
 
 void write_compressed(BitWriter *a_writer, uint8_t *uncompressed_bytes, TreeNode *root)
 {
+  if (root == NULL)
+  {
+    return;
+  }
+
   build_huffman_table(root);
 
   for (int uncompressed_idx = 0; uncompressed_bytes[uncompressed_idx] != '\0'; uncompressed_idx++)
@@ -171,3 +200,277 @@ void write_compressed(BitWriter *a_writer, uint8_t *uncompressed_bytes, TreeNode
     }
   }
 }
+
+static void _destroy_tree_value(void *a_value)
+{
+  TreeNode *root = a_value;
+  destroy_huffman_tree(&root);
+}
+
+TreeNode *read_coding_table(BitReader *a_reader)
+{
+  PQNode *stack = NULL;
+  PQNode *allocated_stack_nodes = NULL;
+  while (is_bit_reader_open(a_reader))
+  {
+    uint8_t bit = read_bit(a_reader);
+    if (bit == 1) // Leaf node
+    {
+      uint8_t c = read_bits(a_reader, 8);
+      TreeNode *new_tree_node = malloc(sizeof(*new_tree_node));
+      *new_tree_node = (TreeNode){.character = (uchar)c, .frequency = 0, .left = NULL, .right = NULL};
+      stack_push(&stack, new_tree_node);
+    }
+    else // Internal Node
+    {
+      if (stack == NULL) // Empty table, or a malformed one
+      {
+        destroy_list(&allocated_stack_nodes, free);
+        return NULL;
+      }
+      if (stack->next == NULL) // The root
+      {
+        PQNode *stack_node = stack_pop(&stack);
+        TreeNode *huffman_tree = stack_node->a_value;
+        destroy_list(&allocated_stack_nodes, free);
+        free(stack_node);
+        return huffman_tree;
+      }
+      PQNode *right = stack_pop(&stack);
+      PQNode *left = stack_pop(&stack);
+      TreeNode *right_tree_node = right->a_value;
+      TreeNode *left_tree_node = left->a_value;
+      TreeNode *new_tree_node = malloc(sizeof(*new_tree_node));
+      *new_tree_node = (TreeNode){.character = '\0', .frequency = 0, .left = left_tree_node, .right = right_tree_node};
+      stack_push(&stack, new_tree_node);
+      stack_push(&allocated_stack_nodes, left);
+      stack_push(&allocated_stack_nodes, right);
+    }
+  }
+
+  // The input ended inside the table
+  destroy_list(&stack, _destroy_tree_value);
+  destroy_list(&allocated_stack_nodes, free);
+  return NULL;
+}
+
+void read_compressed(BitReader *a_reader, FILE *uncompressed, TreeNode *root, uint32_t num_uncompressed_bytes)
+{
+  uint32_t num_bytes_written = 0;
+  TreeNode *curr = root;
+
+  while (num_bytes_written < num_uncompressed_bytes)
+  {
+    while (curr->left != NULL && curr->right != NULL)
+    {
+      uint8_t bit = read_bit(a_reader);
+      if (bit == 0)
+      {
+        curr = curr->left;
+      }
+      else
+      {
+        curr = curr->right;
+      }
+    }
+    fwrite(&(curr->character), sizeof(curr->character), 1, uncompressed);
+    num_bytes_written++;
+    curr = root;
+  }
+}
+
+static void _store_encoder_codes(HuffEncoder *a_encoder, TreeNode *node, uint64_t bits, uint8_t length)
+{
+  if (node->left == NULL && node->right == NULL)
+  {
+    a_encoder->codes[node->character] = (HuffCode){.bits = bits, .length = length};
+    return;
+  }
+  _store_encoder_codes(a_encoder, node->left, bits << 1, length + 1);
+  _store_encoder_codes(a_encoder, node->right, (bits << 1) | 1, length + 1);
+}
+
+void build_huff_encoder(HuffEncoder *a_encoder, TreeNode *root)
+{
+  memset(a_encoder, 0, sizeof(*a_encoder));
+  if (root != NULL)
+  {
+    _store_encoder_codes(a_encoder, root, 0, 0);
+  }
+}
+
+void write_symbols(BitWriter *a_writer, const HuffEncoder *a_encoder, const uint8_t *bytes, size_t num_bytes)
+{
+  for (size_t idx = 0; idx < num_bytes; idx++)
+  {
+    HuffCode code = a_encoder->codes[bytes[idx]];
+    write_code(a_writer, code.bits, code.length);
+  }
+}
+
+static void _fill_lookup(HuffDecoder *a_decoder, TreeNode *node, uint32_t code, uint8_t length)
+{
+  if (length == HUFF_LOOKUP_BITS || node->left == NULL || node->right == NULL)
+  {
+    // Every index that starts with `code` leads here
+    uint32_t num_entries = 1u << (HUFF_LOOKUP_BITS - length);
+    for (uint32_t idx = 0; idx < num_entries; idx++)
+    {
+      a_decoder->lookup[(code << (HUFF_LOOKUP_BITS - length)) | idx] = (HuffLookupEntry){.node = node, .length = length};
+    }
+    return;
+  }
+  _fill_lookup(a_decoder, node->left, code << 1, length + 1);
+  _fill_lookup(a_decoder, node->right, (code << 1) | 1, length + 1);
+}
+
+void build_huff_decoder(HuffDecoder *a_decoder, TreeNode *root)
+{
+  _fill_lookup(a_decoder, root, 0, 0);
+}
+
+uint8_t decode_symbol(const HuffDecoder *a_decoder, BitReader *a_reader)
+{
+  const HuffLookupEntry *entry = &a_decoder->lookup[peek_bits(a_reader, HUFF_LOOKUP_BITS)];
+  skip_bits(a_reader, entry->length);
+  TreeNode *curr = entry->node;
+  while (curr->left != NULL && curr->right != NULL)
+  {
+    curr = read_bit(a_reader) ? curr->right : curr->left;
+  }
+  return curr->character;
+}
+
+void read_symbols(BitReader *a_reader, TreeNode *root, uint8_t *bytes, size_t num_bytes)
+{
+  // Filling the table costs about as much as decoding that many codes bit by bit
+  if (a_reader->buffer != NULL && num_bytes >= (1u << HUFF_LOOKUP_BITS))
+  {
+    HuffDecoder *decoder = malloc(sizeof(*decoder));
+    build_huff_decoder(decoder, root);
+    for (size_t idx = 0; idx < num_bytes; idx++)
+    {
+      bytes[idx] = decode_symbol(decoder, a_reader);
+    }
+    free(decoder);
+    return;
+  }
+
+  for (size_t idx = 0; idx < num_bytes; idx++)
+  {
+    TreeNode *curr = root;
+    while (curr->left != NULL && curr->right != NULL)
+    {
+      curr = read_bit(a_reader) ? curr->right : curr->left;
+    }
+    bytes[idx] = curr->character;
+  }
+}
+
+void add_frequencies(Frequencies freqs, const uint8_t *bytes, size_t num_bytes)
+{
+  for (size_t idx = 0; idx < num_bytes; idx++)
+  {
+    freqs[bytes[idx]]++;
+  }
+}
+
+double entropy_bits(const Frequencies freqs)
+{
+  uint64_t total = 0;
+  double sum_f_log_f = 0.0;
+  for (int ch = 0; ch < NUM_CHARS; ch++)
+  {
+    if (freqs[ch] > 0)
+    {
+      total += freqs[ch];
+      sum_f_log_f += freqs[ch] * log2((double)freqs[ch]);
+    }
+  }
+  // sum(f * log2(total / f)) == total * log2(total) - sum(f * log2(f))
+  return total > 0 ? total * log2((double)total) - sum_f_log_f : 0.0;
+}
+
+uint64_t coded_bits(const Frequencies freqs, const HuffEncoder *a_encoder)
+{
+  uint64_t num_bits = 0;
+  for (int ch = 0; ch < NUM_CHARS; ch++)
+  {
+    num_bits += freqs[ch] * a_encoder->codes[ch].length;
+  }
+  return num_bits;
+}
+
+uint64_t coding_table_bits(const Frequencies freqs)
+{
+  uint64_t num_leaves = 0;
+  for (int ch = 0; ch < NUM_CHARS; ch++)
+  {
+    num_leaves += freqs[ch] > 0;
+  }
+  // 9 bits per leaf, 1 per internal node, and 1 for the terminator
+  return num_leaves > 0 ? 10 * num_leaves : 0;
+}
+
+void two_file_sizes(const uint8_t *bytes, size_t num_bytes, uint64_t *a_compressed_size, uint64_t *a_table_size)
+{
+  Frequencies freq = {0};
+  add_frequencies(freq, bytes, num_bytes);
+  TreeNode *root = make_huffman_tree(freq);
+  HuffEncoder encoder;
+  build_huff_encoder(&encoder, root);
+  destroy_huffman_tree(&root);
+
+  const uint8_t *nul = memchr(bytes, '\0', num_bytes);
+  Frequencies coded_freq = {0};
+  add_frequencies(coded_freq, bytes, nul != NULL ? (size_t)(nul - bytes) : num_bytes);
+  *a_compressed_size = sizeof(uint32_t) + coded_bits(coded_freq, &encoder) / 8 + 1;
+  // The file has no terminating bit
+  uint64_t table_bits = coding_table_bits(freq);
+  *a_table_size = (table_bits > 0 ? table_bits - 1 : 0) / 8 + 1;
+}
+
+void write_huffman_section(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes)
+{
+  Frequencies freq = {0};
+  add_frequencies(freq, bytes, num_bytes);
+  TreeNode *root = make_huffman_tree(freq);
+  HuffEncoder encoder;
+  build_huff_encoder(&encoder, root);
+
+  write_coding_table(root, a_writer);
+  write_bits(a_writer, 0, 1);
+  write_symbols(a_writer, &encoder, bytes, num_bytes);
+  destroy_huffman_tree(&root);
+}
+
+bool read_huffman_section(BitReader *a_reader, uint8_t *bytes, size_t num_bytes)
+{
+  TreeNode *root = read_coding_table(a_reader);
+  if (root == NULL)
+  {
+    return num_bytes == 0;
+  }
+  read_symbols(a_reader, root, bytes, num_bytes);
+  destroy_huffman_tree(&root);
+  return true;
+}
+
+uint8_t value_code(uint32_t value)
+{
+  if (value < 16)
+  {
+    return (uint8_t)value;
+  }
+  return (uint8_t)(12 + (31 - __builtin_clz(value)));
+}
+
+uint8_t value_code_extra_bits(uint8_t code)
+{
+  return code < 16 ? 0 : code - 12;
+}
+
+uint32_t value_code_base(uint8_t code)
+{
+  return code < 16 ? code : 1u << (code - 12);
+}
@@ -0,0 +1,295 @@
+#include "lz77.h"
+#include "huffman.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define HASH_LOG 16
+
+// A minimum-length match this far back takes more bits than its literals
+#define TOO_FAR (1u << 12)
+
+// The number of chain links followed and the length that ends the search, per level
+static const int MAX_CHAIN[LZ_MAX_LEVEL + 1] = {0, 4, 8, 16, 32, 64, 128, 256, 1024, 4096};
+static const size_t NICE_LENGTH[LZ_MAX_LEVEL + 1] = {0, 16, 32, 32, 64, 128, 128, 258, 1024, SIZE_MAX};
+#define MIN_LAZY_LEVEL 4
+
+/*
+ * head[h] is the latest position whose next LZ_MIN_MATCH bytes hash to h, and
+ * prev[pos % window_size] the position before pos with the same hash, so each
+ * hash value heads a chain of earlier positions, newest first.
+ */
+typedef struct _MatchFinder
+{
+  const uint8_t *bytes;
+  size_t num_bytes;
+  int32_t *head;
+  int32_t *prev;
+  size_t window_size;
+  size_t next_insert; // Positions before this are on their chains
+  int max_chain;
+  size_t nice_length;
+} MatchFinder;
+
+static uint32_t _hash(const uint8_t *bytes)
+{
+  uint32_t value;
+  memcpy(&value, bytes, sizeof(value));
+  return (value * 2654435761u) >> (32 - HASH_LOG);
+}
+
+static void _insert_before(MatchFinder *a_finder, size_t pos)
+{
+  for (; a_finder->next_insert < pos && a_finder->next_insert + LZ_MIN_MATCH <= a_finder->num_bytes;
+       a_finder->next_insert++)
+  {
+    uint32_t hash = _hash(a_finder->bytes + a_finder->next_insert);
+    a_finder->prev[a_finder->next_insert & (a_finder->window_size - 1)] = a_finder->head[hash];
+    a_finder->head[hash] = (int32_t)a_finder->next_insert;
+  }
+}
+
+// The length of the longest match for the bytes at `pos`, or 0 if there is none
+static size_t _longest_match(MatchFinder *a_finder, size_t pos, size_t *a_distance)
+{
+  if (pos + LZ_MIN_MATCH > a_finder->num_bytes)
+  {
+    return 0;
+  }
+  _insert_before(a_finder, pos);
+
+  const uint8_t *bytes = a_finder->bytes;
+  size_t max_length = a_finder->num_bytes - pos;
+  size_t best_length = 0;
+  int chain = a_finder->max_chain;
+  // prev[] only holds the last window_size positions, so stop before the ring wraps
+  for (int32_t candidate = a_finder->head[_hash(bytes + pos)];
+       candidate >= 0 && pos - (size_t)candidate < a_finder->window_size && chain-- > 0;
+       candidate = a_finder->prev[candidate & (a_finder->window_size - 1)])
+  {
+    if (bytes[candidate + best_length] != bytes[pos + best_length])
+    {
+      continue;
+    }
+    size_t length = 0;
+    while (length < max_length && bytes[candidate + length] == bytes[pos + length])
+    {
+      length++;
+    }
+    if (length > best_length)
+    {
+      best_length = length;
+      *a_distance = pos - candidate;
+      if (length >= a_finder->nice_length || length == max_length)
+      {
+        break;
+      }
+    }
+  }
+
+  if (best_length < LZ_MIN_MATCH || (best_length == LZ_MIN_MATCH && *a_distance > TOO_FAR))
+  {
+    return 0;
+  }
+  return best_length;
+}
+
+typedef struct _Sequences
+{
+  size_t num_sequences;
+  uint32_t *literal_lengths;
+  uint32_t *match_lengths;
+  uint32_t *distances;
+  size_t num_literals;
+  uint8_t *literals;
+} Sequences;
+
+static void _parse(const uint8_t *bytes, size_t num_bytes, const LzOptions *a_options, Sequences *a_sequences)
+{
+  int level = a_options->level < 1 ? 1 : a_options->level > LZ_MAX_LEVEL ? LZ_MAX_LEVEL : a_options->level;
+  int window_log = a_options->window_log < LZ_MIN_WINDOW_LOG   ? LZ_MIN_WINDOW_LOG
+                   : a_options->window_log > LZ_MAX_WINDOW_LOG ? LZ_MAX_WINDOW_LOG
+                                                               : a_options->window_log;
+  MatchFinder finder = {.bytes = bytes,
+                        .num_bytes = num_bytes,
+                        .head = malloc(sizeof(int32_t) << HASH_LOG),
+                        .prev = malloc(sizeof(int32_t) << window_log),
+                        .window_size = (size_t)1 << window_log,
+                        .next_insert = 0,
+                        .max_chain = MAX_CHAIN[level],
+                        .nice_length = NICE_LENGTH[level]};
+  memset(finder.head, 0xff, sizeof(int32_t) << HASH_LOG);
+
+  size_t max_sequences = num_bytes / LZ_MIN_MATCH + 1;
+  *a_sequences = (Sequences){.literal_lengths = malloc(max_sequences * sizeof(uint32_t)),
+                             .match_lengths = malloc(max_sequences * sizeof(uint32_t)),
+                             .distances = malloc(max_sequences * sizeof(uint32_t)),
+                             .literals = malloc(num_bytes + 1)};
+
+  size_t literal_start = 0;
+  size_t pos = 0;
+  while (pos + LZ_MIN_MATCH <= num_bytes)
+  {
+    size_t distance = 0;
+    size_t length = _longest_match(&finder, pos, &distance);
+    if (length == 0)
+    {
+      pos++;
+      continue;
+    }
+
+    // Lazy matching: a longer match one byte on is worth an extra literal
+    if (level >= MIN_LAZY_LEVEL && length < finder.nice_length)
+    {
+      size_t next_distance = 0;
+      size_t next_length = _longest_match(&finder, pos + 1, &next_distance);
+      if (next_length > length)
+      {
+        pos++;
+        length = next_length;
+        distance = next_distance;
+      }
+    }
+
+    size_t num_literals = pos - literal_start;
+    memcpy(a_sequences->literals + a_sequences->num_literals, bytes + literal_start, num_literals);
+    a_sequences->num_literals += num_literals;
+    a_sequences->literal_lengths[a_sequences->num_sequences] = (uint32_t)num_literals;
+    a_sequences->match_lengths[a_sequences->num_sequences] = (uint32_t)length;
+    a_sequences->distances[a_sequences->num_sequences] = (uint32_t)distance;
+    a_sequences->num_sequences++;
+
+    pos += length;
+    literal_start = pos;
+  }
+
+  memcpy(a_sequences->literals + a_sequences->num_literals, bytes + literal_start, num_bytes - literal_start);
+  a_sequences->num_literals += num_bytes - literal_start;
+
+  free(finder.head);
+  free(finder.prev);
+}
+
+static void _destroy_sequences(Sequences *a_sequences)
+{
+  free(a_sequences->literal_lengths);
+  free(a_sequences->match_lengths);
+  free(a_sequences->distances);
+  free(a_sequences->literals);
+}
+
+static void _write_value_codes(BitWriter *a_writer, const uint32_t *values, size_t num_values, uint32_t bias)
+{
+  uint8_t *codes = malloc(num_values + 1);
+  for (size_t i = 0; i < num_values; i++)
+  {
+    codes[i] = value_code(values[i] - bias);
+  }
+  write_huffman_section(a_writer, codes, num_values);
+  free(codes);
+}
+
+static void _write_extra_bits(BitWriter *a_writer, uint32_t value)
+{
+  uint8_t code = value_code(value);
+  write_code(a_writer, value - value_code_base(code), value_code_extra_bits(code));
+}
+
+void lz77_write_payload(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes, const LzOptions *a_options)
+{
+  Sequences sequences;
+  _parse(bytes, num_bytes, a_options, &sequences);
+
+  write_uint32(a_writer, (uint32_t)sequences.num_sequences);
+  write_uint32(a_writer, (uint32_t)sequences.num_literals);
+  write_huffman_section(a_writer, sequences.literals, sequences.num_literals);
+  _write_value_codes(a_writer, sequences.literal_lengths, sequences.num_sequences, 0);
+  _write_value_codes(a_writer, sequences.match_lengths, sequences.num_sequences, LZ_MIN_MATCH);
+  _write_value_codes(a_writer, sequences.distances, sequences.num_sequences, 1);
+  for (size_t i = 0; i < sequences.num_sequences; i++)
+  {
+    _write_extra_bits(a_writer, sequences.literal_lengths[i]);
+    _write_extra_bits(a_writer, sequences.match_lengths[i] - LZ_MIN_MATCH);
+    _write_extra_bits(a_writer, sequences.distances[i] - 1);
+  }
+
+  _destroy_sequences(&sequences);
+}
+
+static bool _read_value_codes(BitReader *a_reader, uint8_t *codes, size_t num_codes)
+{
+  if (!read_huffman_section(a_reader, codes, num_codes))
+  {
+    return false;
+  }
+  for (size_t i = 0; i < num_codes; i++)
+  {
+    if (codes[i] >= NUM_VALUE_CODES)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static uint64_t _read_value(BitReader *a_reader, uint8_t code)
+{
+  return value_code_base(code) + read_code(a_reader, value_code_extra_bits(code));
+}
+
+bool lz77_read_payload(BitReader *a_reader, uint8_t *bytes, size_t num_bytes)
+{
+  uint32_t num_sequences = read_uint32(a_reader);
+  uint32_t num_literals = read_uint32(a_reader);
+  if (!is_bit_reader_open(a_reader) || num_literals > num_bytes || num_sequences > num_bytes / LZ_MIN_MATCH)
+  {
+    return false;
+  }
+
+  uint8_t *literals = malloc(num_literals + 1);
+  uint8_t *codes = malloc(3 * (size_t)num_sequences + 1);
+  uint8_t *literal_codes = codes;
+  uint8_t *match_codes = codes + num_sequences;
+  uint8_t *distance_codes = codes + 2 * (size_t)num_sequences;
+  bool ok = read_huffman_section(a_reader, literals, num_literals) &&
+            _read_value_codes(a_reader, literal_codes, num_sequences) &&
+            _read_value_codes(a_reader, match_codes, num_sequences) &&
+            _read_value_codes(a_reader, distance_codes, num_sequences);
+
+  size_t pos = 0;
+  size_t literal_pos = 0;
+  for (uint32_t i = 0; ok && i < num_sequences; i++)
+  {
+    uint64_t literal_length = _read_value(a_reader, literal_codes[i]);
+    uint64_t match_length = _read_value(a_reader, match_codes[i]) + LZ_MIN_MATCH;
+    uint64_t distance = _read_value(a_reader, distance_codes[i]) + 1;
+    if (literal_length > num_literals - literal_pos || literal_length + match_length > num_bytes - pos ||
+        distance > pos + literal_length)
+    {
+      ok = false;
+      break;
+    }
+
+    memcpy(bytes + pos, literals + literal_pos, literal_length);
+    pos += literal_length;
+    literal_pos += literal_length;
+    // Byte by byte, since a match may overlap the bytes it produces
+    for (uint64_t j = 0; j < match_length; j++, pos++)
+    {
+      bytes[pos] = bytes[pos - distance];
+    }
+  }
+
+  if (ok && num_literals - literal_pos == num_bytes - pos)
+  {
+    memcpy(bytes + pos, literals + literal_pos, num_literals - literal_pos);
+  }
+  else
+  {
+    ok = false;
+  }
+
+  free(literals);
+  free(codes);
+  return ok && is_bit_reader_open(a_reader);
+}
@@ -0,0 +1,61 @@
+#ifndef LZ77_H
+#define LZ77_H
+
+#include "bit_tools.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Shorter repeats cost more as a (length, distance) pair than as literals
+#define LZ_MIN_MATCH 4
+
+#define LZ_MAX_LEVEL 9
+#define LZ_MIN_WINDOW_LOG 10
+#define LZ_MAX_WINDOW_LOG 24
+#define LZ_DEFAULT_LEVEL 6
+#define LZ_DEFAULT_WINDOW_LOG 16
+
+/**
+ * Settings for the match finder. Higher levels follow longer hash chains,
+ * and from level 4 on defer a match by one byte when the next position starts
+ * a longer one, trading speed for smaller output. The window only limits the
+ * encoder; the decoder accepts any distance back into the block.
+ */
+typedef struct _LzOptions
+{
+  int level;      // 1 to LZ_MAX_LEVEL
+  int window_log; // Matches reach back at most 2^window_log - 1 bytes
+} LzOptions;
+
+/**
+ * @brief Parse `bytes` into literals and back-references with a hash-chain
+ * match finder and write them as a block payload.
+ *
+ * The input becomes a list of sequences, each some literals followed by a
+ * match of at least LZ_MIN_MATCH bytes; literals after the last match are
+ * implied by `num_bytes`. The payload is the number of sequences and of
+ * literals (uint32), then four Huffman sections (see
+ * write_huffman_section(...)): the literal bytes, and the value codes (see
+ * value_code(...)) of the literal counts, of the match lengths minus
+ * LZ_MIN_MATCH, and of the distances minus one. The extra bits of the three
+ * values of each sequence follow in sequence order.
+ *
+ * @param a_writer the BitWriter to write the payload to
+ * @param bytes the bytes to compress
+ * @param num_bytes the number of bytes to compress
+ * @param a_options the match finder settings
+ */
+void lz77_write_payload(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes, const LzOptions *a_options);
+
+/**
+ * @brief Decode a payload written by lz77_write_payload(...).
+ *
+ * @param a_reader the BitReader positioned at the payload
+ * @param bytes where to store the decoded bytes
+ * @param num_bytes the number of bytes the payload decodes to
+ * @return bool false if the payload is malformed
+ */
+bool lz77_read_payload(BitReader *a_reader, uint8_t *bytes, size_t num_bytes);
+
+#endif // LZ77_H
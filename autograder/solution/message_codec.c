@@ -0,0 +1,159 @@
+#include "message_codec.h"
+#include "dictionary.h"
+
+// A varint of a size_t takes at most this many bytes
+#define MAX_VARINT_BYTES 10
+
+void init_message_codec(MessageCodec *a_codec, const Frequencies freq)
+{
+  a_codec->root = train_dictionary_tree(freq);
+  build_huff_encoder(&a_codec->encoder, a_codec->root);
+  build_huff_decoder(&a_codec->decoder, a_codec->root);
+  a_codec->max_code_length = 0;
+  for (int ch = 0; ch < 256; ch++)
+  {
+    uint8_t length = a_codec->encoder.codes[ch].length;
+    a_codec->max_code_length = length > a_codec->max_code_length ? length : a_codec->max_code_length;
+  }
+}
+
+void destroy_message_codec(MessageCodec *a_codec)
+{
+  destroy_huffman_tree(&a_codec->root);
+}
+
+size_t message_bound(const MessageCodec *a_codec, size_t num_bytes)
+{
+  return MAX_VARINT_BYTES + (num_bytes * a_codec->max_code_length + 7) / 8;
+}
+
+size_t encode_message(const MessageCodec *a_codec, const uint8_t *message, size_t num_bytes, uint8_t *dst,
+                      size_t capacity)
+{
+  size_t pos = 0;
+  size_t length = num_bytes;
+  do
+  {
+    if (pos == capacity)
+    {
+      return 0;
+    }
+    dst[pos++] = (uint8_t)((length & 0x7f) | (length >= 0x80 ? 0x80 : 0));
+    length >>= 7;
+  } while (length > 0);
+
+  // The low `num_pending` bits of `pending` are not yet written; codes over 32 bits go in two parts
+  uint64_t pending = 0;
+  int num_pending = 0;
+  for (size_t idx = 0; idx < num_bytes; idx++)
+  {
+    const HuffCode *code = &a_codec->encoder.codes[message[idx]];
+    if (code->length > 32)
+    {
+      pending = (pending << (code->length - 32)) | (code->bits >> 32);
+      num_pending += code->length - 32;
+      pending = (pending << 32) | (code->bits & UINT32_MAX);
+      num_pending += 32;
+    }
+    else
+    {
+      pending = (pending << code->length) | code->bits;
+      num_pending += code->length;
+    }
+    while (num_pending >= 8)
+    {
+      if (pos == capacity)
+      {
+        return 0;
+      }
+      num_pending -= 8;
+      dst[pos++] = (uint8_t)(pending >> num_pending);
+    }
+  }
+  if (num_pending > 0)
+  {
+    if (pos == capacity)
+    {
+      return 0;
+    }
+    dst[pos++] = (uint8_t)(pending << (8 - num_pending));
+  }
+  return pos;
+}
+
+/*
+ * The next bits of a message, most significant first. Bytes past the end of
+ * the input read as 0, and `next_byte` keeps counting so that an overrun
+ * can be detected once the message is decoded.
+ */
+typedef struct _BitWindow
+{
+  const uint8_t *src;
+  size_t src_size;
+  size_t next_byte;
+  uint64_t bits;
+  int num_bits;
+} BitWindow;
+
+static inline void _refill(BitWindow *a_window)
+{
+  while (a_window->num_bits <= 56)
+  {
+    uint8_t byte = a_window->next_byte < a_window->src_size ? a_window->src[a_window->next_byte] : 0;
+    a_window->bits |= (uint64_t)byte << (56 - a_window->num_bits);
+    a_window->next_byte++;
+    a_window->num_bits += 8;
+  }
+}
+
+bool decode_message(const MessageCodec *a_codec, const uint8_t *src, size_t src_size, uint8_t *dst, size_t capacity,
+                    size_t *a_num_bytes, size_t *a_num_consumed)
+{
+  uint64_t num_bytes = 0;
+  size_t pos = 0;
+  for (int shift = 0;; shift += 7)
+  {
+    if (pos == src_size || shift >= 7 * MAX_VARINT_BYTES)
+    {
+      return false;
+    }
+    uint8_t byte = src[pos++];
+    num_bytes |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+    {
+      break;
+    }
+  }
+  if (num_bytes > capacity)
+  {
+    return false;
+  }
+
+  BitWindow window = {.src = src, .src_size = src_size, .next_byte = pos, .bits = 0, .num_bits = 0};
+  for (size_t idx = 0; idx < num_bytes; idx++)
+  {
+    _refill(&window);
+    const HuffLookupEntry *entry = &a_codec->decoder.lookup[window.bits >> (64 - HUFF_LOOKUP_BITS)];
+    window.bits <<= entry->length;
+    window.num_bits -= entry->length;
+    const TreeNode *node = entry->node;
+    while (node->left != NULL && node->right != NULL)
+    {
+      _refill(&window);
+      node = window.bits >> 63 ? node->right : node->left;
+      window.bits <<= 1;
+      window.num_bits--;
+    }
+    dst[idx] = node->character;
+  }
+
+  // Whole bytes still in the window were never used
+  size_t num_consumed = window.next_byte - window.num_bits / 8;
+  if (num_consumed > src_size)
+  {
+    return false;
+  }
+  *a_num_bytes = num_bytes;
+  *a_num_consumed = num_consumed;
+  return true;
+}
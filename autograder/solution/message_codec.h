@@ -0,0 +1,89 @@
+#ifndef MESSAGE_CODEC_H
+#define MESSAGE_CODEC_H
+
+#include "huffman.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Coding for many small records (log lines, RPC bodies) that share their
+ * statistics. One tree is built from the byte counts of the whole batch (or
+ * of a sample of it) and every message is coded with it, so a message is
+ * only its length and its codes: the number of bytes as a varint (see
+ * write_varint(...)), then the codes, padded to a whole byte.
+ *
+ * Encoding and decoding work on caller buffers and do not allocate, so one
+ * codec can serve any number of messages, from any number of threads.
+ */
+
+/**
+ * The shared tables of a batch.
+ */
+typedef struct _MessageCodec
+{
+  TreeNode *root;
+  HuffEncoder encoder;
+  HuffDecoder decoder;
+  uint8_t max_code_length;
+} MessageCodec;
+
+/**
+ * @brief Build the codec for a batch with the byte counts `freq`. Every byte
+ * gets a code (see train_dictionary_tree(...)), so messages may contain
+ * bytes the counts never saw.
+ *
+ * @param a_codec the codec to fill; destroy it with destroy_message_codec(...)
+ * @param freq the byte counts of the batch, or of a sample like it
+ */
+void init_message_codec(MessageCodec *a_codec, const Frequencies freq);
+
+/**
+ * @brief Free the tree of a codec.
+ *
+ * @param a_codec the codec to destroy
+ */
+void destroy_message_codec(MessageCodec *a_codec);
+
+/**
+ * @brief The most bytes encode_message(...) can write for a message of
+ * `num_bytes` bytes, for sizing the caller's buffer.
+ *
+ * @param a_codec the codec
+ * @param num_bytes the message length
+ * @return size_t
+ */
+size_t message_bound(const MessageCodec *a_codec, size_t num_bytes);
+
+/**
+ * @brief Encode one message into `dst`.
+ *
+ * @param a_codec the codec of the batch
+ * @param message the message bytes
+ * @param num_bytes the message length
+ * @param dst where to write the encoded message
+ * @param capacity the size of `dst`
+ * @return size_t the number of bytes written, or 0 if `dst` is too small
+ */
+size_t encode_message(const MessageCodec *a_codec, const uint8_t *message, size_t num_bytes, uint8_t *dst,
+                      size_t capacity);
+
+/**
+ * @brief Decode the message at the start of `src`. Encoded messages can be
+ * stored back to back, each decoded from where the last one ended.
+ *
+ * @param a_codec the codec the message was encoded with
+ * @param src the encoded bytes
+ * @param src_size the number of bytes available at `src`
+ * @param dst where to write the message
+ * @param capacity the size of `dst`
+ * @param a_num_bytes where to store the message length
+ * @param a_num_consumed where to store the number of encoded bytes read
+ * @return bool false if the message is longer than `capacity` or runs past
+ * the end of `src`
+ */
+bool decode_message(const MessageCodec *a_codec, const uint8_t *src, size_t src_size, uint8_t *dst, size_t capacity,
+                    size_t *a_num_bytes, size_t *a_num_consumed);
+
+#endif // MESSAGE_CODEC_H
@@ -0,0 +1,57 @@
+#ifndef PARALLEL_HUFFMAN_H
+#define PARALLEL_HUFFMAN_H
+
+#include "huffman.h"
+#include "bit_tools.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Multithreaded coding of the original two-file format, whose codes form one
+ * unbroken stream. Every code length is known from the tree, so the exact bit
+ * offset of any stretch of input is the sum of the code lengths before it:
+ * chunks are counted in parallel, their offsets found by a prefix sum, and
+ * each chunk is coded on its own thread already shifted to its offset. The
+ * chunks then only overlap in one byte at each boundary, which is ORed in.
+ *
+ * Decoding has no such offsets to go on, since the format has no index. Each
+ * thread instead starts at an arbitrary bit of its chunk, which is likely not
+ * the start of a code, and decodes anyway: a prefix code tends to fall back
+ * into step with the true code boundaries within a few codes. Once the
+ * chunk before it is known to end at a true boundary, the chunk is decoded
+ * from there only until it meets one of the boundaries its thread found, and
+ * the thread's output is used from that point on. A chunk whose thread never
+ * fell into step is decoded again from its true start.
+ */
+
+/**
+ * @brief Write exactly what write_compressed(...) writes, on `num_threads`
+ * threads. Like write_compressed(...), coding stops at the first NUL byte.
+ *
+ * @param a_writer the BitWriter to write to; it may hold pending bits
+ * @param uncompressed_bytes the NUL-terminated text to compress
+ * @param root the root of the Huffman tree to use for compression
+ * @param num_threads the number of threads, or 0 for one per core; short
+ * inputs use fewer
+ */
+void write_compressed_parallel(BitWriter *a_writer, uint8_t *uncompressed_bytes, TreeNode *root, int num_threads);
+
+/**
+ * @brief Write exactly what read_compressed(...) writes, decoding on
+ * `num_threads` threads. The input is read in rounds of about a megabyte per
+ * thread, and each round's bytes are written before the next is read, so
+ * memory does not grow with the input, which may be a pipe.
+ *
+ * @param a_reader the byte-aligned BitReader positioned at the first code
+ * @param uncompressed the stream to write the decoded bytes to
+ * @param root the root of the Huffman tree used for encoding
+ * @param num_uncompressed_bytes the number of bytes to decode
+ * @param num_threads the number of threads, or 0 for one per core; short
+ * inputs use fewer
+ */
+void read_compressed_parallel(BitReader *a_reader, FILE *uncompressed, TreeNode *root,
+                              uint32_t num_uncompressed_bytes, int num_threads);
+
+#endif // PARALLEL_HUFFMAN_H
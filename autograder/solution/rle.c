@@ -0,0 +1,57 @@
+#include "rle.h"
+
+#include <string.h>
+
+size_t rle_encode_runs(const uint8_t *bytes, size_t num_bytes, uint8_t symbol, uint8_t *encoded)
+{
+  size_t num_encoded = 0;
+  size_t idx = 0;
+  while (idx < num_bytes)
+  {
+    if (bytes[idx] != symbol)
+    {
+      encoded[num_encoded++] = bytes[idx++];
+      continue;
+    }
+
+    size_t run = 1;
+    while (idx + run < num_bytes && bytes[idx + run] == symbol && run < RLE_MAX_RUN)
+    {
+      run++;
+    }
+    encoded[num_encoded++] = symbol;
+    encoded[num_encoded++] = (uint8_t)(run - 1);
+    idx += run;
+  }
+  return num_encoded;
+}
+
+bool rle_decode_runs(const uint8_t *encoded, size_t num_encoded_bytes, uint8_t symbol, uint8_t *bytes, size_t num_bytes)
+{
+  size_t num_decoded = 0;
+  for (size_t idx = 0; idx < num_encoded_bytes; idx++)
+  {
+    if (encoded[idx] != symbol)
+    {
+      if (num_decoded == num_bytes)
+      {
+        return false;
+      }
+      bytes[num_decoded++] = encoded[idx];
+      continue;
+    }
+
+    if (idx + 1 == num_encoded_bytes)
+    {
+      return false;
+    }
+    size_t run = (size_t)encoded[++idx] + 1;
+    if (run > num_bytes - num_decoded)
+    {
+      return false;
+    }
+    memset(bytes + num_decoded, symbol, run);
+    num_decoded += run;
+  }
+  return num_decoded == num_bytes;
+}
@@ -0,0 +1,36 @@
+#ifndef RLE_H
+#define RLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// The longest run that one (symbol, count) pair can stand for
+#define RLE_MAX_RUN 256
+
+/**
+ * @brief Shorten every run of `symbol` in `bytes`. A run of length r becomes
+ * `symbol` followed by a count byte holding r - 1, repeated as needed for runs
+ * longer than RLE_MAX_RUN. Every other byte is copied unchanged.
+ *
+ * @param bytes the bytes to encode
+ * @param num_bytes the number of bytes to encode
+ * @param symbol the byte whose runs are shortened
+ * @param encoded where to store the result; needs room for 2 * num_bytes
+ * @return size_t the number of bytes stored in encoded
+ */
+size_t rle_encode_runs(const uint8_t *bytes, size_t num_bytes, uint8_t symbol, uint8_t *encoded);
+
+/**
+ * @brief Undo rle_encode_runs(...).
+ *
+ * @param encoded the encoded bytes
+ * @param num_encoded_bytes the number of encoded bytes
+ * @param symbol the byte whose runs were shortened
+ * @param bytes where to store the decoded bytes
+ * @param num_bytes the exact number of bytes the encoded bytes expand to
+ * @return bool false if the encoded bytes do not expand to num_bytes bytes
+ */
+bool rle_decode_runs(const uint8_t *encoded, size_t num_encoded_bytes, uint8_t symbol, uint8_t *bytes, size_t num_bytes);
+
+#endif // RLE_H
@@ -0,0 +1,62 @@
+#ifndef TANS_H
+#define TANS_H
+
+#include "bit_tools.h"
+#include "huffman.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Table-based asymmetric numeral systems (tANS, as in FSE). A Huffman code
+ * spends a whole number of bits on every symbol, so a byte that makes up 90%
+ * of a block still costs a bit where its information is 0.15 bits. tANS
+ * keeps a state in [L, 2L), L = 2^table_log, and each symbol moves the state
+ * by a fraction of a bit on average, coming within about 0.1% of the entropy
+ * of the normalized histogram.
+ */
+
+#define TANS_MIN_TABLE_LOG 5
+#define TANS_MAX_TABLE_LOG 12
+#define TANS_DEFAULT_TABLE_LOG 11
+
+/**
+ * @brief Scale a histogram to counts that sum to 2^table_log, keeping every
+ * byte that occurs at 1 or more. Rounding is corrected one count at a time
+ * where it costs the fewest bits.
+ *
+ * @param freq the byte counts (see calc_frequencies(...) and add_frequencies(...))
+ * @param table_log the log2 of the table size, TANS_MIN_TABLE_LOG to TANS_MAX_TABLE_LOG
+ * @param normalized where to store the scaled count of each byte
+ */
+void tans_normalize(const Frequencies freq, int table_log, uint16_t normalized[256]);
+
+/**
+ * @brief Write `bytes` coded with tANS over the histogram `freq`. The
+ * payload is the table log (one byte), the number of bytes that occur (nine
+ * bits), the value codes (see value_code(...)) of each such byte's distance
+ * from the previous one and of its normalized count less one as a Huffman
+ * section with their extra bits following, the final encoder state
+ * (table_log bits), then the bits that take the decoder from state to state.
+ * The encoder runs backwards over `bytes` so that the decoder reads forwards.
+ *
+ * @param a_writer the BitWriter to write the payload to
+ * @param bytes the bytes to compress
+ * @param num_bytes the number of bytes to compress
+ * @param freq the byte counts of `bytes`
+ */
+void tans_write_payload(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes, const Frequencies freq);
+
+/**
+ * @brief Decode a payload written by tans_write_payload(...), one table
+ * lookup per byte.
+ *
+ * @param a_reader the memory BitReader positioned at the payload
+ * @param bytes where to store the decoded bytes
+ * @param num_bytes the number of bytes the payload decodes to
+ * @return bool false if the payload is malformed
+ */
+bool tans_read_payload(BitReader *a_reader, uint8_t *bytes, size_t num_bytes);
+
+#endif // TANS_H
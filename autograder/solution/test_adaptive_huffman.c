@@ -0,0 +1,133 @@
+#include "adaptive_huffman.h"
+#include "cu_unit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compress `len` bytes and decode them again; true if the decoded bytes match
+static bool round_trip(const uint8_t *bytes, size_t len, size_t *a_compressed_len)
+{
+  FILE *input = tmpfile();
+  fwrite(bytes, 1, len, input);
+  rewind(input);
+
+  BitWriter writer = {.file = tmpfile(), .current_byte = 0, .num_bits_left = 8};
+  uint64_t num_encoded = adaptive_compress_stream(input, &writer);
+  flush_bit_writer(&writer);
+  fclose(input);
+  if (a_compressed_len != NULL)
+  {
+    *a_compressed_len = ftell(writer.file);
+  }
+
+  rewind(writer.file);
+  BitReader reader = {.file = writer.file, .current_byte = 0, .current_bit = -1};
+  FILE *decoded = tmpfile();
+  uint64_t num_decoded = adaptive_decompress_stream(&reader, decoded);
+  close_bit_reader(&reader);
+
+  bool matches = num_encoded == len && num_decoded == len;
+  rewind(decoded);
+  for (size_t idx = 0; matches && idx < len; idx++)
+  {
+    matches = getc(decoded) == bytes[idx];
+  }
+  fclose(decoded);
+  return matches;
+}
+
+static bool round_trip_file(const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+  {
+    return false;
+  }
+  uint8_t bytes[1 << 17];
+  size_t len = fread(bytes, 1, sizeof(bytes), file);
+  fclose(file);
+  return round_trip(bytes, len, NULL);
+}
+
+static int _test_adaptive_empty()
+{
+  cu_start();
+  // -------------------------------
+  size_t compressed_len = 0;
+  cu_check(round_trip((const uint8_t *)"", 0, &compressed_len));
+  cu_check(compressed_len == 2); // NYT code is empty, so just the 9-bit end-of-stream symbol
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_adaptive_single_symbol()
+{
+  cu_start();
+  // -------------------------------
+  uint8_t bytes[1000];
+  memset(bytes, 'z', sizeof(bytes));
+  size_t compressed_len = 0;
+  cu_check(round_trip(bytes, sizeof(bytes), &compressed_len));
+  cu_check(compressed_len < 200);
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_adaptive_all_bytes()
+{
+  cu_start();
+  // -------------------------------
+  uint8_t bytes[256 * 4];
+  for (size_t idx = 0; idx < sizeof(bytes); idx++)
+  {
+    bytes[idx] = (uint8_t)(idx * 37 + idx / 256);
+  }
+  cu_check(round_trip(bytes, sizeof(bytes), NULL));
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_adaptive_sibling_property()
+{
+  cu_start();
+  // -------------------------------
+  AdaptiveModel model;
+  init_adaptive_model(&model);
+  BitWriter writer = {.file = NULL, .current_byte = 0, .num_bits_left = 8};
+  const char *text = "abracadabra, mississippi";
+  for (const char *ch = text; *ch != '\0'; ch++)
+  {
+    adaptive_encode_symbol(&model, &writer, (uint8_t)*ch);
+  }
+  for (int idx = model.nyt; idx + 1 < ADAPTIVE_MAX_NODES; idx++)
+  {
+    cu_check(model.nodes[idx].weight <= model.nodes[idx + 1].weight);
+  }
+  cu_check(model.nodes[ADAPTIVE_MAX_NODES - 1].weight == strlen(text));
+  // -------------------------------
+  cu_end();
+}
+
+static int _test_adaptive_corpus()
+{
+  cu_start();
+  // -------------------------------
+  cu_check(round_trip_file("./tests/bee-movie.txt"));
+  cu_check(round_trip_file("./tests/gophers.txt"));
+  cu_check(round_trip_file("./tests/hello_world.c"));
+  cu_check(round_trip_file("./tests/dialogue.txt"));
+  // -------------------------------
+  cu_end();
+}
+
+int main()
+{
+  cu_start_tests();
+  cu_run(_test_adaptive_empty);
+  cu_run(_test_adaptive_single_symbol);
+  cu_run(_test_adaptive_all_bytes);
+  cu_run(_test_adaptive_sibling_property);
+  cu_run(_test_adaptive_corpus);
+  cu_end_tests();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,63 @@
+#include "huffman.h"
+#include "dictionary.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Builds a dictionary (see dictionary.h) from the byte counts of sample
+ * files, for `compress -d` and `decompress -d`. Samples should look like the
+ * messages the dictionary will code.
+ */
+
+static void _print_usage(const char *program)
+{
+  printf("Usage: %s [-o <dictionary_file>] <sample_file>...\n", program);
+  printf("  -o           dictionary output path (default dictionary.bits)\n");
+}
+
+int main(int argc, char *argv[])
+{
+  const char *output_path = "dictionary.bits";
+  int opt;
+  while ((opt = getopt(argc, argv, "o:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'o':
+      output_path = optarg;
+      break;
+    default:
+      _print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (optind == argc)
+  {
+    _print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  Frequencies freq = {0};
+  for (int idx = optind; idx < argc; idx++)
+  {
+    const char *error = NULL;
+    if (!calc_frequencies(freq, argv[idx], &error))
+    {
+      printf("Error: %s: %s\n", argv[idx], error);
+      return EXIT_FAILURE;
+    }
+  }
+
+  BitWriter writer = open_bit_writer(output_path);
+  if (writer.file == NULL)
+  {
+    printf("Error: %s: %s\n", output_path, strerror(errno));
+    return EXIT_FAILURE;
+  }
+  TreeNode *root = train_dictionary_tree(freq);
+  write_dictionary(&writer, root);
+  fclose(writer.file); // The dictionary ends aligned; flushing would add a byte
+  destroy_huffman_tree(&root);
+  return EXIT_SUCCESS;
+}
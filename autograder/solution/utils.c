@@ -1,5 +1,7 @@
 #include "utils.h"
 
+#include <string.h>
+
 void print_list(PQNode *head, void (*print_one_element_fn)(void *))
 {
   // print_one_element_fn(…) is a function
@@ -27,3 +29,110 @@ void _print_tree_node(void *a_node)
   printf("{char: %c, freq: %zu}", node->character, node->frequency);
 }
 
+uint8_t *read_stream(FILE *stream, size_t *a_num_bytes)
+{
+  size_t capacity = 1 << 16;
+  uint8_t *buffer = malloc(capacity);
+  *a_num_bytes = 0;
+  size_t num_read;
+  while ((num_read = fread(buffer + *a_num_bytes, 1, capacity - *a_num_bytes, stream)) > 0)
+  {
+    *a_num_bytes += num_read;
+    if (*a_num_bytes == capacity)
+    {
+      capacity *= 2;
+      buffer = realloc(buffer, capacity);
+    }
+  }
+  return buffer;
+}
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ull
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4Full
+#define XXH_PRIME64_3 0x165667B19E3779F9ull
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ull
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ull
+
+static inline uint64_t _rotate_left(uint64_t value, int bits)
+{
+  return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t _load64(const uint8_t *bytes)
+{
+  uint64_t value;
+  memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+static inline uint32_t _load32(const uint8_t *bytes)
+{
+  uint32_t value;
+  memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+static inline uint64_t _xxh_round(uint64_t accumulator, uint64_t input)
+{
+  accumulator += input * XXH_PRIME64_2;
+  return _rotate_left(accumulator, 31) * XXH_PRIME64_1;
+}
+
+static inline uint64_t _xxh_merge(uint64_t hash, uint64_t accumulator)
+{
+  hash ^= _xxh_round(0, accumulator);
+  return hash * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+uint64_t xxhash64(const uint8_t *bytes, size_t num_bytes, uint64_t seed)
+{
+  const uint8_t *end = bytes + num_bytes;
+  uint64_t hash;
+  if (num_bytes >= 32)
+  {
+    // Four lanes over 32-byte stripes
+    uint64_t lanes[4] = {seed + XXH_PRIME64_1 + XXH_PRIME64_2, seed + XXH_PRIME64_2, seed, seed - XXH_PRIME64_1};
+    for (; end - bytes >= 32; bytes += 32)
+    {
+      for (int lane = 0; lane < 4; lane++)
+      {
+        lanes[lane] = _xxh_round(lanes[lane], _load64(bytes + 8 * lane));
+      }
+    }
+    hash = _rotate_left(lanes[0], 1) + _rotate_left(lanes[1], 7) + _rotate_left(lanes[2], 12) +
+           _rotate_left(lanes[3], 18);
+    for (int lane = 0; lane < 4; lane++)
+    {
+      hash = _xxh_merge(hash, lanes[lane]);
+    }
+  }
+  else
+  {
+    hash = seed + XXH_PRIME64_5;
+  }
+  hash += num_bytes;
+
+  for (; end - bytes >= 8; bytes += 8)
+  {
+    hash ^= _xxh_round(0, _load64(bytes));
+    hash = _rotate_left(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+  }
+  if (end - bytes >= 4)
+  {
+    hash ^= _load32(bytes) * XXH_PRIME64_1;
+    hash = _rotate_left(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+    bytes += 4;
+  }
+  for (; bytes < end; bytes++)
+  {
+    hash ^= *bytes * XXH_PRIME64_5;
+    hash = _rotate_left(hash, 11) * XXH_PRIME64_1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= XXH_PRIME64_2;
+  hash ^= hash >> 29;
+  hash *= XXH_PRIME64_3;
+  hash ^= hash >> 32;
+  return hash;
+}
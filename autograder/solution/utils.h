@@ -20,4 +20,23 @@ void print_list(PQNode *head, void (*print_one_element_fn)(void *));
  */
 void _print_tree_node(void *a_node);
 
+/**
+ * @brief Utility function to read everything from `stream`, which may be a pipe.
+ *
+ * @param stream the stream to read until EOF
+ * @param a_num_bytes where to store the number of bytes read
+ * @return uint8_t* a malloc'd buffer holding the bytes
+ */
+uint8_t *read_stream(FILE *stream, size_t *a_num_bytes);
+
+/**
+ * @brief Utility function for a 64-bit xxHash (XXH64) of `num_bytes` bytes.
+ *
+ * @param bytes the bytes to hash
+ * @param num_bytes the number of bytes at bytes
+ * @param seed the seed, so that several independent hashes can be taken
+ * @return uint64_t
+ */
+uint64_t xxhash64(const uint8_t *bytes, size_t num_bytes, uint64_t seed);
+
 #endif // UTILS_H
\ No newline at end of file
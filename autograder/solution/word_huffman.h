@@ -0,0 +1,40 @@
+#ifndef WORD_HUFFMAN_H
+#define WORD_HUFFMAN_H
+
+#include "bit_tools.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Write `bytes` as a sequence of word tokens coded with a canonical
+ * Huffman code (see canonical_huffman.h) over a dictionary of the distinct
+ * tokens. A token is a maximal run of letters and digits, or a maximal run
+ * of other bytes, so text alternates between words and the separators
+ * between them and each code stands for several bytes.
+ *
+ * Tokens are numbered by code length, so the table is just the number of
+ * codes of each length. The payload is the number of distinct and of coded
+ * tokens (uint32), the value codes (see value_code(...)) of the dictionary
+ * token lengths as a Huffman section with their extra bits following, the
+ * dictionary bytes as a Huffman section, the longest code length (one byte)
+ * and the number of codes of each length up to it (uint32), then the codes.
+ *
+ * @param a_writer the BitWriter to write the payload to
+ * @param bytes the bytes to compress
+ * @param num_bytes the number of bytes to compress
+ */
+void words_write_payload(BitWriter *a_writer, const uint8_t *bytes, size_t num_bytes);
+
+/**
+ * @brief Decode a payload written by words_write_payload(...).
+ *
+ * @param a_reader the memory BitReader positioned at the payload
+ * @param bytes where to store the decoded bytes
+ * @param num_bytes the number of bytes the payload decodes to
+ * @return bool false if the payload is malformed
+ */
+bool words_read_payload(BitReader *a_reader, uint8_t *bytes, size_t num_bytes);
+
+#endif // WORD_HUFFMAN_H